@@ -18,6 +18,11 @@
 #include <linux/module.h>
 #include <linux/init.h>
 #include <linux/interrupt.h>
+#include <linux/irq.h>
+#include <linux/irqdomain.h>
+#include <linux/irq_work.h>
+#include <linux/workqueue.h>
+#include <linux/freezer.h>
 #include <linux/platform_device.h>
 #include <linux/mutex.h>
 #include <linux/err.h>
@@ -32,6 +37,30 @@
 #include <linux/sensors.h>
 #include "fake6050.h"
 #include <linux/kthread.h>
+#include <linux/vmalloc.h>
+#include <linux/seqlock.h>
+#include <linux/rcupdate.h>
+#include <linux/log2.h>
+#include <linux/random.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/kref.h>
+#include <linux/kfifo.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/completion.h>
+#include <linux/regmap.h>
+#include <asm/unaligned.h>
+
+#define CREATE_TRACE_POINTS
+#include "fake6050_trace.h"
+#ifdef CONFIG_SENSORS_FAKE6050_IIO
+#include <linux/iio/iio.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/trigger.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
+#endif
 
 #define MPU6050_ACCEL_MIN_VALUE	-32768
 #define MPU6050_ACCEL_MAX_VALUE	32767
@@ -39,13 +68,16 @@
 #define MPU6050_GYRO_MAX_VALUE	32767
 
 #define MPU6050_MAX_EVENT_CNT	170
-/* Limit mininum delay to 10ms as we do not need higher rate so far */
-#define MPU6050_ACCEL_MIN_POLL_INTERVAL_MS	10
+/*
+ * The HAL delay is millisecond granular, finer periods down to the emulated
+ * ODR are set through the poll_period_ns attribute.
+ */
+#define MPU6050_ACCEL_MIN_POLL_INTERVAL_MS	1
 #define MPU6050_ACCEL_MAX_POLL_INTERVAL_MS	5000
 #define MPU6050_ACCEL_DEFAULT_POLL_INTERVAL_MS	200
 #define MPU6050_ACCEL_INT_MAX_DELAY			19
 
-#define MPU6050_GYRO_MIN_POLL_INTERVAL_MS	10
+#define MPU6050_GYRO_MIN_POLL_INTERVAL_MS	1
 #define MPU6050_GYRO_MAX_POLL_INTERVAL_MS	5000
 #define MPU6050_GYRO_DEFAULT_POLL_INTERVAL_MS	200
 #define MPU6050_GYRO_INT_MAX_DELAY		18
@@ -54,6 +86,8 @@
 #define MPU6050_RAW_GYRO_DATA_LEN	6
 
 #define MPU6050_RESET_SLEEP_US	10
+/* TEMP_OUT of 25 degC, T = TEMP_OUT / 340 + 36.53 */
+#define MPU6050_TEMP_RAW_25C	(-3920)
 
 #define MPU6050_DEV_NAME_ACCEL	"MPU6050-accel"
 #define MPU6050_DEV_NAME_GYRO	"gyroscope"
@@ -66,10 +100,74 @@
 #define MPU_ACC_CAL_NUM	(MPU_ACC_CAL_COUNT - CAL_SKIP_COUNT)
 #define MPU_ACC_CAL_BUF_SIZE	22
 #define RAW_TO_1G	16384
-#define MPU_ACC_CAL_DELAY 100	/* ms */
+#define MPU_ACC_CAL_DELAY 100	/* ms, slowest collection period */
+#define MPU_ACC_CAL_TIMEOUT_MS(period_ms)				\
+	(2 * MPU_ACC_CAL_COUNT * (period_ms) + POWER_UP_TIME_MS +	\
+	SENSOR_UP_TIME_MS)
+#define MPU_ACC_CAL_MATRIX_SHIFT	14	/* Q14, 1 << 14 is 1.0 */
+#define MPU_ACC_CAL_MATRIX_MAX	(4 << MPU_ACC_CAL_MATRIX_SHIFT)
 #define POLL_MS_100HZ 10
+#define MPU6050_MOT_STILL_MS	2000
+#define MPU6050_AUTOSUSPEND_MS	1000
 #define SNS_TYPE_GYRO 0
 #define SNS_TYPE_ACCEL 1
+#define SNS_TYPE_MAX 2
+/* shorter periods are served in bursts, poll threads wake at most at 1kHz */
+#define MPU6050_MIN_WAKE_NS	NSEC_PER_MSEC
+/* max number of late wakeups a poll thread catches up at once */
+#define MPU6050_CATCHUP_MAX_TICKS	4
+
+static bool unified_sched;
+module_param(unified_sched, bool, S_IRUGO);
+MODULE_PARM_DESC(unified_sched,
+	"Service accel and gyro with a single timer and poll thread");
+
+static bool hw_fifo;
+module_param(hw_fifo, bool, S_IRUGO);
+MODULE_PARM_DESC(hw_fifo,
+	"Read samples through the emulated chip FIFO, implies unified_sched");
+
+#define MPU6050_HWFIFO_BATCH	16	/* frames per burst read */
+
+static bool use_irq;
+module_param(use_irq, bool, S_IRUGO);
+MODULE_PARM_DESC(use_irq,
+	"Use the emulated data ready interrupt instead of timer polling");
+
+static unsigned int virt_devices;
+module_param(virt_devices, uint, S_IRUGO);
+MODULE_PARM_DESC(virt_devices,
+	"Number of virtual sensors to create, next to the I2C bound ones");
+
+#define MPU6050_VIRT_MAX	64
+#define MPU6050_NAME_LEN	32
+
+/* 2^18 frames is more than 20 minutes of a 200Hz capture */
+#define MPU6050_TRACE_MAX_FRAMES	(1 << 18)
+#define MPU6050_TRACE_MIN_FRAMES	256	/* first allocation */
+#define MPU6050_TRACE_FRAME_SIZE	sizeof(struct mpu6050_trace_frame)
+
+#define MPU6050_INJECT_QUEUE_LEN	256	/* power of two */
+#define MPU6050_INJECT_MAX_FRAMES	(PAGE_SIZE / MPU6050_TRACE_FRAME_SIZE)
+
+/*
+ * Physical injection converts mg and mdps to LSB with a Q20 factor per full
+ * scale range. Gyro sensitivity is kept in tenths of LSB/dps, 131 LSB/dps
+ * at 250dps, halved with each doubling of the range like the accel one.
+ */
+#define MPU6050_PHYS_SHIFT	20
+#define MPU6050_PHYS_MAX	10000000	/* mg or mdps */
+#define MPU6050_GYRO_LSB_X10	1310
+#define MPU6050_PHYS_MULT(lsb, div)					\
+	((u32)((((u64)(lsb) << MPU6050_PHYS_SHIFT) + (div) / 2) / (div)))
+
+#define MPU6050_GEN_AXES	6
+#define MPU6050_GEN_MAX_FREQ_MHZ	1000000
+
+#define MPU6050_LAT_BUCKETS	32
+
+#define MPU6050_RING_NAME	"fake6050"
+#define MPU6050_RING_FRAMES	4096	/* power of two */
 
 enum mpu6050_place {
 	MPU6050_PLACE_PU = 0,
@@ -98,46 +196,438 @@ struct axis_data {
 	s16 rz;
 };
 
+/**
+ *  struct mpu6050_acc_corr - accelerometer correction for one poll
+ *  @bias:	bias subtracted from the remapped sample
+ *  @matrix:	Q14 scale and misalignment matrix applied after @bias
+ *  @use_matrix:	@matrix is not the identity
+ */
+struct mpu6050_acc_corr {
+	s32 bias[3];
+	s32 matrix[3][3];
+	bool use_matrix;
+};
+
+/**
+ *  struct mpu6050_acc_cal - accelerometer bias collection
+ *  @active:	the poll thread collects samples
+ *  @count:	samples seen, the first CAL_SKIP_COUNT are skipped
+ *  @sum:	sum of the collected samples, per axis
+ *  @done:	MPU_ACC_CAL_COUNT samples were seen
+ *  @owned:	the accelerometer is enabled for the calibration only, a
+ *		client enabling it meanwhile takes it over. op_lock held.
+ *
+ *  @count and @sum are owned by the accelerometer poll thread while
+ *  @active is set.
+ */
+struct mpu6050_acc_cal {
+	atomic_t active;
+	int count;
+	s32 sum[3];
+	struct completion done;
+	bool owned;
+};
+
+/**
+ *  struct mpu6050_motion - wake on motion
+ *  @thr:	motion threshold, in MOT_THR_MG_PER_LSB units
+ *  @dur:	motion duration in ms
+ *  @still_ms:	stillness before the streams are parked
+ *  @ref:	reference frame of the stillness detector
+ *  @still_since_ns:	timestamp of @ref, 0 to take the next frame
+ *  @park_req:	the detector asks @work to park the streams
+ *  @event:	a motion interrupt was seen in INT_STATUS
+ *  @parked:	the streams are parked and the chip watches for motion
+ *  @events:	motion events reported through ABS_MISC
+ *  @work:	parks and resumes the streams, polls INT_STATUS when parked
+ *		in polling mode
+ *
+ *  @ref and @still_since_ns are owned by the thread delivering accel
+ *  samples. @parked is changed with op_lock held.
+ */
+struct mpu6050_motion {
+	u8 thr;
+	u8 dur;
+	u32 still_ms;
+	s16 ref[3];
+	s64 still_since_ns;
+	atomic_t park_req;
+	atomic_t event;
+	bool parked;
+	u32 events;
+	struct delayed_work work;
+};
+
+/**
+ *  struct mpu6050_remap - placement of one sensor type, resolved at probe
+ *  @src:	raw axis feeding output axis X, Y and Z
+ *  @neg:	-1 to negate the output axis, 0 to keep it
+ */
+struct mpu6050_remap {
+	u8 src[3];
+	s16 neg[3];
+};
+
+/**
+ *  struct mpu6050_sample - one remapped and timestamped sensor sample
+ *  @data:	X, Y and Z axis value
+ *  @timestamp:	sample timestamp
+ */
+struct mpu6050_sample {
+	s16 data[3];
+	ktime_t timestamp;
+};
+
+/**
+ *  struct mpu6050_fifo - software batching FIFO of one sensor
+ *  @buf:	buffered samples
+ *  @head:	index of the oldest sample in @buf
+ *  @count:	number of buffered samples
+ *  @flush_req:	number of pending flush requests from the HAL
+ *  @drain_req:	deliver buffered samples without a flush marker
+ *
+ *  @buf, @head and @count are only touched by the poll thread of the
+ *  owning sensor, so they need no locking.
+ */
+struct mpu6050_fifo {
+	struct mpu6050_sample buf[MPU6050_MAX_EVENT_CNT];
+	u32 head;
+	u32 count;
+	atomic_t flush_req;
+	atomic_t drain_req;
+};
+
+/**
+ *  struct mpu6050_hwfifo - FIFO of the emulated chip
+ *  @buf:	FIFO bytes
+ *  @head:	index of the oldest byte in @buf
+ *  @count:	number of bytes in @buf, as read from FIFO_COUNT
+ *  @next_ns:	next edge of the chip sample clock
+ *  @fill:	frames built outside regs_lock before they are pushed
+ */
+struct mpu6050_hwfifo {
+	u8 buf[MPU6050_FIFO_SIZE_BYTE];
+	u32 head;
+	u32 count;
+	u64 next_ns;
+	u8 fill[MPU6050_FIFO_SIZE_BYTE + MPU6050_FIFO_FRAME_MAX];
+};
+
+/* one injected sample of a sensor, queued until its next sampling tick */
+struct mpu6050_inject_sample {
+	s16 data[3];
+};
+
+enum mpu6050_replay_mode {
+	MPU6050_REPLAY_OFF = 0,
+	MPU6050_REPLAY_ONCE = 1,
+	MPU6050_REPLAY_LOOP = 2,
+};
+
+/**
+ *  struct mpu6050_trace - recorded trace replay state
+ *  @frames:	trace ring, grown to what was written
+ *  @max_frames:	number of frames @frames has room for
+ *  @nr_frames:	number of valid frames in @frames
+ *  @pos:	next frame to replay, per sensor type
+ *  @mode:	replay mode, MPU6050_REPLAY_OFF when injected data is used
+ *
+ *  Samplers read @frames and @nr_frames in an RCU read side section once
+ *  they saw @mode on. Turning the replay off waits for them, after that
+ *  the writer owns the buffer until the replay is turned on again.
+ */
+struct mpu6050_trace {
+	struct mpu6050_trace_frame *frames;
+	u32 max_frames;
+	u32 nr_frames;
+	u32 pos[SNS_TYPE_MAX];
+	enum mpu6050_replay_mode mode;
+};
+
+enum mpu6050_wave_type {
+	MPU6050_WAVE_OFF = 0,
+	MPU6050_WAVE_CONST,
+	MPU6050_WAVE_SINE,
+	MPU6050_WAVE_SQUARE,
+	MPU6050_WAVE_RAMP,
+	MPU6050_WAVE_STEP,
+};
+
+/**
+ *  struct mpu6050_wave - waveform of one generated axis
+ *  @type:	waveform shape
+ *  @amplitude:	peak deviation from @offset
+ *  @offset:	value around which the waveform swings
+ *  @noise:	amplitude of the uniform noise added to every sample
+ *  @freq_mhz:	waveform frequency in millihertz. A step happens after
+ *		one period
+ *  @seq:	bumped on every update, restarts the waveform
+ */
+struct mpu6050_wave {
+	enum mpu6050_wave_type type;
+	s16 amplitude;
+	s16 offset;
+	u16 noise;
+	u32 freq_mhz;
+	u32 seq;
+};
+
+/**
+ *  struct mpu6050_gen - in-kernel waveform generator
+ *  @wave:	configuration, per axis in x, y, z, rx, ry, rz order
+ *  @lock:	publish @wave to the poll threads
+ *  @active:	bitmap of axes with a waveform
+ *  @seen:	@wave seq the generator state belongs to, per axis
+ *  @phase:	phase accumulator, a full turn is 2^32, per axis
+ *  @inc:	phase increment per sample, per axis
+ *  @inc_period:	sampling period @inc was computed for, per axis
+ *  @stepped:	step waveform has stepped, per axis
+ *
+ *  All but @wave, @lock and @active are only touched under the src_lock
+ *  of the sensor.
+ */
+struct mpu6050_gen {
+	struct mpu6050_wave wave[MPU6050_GEN_AXES];
+	seqlock_t lock;
+	unsigned long active;
+	u32 seen[MPU6050_GEN_AXES];
+	u32 phase[MPU6050_GEN_AXES];
+	u32 inc[MPU6050_GEN_AXES];
+	u64 inc_period[MPU6050_GEN_AXES];
+	bool stepped[MPU6050_GEN_AXES];
+};
+
+enum mpu6050_lat_metric {
+	MPU6050_LAT_TIMER_WAKEUP = 0,	/* timer callback to poll thread */
+	MPU6050_LAT_WAKEUP_SYNC,	/* poll thread to last input_sync */
+	MPU6050_LAT_INTERVAL,		/* between two poll thread wakeups */
+	MPU6050_LAT_FIRST_SAMPLE,	/* enable request to first sample */
+	MPU6050_LAT_MAX,
+};
+
+/* Progress of a sensor from off to streaming, see mpu6050_enable_step(). */
+enum mpu6050_en_state {
+	MPU6050_EN_OFF = 0,	/* no runtime PM reference */
+	MPU6050_EN_BOOTING,	/* powered, the chip may still boot */
+	MPU6050_EN_SETTLING,	/* engine on, output not valid yet */
+	MPU6050_EN_ON,		/* streaming */
+};
+
+/**
+ *  struct mpu6050_lat_hist - log2 latency histogram
+ *  @bucket:	bucket i counts latencies in [2^(i-1), 2^i) ns, the last
+ *		one everything above
+ *  @count:	number of recorded latencies
+ *  @max_ns:	largest recorded latency
+ */
+struct mpu6050_lat_hist {
+	u64 bucket[MPU6050_LAT_BUCKETS];
+	u64 count;
+	u64 max_ns;
+};
+
+/**
+ *  struct mpu6050_latency - end-to-end latency instrumentation
+ *  @enable:	record latencies, set through debugfs
+ *  @fire_ns:	time of the last timer callback, per sensor type
+ *  @wake_ns:	time of the last poll thread wakeup, per sensor type
+ *  @hist:	histograms, per sensor type and metric
+ *
+ *  The histograms of a sensor are only updated by its poll thread. They
+ *  are statistics, so resets and reads do not synchronize with it.
+ */
+struct mpu6050_latency {
+	u32 enable;
+	u64 fire_ns[SNS_TYPE_MAX];
+	u64 wake_ns[SNS_TYPE_MAX];
+	struct mpu6050_lat_hist hist[SNS_TYPE_MAX][MPU6050_LAT_MAX];
+};
+
+/* per-CPU statistics counters, summed up when read */
+struct mpu6050_stats {
+	u64 cnt[SNS_TYPE_MAX][MPU6050_STAT_MAX];
+};
+
+/**
+ *  struct mpu6050_ring - mmap ring of the /dev/fake6050 character device
+ *  @ref:	held by the sensor and by every open file, the mapping
+ *		must outlive the sensor while userspace still has it
+ *  @misc:	misc device of the ring
+ *  @hdr:	shared control page, followed by the frames
+ *  @frames:	shared frame array
+ *  @nr_frames:	number of frames in @frames
+ *  @size:	size of the shared mapping
+ *  @head:	private copy of @hdr->head, userspace cannot corrupt it
+ *  @lock:	serialize producers
+ *  @users:	number of open files, nothing is copied when zero
+ *  @wq:	poll() wait queue
+ */
+struct mpu6050_ring {
+	struct kref ref;
+	struct miscdevice misc;
+	struct mpu6050_ring_header *hdr;
+	struct mpu6050_ring_frame *frames;
+	u32 nr_frames;
+	size_t size;
+	u32 head;
+	spinlock_t lock;
+	atomic_t users;
+	wait_queue_head_t wq;
+};
+
 /**
  *  struct mpu6050_sensor - Cached chip configuration data
- *  @client:		I2C client
+ *  @client:		I2C client, NULL for a virtual sensor
  *  @dev:		device structure
+ *  @name:		ring and IIO device name, unique per instance
+ *  @accel_name:	accelerometer input and class device name
+ *  @gyro_name:		gyroscope input device name
+ *  @gyro_cdev_name:	gyroscope class device name
  *  @accel_dev:		accelerometer input device structure
  *  @gyro_dev:		gyroscope input device structure
  *  @accel_cdev:		sensor class device structure for accelerometer
  *  @gyro_cdev:		sensor class device structure for gyroscope
  *  @pdata:	device platform dependent data
+ *  @remap:	axis remapping for @pdata place, per sensor type
  *  @op_lock:	device operation mutex
  *  @chip_type:	sensor hardware model
+ *  @resume_work:	restores the context and restarts the streams after
+ *		a resume, off the resume path, once the chip booted
  *  @fifo_flush_work:	work structure to flush sensor fifo
  *  @reg:		notable slave registers
+ *  @regmap:	register map of the emulated register file
+ *  @fifo_map:	uncached register map for FIFO_R_W burst reads
+ *  @regs_lock:	protect @regfile and @hwfifo, both maps share them
+ *  @src_lock:	serialize the consumers of the data sources: poll threads,
+ *		bus accesses of both maps and the motion clock. The sources
+ *		are never advanced under @regs_lock.
+ *  @regfile:	emulated register file, only accessed through @regmap
+ *		and @fifo_map
+ *  @hwfifo:	emulated chip FIFO
+ *  @drdy_timer:	sample clock of the chip raising data ready
+ *  @drdy_running:	@drdy_timer is armed
+ *  @drdy_edges:	sample clock edges seen by @drdy_timer
+ *  @latch_edges:	@drdy_edges when the data registers were last latched
+ *  @src_hold:	sample clock edges left before the data source of a sensor
+ *		advances again, see mpu6050_chip_sample()
+ *  @src_held:	value the chip holds for each sensor type
+ *  @mot_clk:	motion clock of the chip, compares accel frames
+ *  @mot_irq_work:	raises the interrupt line for @mot_clk
+ *  @mot_running:	@mot_clk is queued
+ *  @mot_ref:	reference frame of the chip motion detector
+ *  @mot_ref_valid:	@mot_ref was taken
+ *  @mot_ms:	time the motion threshold has been exceeded
  *  @cfg:		cached chip configuration data
  *  @axis:	axis data reading
+ *  @axis_lock:	seqlock publishing @axis to the poll threads
+ *  @phys:	last physical injection in mg and mdps, per sensor type
+ *  @phys_valid:	@phys is the source of @axis, so a full scale range
+ *		change requantizes it. Both are written under @axis_lock.
  *  @gyro_poll_ms:	gyroscope polling delay
  *  @accel_poll_ms:	accelerometer polling delay
+ *  @req_ns:	requested sampling period in nanoseconds, per sensor type
+ *  @poll_ns:	sampling period on the emulated sample clock, per sensor type
+ *  @burst:	samples taken per timer wakeup, per sensor type
+ *  @sample_interval_ns:	interval of the emulated sample clock
  *  @accel_latency_ms:	max latency for accelerometer batching
  *  @gyro_latency_ms:	max latency for gyroscope batching
  *  @accel_en:	accelerometer enabling flag
  *  @gyro_en:	gyroscope enabling flag
  *  @use_poll:		use polling mode instead of  interrupt mode
  *  @motion_det_en:	motion detection wakeup is enabled
+ *  @mot:	wake on motion state
  *  @batch_accel:	accelerometer is working on batch mode
  *  @batch_gyro:	gyroscope is working on batch mode
- *  @acc_cal_buf:	accelerometer calibration string format bias
+ *  @acc_cal_buf:	accelerometer calibration string format bias, double
+ *		buffered behind accel_cdev.params
  *  @acc_cal_params:	accelerometer calibration bias
  *  @acc_use_cal:	accelerometer use calibration bias to
 			compensate raw data
+ *  @acc_cal_matrix:	accelerometer Q14 scale and misalignment matrix
+ *  @acc_use_matrix:	@acc_cal_matrix is not the identity
+ *  @acc_cal_lock:	publish the calibration to the poll thread, serialize
+ *		the bias writers
+ *  @acc_cal:	bias collection state
  *  @enable_gpio:	enable GPIO
  *  @power_enabled:	flag of device power state
+ *  @power_up_ns:	time of the last power up, the chip boots for
+ *		POWER_UP_TIME_MS after it
+ *  @ctx_lost:	the chip lost its registers with the power
+ *  @pm_lock:	serialize the runtime PM callbacks and the context restore
+ *  @pm_refs:	sensor types holding a runtime PM reference, op_lock held
+ *  @suspended:	system suspend stopped the streams
+ *  @enable_work:	moves the sensors toward @en_req, on @data_wq
+ *  @en_req:	bitmap of sensor types requested on
+ *  @en_req_ns:	time of the request that set the bit in @en_req
+ *  @en_state:	enable progress, per sensor type, op_lock held
+ *  @ready_ns:	end of the engine settling time, per sensor type
+ *  @first_pending:	the next sample is the first since the stream started
+ *  @en_err:	last failed enable, per sensor type, returned by the next
+ *		mpu6050_set_enable() call
+ *  @removing:	mpu6050_remove_dev() started, no new enable is accepted
  *  @pinctrl:	pinctrl struct for interrupt pin
  *  @pin_default:	pinctrl default state
  *  @pin_sleep:	pinctrl sleep state
  *  @flush_count:	number of flush
- *  @fifo_start_ns:		timestamp of first fifo data
+ *  @fifo:	software batching FIFO, per sensor type
+ *  @ticks:	timer ticks not yet serviced, per sensor type
+ *  @overruns:	ticks serviced later than their deadline, per sensor type
+ *  @dropped:	ticks skipped by the catch-up policy, per sensor type
+ *  @grid_epoch_ns:	timestamp of the first sample after a (re)start
+ *  @grid_rebase:	@grid_epoch_ns was updated for the poll thread
+ *  @grid_start_ns:	poll thread copy of @grid_epoch_ns
+ *  @grid_idx:	number of samples since @grid_start_ns
+ *  @ts_jitter_ns:	amplitude of the emulated timestamp jitter
+ *  @ts_skew_ns:	wakeup time minus timestamp of the last sample
+ *  @ts_skew_max_ns:	largest @ts_skew_ns seen
+ *  @fifo_start_ns:		epoch of the emulated sample clock
+ *  @unified:	one timer and thread serve both sensors
+ *  @sched_timer:	timer of the unified scheduler
+ *  @sched_lock:	protect @sched_next and @sched_active
+ *  @sched_next:	next deadline, per sensor type
+ *  @sched_active:	bitmap of sensor types being scheduled
+ *  @sched_task:	poll thread of the unified scheduler
+ *  @sched_wq:	wait queue of @sched_task
+ *  @hwfifo_mode:	samples are read through the chip FIFO
+ *  @hwfifo_lock:	protect the driver side state of the chip FIFO
+ *  @hwfifo_en:	FIFO_EN as programmed
+ *  @hwfifo_frame:	bytes per FIFO frame, 0 when the FIFO is off
+ *  @hwfifo_interval_ns:	sample clock interval of the FIFO frames
+ *  @hwfifo_ts_ns:	timestamp of the next FIFO frame
+ *  @hwfifo_batch:	frames per FIFO_R_W burst read
+ *  @hwfifo_buf:	burst read buffer
+ *  @decim:	chip frames per delivered sample, per sensor type
+ *  @decim_skip:	chip frames to skip before the next delivered sample
+ *  @irq_domain:	domain of the emulated data ready interrupt
+ *  @irq:	virtual interrupt number, 0 in polling mode
+ *  @irq_ts_ns:	time of the last data ready interrupt
+ *  @irq_edges:	@drdy_edges seen by the interrupt thread
+ *  @trace:	recorded trace replayed instead of @axis
+ *  @trace_lock:	serialize trace loading and replay control
+ *  @ring:	mmap ring of the character device
+ *  @gen:	waveform generator, used instead of @axis for its axes
+ *  @indio_dev:	IIO device of the triggered buffer backend
+ *  @iio_trig:	trigger fired by the poll threads
+ *  @iio_lock:	protect @iio_last and @iio_ts
+ *  @iio_last:	last sample of each axis, in scan index order
+ *  @iio_ts:	timestamp of the sample firing the trigger
+ *  @iio_lead:	sensor type firing the trigger, -1 when the buffer is off
+ *  @iio_owned:	bitmap of sensor types enabled by the buffer
+ *  @lat:	latency histograms
+ *  @stats:	per-CPU statistics counters
+ *  @enabled_since_ns:	time the sensor was enabled, 0 while disabled
+ *  @last_data:	previous sample, per sensor type, to count duplicates
+ *  @debugfs:	debugfs directory of the sensor
+ *  @inject:	queued injected samples, per sensor type. Filled under
+ *		@op_lock, drained by the poll thread of the sensor
  */
 struct mpu6050_sensor {
 	struct i2c_client *client;
 	struct device *dev;
+	char name[MPU6050_NAME_LEN];
+	char accel_name[MPU6050_NAME_LEN];
+	char gyro_name[MPU6050_NAME_LEN];
+	char gyro_cdev_name[MPU6050_NAME_LEN];
 	struct hrtimer gyro_timer;
 	struct hrtimer accel_timer;
 	struct input_dev *accel_dev;
@@ -145,49 +635,158 @@ struct mpu6050_sensor {
 	struct sensors_classdev accel_cdev;
 	struct sensors_classdev gyro_cdev;
 	struct mpu6050_platform_data *pdata;
+	struct mpu6050_remap remap[SNS_TYPE_MAX];
 	struct mutex op_lock;
 	enum inv_devices chip_type;
 	struct workqueue_struct *data_wq;
-	struct work_struct resume_work;
+	struct delayed_work resume_work;
 	struct delayed_work fifo_flush_work;
 	struct mpu_reg_map reg;
+	struct regmap *regmap;
+	struct regmap *fifo_map;
+	spinlock_t regs_lock;
+	struct mutex src_lock;
+	u8 regfile[MPU6050_NUM_REGS];
+	struct mpu6050_hwfifo hwfifo;
+	struct hrtimer drdy_timer;
+	bool drdy_running;
+	u32 drdy_edges;
+	u32 latch_edges;
+	u32 src_hold[SNS_TYPE_MAX];
+	struct axis_data src_held[SNS_TYPE_MAX];
+	struct delayed_work mot_clk;
+	struct irq_work mot_irq_work;
+	bool mot_running;
+	s16 mot_ref[3];
+	bool mot_ref_valid;
+	u32 mot_ms;
 	struct mpu_chip_config cfg;
 	struct axis_data axis;
+	seqlock_t axis_lock;
+	s32 phys[SNS_TYPE_MAX][3];
+	bool phys_valid[SNS_TYPE_MAX];
 	u32 gyro_poll_ms;
 	u32 accel_poll_ms;
+	u64 req_ns[SNS_TYPE_MAX];
+	u64 poll_ns[SNS_TYPE_MAX];
+	u32 burst[SNS_TYPE_MAX];
+	u64 sample_interval_ns;
 	u32 accel_latency_ms;
 	u32 gyro_latency_ms;
 	atomic_t accel_en;
 	atomic_t gyro_en;
 	bool use_poll;
 	bool motion_det_en;
+	struct mpu6050_motion mot;
 	bool batch_accel;
 	bool batch_gyro;
 
 	/* calibration */
-	char acc_cal_buf[MPU_ACC_CAL_BUF_SIZE];
+	char acc_cal_buf[2][MPU_ACC_CAL_BUF_SIZE];
 	int acc_cal_params[3];
 	bool acc_use_cal;
+	s32 acc_cal_matrix[3][3];
+	bool acc_use_matrix;
+	seqlock_t acc_cal_lock;
+	struct mpu6050_acc_cal acc_cal;
 
 	/* power control */
 	int enable_gpio;
 	bool power_enabled;
+	u64 power_up_ns;
+	bool ctx_lost;
+	struct mutex pm_lock;
+	unsigned long pm_refs;
+	bool suspended;
+
+	/* asynchronous enable */
+	struct delayed_work enable_work;
+	unsigned long en_req;
+	u64 en_req_ns[SNS_TYPE_MAX];
+	enum mpu6050_en_state en_state[SNS_TYPE_MAX];
+	u64 ready_ns[SNS_TYPE_MAX];
+	atomic_t first_pending[SNS_TYPE_MAX];
+	atomic_t en_err[SNS_TYPE_MAX];
+	bool removing;
 
 	/* pinctrl */
 	struct pinctrl *pinctrl;
 	struct pinctrl_state *pin_default;
 	struct pinctrl_state *pin_sleep;
 
-	u32 flush_count;
+	atomic_t flush_count;
 	u64 fifo_start_ns;
-	int gyro_wkp_flag;
-	int accel_wkp_flag;
+	struct mpu6050_fifo fifo[SNS_TYPE_MAX];
+	atomic_t ticks[SNS_TYPE_MAX];
+	atomic_t overruns[SNS_TYPE_MAX];
+	atomic_t dropped[SNS_TYPE_MAX];
+	u64 grid_epoch_ns[SNS_TYPE_MAX];
+	atomic_t grid_rebase[SNS_TYPE_MAX];
+	u64 grid_start_ns[SNS_TYPE_MAX];
+	u64 grid_idx[SNS_TYPE_MAX];
+	u32 ts_jitter_ns[SNS_TYPE_MAX];
+	s64 ts_skew_ns[SNS_TYPE_MAX];
+	s64 ts_skew_max_ns[SNS_TYPE_MAX];
 	struct task_struct *gyr_task;
 	struct task_struct *accel_task;
-	bool gyro_delay_change;
-	bool accel_delay_change;
+	atomic_t gyro_delay_change;
+	atomic_t accel_delay_change;
 	wait_queue_head_t	gyro_wq;
 	wait_queue_head_t	accel_wq;
+
+	/* unified scheduler */
+	bool unified;
+	struct hrtimer sched_timer;
+	spinlock_t sched_lock;
+	ktime_t sched_next[SNS_TYPE_MAX];
+	unsigned long sched_active;
+	struct task_struct *sched_task;
+	wait_queue_head_t sched_wq;
+
+	/* chip FIFO reader */
+	bool hwfifo_mode;
+	struct mutex hwfifo_lock;
+	u8 hwfifo_en;
+	u32 hwfifo_frame;
+	u64 hwfifo_interval_ns;
+	u64 hwfifo_ts_ns;
+	u32 hwfifo_batch;
+	u8 hwfifo_buf[MPU6050_FIFO_SIZE_BYTE];
+	u32 decim[SNS_TYPE_MAX];
+	u32 decim_skip[SNS_TYPE_MAX];
+
+	/* data ready interrupt */
+	struct irq_domain *irq_domain;
+	unsigned int irq;
+	s64 irq_ts_ns;
+	u32 irq_edges;
+
+	/* trace replay */
+	struct mpu6050_trace trace;
+	struct mutex trace_lock;
+
+	struct mpu6050_ring *ring;
+
+	struct mpu6050_gen gen;
+
+	struct mpu6050_latency lat;
+	struct dentry *debugfs;
+	struct mpu6050_stats __percpu *stats;
+	u64 enabled_since_ns[SNS_TYPE_MAX];
+	s16 last_data[SNS_TYPE_MAX][3];
+
+#ifdef CONFIG_SENSORS_FAKE6050_IIO
+	struct iio_dev *indio_dev;
+	struct iio_trigger *iio_trig;
+	spinlock_t iio_lock;
+	s16 iio_last[6];
+	s64 iio_ts;
+	int iio_lead;
+	unsigned long iio_owned;
+#endif
+
+	DECLARE_KFIFO(inject[SNS_TYPE_MAX], struct mpu6050_inject_sample,
+			MPU6050_INJECT_QUEUE_LEN);
 };
 
 /* Accelerometer information read by HAL */
@@ -285,6 +884,100 @@ mpu6050_gyro_axis_remap_tab[MPU6050_AXIS_REMAP_TAB_SZ] = {
 	{  1,    0,    2,    -1,      1,      1 }, /* P7 */
 };
 
+/* Q20 LSB per mg, indexed by enum mpu_accl_fs */
+static const u32 mpu6050_accel_phys_mult[NUM_ACCL_FSR] = {
+	MPU6050_PHYS_MULT(RAW_TO_1G, 1000),
+	MPU6050_PHYS_MULT(RAW_TO_1G, 2000),
+	MPU6050_PHYS_MULT(RAW_TO_1G, 4000),
+	MPU6050_PHYS_MULT(RAW_TO_1G, 8000),
+};
+
+/* Q20 LSB per mdps, indexed by enum mpu_fsr */
+static const u32 mpu6050_gyro_phys_mult[NUM_FSR] = {
+	MPU6050_PHYS_MULT(MPU6050_GYRO_LSB_X10, 10000),
+	MPU6050_PHYS_MULT(MPU6050_GYRO_LSB_X10, 20000),
+	MPU6050_PHYS_MULT(MPU6050_GYRO_LSB_X10, 40000),
+	MPU6050_PHYS_MULT(MPU6050_GYRO_LSB_X10, 80000),
+};
+
+static const u16 mpu6050_accel_fsr_g[NUM_ACCL_FSR] = { 2, 4, 8, 16 };
+static const u16 mpu6050_gyro_fsr_dps[NUM_FSR] = { 250, 500, 1000, 2000 };
+
+static const char * const mpu6050_sns_name[SNS_TYPE_MAX] = {
+	[SNS_TYPE_GYRO] = "gyro",
+	[SNS_TYPE_ACCEL] = "accel",
+};
+
+static const char * const mpu6050_lat_name[MPU6050_LAT_MAX] = {
+	[MPU6050_LAT_TIMER_WAKEUP] = "timer_to_wakeup",
+	[MPU6050_LAT_WAKEUP_SYNC] = "wakeup_to_sync",
+	[MPU6050_LAT_INTERVAL] = "wakeup_interval",
+	[MPU6050_LAT_FIRST_SAMPLE] = "enable_to_first_sample",
+};
+
+static const char * const mpu6050_stat_name[MPU6050_STAT_MAX] = {
+	[MPU6050_STAT_SAMPLES] = "samples",
+	[MPU6050_STAT_DROPPED] = "dropped",
+	[MPU6050_STAT_OVERRUNS] = "overruns",
+	[MPU6050_STAT_INJECTED] = "injected",
+	[MPU6050_STAT_DUPLICATES] = "duplicates",
+	[MPU6050_STAT_ENABLES] = "enables",
+	[MPU6050_STAT_DISABLES] = "disables",
+	[MPU6050_STAT_RATE_CHANGES] = "rate_changes",
+	[MPU6050_STAT_ENABLED_NS] = "enabled_ns",
+	[MPU6050_STAT_PARKS] = "parks",
+	[MPU6050_STAT_ENABLE_ERRORS] = "enable_errors",
+};
+
+static const char * const mpu6050_gen_axis_name[MPU6050_GEN_AXES] = {
+	"x", "y", "z", "rx", "ry", "rz",
+};
+
+static const char * const mpu6050_wave_name[] = {
+	[MPU6050_WAVE_OFF] = "off",
+	[MPU6050_WAVE_CONST] = "const",
+	[MPU6050_WAVE_SINE] = "sine",
+	[MPU6050_WAVE_SQUARE] = "square",
+	[MPU6050_WAVE_RAMP] = "ramp",
+	[MPU6050_WAVE_STEP] = "step",
+};
+
+/* one sine period in Q15 */
+static const s16 mpu6050_sine_table[256] = {
+	0, 804, 1608, 2410, 3212, 4011, 4808, 5602,
+	6393, 7179, 7962, 8739, 9512, 10278, 11039, 11793,
+	12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+	18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+	23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+	27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+	30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971,
+	32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+	32767, 32757, 32728, 32678, 32609, 32521, 32412, 32285,
+	32137, 31971, 31785, 31580, 31356, 31113, 30852, 30571,
+	30273, 29956, 29621, 29268, 28898, 28510, 28105, 27683,
+	27245, 26790, 26319, 25832, 25329, 24811, 24279, 23731,
+	23170, 22594, 22005, 21403, 20787, 20159, 19519, 18868,
+	18204, 17530, 16846, 16151, 15446, 14732, 14010, 13279,
+	12539, 11793, 11039, 10278, 9512, 8739, 7962, 7179,
+	6393, 5602, 4808, 4011, 3212, 2410, 1608, 804,
+	0, -804, -1608, -2410, -3212, -4011, -4808, -5602,
+	-6393, -7179, -7962, -8739, -9512, -10278, -11039, -11793,
+	-12539, -13279, -14010, -14732, -15446, -16151, -16846, -17530,
+	-18204, -18868, -19519, -20159, -20787, -21403, -22005, -22594,
+	-23170, -23731, -24279, -24811, -25329, -25832, -26319, -26790,
+	-27245, -27683, -28105, -28510, -28898, -29268, -29621, -29956,
+	-30273, -30571, -30852, -31113, -31356, -31580, -31785, -31971,
+	-32137, -32285, -32412, -32521, -32609, -32678, -32728, -32757,
+	-32767, -32757, -32728, -32678, -32609, -32521, -32412, -32285,
+	-32137, -31971, -31785, -31580, -31356, -31113, -30852, -30571,
+	-30273, -29956, -29621, -29268, -28898, -28510, -28105, -27683,
+	-27245, -26790, -26319, -25832, -25329, -24811, -24279, -23731,
+	-23170, -22594, -22005, -21403, -20787, -20159, -19519, -18868,
+	-18204, -17530, -16846, -16151, -15446, -14732, -14010, -13279,
+	-12539, -11793, -11039, -10278, -9512, -8739, -7962, -7179,
+	-6393, -5602, -4808, -4011, -3212, -2410, -1608, -804,
+};
+
 static const struct mpu6050_place_name
 mpu6050_place_name2num[MPU6050_AXIS_REMAP_TAB_SZ] = {
 	{"Portrait Up", MPU6050_PLACE_PU},
@@ -303,13 +996,25 @@ static int accel_poll_thread(void *data);
 static void mpu6050_pinctrl_state(struct mpu6050_sensor *sensor,
 			bool active);
 static int mpu6050_config_sample_rate(struct mpu6050_sensor *sensor);
+static int mpu6050_update_periods(struct mpu6050_sensor *sensor);
+static void mpu6050_hwfifo_fill(struct mpu6050_sensor *sensor);
+static int mpu6050_hwfifo_config(struct mpu6050_sensor *sensor);
+static void mpu6050_sample_source(struct mpu6050_sensor *sensor, int sns_type,
+				u64 period, struct axis_data *axis);
+static void mpu6050_source_skip(struct mpu6050_sensor *sensor, int sns_type,
+				u64 period, u64 n);
+static int mpu6050_irq_config(struct mpu6050_sensor *sensor);
+static int mpu6050_set_enable(struct mpu6050_sensor *sensor, int sns_type,
+				bool enable);
 
 static int mpu6050_power_ctl(struct mpu6050_sensor *sensor, bool on)
 {
 	int rc = 0;
-	printk("MPU6050 - power ctl\n");
+	bool changed = (on != sensor->power_enabled);
+
 	if (on && (!sensor->power_enabled)) {
-		msleep(POWER_UP_TIME_MS);
+		/* the boot time is waited for by the first register access */
+		sensor->power_up_ns = ktime_to_ns(ktime_get_boottime());
 
 		mpu6050_pinctrl_state(sensor, true);
 
@@ -318,916 +1023,4982 @@ static int mpu6050_power_ctl(struct mpu6050_sensor *sensor, bool on)
 		mpu6050_pinctrl_state(sensor, false);
 
 		sensor->power_enabled = false;
-	} else {
-		printk("MPU6050 - Ignore power status change from %d to %d\n",
-				on, sensor->power_enabled);
 	}
-	printk("MPU6050 - Power report %d\n", rc);
+	trace_mpu6050_power(sensor->dev, on, changed);
 	return rc;
 }
 
+/* The emulated chip has no supplies, the mpu6050_power event covers it. */
 static int mpu6050_power_init(struct mpu6050_sensor *sensor)
 {
-	printk("MPU6050 - Power init\n");
-
 	return 0;
 }
 
 static int mpu6050_power_deinit(struct mpu6050_sensor *sensor)
 {
-	int ret = 0;
-	printk("MPU6050 - power deinit\n");
-	return ret;
+	return 0;
 }
 
-static void mpu6050_remap_accel_data(struct axis_data *data, int place)
+/*
+ * Resolve the placement of one sensor type into a permutation and sign
+ * vector once, so the hot path neither decodes the bitfield tables nor
+ * branches on the placement. Place 0 needs not to be remapped.
+ */
+static void mpu6050_remap_init(struct mpu6050_remap *remap,
+				const struct sensor_axis_remap *tab, int place)
 {
-	const struct sensor_axis_remap *remap;
-	s16 tmp[3];
-	/* sensor with place 0 needs not to be remapped */
-	if ((place <= 0) || (place >= MPU6050_AXIS_REMAP_TAB_SZ))
-		return;
-
-	remap = &mpu6050_accel_axis_remap_tab[place];
+	const struct sensor_axis_remap *entry;
 
-	tmp[0] = data->x;
-	tmp[1] = data->y;
-	tmp[2] = data->z;
-	data->x = tmp[remap->src_x] * remap->sign_x;
-	data->y = tmp[remap->src_y] * remap->sign_y;
-	data->z = tmp[remap->src_z] * remap->sign_z;
+	if ((place <= 0) || (place >= MPU6050_AXIS_REMAP_TAB_SZ)) {
+		remap->src[0] = 0;
+		remap->src[1] = 1;
+		remap->src[2] = 2;
+		remap->neg[0] = remap->neg[1] = remap->neg[2] = 0;
+		return;
+	}
 
-	return;
+	entry = &tab[place];
+	remap->src[0] = entry->src_x;
+	remap->src[1] = entry->src_y;
+	remap->src[2] = entry->src_z;
+	remap->neg[0] = (entry->sign_x < 0) ? -1 : 0;
+	remap->neg[1] = (entry->sign_y < 0) ? -1 : 0;
+	remap->neg[2] = (entry->sign_z < 0) ? -1 : 0;
 }
 
-static void mpu6050_remap_gyro_data(struct axis_data *data, int place)
+/* Remap a raw frame into a separate output frame, (v ^ -1) - -1 == -v. */
+static inline void mpu6050_remap(const struct mpu6050_remap *remap,
+				const s16 *raw, s16 *out)
 {
-	const struct sensor_axis_remap *remap;
-	s16 tmp[3];
-	/* sensor with place 0 needs not to be remapped */
-	if ((place <= 0) || (place >= MPU6050_AXIS_REMAP_TAB_SZ))
-		return;
-
-	remap = &mpu6050_gyro_axis_remap_tab[place];
-	tmp[0] = data->rx;
-	tmp[1] = data->ry;
-	tmp[2] = data->rz;
-	data->rx = tmp[remap->src_x] * remap->sign_x;
-	data->ry = tmp[remap->src_y] * remap->sign_y;
-	data->rz = tmp[remap->src_z] * remap->sign_z;
-
-	return;
+	out[0] = (raw[remap->src[0]] ^ remap->neg[0]) - remap->neg[0];
+	out[1] = (raw[remap->src[1]] ^ remap->neg[1]) - remap->neg[1];
+	out[2] = (raw[remap->src[2]] ^ remap->neg[2]) - remap->neg[2];
 }
 
-static int mpu6050_manage_polling(int sns_type, struct mpu6050_sensor *sensor)
+/* Raw frame of one sensor type from a full axis snapshot. */
+static inline void mpu6050_axis_raw(const struct axis_data *axis,
+				int sns_type, s16 *raw)
 {
-	ktime_t ktime;
-	int ret = 0;
-
-	switch (sns_type) {
-	case SNS_TYPE_GYRO:
-		if (atomic_read(&sensor->gyro_en)) {
-			ktime = ktime_set(0,
-				sensor->gyro_poll_ms * NSEC_PER_MSEC);
-			ret = hrtimer_start(&sensor->gyro_timer,
-					ktime,
-					HRTIMER_MODE_REL);
-		} else
-			ret = hrtimer_try_to_cancel(&sensor->gyro_timer);
-		break;
+	if (sns_type == SNS_TYPE_ACCEL) {
+		raw[0] = axis->x;
+		raw[1] = axis->y;
+		raw[2] = axis->z;
+	} else {
+		raw[0] = axis->rx;
+		raw[1] = axis->ry;
+		raw[2] = axis->rz;
+	}
+}
 
-	case SNS_TYPE_ACCEL:
-		if (atomic_read(&sensor->accel_en)) {
-			ktime = ktime_set(0,
-				sensor->accel_poll_ms * NSEC_PER_MSEC);
-			ret = hrtimer_start(&sensor->accel_timer,
-					ktime,
-					HRTIMER_MODE_REL);
-		} else
-			ret = hrtimer_try_to_cancel(&sensor->accel_timer);
-		break;
+/*
+ * Take a consistent snapshot of the injected axis data. Readers never block
+ * the injectors, they simply retry if a frame was published meanwhile.
+ */
+static void mpu6050_read_axis(struct mpu6050_sensor *sensor,
+				struct axis_data *data)
+{
+	unsigned int seq;
 
-	default:
-		printk("MPU6050 - Invalid sensor type\n");
-		ret = -EINVAL;
-		break;
-	}
-	return ret;
+	do {
+		seq = read_seqbegin(&sensor->axis_lock);
+		*data = sensor->axis;
+	} while (read_seqretry(&sensor->axis_lock, seq));
 }
 
-static enum hrtimer_restart gyro_timer_handle(struct hrtimer *hrtimer)
+/*
+ * Emulated register file. It sits behind a regmap bus, so every access is
+ * serialized by the regmap lock and the driver sees the same raw, auto
+ * incrementing byte transfers as on I2C. Configuration registers are
+ * cached by regmap, status and data registers are volatile.
+ */
+static void mpu6050_regs_reset(struct mpu6050_sensor *sensor)
 {
-	struct mpu6050_sensor *sensor;
-	sensor = container_of(hrtimer, struct mpu6050_sensor, gyro_timer);
-	sensor->gyro_wkp_flag = 1;
-	wake_up_interruptible(&sensor->gyro_wq);
-	if (mpu6050_manage_polling(SNS_TYPE_GYRO, sensor) < 0)
-		printk("MPU6050 - gyr: failed to start/cancel timer\n");
-	return HRTIMER_NORESTART;
+	memset(sensor->regfile, 0, sizeof(sensor->regfile));
+	sensor->regfile[REG_PWR_MGMT_1] = BIT_SLEEP;
+	sensor->regfile[REG_WHOAMI] = MPU6050_ID;
+	sensor->hwfifo.head = 0;
+	sensor->hwfifo.count = 0;
 }
 
-static enum hrtimer_restart accel_timer_handle(struct hrtimer *hrtimer)
+/* Bytes per FIFO frame for a FIFO_EN value. */
+static inline u32 mpu6050_fifo_frame_size(u8 fifo_en)
 {
-	struct mpu6050_sensor *sensor;
-	sensor = container_of(hrtimer, struct mpu6050_sensor, accel_timer);
-	sensor->accel_wkp_flag = 1;
-	wake_up_interruptible(&sensor->accel_wq);
-	if (mpu6050_manage_polling(SNS_TYPE_ACCEL, sensor) < 0)
-		printk("MPU6050 - acc: failed to start/cancel timer\n");
-	return HRTIMER_NORESTART;
+	return ((fifo_en & BIT_ACCEL_OUT) ? 6 : 0) +
+		((fifo_en & BIT_TEMP_OUT) ? 2 : 0) +
+		2 * hweight8(fifo_en & BITS_GYRO_OUT);
 }
 
-static int gyro_poll_thread(void *data)
+/* wake interval of the low power accel cycle, per LP_WAKE_CTRL */
+static const u16 mpu6050_lp_wake_ms[] = { 800, 200, 50, 25 };
+
+/* Sample clock interval of the chip, from SMPLRT_DIV and DLPF_CFG. */
+static u64 mpu6050_regs_interval_ns(struct mpu6050_sensor *sensor)
 {
-	struct mpu6050_sensor *sensor = data;
-	ktime_t timestamp;
+	u8 dlpf = sensor->regfile[REG_CONFIG] & 0x07;
+	u32 odr;
 
-	while (1) {
-		wait_event_interruptible(sensor->gyro_wq,
-			((sensor->gyro_wkp_flag != 0) ||
-				kthread_should_stop()));
-		sensor->gyro_wkp_flag = 0;
+	if ((dlpf == MPU_DLPF_256HZ_NOLPF2) || (dlpf == MPU_DLPF_RESERVED))
+		odr = ODR_DLPF_DIS;
+	else
+		odr = ODR_DLPF_ENA;
 
-		if (kthread_should_stop())
-			break;
+	return div_u64(NSEC_PER_SEC *
+			(sensor->regfile[REG_SAMPLE_RATE_DIV] + 1ULL), odr);
+}
 
-		mutex_lock(&sensor->op_lock);
-		if (sensor->gyro_delay_change) {
-			if (sensor->gyro_poll_ms <= POLL_MS_100HZ)
-				set_wake_up_idle(true);
-			else
-				set_wake_up_idle(false);
-			sensor->gyro_delay_change = false;
+/*
+ * Write bytes to the chip FIFO. When it is full the oldest bytes are
+ * overwritten, as on the real part, and FIFO_OFLOW_INT is raised.
+ */
+static void mpu6050_hwfifo_put(struct mpu6050_sensor *sensor,
+				const u8 *data, u32 len)
+{
+	struct mpu6050_hwfifo *hw = &sensor->hwfifo;
+	u32 i;
+
+	for (i = 0; i < len; i++) {
+		hw->buf[(hw->head + hw->count) &
+				(MPU6050_FIFO_SIZE_BYTE - 1)] = data[i];
+		if (hw->count == MPU6050_FIFO_SIZE_BYTE) {
+			hw->head = (hw->head + 1) & (MPU6050_FIFO_SIZE_BYTE - 1);
+			sensor->regfile[REG_INT_STATUS] |= BIT_FIFO_OVERFLOW;
+		} else {
+			hw->count++;
 		}
-		mutex_unlock(&sensor->op_lock);
-
-		timestamp = ktime_get_boottime();
-		mpu6050_remap_gyro_data(&sensor->axis, sensor->pdata->place);
-		input_report_abs(sensor->gyro_dev, ABS_RX, sensor->axis.rx);
-		input_report_abs(sensor->gyro_dev, ABS_RY, sensor->axis.ry);
-		input_report_abs(sensor->gyro_dev, ABS_RZ, sensor->axis.rz);
-		input_event(sensor->gyro_dev,
-				EV_SYN, SYN_TIME_SEC,
-				ktime_to_timespec(timestamp).tv_sec);
-		input_event(sensor->gyro_dev, EV_SYN,
-			SYN_TIME_NSEC,
-			ktime_to_timespec(timestamp).tv_nsec);
-		input_sync(sensor->gyro_dev);
 	}
-	return 0;
 }
 
-static int accel_poll_thread(void *data)
+static u8 mpu6050_hwfifo_pop(struct mpu6050_sensor *sensor)
 {
-	struct mpu6050_sensor *sensor = data;
-	ktime_t timestamp;
+	struct mpu6050_hwfifo *hw = &sensor->hwfifo;
+	u8 val;
 
-	while (1) {
-		wait_event_interruptible(sensor->accel_wq,
-			((sensor->accel_wkp_flag != 0) ||
-				kthread_should_stop()));
-		sensor->accel_wkp_flag = 0;
+	if (!hw->count)
+		return 0;
 
-		if (kthread_should_stop())
-			break;
+	val = hw->buf[hw->head];
+	hw->head = (hw->head + 1) & (MPU6050_FIFO_SIZE_BYTE - 1);
+	hw->count--;
+	return val;
+}
 
-		mutex_lock(&sensor->op_lock);
-		if (sensor->accel_delay_change) {
-			if (sensor->accel_poll_ms <= POLL_MS_100HZ)
-				set_wake_up_idle(true);
-			else
-				set_wake_up_idle(false);
-			sensor->accel_delay_change = false;
-		}
-		mutex_unlock(&sensor->op_lock);
+static inline bool mpu6050_regs_is_data(unsigned int reg)
+{
+	return (reg >= REG_RAW_ACCEL) &&
+		(reg < REG_RAW_ACCEL + MPU6050_RAW_DATA_LEN);
+}
 
-		timestamp = ktime_get_boottime();
-		mpu6050_remap_accel_data(&sensor->axis, sensor->pdata->place);
-		input_report_abs(sensor->accel_dev, ABS_X, sensor->axis.x);
-		input_report_abs(sensor->accel_dev, ABS_Y, sensor->axis.y);
-		input_report_abs(sensor->accel_dev, ABS_Z, sensor->axis.z);
-		input_event(sensor->accel_dev,
-				EV_SYN, SYN_TIME_SEC,
-				ktime_to_timespec(timestamp).tv_sec);
-		input_event(sensor->accel_dev, EV_SYN,
-			SYN_TIME_NSEC,
-			ktime_to_timespec(timestamp).tv_nsec);
-		input_sync(sensor->accel_dev);
+static bool mpu6050_regs_writeable(struct device *dev, unsigned int reg)
+{
+	switch (reg) {
+	case REG_SAMPLE_RATE_DIV:
+	case REG_CONFIG:
+	case REG_GYRO_CONFIG:
+	case REG_ACCEL_CONFIG:
+	case REG_ACCEL_MOT_THR:
+	case REG_ACCEL_MOT_DUR:
+	case REG_FIFO_EN:
+	case REG_INT_PIN_CFG:
+	case REG_INT_ENABLE:
+	case REG_DETECT_CTRL:
+	case REG_USER_CTRL:
+	case REG_PWR_MGMT_1:
+	case REG_PWR_MGMT_2:
+	case REG_FIFO_R_W:
+		return true;
+	default:
+		return false;
 	}
-
-	return 0;
 }
 
-/**
- *  mpu6050_set_lpa_freq() - set low power wakeup frequency.
- */
-static int mpu6050_set_lpa_freq(struct mpu6050_sensor *sensor, int lpa_freq)
+static bool mpu6050_regs_readable(struct device *dev, unsigned int reg)
 {
-	sensor->cfg.lpa_freq = lpa_freq;
-	printk("MPU6050 - set lpa-freq_%d REG_108 READ_63 WRITE_127 \n",sensor->cfg.lpa_freq);
-
-	return 0;
+	switch (reg) {
+	case REG_INT_STATUS:
+	case REG_FIFO_COUNT_H:
+	case REG_FIFO_COUNT_L:
+	case REG_WHOAMI:
+		return true;
+	default:
+		return mpu6050_regs_is_data(reg) ||
+			mpu6050_regs_writeable(dev, reg);
+	}
 }
 
-static int mpu6050_switch_engine(struct mpu6050_sensor *sensor,
-				bool en, u32 mask)
+static bool mpu6050_regs_volatile(struct device *dev, unsigned int reg)
 {
-	struct mpu_reg_map *reg;
-	u8 /* data, */ mgmt_1;
-	int ret;
-	printk("MPU6050 - switch engine\n");
-	ret = 0;
-	reg = &sensor->reg;
-	/*
-	 * switch clock needs to be careful. Only when gyro is on, can
-	 * clock source be switched to gyro. Otherwise, it must be set to
-	 * internal clock
-	 */
-	mgmt_1 = MPU_CLK_INTERNAL;
-	if (BIT_PWR_GYRO_STBY_MASK == mask) {
-		ret = 1;
-		mgmt_1 = (u8)ret;
-		mgmt_1 &= ~BIT_CLK_MASK;
+	switch (reg) {
+	case REG_PWR_MGMT_1:	/* H_RESET clears itself */
+	case REG_USER_CTRL:	/* so does FIFO_RESET */
+	case REG_INT_STATUS:
+	case REG_FIFO_COUNT_H:
+	case REG_FIFO_COUNT_L:
+	case REG_FIFO_R_W:
+		return true;
+	default:
+		return mpu6050_regs_is_data(reg);
 	}
+}
 
-	if ((BIT_PWR_GYRO_STBY_MASK == mask) && (!en)) {
-		mgmt_1 |= MPU_CLK_INTERNAL;
-	}
+static bool mpu6050_regs_precious(struct device *dev, unsigned int reg)
+{
+	return (reg == REG_INT_STATUS) || (reg == REG_FIFO_R_W);
+}
 
-	if ((BIT_PWR_GYRO_STBY_MASK == mask) && en) {
-		/* wait gyro stable */
-		msleep(SENSOR_UP_TIME_MS);
-		/* after gyro is on & stable, switch internal clock to PLL */
-		mgmt_1 |= MPU_CLK_PLL_X;
+/*
+ * Sample the data source of a sensor after @edges more edges of the chip
+ * sample clock. A decimated sensor runs at a fraction of the clock, its
+ * source advances once per @decim edges and the chip holds the value in
+ * between, so a sensor consumes one injected or replayed frame per sampling
+ * tick and not per edge. Whichever frame of a @decim run the driver keeps,
+ * it sees every value once. src_lock must be held.
+ */
+static void mpu6050_chip_sample(struct mpu6050_sensor *sensor, int sns_type,
+				u64 interval, u64 edges, struct axis_data *axis)
+{
+	u32 decim = max_t(u32, READ_ONCE(sensor->decim[sns_type]), 1);
+	u32 *hold = &sensor->src_hold[sns_type];
+	u64 fresh;
+	u32 rem;
+
+	*hold = min(*hold, decim - 1);
+	if (edges <= *hold) {
+		*hold -= edges;
+	} else {
+		fresh = div_u64_rem(edges - *hold - 1, decim, &rem) + 1;
+		*hold = decim - 1 - rem;
+		if (fresh > 1)
+			mpu6050_source_skip(sensor, sns_type, decim * interval,
+					fresh - 1);
+		mpu6050_sample_source(sensor, sns_type, decim * interval,
+				&sensor->src_held[sns_type]);
 	}
-
-	return 0;
+	*axis = sensor->src_held[sns_type];
 }
 
-static int mpu6050_init_engine(struct mpu6050_sensor *sensor)
+/*
+ * Latch the data registers, a burst read sees one consistent frame. While
+ * the sample clock runs the data sources follow its edges since the
+ * previous latch, otherwise every latch takes a new sample. They are
+ * sampled outside regs_lock, src_lock must be held.
+ */
+static void mpu6050_regs_latch(struct mpu6050_sensor *sensor, u8 *data)
 {
-	int ret;
+	struct axis_data accel, gyro;
+	unsigned long flags;
+	u64 interval;
+	bool clocked;
+	u32 edges;
+
+	spin_lock_irqsave(&sensor->regs_lock, flags);
+	edges = sensor->drdy_edges - sensor->latch_edges;
+	sensor->latch_edges = sensor->drdy_edges;
+	clocked = sensor->drdy_running;
+	interval = mpu6050_regs_interval_ns(sensor);
+	spin_unlock_irqrestore(&sensor->regs_lock, flags);
+
+	if (clocked) {
+		mpu6050_chip_sample(sensor, SNS_TYPE_ACCEL, interval, edges,
+				&accel);
+		mpu6050_chip_sample(sensor, SNS_TYPE_GYRO, interval, edges,
+				&gyro);
+	} else {
+		mpu6050_sample_source(sensor, SNS_TYPE_ACCEL, interval, &accel);
+		mpu6050_sample_source(sensor, SNS_TYPE_GYRO, interval, &gyro);
+	}
+	put_unaligned_be16(accel.x, &data[0]);
+	put_unaligned_be16(accel.y, &data[2]);
+	put_unaligned_be16(accel.z, &data[4]);
+	put_unaligned_be16(MPU6050_TEMP_RAW_25C, &data[6]);
+	put_unaligned_be16(gyro.rx, &data[8]);
+	put_unaligned_be16(gyro.ry, &data[10]);
+	put_unaligned_be16(gyro.rz, &data[12]);
+}
 
-	ret = mpu6050_switch_engine(sensor, false, BIT_PWR_GYRO_STBY_MASK);
-	if (ret)
-		return ret;
+static inline bool mpu6050_regs_drdy_on(struct mpu6050_sensor *sensor)
+{
+	return (sensor->regfile[REG_INT_ENABLE] & BIT_DATA_RDY_EN) &&
+		!(sensor->regfile[REG_PWR_MGMT_1] & BIT_SLEEP);
+}
 
-	ret = mpu6050_switch_engine(sensor, false, BIT_PWR_ACCEL_STBY_MASK);
-	if (ret)
-		return ret;
+/* Start the chip sample clock once data ready is enabled and awake. */
+static void mpu6050_regs_drdy_update(struct mpu6050_sensor *sensor)
+{
+	if (sensor->drdy_running || !mpu6050_regs_drdy_on(sensor))
+		return;
 
-	return 0;
+	sensor->drdy_running = true;
+	hrtimer_start(&sensor->drdy_timer,
+			ns_to_ktime(mpu6050_regs_interval_ns(sensor)),
+			HRTIMER_MODE_REL);
 }
 
-/**
- * mpu6050_set_power_mode() - set the power mode
- * @sensor: sensor data structure
- * @power_on: value to switch on/off of power, 1: normal power,
- *    0: low power
- *
- * Put device to normal-power mode or low-power mode.
+/*
+ * Sample clock edge of the chip. DATA_RDY_INT is set and the line is raised.
+ * With LATCH_INT_EN the line stays up until INT_STATUS is read, so a reader
+ * that fell behind sees one interrupt for several edges, as on the part.
  */
-static int mpu6050_set_power_mode(struct mpu6050_sensor *sensor,
-					bool power_on)
+static enum hrtimer_restart mpu6050_drdy_timer_handle(struct hrtimer *hrtimer)
 {
-	s32 ret;
-	u8 val;
-	ret = 1;
+	struct mpu6050_sensor *sensor = container_of(hrtimer,
+			struct mpu6050_sensor, drdy_timer);
+	u8 *regs = sensor->regfile;
+	bool raise;
+
+	spin_lock(&sensor->regs_lock);
+	if (!mpu6050_regs_drdy_on(sensor)) {
+		sensor->drdy_running = false;
+		spin_unlock(&sensor->regs_lock);
+		return HRTIMER_NORESTART;
+	}
 
-	if (power_on)
-		val = (u8)ret & ~BIT_SLEEP;
-	else
-		val = (u8)ret | BIT_SLEEP;
+	raise = !(regs[REG_INT_PIN_CFG] & BIT_INT_LATCH_EN) ||
+		!(regs[REG_INT_STATUS] & BIT_DATA_RDY_INT);
+	regs[REG_INT_STATUS] |= BIT_DATA_RDY_INT;
+	sensor->drdy_edges++;
+	hrtimer_forward_now(hrtimer,
+			ns_to_ktime(mpu6050_regs_interval_ns(sensor)));
+	spin_unlock(&sensor->regs_lock);
 
-	return 0;
+	if (raise && sensor->irq)
+		generic_handle_irq(sensor->irq);
+
+	return HRTIMER_RESTART;
 }
 
-static int mpu6050_gyro_enable(struct mpu6050_sensor *sensor, bool on)
+static inline bool mpu6050_regs_mot_on(struct mpu6050_sensor *sensor)
 {
-	int ret;
-	u8 data;
-	ret = 0;
+	return (sensor->regfile[REG_INT_ENABLE] & BIT_MOT_EN) &&
+		!(sensor->regfile[REG_PWR_MGMT_1] & BIT_SLEEP);
+}
+
+/* Motion is evaluated at the wake rate in cycle mode, else per sample. */
+static u64 mpu6050_regs_mot_interval_ns(struct mpu6050_sensor *sensor)
+{
+	u8 lp_wake = sensor->regfile[REG_PWR_MGMT_2] >> 6;
+
+	if (sensor->regfile[REG_PWR_MGMT_1] & BIT_CYCLE)
+		return (u64)mpu6050_lp_wake_ms[lp_wake] * NSEC_PER_MSEC;
+	return mpu6050_regs_interval_ns(sensor);
+}
+
+static void mpu6050_regs_mot_queue(struct mpu6050_sensor *sensor)
+{
+	unsigned long delay;
+
+	delay = nsecs_to_jiffies(mpu6050_regs_mot_interval_ns(sensor));
+	queue_delayed_work(system_power_efficient_wq, &sensor->mot_clk,
+			max(delay, 1UL));
+}
+
+/* Start the motion clock once MOT_EN is set and awake. */
+static void mpu6050_regs_mot_update(struct mpu6050_sensor *sensor)
+{
+	if (sensor->mot_running || !mpu6050_regs_mot_on(sensor))
+		return;
+
+	sensor->mot_running = true;
+	sensor->mot_ref_valid = false;
+	sensor->mot_ms = 0;
+	mpu6050_regs_mot_queue(sensor);
+}
+
+static void mpu6050_regs_mot_irq(struct irq_work *work)
+{
+	struct mpu6050_sensor *sensor = container_of(work,
+			struct mpu6050_sensor, mot_irq_work);
+
+	generic_handle_irq(sensor->irq);
+}
+
+/*
+ * Motion clock of the chip. Each tick compares one accel frame with the
+ * reference frame and sets MOT_INT once an axis exceeded MOT_THR for
+ * MOT_DUR ms, then takes the frame as the new reference, like the accel
+ * high pass filter in hold mode. The data source advances with the clock,
+ * so motion injected while the streams are parked is seen here. It runs in
+ * process context, the frame is sampled under src_lock with regs_lock
+ * dropped and only the compare is done under regs_lock.
+ */
+static void mpu6050_regs_mot_work(struct work_struct *work)
+{
+	struct mpu6050_sensor *sensor = container_of(to_delayed_work(work),
+			struct mpu6050_sensor, mot_clk);
+	u8 *regs = sensor->regfile;
+	struct axis_data accel;
+	unsigned long flags;
+	bool over = false, raise = false;
+	u64 interval;
+	u32 thr;
+	s16 frame[3];
+	int i;
+
+	mutex_lock(&sensor->src_lock);
+	spin_lock_irqsave(&sensor->regs_lock, flags);
+	if (!mpu6050_regs_mot_on(sensor))
+		goto stop;
+	interval = mpu6050_regs_mot_interval_ns(sensor);
+	spin_unlock_irqrestore(&sensor->regs_lock, flags);
+
+	mpu6050_sample_source(sensor, SNS_TYPE_ACCEL, interval, &accel);
+	frame[0] = accel.x;
+	frame[1] = accel.y;
+	frame[2] = accel.z;
+
+	spin_lock_irqsave(&sensor->regs_lock, flags);
+	/* MOT_EN may have been cleared while regs_lock was dropped */
+	if (!mpu6050_regs_mot_on(sensor))
+		goto stop;
+	thr = regs[REG_ACCEL_MOT_THR] * MOT_THR_MG_PER_LSB *
+		(RAW_TO_1G >> ((regs[REG_ACCEL_CONFIG] & ACCL_CONFIG_FSR_MASK) >>
+			ACCL_CONFIG_FSR_SHIFT)) / 1000;
+
+	if (sensor->mot_ref_valid) {
+		for (i = 0; i < 3; i++)
+			if (abs(frame[i] - sensor->mot_ref[i]) > thr)
+				over = true;
+	} else {
+		memcpy(sensor->mot_ref, frame, sizeof(frame));
+		sensor->mot_ref_valid = true;
+	}
+
+	if (!over) {
+		sensor->mot_ms = 0;
+	} else {
+		sensor->mot_ms += div_u64(interval, NSEC_PER_MSEC);
+		if (sensor->mot_ms >= regs[REG_ACCEL_MOT_DUR]) {
+			raise = !(regs[REG_INT_PIN_CFG] & BIT_INT_LATCH_EN) ||
+				!(regs[REG_INT_STATUS] & BIT_MOT_INT);
+			regs[REG_INT_STATUS] |= BIT_MOT_INT;
+			memcpy(sensor->mot_ref, frame, sizeof(frame));
+			sensor->mot_ms = 0;
+		}
+	}
+	mpu6050_regs_mot_queue(sensor);
+	spin_unlock_irqrestore(&sensor->regs_lock, flags);
+	mutex_unlock(&sensor->src_lock);
+
+	if (raise && sensor->irq)
+		irq_work_queue(&sensor->mot_irq_work);
+	return;
+
+stop:
+	sensor->mot_running = false;
+	spin_unlock_irqrestore(&sensor->regs_lock, flags);
+	mutex_unlock(&sensor->src_lock);
+}
+
+static void mpu6050_regs_store(struct mpu6050_sensor *sensor, u8 reg, u8 val)
+{
+	u8 old = sensor->regfile[reg];
+	bool fifo_reset;
+
+	if (!mpu6050_regs_writeable(NULL, reg))
+		return;
+
+	switch (reg) {
+	case REG_PWR_MGMT_1:
+		if (val & BIT_H_RESET) {
+			mpu6050_regs_reset(sensor);
+			return;
+		}
+		break;
+	case REG_USER_CTRL:
+		fifo_reset = val & BIT_FIFO_RESET;
+		if (fifo_reset) {
+			sensor->hwfifo.head = 0;
+			sensor->hwfifo.count = 0;
+			val &= ~BIT_FIFO_RESET;
+		}
+		/* the first frame is due one sample clock after (re)start */
+		if ((val & BIT_FIFO_EN) && (fifo_reset || !(old & BIT_FIFO_EN)))
+			sensor->hwfifo.next_ns =
+				ktime_to_ns(ktime_get_boottime()) +
+				mpu6050_regs_interval_ns(sensor);
+		break;
+	case REG_FIFO_R_W:
+		mpu6050_hwfifo_put(sensor, &val, 1);
+		return;
+	}
+
+	sensor->regfile[reg] = val;
+	if ((reg == REG_INT_ENABLE) || (reg == REG_PWR_MGMT_1))
+		mpu6050_regs_drdy_update(sensor);
+	if ((reg == REG_INT_ENABLE) || (reg == REG_PWR_MGMT_1) ||
+		(reg == REG_PWR_MGMT_2))
+		mpu6050_regs_mot_update(sensor);
+}
+
+static int mpu6050_regs_bus_write(void *context, const void *data,
+				size_t count)
+{
+	struct mpu6050_sensor *sensor = context;
+	const u8 *buf = data;
+	u8 reg = buf[0];
+	unsigned long flags;
+	size_t i;
+
+	if ((count < 2) || (reg + count - 1 > MPU6050_NUM_REGS))
+		return -EIO;
+
+	mutex_lock(&sensor->src_lock);
+	mpu6050_hwfifo_fill(sensor);
+	spin_lock_irqsave(&sensor->regs_lock, flags);
+	for (i = 1; i < count; i++) {
+		mpu6050_regs_store(sensor, reg, buf[i]);
+		/* FIFO_R_W does not auto increment */
+		if (reg != REG_FIFO_R_W)
+			reg++;
+	}
+	spin_unlock_irqrestore(&sensor->regs_lock, flags);
+	mutex_unlock(&sensor->src_lock);
+
+	return 0;
+}
+
+static int mpu6050_regs_bus_read(void *context, const void *reg_buf,
+				size_t reg_size, void *val_buf, size_t val_size)
+{
+	struct mpu6050_sensor *sensor = context;
+	u8 data[MPU6050_RAW_DATA_LEN];
+	u8 reg = *(const u8 *)reg_buf;
+	u8 *val = val_buf;
+	bool latched = false;
+	unsigned long flags;
+	size_t i;
+
+	if ((reg != REG_FIFO_R_W) && (reg + val_size > MPU6050_NUM_REGS))
+		return -EIO;
+
+	mutex_lock(&sensor->src_lock);
+	mpu6050_hwfifo_fill(sensor);
+	if ((reg != REG_FIFO_R_W) &&
+		(reg < REG_RAW_ACCEL + MPU6050_RAW_DATA_LEN) &&
+		(reg + val_size > REG_RAW_ACCEL)) {
+		mpu6050_regs_latch(sensor, data);
+		latched = true;
+	}
+	spin_lock_irqsave(&sensor->regs_lock, flags);
+	if (reg == REG_FIFO_R_W) {
+		/* FIFO_R_W does not auto increment, a burst drains the FIFO */
+		for (i = 0; i < val_size; i++)
+			val[i] = mpu6050_hwfifo_pop(sensor);
+		spin_unlock_irqrestore(&sensor->regs_lock, flags);
+		mutex_unlock(&sensor->src_lock);
+		return 0;
+	}
+
+	for (i = 0; i < val_size; i++, reg++) {
+		if (reg == REG_FIFO_COUNT_H) {
+			val[i] = sensor->hwfifo.count >> 8;
+			continue;
+		}
+		if (reg == REG_FIFO_COUNT_L) {
+			val[i] = sensor->hwfifo.count & 0xff;
+			continue;
+		}
+		if (latched && mpu6050_regs_is_data(reg)) {
+			val[i] = data[reg - REG_RAW_ACCEL];
+			continue;
+		}
+
+		val[i] = sensor->regfile[reg];
+		/* INT_STATUS clears on read */
+		if (reg == REG_INT_STATUS)
+			sensor->regfile[reg] = 0;
+	}
+	spin_unlock_irqrestore(&sensor->regs_lock, flags);
+	mutex_unlock(&sensor->src_lock);
+
+	return 0;
+}
+
+static const struct regmap_bus mpu6050_regmap_bus = {
+	.write = mpu6050_regs_bus_write,
+	.read = mpu6050_regs_bus_read,
+};
+
+/* power-on values of the cached registers, a sync skips matching ones */
+static const struct reg_default mpu6050_reg_defaults[] = {
+	{ REG_SAMPLE_RATE_DIV,	0x00 },
+	{ REG_CONFIG,		0x00 },
+	{ REG_GYRO_CONFIG,	0x00 },
+	{ REG_ACCEL_CONFIG,	0x00 },
+	{ REG_ACCEL_MOT_THR,	0x00 },
+	{ REG_ACCEL_MOT_DUR,	0x00 },
+	{ REG_FIFO_EN,		0x00 },
+	{ REG_INT_PIN_CFG,	0x00 },
+	{ REG_INT_ENABLE,	0x00 },
+	{ REG_DETECT_CTRL,	0x00 },
+	{ REG_PWR_MGMT_2,	0x00 },
+	{ REG_WHOAMI,		MPU6050_ID },
+};
+
+static const struct regmap_config mpu6050_regmap_config = {
+	.reg_bits = 8,
+	.val_bits = 8,
+	.max_register = REG_WHOAMI,
+	.writeable_reg = mpu6050_regs_writeable,
+	.readable_reg = mpu6050_regs_readable,
+	.volatile_reg = mpu6050_regs_volatile,
+	.precious_reg = mpu6050_regs_precious,
+	.reg_defaults = mpu6050_reg_defaults,
+	.num_reg_defaults = ARRAY_SIZE(mpu6050_reg_defaults),
+	.cache_type = REGCACHE_FLAT,
+};
+
+/* FIFO data path, raw bursts from FIFO_R_W must not go through the cache */
+static const struct regmap_config mpu6050_fifo_regmap_config = {
+	.name = "fifo",
+	.reg_bits = 8,
+	.val_bits = 8,
+	.max_register = REG_WHOAMI,
+	.readable_reg = mpu6050_regs_readable,
+	.cache_type = REGCACHE_NONE,
+};
+
+/*
+ * Publish the next queued injected sample of one sensor type. It stays the
+ * current value of the sensor until the following one is consumed.
+ */
+static void mpu6050_inject_next(struct mpu6050_sensor *sensor, int sns_type)
+{
+	struct mpu6050_inject_sample sample;
+
+	if (!kfifo_get(&sensor->inject[sns_type], &sample))
+		return;
+
+	write_seqlock(&sensor->axis_lock);
+	if (sns_type == SNS_TYPE_ACCEL) {
+		sensor->axis.x = sample.data[0];
+		sensor->axis.y = sample.data[1];
+		sensor->axis.z = sample.data[2];
+	} else {
+		sensor->axis.rx = sample.data[0];
+		sensor->axis.ry = sample.data[1];
+		sensor->axis.rz = sample.data[2];
+	}
+	sensor->phys_valid[sns_type] = false;
+	write_sequnlock(&sensor->axis_lock);
+}
+
+/*
+ * Fetch the next replayed frame for one sensor type into @data. Each sensor
+ * walks the trace with its own cursor so that accel and gyro can be replayed
+ * at different rates. Return false if no trace is being replayed.
+ */
+static bool mpu6050_trace_next(struct mpu6050_sensor *sensor, int sns_type,
+				struct axis_data *data)
+{
+	struct mpu6050_trace *trace = &sensor->trace;
+	const struct mpu6050_trace_frame *frame;
+	enum mpu6050_replay_mode mode;
+	u32 pos, nr_frames;
+
+	rcu_read_lock();
+	mode = smp_load_acquire(&trace->mode);
+	nr_frames = READ_ONCE(trace->nr_frames);
+	if ((mode == MPU6050_REPLAY_OFF) || !nr_frames) {
+		rcu_read_unlock();
+		return false;
+	}
+
+	pos = trace->pos[sns_type];
+	if (pos >= nr_frames) {
+		/* a finished single shot replay holds the last frame */
+		if (mode == MPU6050_REPLAY_LOOP)
+			pos = 0;
+		else
+			pos = nr_frames - 1;
+	}
+	frame = &trace->frames[pos];
+	trace->pos[sns_type] = pos + 1;
+
+	if (sns_type == SNS_TYPE_ACCEL) {
+		data->x = frame->x;
+		data->y = frame->y;
+		data->z = frame->z;
+	} else {
+		data->rx = frame->rx;
+		data->ry = frame->ry;
+		data->rz = frame->rz;
+	}
+
+	rcu_read_unlock();
+	return true;
+}
+
+/* Move the replay cursor of one sensor type by @n dropped frames. */
+static bool mpu6050_trace_skip(struct mpu6050_sensor *sensor, int sns_type,
+				u64 n)
+{
+	struct mpu6050_trace *trace = &sensor->trace;
+	enum mpu6050_replay_mode mode;
+	u32 nr_frames, rem;
+	u64 pos;
+
+	rcu_read_lock();
+	mode = smp_load_acquire(&trace->mode);
+	nr_frames = READ_ONCE(trace->nr_frames);
+	if ((mode == MPU6050_REPLAY_OFF) || !nr_frames) {
+		rcu_read_unlock();
+		return false;
+	}
+
+	pos = trace->pos[sns_type] + n;
+	if (mode == MPU6050_REPLAY_LOOP) {
+		div_u64_rem(pos, nr_frames, &rem);
+		pos = rem;
+	} else {
+		pos = min_t(u64, pos, nr_frames);
+	}
+	trace->pos[sns_type] = pos;
+	rcu_read_unlock();
+	return true;
+}
+
+/*
+ * Phase increment per sample for a waveform of @freq_mhz sampled every
+ * @period_ns, a full turn being 2^32. Whole turns per sample are dropped
+ * first, which keeps the intermediate product within 64 bits:
+ * 2^32 / 10^12 = 2^20 / 244140625.
+ */
+static u32 mpu6050_gen_phase_inc(u32 freq_mhz, u64 period_ns)
+{
+	u64 turns;
+
+	div64_u64_rem((u64)freq_mhz * period_ns, 1000000000000ULL, &turns);
+	return div64_u64(turns << 20, 244140625);
+}
+
+/* Waveform value at @phase in Q15, before amplitude and offset. */
+static s32 mpu6050_gen_wave(enum mpu6050_wave_type type, u32 phase,
+				bool stepped)
+{
+	s32 a, b, frac;
+
+	switch (type) {
+	case MPU6050_WAVE_SINE:
+		a = mpu6050_sine_table[phase >> 24];
+		b = mpu6050_sine_table[((phase >> 24) + 1) & 0xff];
+		frac = (phase >> 8) & 0xffff;
+		return a + (((b - a) * frac) >> 16);
+	case MPU6050_WAVE_SQUARE:
+		return (phase < 0x80000000) ? 32767 : -32767;
+	case MPU6050_WAVE_RAMP:
+		return (s32)(phase >> 16) - 32768;
+	case MPU6050_WAVE_STEP:
+		return stepped ? 32767 : 0;
+	default:
+		return 0;
+	}
+}
+
+static void mpu6050_gen_store(struct axis_data *data, int axis, s16 value)
+{
+	switch (axis) {
+	case 0:
+		data->x = value;
+		break;
+	case 1:
+		data->y = value;
+		break;
+	case 2:
+		data->z = value;
+		break;
+	case 3:
+		data->rx = value;
+		break;
+	case 4:
+		data->ry = value;
+		break;
+	default:
+		data->rz = value;
+		break;
+	}
+}
+
+/* Take up a new waveform of @axis and the phase increment for @period_ns. */
+static void mpu6050_gen_sync(struct mpu6050_gen *gen, int axis,
+				u64 period_ns, struct mpu6050_wave *wave)
+{
+	unsigned int seq;
+
+	do {
+		seq = read_seqbegin(&gen->lock);
+		*wave = gen->wave[axis];
+	} while (read_seqretry(&gen->lock, seq));
+
+	if (wave->seq != gen->seen[axis]) {
+		gen->seen[axis] = wave->seq;
+		gen->phase[axis] = 0;
+		gen->stepped[axis] = false;
+		gen->inc_period[axis] = 0;
+	}
+	if (period_ns != gen->inc_period[axis]) {
+		gen->inc[axis] = mpu6050_gen_phase_inc(wave->freq_mhz,
+				period_ns);
+		gen->inc_period[axis] = period_ns;
+	}
+}
+
+/*
+ * Synthesize the next sample of the generated axes of one sensor type into
+ * @data, sampled every @period_ns. Only integer arithmetic is used, the
+ * phase accumulators wrap freely so the generator can run indefinitely.
+ */
+static void mpu6050_gen_next(struct mpu6050_sensor *sensor, int sns_type,
+				u64 period_ns, struct axis_data *data)
+{
+	struct mpu6050_gen *gen = &sensor->gen;
+	struct mpu6050_wave wave;
+	int axis, first = (sns_type == SNS_TYPE_ACCEL) ? 0 : 3;
+	u32 phase;
+	s32 value;
+
+	for (axis = first; axis < first + 3; axis++) {
+		if (!test_bit(axis, &gen->active))
+			continue;
+
+		mpu6050_gen_sync(gen, axis, period_ns, &wave);
+		value = mpu6050_gen_wave(wave.type, gen->phase[axis],
+				gen->stepped[axis]);
+		value = wave.offset + ((wave.amplitude * value) >> 15);
+		if (wave.noise)
+			value += (s32)prandom_u32_max(2 * wave.noise + 1) -
+					wave.noise;
+		mpu6050_gen_store(data, axis, clamp_t(s32, value, S16_MIN,
+				S16_MAX));
+
+		phase = gen->phase[axis] + gen->inc[axis];
+		if (phase < gen->phase[axis])
+			gen->stepped[axis] = true;
+		gen->phase[axis] = phase;
+	}
+}
+
+/*
+ * Advance the generated axes of one sensor type by @n samples that are
+ * dropped. A whole turn of the phase is 2^32, so only the low 32 bits of
+ * @n move it.
+ */
+static void mpu6050_gen_skip(struct mpu6050_sensor *sensor, int sns_type,
+				u64 period_ns, u64 n)
+{
+	struct mpu6050_gen *gen = &sensor->gen;
+	struct mpu6050_wave wave;
+	int axis, first = (sns_type == SNS_TYPE_ACCEL) ? 0 : 3;
+	u64 adv;
+
+	for (axis = first; axis < first + 3; axis++) {
+		if (!test_bit(axis, &gen->active))
+			continue;
+
+		mpu6050_gen_sync(gen, axis, period_ns, &wave);
+		adv = (u64)gen->inc[axis] * (u32)n;
+		if (gen->inc[axis] && ((n >> 32) ||
+				(gen->phase[axis] + adv > U32_MAX)))
+			gen->stepped[axis] = true;
+		gen->phase[axis] += (u32)adv;
+	}
+}
+
+static inline void mpu6050_stat_add(struct mpu6050_sensor *sensor,
+				int sns_type, enum mpu6050_stat stat, u64 n)
+{
+	this_cpu_add(sensor->stats->cnt[sns_type][stat], n);
+}
+
+/* Count an enable or disable and the time spent enabled. op_lock held. */
+static void mpu6050_stats_enable(struct mpu6050_sensor *sensor, int sns_type,
+				bool enable)
+{
+	u64 now = ktime_to_ns(ktime_get_boottime());
+
+	if (enable) {
+		mpu6050_stat_add(sensor, sns_type, MPU6050_STAT_ENABLES, 1);
+		if (!sensor->enabled_since_ns[sns_type])
+			sensor->enabled_since_ns[sns_type] = now;
+	} else if (sensor->enabled_since_ns[sns_type]) {
+		mpu6050_stat_add(sensor, sns_type, MPU6050_STAT_DISABLES, 1);
+		mpu6050_stat_add(sensor, sns_type, MPU6050_STAT_ENABLED_NS,
+				now - sensor->enabled_since_ns[sns_type]);
+		sensor->enabled_since_ns[sns_type] = 0;
+	}
+}
+
+static void mpu6050_lat_record(struct mpu6050_sensor *sensor, int sns_type,
+				enum mpu6050_lat_metric metric, u64 ns)
+{
+	struct mpu6050_lat_hist *hist = &sensor->lat.hist[sns_type][metric];
+
+	hist->bucket[min(fls64(ns), MPU6050_LAT_BUCKETS - 1)]++;
+	hist->count++;
+	if (ns > hist->max_ns)
+		hist->max_ns = ns;
+}
+
+/* Note a timer callback for the timer-to-wakeup latency. */
+static inline void mpu6050_lat_fire(struct mpu6050_sensor *sensor,
+				int sns_type, ktime_t now)
+{
+	if (unlikely(READ_ONCE(sensor->lat.enable)))
+		WRITE_ONCE(sensor->lat.fire_ns[sns_type], ktime_to_ns(now));
+}
+
+/* Snapshot the calibration once per poll, return false if it is off. */
+static bool mpu6050_acc_corr_get(struct mpu6050_sensor *sensor,
+				struct mpu6050_acc_corr *corr)
+{
+	unsigned int seq;
+	bool use_cal;
+
+	do {
+		seq = read_seqbegin(&sensor->acc_cal_lock);
+		use_cal = sensor->acc_use_cal;
+		memcpy(corr->bias, sensor->acc_cal_params, sizeof(corr->bias));
+		memcpy(corr->matrix, sensor->acc_cal_matrix,
+				sizeof(corr->matrix));
+		corr->use_matrix = sensor->acc_use_matrix;
+	} while (read_seqretry(&sensor->acc_cal_lock, seq));
+
+	return use_cal;
+}
+
+/* Apply bias and, if set, the Q14 matrix to a remapped accel sample. */
+static inline void mpu6050_acc_correct(const struct mpu6050_acc_corr *corr,
+				s16 *data)
+{
+	s32 v[3];
+	s64 acc;
+	int i;
+
+	for (i = 0; i < 3; i++)
+		v[i] = data[i] - corr->bias[i];
+
+	if (!corr->use_matrix) {
+		for (i = 0; i < 3; i++)
+			data[i] = clamp_t(s32, v[i], S16_MIN, S16_MAX);
+		return;
+	}
+
+	for (i = 0; i < 3; i++) {
+		acc = (s64)corr->matrix[i][0] * v[0] +
+			(s64)corr->matrix[i][1] * v[1] +
+			(s64)corr->matrix[i][2] * v[2];
+		acc = (acc + (1 << (MPU_ACC_CAL_MATRIX_SHIFT - 1))) >>
+				MPU_ACC_CAL_MATRIX_SHIFT;
+		data[i] = clamp_t(s64, acc, S16_MIN, S16_MAX);
+	}
+}
+
+/* Feed an uncorrected accel sample to a running calibration. */
+static void mpu6050_acc_cal_collect(struct mpu6050_sensor *sensor,
+				const s16 *data)
+{
+	struct mpu6050_acc_cal *cal = &sensor->acc_cal;
+	int i;
+
+	/* pairs with smp_wmb() in mpu6050_accel_calibrate() */
+	smp_rmb();
+	if (cal->count++ >= CAL_SKIP_COUNT) {
+		for (i = 0; i < 3; i++)
+			cal->sum[i] += data[i];
+	}
+
+	if (cal->count == MPU_ACC_CAL_COUNT) {
+		atomic_set(&cal->active, 0);
+		complete(&cal->done);
+	}
+}
+
+static inline u64 mpu6050_poll_ns(struct mpu6050_sensor *sensor, int sns_type)
+{
+	return READ_ONCE(sensor->poll_ns[sns_type]);
+}
+
+/* Interval between two timer wakeups of a sensor. */
+static inline u64 mpu6050_wake_ns(struct mpu6050_sensor *sensor, int sns_type)
+{
+	return READ_ONCE(sensor->poll_ns[sns_type]) *
+			READ_ONCE(sensor->burst[sns_type]);
+}
+
+static void mpu6050_report_sample(struct input_dev *dev, int sns_type,
+				const struct mpu6050_sample *sample)
+{
+	unsigned int code = (sns_type == SNS_TYPE_ACCEL) ? ABS_X : ABS_RX;
+
+	trace_mpu6050_sample(dev->dev.parent, sns_type, sample->data,
+			ktime_to_ns(sample->timestamp));
+	input_report_abs(dev, code, sample->data[0]);
+	input_report_abs(dev, code + 1, sample->data[1]);
+	input_report_abs(dev, code + 2, sample->data[2]);
+	input_event(dev, EV_SYN, SYN_TIME_SEC,
+			ktime_to_timespec(sample->timestamp).tv_sec);
+	input_event(dev, EV_SYN, SYN_TIME_NSEC,
+			ktime_to_timespec(sample->timestamp).tv_nsec);
+	input_sync(dev);
+}
+
+/*
+ * Copy one frame to the mmap ring. The consumer owns the tail, so a full
+ * ring drops the new frame instead of overwriting unread ones.
+ */
+static void mpu6050_ring_push(struct mpu6050_sensor *sensor, int sns_type,
+				const struct mpu6050_sample *sample, u8 flags)
+{
+	struct mpu6050_ring *ring = sensor->ring;
+	struct mpu6050_ring_header *hdr = ring->hdr;
+	struct mpu6050_ring_frame *frame;
+
+	if (!atomic_read(&ring->users))
+		return;
+
+	spin_lock(&ring->lock);
+	if (ring->head - smp_load_acquire(&hdr->tail) >= ring->nr_frames) {
+		hdr->overruns++;
+	} else {
+		frame = &ring->frames[ring->head & (ring->nr_frames - 1)];
+		frame->timestamp_ns = ktime_to_ns(sample->timestamp);
+		frame->data[0] = sample->data[0];
+		frame->data[1] = sample->data[1];
+		frame->data[2] = sample->data[2];
+		frame->sns_type = sns_type;
+		frame->flags = flags;
+		ring->head++;
+		smp_store_release(&hdr->head, ring->head);
+	}
+	spin_unlock(&ring->lock);
+}
+
+/*
+ * The ring is readable once the watermark is reached, or right after a
+ * flush complete frame so that a flush never waits for the watermark.
+ */
+static bool mpu6050_ring_ready(struct mpu6050_ring *ring)
+{
+	struct mpu6050_ring_header *hdr = ring->hdr;
+	u32 head = READ_ONCE(ring->head);
+	u32 avail = head - READ_ONCE(hdr->tail);
+	u32 watermark = clamp_t(u32, READ_ONCE(hdr->watermark), 1,
+				ring->nr_frames);
+
+	if (!avail)
+		return false;
+	if (avail >= watermark)
+		return true;
+
+	return ring->frames[(head - 1) & (ring->nr_frames - 1)].flags &
+			MPU6050_RING_FLAG_FLUSH;
+}
+
+static void mpu6050_ring_wake(struct mpu6050_sensor *sensor)
+{
+	struct mpu6050_ring *ring = sensor->ring;
+
+	if (atomic_read(&ring->users) && mpu6050_ring_ready(ring))
+		wake_up_interruptible(&ring->wq);
+}
+
+#ifdef CONFIG_SENSORS_FAKE6050_IIO
+/*
+ * Latch a fresh sample for the IIO scan. Samples of the lead sensor fire the
+ * trigger, the scan then pairs them with the latest sample of the other one.
+ * Called from the poll threads, the trigger handler runs nested in them.
+ */
+static void mpu6050_iio_sample(struct mpu6050_sensor *sensor, int sns_type,
+				const struct mpu6050_sample *sample)
+{
+	int first = (sns_type == SNS_TYPE_ACCEL) ? 0 : 3;
+	int lead = READ_ONCE(sensor->iio_lead);
+
+	if (lead < 0)
+		return;
+
+	spin_lock(&sensor->iio_lock);
+	memcpy(&sensor->iio_last[first], sample->data, sizeof(sample->data));
+	if (sns_type == lead)
+		sensor->iio_ts = ktime_to_ns(sample->timestamp);
+	spin_unlock(&sensor->iio_lock);
+
+	if (sns_type == lead)
+		iio_trigger_poll_chained(sensor->iio_trig);
+}
+#else
+static inline void mpu6050_iio_sample(struct mpu6050_sensor *sensor,
+				int sns_type, const struct mpu6050_sample *sample)
+{
+}
+#endif
+
+/* Queue a sample, return true if the oldest one had to be dropped. */
+static bool mpu6050_fifo_push(struct mpu6050_fifo *fifo,
+				const struct mpu6050_sample *sample)
+{
+	bool dropped = false;
+	u32 tail;
+
+	/* drop the oldest sample rather than the newest one */
+	if (fifo->count == MPU6050_MAX_EVENT_CNT) {
+		fifo->head = (fifo->head + 1) % MPU6050_MAX_EVENT_CNT;
+		fifo->count--;
+		dropped = true;
+	}
+
+	tail = (fifo->head + fifo->count) % MPU6050_MAX_EVENT_CNT;
+	fifo->buf[tail] = *sample;
+	fifo->count++;
+
+	return dropped;
+}
+
+/*
+ * Deliver the buffered samples of one sensor when batching is off, the FIFO
+ * is full, the next sample would exceed the max latency or the HAL asked for
+ * a flush. Each flush request is completed by a SYN_CONFIG marker event.
+ * Return the number of samples delivered.
+ */
+static int mpu6050_fifo_process(struct mpu6050_sensor *sensor, int sns_type)
+{
+	struct mpu6050_fifo *fifo = &sensor->fifo[sns_type];
+	struct mpu6050_sample marker;
+	struct input_dev *dev;
+	u64 latency_ns, elapsed_ns, wake_ns;
+	bool batch;
+	int flush, drain, delivered = 0;
+
+	if (sns_type == SNS_TYPE_ACCEL) {
+		dev = sensor->accel_dev;
+		batch = READ_ONCE(sensor->batch_accel);
+		latency_ns = (u64)READ_ONCE(sensor->accel_latency_ms) *
+				NSEC_PER_MSEC;
+	} else {
+		dev = sensor->gyro_dev;
+		batch = READ_ONCE(sensor->batch_gyro);
+		latency_ns = (u64)READ_ONCE(sensor->gyro_latency_ms) *
+				NSEC_PER_MSEC;
+	}
+	wake_ns = mpu6050_wake_ns(sensor, sns_type);
+
+	flush = atomic_xchg(&fifo->flush_req, 0);
+	drain = atomic_xchg(&fifo->drain_req, 0);
+	if (!flush && !drain && batch && fifo->count &&
+			(fifo->count < MPU6050_MAX_EVENT_CNT)) {
+		elapsed_ns = ktime_to_ns(ktime_sub(ktime_get_boottime(),
+				fifo->buf[fifo->head].timestamp));
+		if (elapsed_ns + wake_ns <= latency_ns)
+			return 0;
+	}
+
+	while (fifo->count) {
+		mpu6050_report_sample(dev, sns_type, &fifo->buf[fifo->head]);
+		mpu6050_ring_push(sensor, sns_type, &fifo->buf[fifo->head], 0);
+		fifo->head = (fifo->head + 1) % MPU6050_MAX_EVENT_CNT;
+		fifo->count--;
+		delivered++;
+	}
+
+	while (flush-- > 0) {
+		input_event(dev, EV_SYN, SYN_CONFIG,
+				atomic_inc_return(&sensor->flush_count));
+		input_sync(dev);
+		memset(&marker, 0, sizeof(marker));
+		marker.timestamp = ktime_get_boottime();
+		mpu6050_ring_push(sensor, sns_type, &marker,
+				MPU6050_RING_FLAG_FLUSH);
+	}
+
+	mpu6050_ring_wake(sensor);
+	mpu6050_stat_add(sensor, sns_type, MPU6050_STAT_SAMPLES, delivered);
+	return delivered;
+}
+
+/*
+ * Ask the poll thread to deliver the batched samples of one sensor, followed
+ * by a flush complete marker if @complete is set.
+ */
+static void mpu6050_flush_fifo(struct mpu6050_sensor *sensor, int sns_type,
+				bool complete)
+{
+	struct mpu6050_fifo *fifo = &sensor->fifo[sns_type];
+
+	if (complete)
+		atomic_inc(&fifo->flush_req);
+	else
+		atomic_set(&fifo->drain_req, 1);
+
+	if (!sensor->use_poll)
+		irq_wake_thread(sensor->irq, sensor);
+	else if (sensor->unified)
+		wake_up_interruptible(&sensor->sched_wq);
+	else if (sns_type == SNS_TYPE_ACCEL)
+		wake_up_interruptible(&sensor->accel_wq);
+	else
+		wake_up_interruptible(&sensor->gyro_wq);
+}
+
+static inline bool mpu6050_fifo_pending(struct mpu6050_sensor *sensor,
+				int sns_type)
+{
+	struct mpu6050_fifo *fifo = &sensor->fifo[sns_type];
+
+	return atomic_read(&fifo->flush_req) || atomic_read(&fifo->drain_req);
+}
+
+/* Earliest deadline of the scheduled sensors, sched_lock must be held. */
+static ktime_t mpu6050_sched_earliest(struct mpu6050_sensor *sensor)
+{
+	ktime_t earliest = KTIME_MAX;
+	int type;
+
+	for (type = 0; type < SNS_TYPE_MAX; type++) {
+		if (test_bit(type, &sensor->sched_active) &&
+			ktime_before(sensor->sched_next[type], earliest))
+			earliest = sensor->sched_next[type];
+	}
+
+	return earliest;
+}
+
+/* Streams are held while parked on stillness or suspended. */
+static inline bool mpu6050_paused(struct mpu6050_sensor *sensor)
+{
+	return READ_ONCE(sensor->mot.parked) || READ_ONCE(sensor->suspended);
+}
+
+static inline bool mpu6050_sensor_enabled(struct mpu6050_sensor *sensor,
+				int sns_type)
+{
+	if (sns_type == SNS_TYPE_ACCEL)
+		return atomic_read(&sensor->accel_en);
+	else
+		return atomic_read(&sensor->gyro_en);
+}
+
+/*
+ * Put a (re)starting sensor on the emulated sample clock. The clock starts
+ * with the first running sensor, the others start on its next edge. Sample
+ * timestamps are derived from the clock, not from the wakeup time. Return the
+ * deadline of the first timer wakeup. op_lock must be held.
+ */
+static ktime_t mpu6050_grid_start(struct mpu6050_sensor *sensor, int sns_type)
+{
+	int other = (sns_type == SNS_TYPE_ACCEL) ? SNS_TYPE_GYRO :
+			SNS_TYPE_ACCEL;
+	u64 interval = sensor->sample_interval_ns;
+	u64 period = sensor->poll_ns[sns_type];
+	u64 now, edges;
+
+	now = ktime_to_ns(ktime_get_boottime());
+	if (!interval || !mpu6050_sensor_enabled(sensor, other)) {
+		sensor->fifo_start_ns = now;
+	} else {
+		edges = div64_u64(now - sensor->fifo_start_ns + interval - 1,
+				interval);
+		now = sensor->fifo_start_ns + edges * interval;
+	}
+
+	atomic_set(&sensor->ticks[sns_type], 0);
+	sensor->grid_epoch_ns[sns_type] = now + period;
+	smp_wmb();
+	atomic_set(&sensor->grid_rebase[sns_type], 1);
+
+	return ns_to_ktime(now + period * sensor->burst[sns_type]);
+}
+
+/*
+ * Add a sensor to the unified scheduler, or pick up its new period. Both
+ * sensors run on the same sample clock, so they share wakeups whenever their
+ * periods coincide.
+ */
+static void mpu6050_sched_start(struct mpu6050_sensor *sensor, int sns_type)
+{
+	ktime_t first = mpu6050_grid_start(sensor, sns_type);
+	unsigned long flags;
+
+	spin_lock_irqsave(&sensor->sched_lock, flags);
+	sensor->sched_next[sns_type] = first;
+	set_bit(sns_type, &sensor->sched_active);
+	hrtimer_start(&sensor->sched_timer, mpu6050_sched_earliest(sensor),
+			HRTIMER_MODE_ABS);
+	spin_unlock_irqrestore(&sensor->sched_lock, flags);
+}
+
+static void mpu6050_sched_stop(struct mpu6050_sensor *sensor, int sns_type)
+{
+	unsigned long flags;
+	bool idle;
+
+	spin_lock_irqsave(&sensor->sched_lock, flags);
+	clear_bit(sns_type, &sensor->sched_active);
+	idle = !sensor->sched_active;
+	spin_unlock_irqrestore(&sensor->sched_lock, flags);
+
+	if (idle)
+		hrtimer_try_to_cancel(&sensor->sched_timer);
+}
+
+/*
+ * Start or restart periodic sampling of one sensor. Parked streams are
+ * started when motion resumes them, suspended ones by the resume work.
+ */
+static void mpu6050_start_polling(struct mpu6050_sensor *sensor, int sns_type)
+{
+	struct hrtimer *timer;
+
+	if (mpu6050_paused(sensor))
+		return;
+
+	if (sensor->hwfifo_mode)
+		mpu6050_hwfifo_config(sensor);
+
+	if (!sensor->use_poll) {
+		mpu6050_irq_config(sensor);
+		return;
+	}
+
+	if (sensor->unified) {
+		mpu6050_sched_start(sensor, sns_type);
+		return;
+	}
+
+	timer = (sns_type == SNS_TYPE_ACCEL) ? &sensor->accel_timer :
+			&sensor->gyro_timer;
+	/* the callback forwards the expiry, it must not run concurrently */
+	hrtimer_cancel(timer);
+	hrtimer_start(timer, mpu6050_grid_start(sensor, sns_type),
+			HRTIMER_MODE_ABS);
+}
+
+static int mpu6050_stop_polling(struct mpu6050_sensor *sensor, int sns_type)
+{
+	if (sensor->hwfifo_mode)
+		mpu6050_hwfifo_config(sensor);
+
+	if (!sensor->use_poll)
+		return mpu6050_irq_config(sensor);
+
+	if (sensor->unified) {
+		mpu6050_sched_stop(sensor, sns_type);
+		return 0;
+	}
+
+	if (sns_type == SNS_TYPE_ACCEL)
+		return hrtimer_try_to_cancel(&sensor->accel_timer);
+	else
+		return hrtimer_try_to_cancel(&sensor->gyro_timer);
+}
+
+static enum hrtimer_restart sched_timer_handle(struct hrtimer *hrtimer)
+{
+	struct mpu6050_sensor *sensor;
+	enum hrtimer_restart ret = HRTIMER_NORESTART;
+	u64 period, missed;
+	u32 burst;
+	bool due = false;
+	ktime_t now;
+	int type;
+
+	sensor = container_of(hrtimer, struct mpu6050_sensor, sched_timer);
+	now = hrtimer_cb_get_time(hrtimer);
+
+	spin_lock(&sensor->sched_lock);
+	/* mpu6050_sched_start() re-armed us while we were waiting */
+	if (hrtimer_is_queued(hrtimer))
+		goto exit;
+
+	for (type = 0; type < SNS_TYPE_MAX; type++) {
+		if (!test_bit(type, &sensor->sched_active) ||
+			ktime_after(sensor->sched_next[type], now))
+			continue;
+		/* stay on the absolute deadline grid, count missed periods */
+		period = mpu6050_wake_ns(sensor, type);
+		burst = READ_ONCE(sensor->burst[type]);
+		missed = div64_u64(ktime_to_ns(ktime_sub(now,
+				sensor->sched_next[type])), period);
+		atomic_add((missed + 1) * burst, &sensor->ticks[type]);
+		if (missed)
+			atomic_add(missed * burst, &sensor->overruns[type]);
+		sensor->sched_next[type] = ktime_add_ns(sensor->sched_next[type],
+				(missed + 1) * period);
+		mpu6050_lat_fire(sensor, type, now);
+		due = true;
+	}
+
+	if (sensor->sched_active) {
+		hrtimer_set_expires(hrtimer, mpu6050_sched_earliest(sensor));
+		ret = HRTIMER_RESTART;
+	}
+
+exit:
+	spin_unlock(&sensor->sched_lock);
+	if (due)
+		wake_up_interruptible(&sensor->sched_wq);
+	return ret;
+}
+
+/*
+ * Periodic tick of a per-sensor timer. Deadlines are absolute: the timer is
+ * forwarded from its previous expiry, so callback latency does not add up,
+ * and every period that expired meanwhile is handed to the poll thread.
+ */
+static enum hrtimer_restart mpu6050_timer_tick(struct mpu6050_sensor *sensor,
+				struct hrtimer *hrtimer, int sns_type)
+{
+	atomic_t *en = (sns_type == SNS_TYPE_ACCEL) ? &sensor->accel_en :
+			&sensor->gyro_en;
+	u32 burst = READ_ONCE(sensor->burst[sns_type]);
+	ktime_t now;
+	u64 elapsed;
+
+	if (!atomic_read(en) || mpu6050_paused(sensor))
+		return HRTIMER_NORESTART;
+
+	now = hrtimer_cb_get_time(hrtimer);
+	mpu6050_lat_fire(sensor, sns_type, now);
+	elapsed = hrtimer_forward(hrtimer, now,
+			ns_to_ktime(mpu6050_wake_ns(sensor, sns_type)));
+	atomic_add(elapsed * burst, &sensor->ticks[sns_type]);
+	if (elapsed > 1)
+		atomic_add((elapsed - 1) * burst, &sensor->overruns[sns_type]);
+
+	if (sns_type == SNS_TYPE_ACCEL)
+		wake_up_interruptible(&sensor->accel_wq);
+	else
+		wake_up_interruptible(&sensor->gyro_wq);
+
+	return HRTIMER_RESTART;
+}
+
+static enum hrtimer_restart gyro_timer_handle(struct hrtimer *hrtimer)
+{
+	struct mpu6050_sensor *sensor;
+	sensor = container_of(hrtimer, struct mpu6050_sensor, gyro_timer);
+	return mpu6050_timer_tick(sensor, hrtimer, SNS_TYPE_GYRO);
+}
+
+static enum hrtimer_restart accel_timer_handle(struct hrtimer *hrtimer)
+{
+	struct mpu6050_sensor *sensor;
+	sensor = container_of(hrtimer, struct mpu6050_sensor, accel_timer);
+	return mpu6050_timer_tick(sensor, hrtimer, SNS_TYPE_ACCEL);
+}
+
+/*
+ * Next raw value of one sensor from the injected, replayed or generated data.
+ * src_lock must be held.
+ */
+static void mpu6050_sample_source(struct mpu6050_sensor *sensor, int sns_type,
+				u64 period, struct axis_data *axis)
+{
+	mpu6050_inject_next(sensor, sns_type);
+	mpu6050_read_axis(sensor, axis);
+	if (!mpu6050_trace_next(sensor, sns_type, axis))
+		mpu6050_gen_next(sensor, sns_type, period, axis);
+}
+
+/*
+ * Advance the sources of one sensor by @n samples that are dropped, as
+ * mpu6050_sample_source() @n times would. src_lock must be held.
+ */
+static void mpu6050_source_skip(struct mpu6050_sensor *sensor, int sns_type,
+				u64 period, u64 n)
+{
+	u64 i;
+
+	for (i = 0; (i < n) && (i < MPU6050_INJECT_QUEUE_LEN); i++)
+		mpu6050_inject_next(sensor, sns_type);
+	if (!mpu6050_trace_skip(sensor, sns_type, n))
+		mpu6050_gen_skip(sensor, sns_type, period, n);
+}
+
+/*
+ * Stillness detector on the delivered accel samples. The device is still
+ * while no axis moves further than the motion threshold from the reference
+ * sample. After still_ms of it the motion work parks the streams.
+ */
+static void mpu6050_motion_feed(struct mpu6050_sensor *sensor,
+				const struct mpu6050_sample *sample)
+{
+	struct mpu6050_motion *mot = &sensor->mot;
+	s64 ts = ktime_to_ns(sample->timestamp);
+	u32 thr;
+	int i;
+
+	thr = READ_ONCE(mot->thr) * MOT_THR_MG_PER_LSB *
+		(RAW_TO_1G >> sensor->cfg.accel_fs) / 1000;
+	for (i = 0; i < 3; i++)
+		if (abs(sample->data[i] - mot->ref[i]) > thr)
+			break;
+
+	/* a calibration lies still too, count from its end */
+	if ((i < 3) || !mot->still_since_ns ||
+		atomic_read(&sensor->acc_cal.active)) {
+		memcpy(mot->ref, sample->data, sizeof(mot->ref));
+		mot->still_since_ns = ts;
+		return;
+	}
+
+	if ((ts - mot->still_since_ns >=
+			(s64)READ_ONCE(mot->still_ms) * NSEC_PER_MSEC) &&
+		!atomic_xchg(&mot->park_req, 1))
+		queue_delayed_work(sensor->data_wq, &mot->work, 0);
+}
+
+/* Hand a motion interrupt seen in INT_STATUS to the motion work. */
+static inline void mpu6050_motion_status(struct mpu6050_sensor *sensor,
+				unsigned int status)
+{
+	if (status & BIT_MOT_INT) {
+		atomic_set(&sensor->mot.event, 1);
+		mod_delayed_work(sensor->data_wq, &sensor->mot.work, 0);
+	}
+}
+
+/*
+ * Remap, correct and queue one raw sample, the timestamp of @sample is
+ * already set. @corr is the accel correction of this poll, NULL when off.
+ */
+static void mpu6050_emit_sample(struct mpu6050_sensor *sensor, int sns_type,
+				const s16 *raw, struct mpu6050_sample *sample,
+				const struct mpu6050_acc_corr *corr)
+{
+	mpu6050_remap(&sensor->remap[sns_type], raw, sample->data);
+	/* once per enable, so recorded whether latency_enable is set or not */
+	if (unlikely(atomic_read(&sensor->first_pending[sns_type])) &&
+		atomic_xchg(&sensor->first_pending[sns_type], 0))
+		mpu6050_lat_record(sensor, sns_type, MPU6050_LAT_FIRST_SAMPLE,
+			ktime_to_ns(ktime_get_boottime()) -
+			READ_ONCE(sensor->en_req_ns[sns_type]));
+	if (sns_type == SNS_TYPE_ACCEL) {
+		if (READ_ONCE(sensor->motion_det_en))
+			mpu6050_motion_feed(sensor, sample);
+		if (unlikely(atomic_read(&sensor->acc_cal.active)))
+			mpu6050_acc_cal_collect(sensor, sample->data);
+		if (corr)
+			mpu6050_acc_correct(corr, sample->data);
+	}
+	if (!memcmp(sensor->last_data[sns_type], sample->data,
+			sizeof(sample->data)))
+		mpu6050_stat_add(sensor, sns_type, MPU6050_STAT_DUPLICATES, 1);
+	memcpy(sensor->last_data[sns_type], sample->data,
+			sizeof(sample->data));
+	if (mpu6050_fifo_push(&sensor->fifo[sns_type], sample))
+		mpu6050_stat_add(sensor, sns_type, MPU6050_STAT_DROPPED, 1);
+	mpu6050_iio_sample(sensor, sns_type, sample);
+}
+
+/*
+ * Take one sample of a sensor per pending timer tick and run its batching
+ * FIFO. Every wakeup brings a burst of ticks at high rates. A poll thread that
+ * fell behind emits the bursts it missed, but at most
+ * MPU6050_CATCHUP_MAX_TICKS of them, older ones are dropped.
+ *
+ * Samples are stamped on the ideal grid of the emulated sample clock, plus
+ * optional emulated jitter. The wakeup time is only kept as a diagnostic.
+ */
+static void mpu6050_poll_sensor(struct mpu6050_sensor *sensor, int sns_type)
+{
+	struct mpu6050_latency *lat = &sensor->lat;
+	struct mpu6050_acc_corr corr;
+	struct mpu6050_sample sample;
+	struct axis_data axis;
+	s16 raw[3];
+	u64 period, ts = 0, wake = 0, fire;
+	s64 skew;
+	u32 jitter;
+	int ticks, burst, max_ticks;
+	bool use_cal = false;
+
+	if (atomic_xchg(&sensor->grid_rebase[sns_type], 0)) {
+		sensor->grid_start_ns[sns_type] =
+			sensor->grid_epoch_ns[sns_type];
+		sensor->grid_idx[sns_type] = 0;
+	}
+
+	burst = READ_ONCE(sensor->burst[sns_type]);
+	max_ticks = MPU6050_CATCHUP_MAX_TICKS * burst;
+	ticks = atomic_xchg(&sensor->ticks[sns_type], 0);
+	if (unlikely(READ_ONCE(lat->enable)) && ticks) {
+		wake = ktime_to_ns(ktime_get_boottime());
+		fire = READ_ONCE(lat->fire_ns[sns_type]);
+		if (fire && (fire <= wake))
+			mpu6050_lat_record(sensor, sns_type,
+					MPU6050_LAT_TIMER_WAKEUP, wake - fire);
+		if (lat->wake_ns[sns_type])
+			mpu6050_lat_record(sensor, sns_type,
+					MPU6050_LAT_INTERVAL,
+					wake - lat->wake_ns[sns_type]);
+		lat->wake_ns[sns_type] = wake;
+	}
+	if (ticks > burst) {
+		atomic_add(ticks - burst, &sensor->overruns[sns_type]);
+		mpu6050_stat_add(sensor, sns_type, MPU6050_STAT_OVERRUNS,
+				ticks - burst);
+	}
+	if (ticks > max_ticks) {
+		atomic_add(ticks - max_ticks, &sensor->dropped[sns_type]);
+		mpu6050_stat_add(sensor, sns_type, MPU6050_STAT_DROPPED,
+				ticks - max_ticks);
+		sensor->grid_idx[sns_type] += ticks - max_ticks;
+		ticks = max_ticks;
+	}
+
+	period = mpu6050_poll_ns(sensor, sns_type);
+	jitter = READ_ONCE(sensor->ts_jitter_ns[sns_type]);
+	if (ticks && (sns_type == SNS_TYPE_ACCEL))
+		use_cal = mpu6050_acc_corr_get(sensor, &corr);
+	while (ticks-- > 0) {
+		ts = sensor->grid_start_ns[sns_type] +
+			sensor->grid_idx[sns_type]++ * period;
+		if (jitter)
+			sample.timestamp = ns_to_ktime(ts +
+				(s64)prandom_u32_max(2 * jitter + 1) - jitter);
+		else
+			sample.timestamp = ns_to_ktime(ts);
+		mutex_lock(&sensor->src_lock);
+		mpu6050_sample_source(sensor, sns_type, period, &axis);
+		mutex_unlock(&sensor->src_lock);
+		mpu6050_axis_raw(&axis, sns_type, raw);
+		mpu6050_emit_sample(sensor, sns_type, raw, &sample,
+				use_cal ? &corr : NULL);
+	}
+
+	if (ts) {
+		skew = ktime_to_ns(ktime_get_boottime()) - ts;
+		sensor->ts_skew_ns[sns_type] = skew;
+		if (skew > sensor->ts_skew_max_ns[sns_type])
+			sensor->ts_skew_max_ns[sns_type] = skew;
+	}
+
+	if (mpu6050_fifo_process(sensor, sns_type) && wake)
+		mpu6050_lat_record(sensor, sns_type, MPU6050_LAT_WAKEUP_SYNC,
+				ktime_to_ns(ktime_get_boottime()) - wake);
+}
+
+/*
+ * The chip delivers frames at the sample clock, each sensor keeps one every
+ * poll_ns / interval of them. Used by the FIFO and interrupt paths.
+ */
+static void mpu6050_decim_reset(struct mpu6050_sensor *sensor, u64 interval)
+{
+	int type;
+
+	for (type = 0; type < SNS_TYPE_MAX; type++) {
+		sensor->decim[type] = max_t(u32,
+				div64_u64(sensor->poll_ns[type], interval), 1);
+		sensor->decim_skip[type] = sensor->decim[type] - 1;
+	}
+}
+
+static inline bool mpu6050_decim_keep(struct mpu6050_sensor *sensor,
+				int sns_type)
+{
+	if (sensor->decim_skip[sns_type]) {
+		sensor->decim_skip[sns_type]--;
+		return false;
+	}
+	sensor->decim_skip[sns_type] = sensor->decim[sns_type] - 1;
+	return true;
+}
+
+/*
+ * Chip side of the FIFO: push one frame per sample clock edge passed since
+ * the last bus access. The sources follow the edges as sampled by
+ * mpu6050_chip_sample(), but frames that would be overwritten before the
+ * next access are dropped, not generated.
+ * Frames are built outside regs_lock, the bus accesses that could change
+ * the FIFO meanwhile are held off by src_lock, which must be held.
+ */
+static void mpu6050_hwfifo_fill(struct mpu6050_sensor *sensor)
+{
+	struct mpu6050_hwfifo *hw = &sensor->hwfifo;
+	u8 *p = hw->fill;
+	struct axis_data accel, gyro;
+	u64 now, interval, edges, keep, skip = 0;
+	unsigned long flags;
+	u32 size;
+	u8 en;
+
+	spin_lock_irqsave(&sensor->regs_lock, flags);
+	en = sensor->regfile[REG_FIFO_EN];
+	size = mpu6050_fifo_frame_size(en);
+	now = ktime_to_ns(ktime_get_boottime());
+	if (!(sensor->regfile[REG_USER_CTRL] & BIT_FIFO_EN) || !size ||
+		(now < hw->next_ns)) {
+		spin_unlock_irqrestore(&sensor->regs_lock, flags);
+		return;
+	}
+	interval = mpu6050_regs_interval_ns(sensor);
+	edges = div64_u64(now - hw->next_ns, interval) + 1;
+	hw->next_ns += edges * interval;
+	spin_unlock_irqrestore(&sensor->regs_lock, flags);
+
+	keep = MPU6050_FIFO_SIZE_BYTE / size + 1;
+	if (edges > keep) {
+		skip = edges - keep;
+		if (en & BIT_ACCEL_OUT)
+			mpu6050_chip_sample(sensor, SNS_TYPE_ACCEL, interval,
+					skip, &accel);
+		if (en & BITS_GYRO_OUT)
+			mpu6050_chip_sample(sensor, SNS_TYPE_GYRO, interval,
+					skip, &gyro);
+		edges = keep;
+	}
+
+	while (edges--) {
+		if (en & BIT_ACCEL_OUT) {
+			mpu6050_chip_sample(sensor, SNS_TYPE_ACCEL, interval,
+					1, &accel);
+			put_unaligned_be16(accel.x, p);
+			put_unaligned_be16(accel.y, p + 2);
+			put_unaligned_be16(accel.z, p + 4);
+			p += 6;
+		}
+		if (en & BIT_TEMP_OUT) {
+			put_unaligned_be16(MPU6050_TEMP_RAW_25C, p);
+			p += 2;
+		}
+		if (en & BITS_GYRO_OUT) {
+			mpu6050_chip_sample(sensor, SNS_TYPE_GYRO, interval,
+					1, &gyro);
+			if (en & BIT_GYRO_X_OUT) {
+				put_unaligned_be16(gyro.rx, p);
+				p += 2;
+			}
+			if (en & BIT_GYRO_Y_OUT) {
+				put_unaligned_be16(gyro.ry, p);
+				p += 2;
+			}
+			if (en & BIT_GYRO_Z_OUT) {
+				put_unaligned_be16(gyro.rz, p);
+				p += 2;
+			}
+		}
+	}
+
+	spin_lock_irqsave(&sensor->regs_lock, flags);
+	if (skip)
+		sensor->regfile[REG_INT_STATUS] |= BIT_FIFO_OVERFLOW;
+	mpu6050_hwfifo_put(sensor, hw->fill, p - hw->fill);
+	spin_unlock_irqrestore(&sensor->regs_lock, flags);
+}
+
+/*
+ * Program FIFO_EN for the enabled sensors and restart the chip FIFO, so
+ * frames are aligned and timestamps restart on the current sample clock.
+ * op_lock must be held.
+ */
+static int mpu6050_hwfifo_config(struct mpu6050_sensor *sensor)
+{
+	struct mpu_reg_map *reg = &sensor->reg;
+	u64 interval = sensor->sample_interval_ns;
+	u8 en = 0;
+	int ret;
+
+	if (atomic_read(&sensor->accel_en))
+		en |= BIT_ACCEL_OUT;
+	if (atomic_read(&sensor->gyro_en))
+		en |= BITS_GYRO_OUT;
+	if (mpu6050_paused(sensor))
+		en = 0;
+
+	mutex_lock(&sensor->hwfifo_lock);
+	ret = regmap_write(sensor->regmap, reg->fifo_en, en);
+	if (ret)
+		goto exit;
+	ret = regmap_write(sensor->regmap, reg->user_ctrl,
+			en ? (BIT_FIFO_EN | BIT_FIFO_RESET) : BIT_FIFO_RESET);
+	if (ret)
+		goto exit;
+
+	sensor->hwfifo_en = en;
+	sensor->hwfifo_frame = mpu6050_fifo_frame_size(en);
+	sensor->hwfifo_interval_ns = interval;
+	sensor->hwfifo_ts_ns = ktime_to_ns(ktime_get_boottime()) + interval;
+	mpu6050_decim_reset(sensor, interval);
+	sensor->cfg.accel_fifo_enable = !!(en & BIT_ACCEL_OUT);
+	sensor->cfg.gyro_fifo_enable = !!(en & BITS_GYRO_OUT);
+	sensor->cfg.cfg_fifo_en = !!en;
+
+exit:
+	mutex_unlock(&sensor->hwfifo_lock);
+	if (ret)
+		printk("MPU6050 - Failed to configure FIFO ret=%d\n", ret);
+	return ret;
+}
+
+static void mpu6050_hwfifo_parse(struct mpu6050_sensor *sensor,
+				const u8 *p, const struct mpu6050_acc_corr *corr)
+{
+	struct mpu6050_sample sample;
+	s16 raw[3];
+
+	sample.timestamp = ns_to_ktime(sensor->hwfifo_ts_ns);
+	sensor->hwfifo_ts_ns += sensor->hwfifo_interval_ns;
+
+	if (sensor->hwfifo_en & BIT_ACCEL_OUT) {
+		if (mpu6050_decim_keep(sensor, SNS_TYPE_ACCEL)) {
+			raw[0] = get_unaligned_be16(p);
+			raw[1] = get_unaligned_be16(p + 2);
+			raw[2] = get_unaligned_be16(p + 4);
+			mpu6050_emit_sample(sensor, SNS_TYPE_ACCEL, raw,
+					&sample, corr);
+		}
+		p += 6;
+	}
+	if (sensor->hwfifo_en & BITS_GYRO_OUT) {
+		if (mpu6050_decim_keep(sensor, SNS_TYPE_GYRO)) {
+			raw[0] = get_unaligned_be16(p);
+			raw[1] = get_unaligned_be16(p + 2);
+			raw[2] = get_unaligned_be16(p + 4);
+			mpu6050_emit_sample(sensor, SNS_TYPE_GYRO, raw,
+					&sample, NULL);
+		}
+	}
+}
+
+/*
+ * Driver side of the chip FIFO: read FIFO_COUNT, then pull whole frames
+ * from FIFO_R_W in bursts of at most hwfifo_batch frames. An overflow
+ * breaks the frame alignment, so the FIFO is reset and timestamps restart.
+ */
+static void mpu6050_hwfifo_drain(struct mpu6050_sensor *sensor)
+{
+	struct mpu_reg_map *reg = &sensor->reg;
+	struct mpu6050_acc_corr corr;
+	unsigned int status;
+	u32 size, frames, batch, n, i;
+	__be16 count;
+	bool use_cal;
+	int type, ret;
+
+	mutex_lock(&sensor->hwfifo_lock);
+	size = sensor->hwfifo_frame;
+	if (!size)
+		goto exit;
+
+	ret = regmap_read(sensor->regmap, reg->int_status, &status);
+	if (ret)
+		goto exit;
+	mpu6050_motion_status(sensor, status);
+	if (status & BIT_FIFO_OVERFLOW) {
+		ret = regmap_write(sensor->regmap, reg->user_ctrl,
+				BIT_FIFO_EN | BIT_FIFO_RESET);
+		sensor->hwfifo_ts_ns = ktime_to_ns(ktime_get_boottime()) +
+				sensor->hwfifo_interval_ns;
+		for (type = 0; type < SNS_TYPE_MAX; type++) {
+			sensor->decim_skip[type] = sensor->decim[type] - 1;
+			if (mpu6050_sensor_enabled(sensor, type))
+				mpu6050_stat_add(sensor, type,
+					MPU6050_STAT_OVERRUNS, 1);
+		}
+		goto exit;
+	}
+
+	ret = regmap_bulk_read(sensor->regmap, reg->fifo_count_h, &count,
+			sizeof(count));
+	if (ret)
+		goto exit;
+	frames = be16_to_cpu(count) / size;
+	batch = clamp_t(u32, READ_ONCE(sensor->hwfifo_batch), 1,
+			MPU6050_FIFO_SIZE_BYTE / size);
+	use_cal = mpu6050_acc_corr_get(sensor, &corr);
+
+	while (frames) {
+		n = min(frames, batch);
+		ret = regmap_raw_read(sensor->fifo_map, reg->fifo_r_w,
+				sensor->hwfifo_buf, n * size);
+		if (ret)
+			break;
+		for (i = 0; i < n; i++)
+			mpu6050_hwfifo_parse(sensor,
+					sensor->hwfifo_buf + i * size,
+					use_cal ? &corr : NULL);
+		frames -= n;
+	}
+
+exit:
+	mutex_unlock(&sensor->hwfifo_lock);
+}
+
+/*
+ * Emulated data ready line. The chip side raises it from its sample clock,
+ * a one interrupt domain turns it into a regular threaded interrupt.
+ */
+static int mpu6050_irq_map(struct irq_domain *d, unsigned int virq,
+				irq_hw_number_t hw)
+{
+	irq_set_chip_data(virq, d->host_data);
+	irq_set_chip_and_handler(virq, &dummy_irq_chip, handle_simple_irq);
+	irq_set_noprobe(virq);
+
+	return 0;
+}
+
+static const struct irq_domain_ops mpu6050_irq_domain_ops = {
+	.map	= mpu6050_irq_map,
+	.xlate	= irq_domain_xlate_onecell,
+};
+
+static irqreturn_t mpu6050_irq_handler(int irq, void *data)
+{
+	struct mpu6050_sensor *sensor = data;
+
+	WRITE_ONCE(sensor->irq_ts_ns, ktime_to_ns(ktime_get_boottime()));
+	return IRQ_WAKE_THREAD;
+}
+
+/*
+ * Read INT_STATUS, which also drops the latched line, and the data registers
+ * in one burst. Samples are stamped with the time of the interrupt. Edges
+ * that came while the line was still latched are lost and counted as
+ * overruns.
+ */
+static irqreturn_t mpu6050_irq_thread(int irq, void *data)
+{
+	struct mpu6050_sensor *sensor = data;
+	struct mpu_reg_map *reg = &sensor->reg;
+	struct mpu6050_acc_corr corr;
+	struct mpu6050_sample sample;
+	u8 buf[MPU6050_RAW_DATA_LEN];
+	unsigned int status;
+	u32 edges, missed;
+	s64 ts;
+	s16 raw[3];
+	int type;
+
+	if (sensor->hwfifo_mode) {
+		mpu6050_hwfifo_drain(sensor);
+		goto exit;
+	}
+
+	ts = READ_ONCE(sensor->irq_ts_ns);
+	if (regmap_read(sensor->regmap, reg->int_status, &status))
+		goto exit;
+	mpu6050_motion_status(sensor, status);
+	if (!(status & BIT_DATA_RDY_INT))
+		goto exit;
+	if (regmap_bulk_read(sensor->regmap, reg->raw_accel, buf, sizeof(buf)))
+		goto exit;
+
+	edges = READ_ONCE(sensor->drdy_edges);
+	missed = edges - sensor->irq_edges - 1;
+	sensor->irq_edges = edges;
+
+	if (unlikely(READ_ONCE(sensor->lat.enable))) {
+		for (type = 0; type < SNS_TYPE_MAX; type++)
+			if (mpu6050_sensor_enabled(sensor, type))
+				mpu6050_lat_record(sensor, type,
+					MPU6050_LAT_TIMER_WAKEUP,
+					ktime_to_ns(ktime_get_boottime()) - ts);
+	}
+
+	sample.timestamp = ns_to_ktime(ts);
+	if (atomic_read(&sensor->accel_en)) {
+		if (missed)
+			mpu6050_stat_add(sensor, SNS_TYPE_ACCEL,
+					MPU6050_STAT_OVERRUNS, missed);
+		if (mpu6050_decim_keep(sensor, SNS_TYPE_ACCEL)) {
+			raw[0] = get_unaligned_be16(buf);
+			raw[1] = get_unaligned_be16(buf + 2);
+			raw[2] = get_unaligned_be16(buf + 4);
+			mpu6050_emit_sample(sensor, SNS_TYPE_ACCEL, raw,
+					&sample, mpu6050_acc_corr_get(sensor,
+						&corr) ? &corr : NULL);
+		}
+	}
+	if (atomic_read(&sensor->gyro_en)) {
+		if (missed)
+			mpu6050_stat_add(sensor, SNS_TYPE_GYRO,
+					MPU6050_STAT_OVERRUNS, missed);
+		if (mpu6050_decim_keep(sensor, SNS_TYPE_GYRO)) {
+			raw[0] = get_unaligned_be16(buf + 8);
+			raw[1] = get_unaligned_be16(buf + 10);
+			raw[2] = get_unaligned_be16(buf + 12);
+			mpu6050_emit_sample(sensor, SNS_TYPE_GYRO, raw,
+					&sample, NULL);
+		}
+	}
+
+exit:
+	mpu6050_fifo_process(sensor, SNS_TYPE_ACCEL);
+	mpu6050_fifo_process(sensor, SNS_TYPE_GYRO);
+	return IRQ_HANDLED;
+}
+
+/*
+ * Enable data ready while a sensor runs and restart the decimation on the
+ * current sample clock. op_lock must be held.
+ */
+static int mpu6050_irq_config(struct mpu6050_sensor *sensor)
+{
+	struct mpu_reg_map *reg = &sensor->reg;
+	bool on = (atomic_read(&sensor->accel_en) ||
+			atomic_read(&sensor->gyro_en)) &&
+			!mpu6050_paused(sensor);
+	unsigned int status;
+	int ret;
+
+	/* waits for a running interrupt thread */
+	disable_irq(sensor->irq);
+	mpu6050_decim_reset(sensor, sensor->sample_interval_ns);
+	ret = regmap_update_bits(sensor->regmap, reg->int_enable,
+			BIT_DATA_RDY_EN, on ? BIT_DATA_RDY_EN : 0);
+	if (!ret) {
+		sensor->cfg.int_enabled = on;
+		/* drop a stale latch, the next edge starts the new period */
+		ret = regmap_read(sensor->regmap, reg->int_status, &status);
+		if (!ret)
+			mpu6050_motion_status(sensor, status);
+		sensor->irq_edges = READ_ONCE(sensor->drdy_edges);
+	}
+	enable_irq(sensor->irq);
+
+	if (ret)
+		printk("MPU6050 - Failed to configure interrupt ret=%d\n", ret);
+	return ret;
+}
+
+static int mpu6050_irq_init(struct mpu6050_sensor *sensor)
+{
+	int ret;
+
+	sensor->irq_domain = irq_domain_add_linear(NULL, 1,
+			&mpu6050_irq_domain_ops, sensor);
+	if (!sensor->irq_domain)
+		return -ENOMEM;
+
+	sensor->irq = irq_create_mapping(sensor->irq_domain, 0);
+	if (!sensor->irq) {
+		ret = -EINVAL;
+		goto err_remove_domain;
+	}
+
+	ret = request_threaded_irq(sensor->irq, mpu6050_irq_handler,
+			mpu6050_irq_thread, IRQF_ONESHOT, "mpu6050_drdy", sensor);
+	if (ret)
+		goto err_dispose_mapping;
+
+	return 0;
+
+err_dispose_mapping:
+	irq_dispose_mapping(sensor->irq);
+	sensor->irq = 0;
+err_remove_domain:
+	irq_domain_remove(sensor->irq_domain);
+	return ret;
+}
+
+static void mpu6050_irq_exit(struct mpu6050_sensor *sensor)
+{
+	/* stop the sample and motion clocks before the line goes away */
+	regmap_write(sensor->regmap, sensor->reg.int_enable, 0);
+	hrtimer_cancel(&sensor->drdy_timer);
+	cancel_delayed_work_sync(&sensor->mot_clk);
+	irq_work_sync(&sensor->mot_irq_work);
+	free_irq(sensor->irq, sensor);
+	irq_dispose_mapping(sensor->irq);
+	sensor->irq = 0;
+	irq_domain_remove(sensor->irq_domain);
+}
+
+/* Without an interrupt line INT_STATUS is polled at the LP_WAKE rate. */
+static unsigned long mpu6050_motion_poll_delay(struct mpu6050_sensor *sensor)
+{
+	unsigned int val = 0;
+
+	regmap_read(sensor->regmap, sensor->reg.pwr_mgmt_2, &val);
+	return msecs_to_jiffies(
+			mpu6050_lp_wake_ms[(val & BIT_LPA_FREQ_MASK) >> 6]);
+}
+
+/*
+ * Park the running streams once the device lies still. The chip is put in
+ * accel cycle mode with the motion interrupt enabled, so the timers stop and
+ * only the LP_WAKE clock of the chip runs. op_lock must be held.
+ */
+static void mpu6050_motion_park(struct mpu6050_sensor *sensor)
+{
+	struct mpu6050_motion *mot = &sensor->mot;
+	struct mpu_reg_map *reg = &sensor->reg;
+	int type, ret;
+
+	/* a request queued before a calibration started */
+	if (mot->parked || !sensor->motion_det_en ||
+		!atomic_read(&sensor->accel_en) ||
+		atomic_read(&sensor->acc_cal.active))
+		return;
+
+	ret = regmap_update_bits(sensor->regmap, reg->pwr_mgmt_1, BIT_CYCLE,
+			BIT_CYCLE);
+	if (!ret)
+		ret = regmap_update_bits(sensor->regmap, reg->int_enable,
+				BIT_MOT_EN, BIT_MOT_EN);
+	if (ret) {
+		printk("MPU6050 - Failed to enable motion detection ret=%d\n",
+			ret);
+		return;
+	}
+	sensor->cfg.lpa_mode = 1;
+	sensor->cfg.mot_det_on = 1;
+
+	mot->parked = true;
+	for (type = 0; type < SNS_TYPE_MAX; type++) {
+		if (mpu6050_sensor_enabled(sensor, type)) {
+			mpu6050_stop_polling(sensor, type);
+			mpu6050_flush_fifo(sensor, type, false);
+		}
+	}
+	mpu6050_stat_add(sensor, SNS_TYPE_ACCEL, MPU6050_STAT_PARKS, 1);
+
+	if (sensor->use_poll)
+		queue_delayed_work(sensor->data_wq, &mot->work,
+				mpu6050_motion_poll_delay(sensor));
+}
+
+/*
+ * Leave cycle mode and restart the parked streams, on motion or when motion
+ * detection or the accelerometer is turned off. A motion event is reported
+ * as an ABS_MISC count on the accel input device. op_lock must be held.
+ */
+static void mpu6050_motion_resume(struct mpu6050_sensor *sensor, bool report)
+{
+	struct mpu6050_motion *mot = &sensor->mot;
+	struct mpu_reg_map *reg = &sensor->reg;
+	int type, ret;
+
+	if (!mot->parked)
+		return;
+
+	ret = regmap_update_bits(sensor->regmap, reg->int_enable, BIT_MOT_EN,
+			0);
+	if (!ret)
+		ret = regmap_update_bits(sensor->regmap, reg->pwr_mgmt_1,
+				BIT_CYCLE, 0);
+	if (ret)
+		printk("MPU6050 - Failed to disable motion detection ret=%d\n",
+			ret);
+	sensor->cfg.lpa_mode = 0;
+	sensor->cfg.mot_det_on = 0;
+
+	mot->parked = false;
+	mot->still_since_ns = 0;
+	for (type = 0; type < SNS_TYPE_MAX; type++)
+		if (mpu6050_sensor_enabled(sensor, type))
+			mpu6050_start_polling(sensor, type);
+
+	if (report) {
+		input_report_abs(sensor->accel_dev, ABS_MISC, ++mot->events);
+		input_sync(sensor->accel_dev);
+	}
+}
+
+static void mpu6050_motion_work(struct work_struct *work)
+{
+	struct mpu6050_motion *mot = container_of(to_delayed_work(work),
+			struct mpu6050_motion, work);
+	struct mpu6050_sensor *sensor = container_of(mot,
+			struct mpu6050_sensor, mot);
+	unsigned int status;
+	bool moved;
+
+	mutex_lock(&sensor->op_lock);
+	moved = atomic_xchg(&mot->event, 0);
+	if (mot->parked && !moved && sensor->use_poll &&
+		!regmap_read(sensor->regmap, sensor->reg.int_status, &status))
+		moved = status & BIT_MOT_INT;
+
+	if (mot->parked && moved)
+		mpu6050_motion_resume(sensor, true);
+	else if (mot->parked && sensor->use_poll)
+		queue_delayed_work(sensor->data_wq, &mot->work,
+				mpu6050_motion_poll_delay(sensor));
+	else if (atomic_xchg(&mot->park_req, 0))
+		mpu6050_motion_park(sensor);
+	mutex_unlock(&sensor->op_lock);
+}
+
+static int gyro_poll_thread(void *data)
+{
+	struct mpu6050_sensor *sensor = data;
+
+	set_freezable();
+	while (1) {
+		wait_event_freezable(sensor->gyro_wq,
+			(atomic_read(&sensor->ticks[SNS_TYPE_GYRO]) ||
+				mpu6050_fifo_pending(sensor, SNS_TYPE_GYRO) ||
+				kthread_should_stop()));
+
+		if (kthread_should_stop())
+			break;
+
+		if (atomic_xchg(&sensor->gyro_delay_change, 0)) {
+			if (READ_ONCE(sensor->gyro_poll_ms) <= POLL_MS_100HZ)
+				set_wake_up_idle(true);
+			else
+				set_wake_up_idle(false);
+		}
+
+		mpu6050_poll_sensor(sensor, SNS_TYPE_GYRO);
+	}
+	return 0;
+}
+
+static int accel_poll_thread(void *data)
+{
+	struct mpu6050_sensor *sensor = data;
+
+	set_freezable();
+	while (1) {
+		wait_event_freezable(sensor->accel_wq,
+			(atomic_read(&sensor->ticks[SNS_TYPE_ACCEL]) ||
+				mpu6050_fifo_pending(sensor, SNS_TYPE_ACCEL) ||
+				kthread_should_stop()));
+
+		if (kthread_should_stop())
+			break;
+
+		if (atomic_xchg(&sensor->accel_delay_change, 0)) {
+			if (READ_ONCE(sensor->accel_poll_ms) <= POLL_MS_100HZ)
+				set_wake_up_idle(true);
+			else
+				set_wake_up_idle(false);
+		}
+
+		mpu6050_poll_sensor(sensor, SNS_TYPE_ACCEL);
+	}
+
+	return 0;
+}
+
+static int imu_poll_thread(void *data)
+{
+	struct mpu6050_sensor *sensor = data;
+	u32 poll_ms;
+
+	set_freezable();
+	while (1) {
+		wait_event_freezable(sensor->sched_wq,
+			(atomic_read(&sensor->ticks[SNS_TYPE_ACCEL]) ||
+				atomic_read(&sensor->ticks[SNS_TYPE_GYRO]) ||
+				mpu6050_fifo_pending(sensor, SNS_TYPE_ACCEL) ||
+				mpu6050_fifo_pending(sensor, SNS_TYPE_GYRO) ||
+				kthread_should_stop()));
+
+		if (kthread_should_stop())
+			break;
+
+		if (atomic_xchg(&sensor->accel_delay_change, 0) |
+			atomic_xchg(&sensor->gyro_delay_change, 0)) {
+			poll_ms = min(READ_ONCE(sensor->accel_poll_ms),
+					READ_ONCE(sensor->gyro_poll_ms));
+			if (poll_ms <= POLL_MS_100HZ)
+				set_wake_up_idle(true);
+			else
+				set_wake_up_idle(false);
+		}
+
+		if (sensor->hwfifo_mode) {
+			atomic_set(&sensor->ticks[SNS_TYPE_ACCEL], 0);
+			atomic_set(&sensor->ticks[SNS_TYPE_GYRO], 0);
+			mpu6050_hwfifo_drain(sensor);
+			mpu6050_fifo_process(sensor, SNS_TYPE_ACCEL);
+			mpu6050_fifo_process(sensor, SNS_TYPE_GYRO);
+			continue;
+		}
+
+		mpu6050_poll_sensor(sensor, SNS_TYPE_ACCEL);
+		mpu6050_poll_sensor(sensor, SNS_TYPE_GYRO);
+	}
+
+	return 0;
+}
+
+static void mpu6050_stop_threads(struct mpu6050_sensor *sensor)
+{
+	if (!sensor->use_poll) {
+		mpu6050_irq_exit(sensor);
+	} else if (sensor->unified) {
+		kthread_stop(sensor->sched_task);
+	} else {
+		kthread_stop(sensor->gyr_task);
+		kthread_stop(sensor->accel_task);
+	}
+}
+
+/**
+ *  mpu6050_set_lpa_freq() - set low power wakeup frequency.
+ */
+static int mpu6050_set_lpa_freq(struct mpu6050_sensor *sensor, int lpa_freq)
+{
+	int ret;
+
+	ret = regmap_update_bits(sensor->regmap, sensor->reg.pwr_mgmt_2,
+			BIT_LPA_FREQ_MASK, lpa_freq & BIT_LPA_FREQ_MASK);
+	if (ret)
+		return ret;
+	sensor->cfg.lpa_freq = lpa_freq;
+
+	return 0;
+}
+
+static int mpu6050_switch_engine(struct mpu6050_sensor *sensor,
+				bool en, u32 mask)
+{
+	struct mpu_reg_map *reg;
+	int ret;
+
+	trace_mpu6050_switch_engine(sensor->dev, en, mask);
+	reg = &sensor->reg;
+	/*
+	 * switch clock needs to be careful. Only when gyro is on, can
+	 * clock source be switched to gyro. Otherwise, it must be set to
+	 * internal clock
+	 */
+	if ((BIT_PWR_GYRO_STBY_MASK == mask) && (!en)) {
+		ret = regmap_update_bits(sensor->regmap, reg->pwr_mgmt_1,
+				BIT_CLK_MASK, MPU_CLK_INTERNAL);
+		if (ret)
+			return ret;
+	}
+
+	/*
+	 * An enabled gyro needs SENSOR_UP_TIME_MS to be stable, the caller
+	 * switches the clock with mpu6050_gyro_clk_pll() after that.
+	 */
+	return regmap_update_bits(sensor->regmap, reg->pwr_mgmt_2, mask,
+			en ? 0 : mask);
+}
+
+/* Once the gyro is on and stable, switch the internal clock to its PLL. */
+static int mpu6050_gyro_clk_pll(struct mpu6050_sensor *sensor)
+{
+	return regmap_update_bits(sensor->regmap, sensor->reg.pwr_mgmt_1,
+			BIT_CLK_MASK, MPU_CLK_PLL_X);
+}
+
+static int mpu6050_init_engine(struct mpu6050_sensor *sensor)
+{
+	int ret;
+
+	ret = mpu6050_switch_engine(sensor, false, BIT_PWR_GYRO_STBY_MASK);
+	if (ret)
+		return ret;
+
+	ret = mpu6050_switch_engine(sensor, false, BIT_PWR_ACCEL_STBY_MASK);
+	if (ret)
+		return ret;
+
+	return 0;
+}
+
+/**
+ * mpu6050_set_power_mode() - set the power mode
+ * @sensor: sensor data structure
+ * @power_on: value to switch on/off of power, 1: normal power,
+ *    0: low power
+ *
+ * Put device to normal-power mode or low-power mode.
+ */
+static int mpu6050_set_power_mode(struct mpu6050_sensor *sensor,
+					bool power_on)
+{
+	return regmap_update_bits(sensor->regmap, sensor->reg.pwr_mgmt_1,
+			BIT_SLEEP, power_on ? 0 : BIT_SLEEP);
+}
+
+static int mpu6050_gyro_enable(struct mpu6050_sensor *sensor, bool on)
+{
+	int ret;
+
 	if (sensor->cfg.is_asleep) {
 		printk("MPU6050 - Fail to set gyro state, device is asleep.\n");
 		return -EINVAL;
 	}
 
-	ret = 1;
-	data = (u8)ret;
-	if (on) {
-		ret = mpu6050_switch_engine(sensor, true,
-			BIT_PWR_GYRO_STBY_MASK);
-		if (ret)
-			return ret;
-		sensor->cfg.gyro_enable = 1;
+	if (on) {
+		ret = mpu6050_switch_engine(sensor, true,
+			BIT_PWR_GYRO_STBY_MASK);
+		if (ret)
+			return ret;
+		sensor->cfg.gyro_enable = 1;
+
+		ret = mpu6050_set_power_mode(sensor, true);
+		if (ret)
+			return ret;
+		sensor->cfg.enable = 1;
+	} else {
+		ret = mpu6050_switch_engine(sensor, false,
+			BIT_PWR_GYRO_STBY_MASK);
+		if (ret)
+			return ret;
+		sensor->cfg.gyro_enable = 0;
+		if (!sensor->cfg.accel_enable) {
+			ret = mpu6050_set_power_mode(sensor, false);
+			if (ret)
+				return ret;
+			sensor->cfg.enable = 0;
+		}
+	}
+	return 0;
+}
+
+/**
+ * mpu6050_restore_context() - update the sensor register context
+ *
+ * The register cache holds the whole configuration, so after a reset only
+ * registers that differ from their power-on value are written back.
+ */
+
+static int mpu6050_restore_context(struct mpu6050_sensor *sensor)
+{
+	int ret;
+
+	ret = regcache_sync(sensor->regmap);
+	if (ret < 0)
+		printk("MPU6050 - register sync failed ret=%d\n", ret);
+
+	return ret;
+}
+
+/**
+ * mpu6050_reset_chip() - reset chip to default state
+ */
+static void mpu6050_reset_chip(struct mpu6050_sensor *sensor)
+{
+	unsigned int val;
+	int ret, i;
+
+	ret = regmap_write(sensor->regmap, sensor->reg.pwr_mgmt_1,
+			BIT_H_RESET);
+	if (ret) {
+		printk("MPU6050 - Failed to reset chip ret=%d\n", ret);
+		return;
+	}
+
+	for (i = 0; i < MPU6050_RESET_RETRY_CNT; i++) {
+		ret = regmap_read(sensor->regmap, sensor->reg.pwr_mgmt_1, &val);
+		if (!ret && !(val & BIT_H_RESET))
+			break;
+
+		usleep_range(MPU6050_RESET_SLEEP_US,
+				MPU6050_RESET_SLEEP_US * 2);
+	}
+
+	/* the chip is back at power-on values, the cache is not */
+	regcache_mark_dirty(sensor->regmap);
+}
+
+/* Time in ns until a chip that lost its registers has booted, 0 if it has. */
+static u64 mpu6050_boot_remaining(struct mpu6050_sensor *sensor)
+{
+	u64 now = ktime_to_ns(ktime_get_boottime());
+	u64 done;
+
+	mutex_lock(&sensor->pm_lock);
+	done = sensor->power_up_ns + POWER_UP_TIME_MS * NSEC_PER_MSEC;
+	if (!sensor->ctx_lost || !sensor->power_enabled || (done < now))
+		done = now;
+	mutex_unlock(&sensor->pm_lock);
+
+	return done - now;
+}
+
+/*
+ * Bring a chip that lost its registers back to the cached context. Nothing
+ * sleeps through the boot time, -EAGAIN is returned until it has passed.
+ */
+static int mpu6050_ctx_restore(struct mpu6050_sensor *sensor)
+{
+	int ret = 0;
+
+	mutex_lock(&sensor->pm_lock);
+	if (!sensor->ctx_lost || !sensor->power_enabled)
+		goto exit;
+
+	if (ktime_to_ns(ktime_get_boottime()) < sensor->power_up_ns +
+			POWER_UP_TIME_MS * NSEC_PER_MSEC) {
+		ret = -EAGAIN;
+		goto exit;
+	}
+
+	regcache_cache_only(sensor->regmap, false);
+	mpu6050_reset_chip(sensor);
+	ret = mpu6050_restore_context(sensor);
+	if (!ret)
+		sensor->ctx_lost = false;
+
+exit:
+	mutex_unlock(&sensor->pm_lock);
+	return ret;
+}
+
+/*
+ * Every running sensor holds a runtime PM reference, the chip powers down
+ * MPU6050_AUTOSUSPEND_MS after the last one stopped. No reference is taken
+ * once mpu6050_remove_dev() dropped them. op_lock must be held.
+ */
+static int mpu6050_pm_get(struct mpu6050_sensor *sensor, int sns_type)
+{
+	int ret;
+
+	if (!test_bit(sns_type, &sensor->pm_refs)) {
+		if (READ_ONCE(sensor->removing))
+			return -ENODEV;
+		ret = pm_runtime_get_sync(sensor->dev);
+		if (ret < 0) {
+			pm_runtime_put_noidle(sensor->dev);
+			printk("MPU6050 - Failed to power up mpu6050 ret=%d\n",
+				ret);
+			return ret;
+		}
+		set_bit(sns_type, &sensor->pm_refs);
+	}
+
+	return 0;
+}
+
+static void mpu6050_pm_put(struct mpu6050_sensor *sensor, int sns_type)
+{
+	if (!test_and_clear_bit(sns_type, &sensor->pm_refs))
+		return;
+
+	pm_runtime_mark_last_busy(sensor->dev);
+	pm_runtime_put_autosuspend(sensor->dev);
+}
+
+/*
+ * Context restore after a runtime or system resume, then restart streams.
+ * data_wq is ordered, so the work comes back after the boot time rather
+ * than sleep through it in front of the enable work.
+ */
+static void mpu6050_resume_work(struct work_struct *work)
+{
+	struct mpu6050_sensor *sensor = container_of(to_delayed_work(work),
+			struct mpu6050_sensor, resume_work);
+	u64 boot_ns;
+	int type;
+
+	boot_ns = mpu6050_boot_remaining(sensor);
+	if (boot_ns) {
+		queue_delayed_work(sensor->data_wq, &sensor->resume_work,
+				nsecs_to_jiffies(boot_ns) + 1);
+		return;
+	}
+
+	mutex_lock(&sensor->op_lock);
+	if (mpu6050_ctx_restore(sensor) < 0)
+		printk("MPU6050 - Failed to restore context\n");
+
+	if (sensor->suspended) {
+		WRITE_ONCE(sensor->suspended, false);
+		for (type = 0; type < SNS_TYPE_MAX; type++)
+			if (mpu6050_sensor_enabled(sensor, type))
+				mpu6050_start_polling(sensor, type);
+	}
+	mutex_unlock(&sensor->op_lock);
+}
+
+/* Update sensor sample rate divider upon accel and gyro polling rate. */
+static int mpu6050_config_sample_rate(struct mpu6050_sensor *sensor)
+{
+	u64 period_ns, div;
+	u32 odr;
+	int ret;
+
+	if (sensor->cfg.is_asleep)
+		return -EINVAL;
+
+	period_ns = min(sensor->req_ns[SNS_TYPE_ACCEL],
+			sensor->req_ns[SNS_TYPE_GYRO]);
+
+	if ((sensor->cfg.lpf != MPU_DLPF_256HZ_NOLPF2) &&
+		(sensor->cfg.lpf != MPU_DLPF_RESERVED))
+		odr = ODR_DLPF_ENA;
+	else
+		odr = ODR_DLPF_DIS;
+
+	/* Sample_rate = internal_ODR/(1+SMPLRT_DIV) */
+	div = div64_u64(period_ns * odr, NSEC_PER_SEC);
+	if (div)
+		div--;
+	if (div > SAMPLE_DIV_MAX)
+		div = SAMPLE_DIV_MAX;
+	trace_mpu6050_sample_rate(sensor->dev, period_ns, odr, div);
+
+	if (sensor->cfg.rate_div == div)
+		return 0;
+
+	ret = regmap_write(sensor->regmap, sensor->reg.sample_rate_div, div);
+	if (ret < 0)
+		return ret;
+	sensor->cfg.rate_div = div;
+
+	return 0;
+}
+
+/*
+ * Calculate sample interval according to sample rate.
+ * Return sample interval in nanosecond.
+ */
+static inline u64 mpu6050_get_sample_interval(struct mpu6050_sensor *sensor)
+{
+	u64 interval_ns;
+
+	if ((sensor->cfg.lpf == MPU_DLPF_256HZ_NOLPF2) ||
+		(sensor->cfg.lpf == MPU_DLPF_RESERVED)) {
+		interval_ns = (sensor->cfg.rate_div + 1) * NSEC_PER_MSEC;
+		interval_ns /= 8;
+	} else {
+		interval_ns = (sensor->cfg.rate_div + 1) * NSEC_PER_MSEC;
+	}
+
+	return interval_ns;
+}
+
+/* Shortest sampling period, the emulated internal ODR at the DLPF setting. */
+static inline u64 mpu6050_min_period_ns(struct mpu6050_sensor *sensor)
+{
+	if ((sensor->cfg.lpf == MPU_DLPF_256HZ_NOLPF2) ||
+		(sensor->cfg.lpf == MPU_DLPF_RESERVED))
+		return NSEC_PER_SEC / ODR_DLPF_DIS;
+	else
+		return NSEC_PER_SEC / ODR_DLPF_ENA;
+}
+
+/*
+ * Derive the sample rate divider from the requested periods and put both
+ * sensors on the resulting sample clock. Like the decimated outputs of the
+ * real part, effective periods are whole multiples of the sample interval,
+ * the longest one not above the request. Running sensors whose period or
+ * clock changed are restarted. op_lock must be held.
+ */
+static int mpu6050_update_periods(struct mpu6050_sensor *sensor)
+{
+	u64 interval, period;
+	bool clock_changed;
+	int type, ret;
+
+	ret = mpu6050_config_sample_rate(sensor);
+	if (ret < 0)
+		return ret;
+
+	interval = mpu6050_get_sample_interval(sensor);
+	clock_changed = (interval != sensor->sample_interval_ns);
+	if (clock_changed) {
+		sensor->sample_interval_ns = interval;
+		sensor->fifo_start_ns = ktime_to_ns(ktime_get_boottime());
+	}
+
+	for (type = 0; type < SNS_TYPE_MAX; type++) {
+		/* round down, a sensor never runs slower than requested */
+		period = div64_u64(sensor->req_ns[type], interval);
+		period = max_t(u64, period, 1) * interval;
+		if (!clock_changed && (period == sensor->poll_ns[type]))
+			continue;
+
+		sensor->poll_ns[type] = period;
+		if (period < MPU6050_MIN_WAKE_NS)
+			sensor->burst[type] = DIV_ROUND_UP(MPU6050_MIN_WAKE_NS,
+					(u32)period);
+		else
+			sensor->burst[type] = 1;
+		trace_mpu6050_poll_period(sensor->dev, type,
+				sensor->req_ns[type], period, sensor->burst[type]);
+		mpu6050_stat_add(sensor, type, MPU6050_STAT_RATE_CHANGES, 1);
+
+		if (mpu6050_sensor_enabled(sensor, type))
+			mpu6050_start_polling(sensor, type);
+	}
+
+	return 0;
+}
+
+/*
+ * Set the requested sampling period of one sensor in nanoseconds and apply
+ * it to a running sensor. op_lock must be held.
+ */
+static int mpu6050_set_poll_period(struct mpu6050_sensor *sensor,
+				int sns_type, u64 period_ns)
+{
+	u64 max_ns;
+	u32 poll_ms;
+	int ret;
+
+	if (sns_type == SNS_TYPE_ACCEL)
+		max_ns = (u64)MPU6050_ACCEL_MAX_POLL_INTERVAL_MS * NSEC_PER_MSEC;
+	else
+		max_ns = (u64)MPU6050_GYRO_MAX_POLL_INTERVAL_MS * NSEC_PER_MSEC;
+	period_ns = clamp(period_ns, mpu6050_min_period_ns(sensor), max_ns);
+
+	if (sensor->req_ns[sns_type] == period_ns)
+		return 0;
+	sensor->req_ns[sns_type] = period_ns;
+
+	poll_ms = max_t(u32, div_u64(period_ns, NSEC_PER_MSEC), 1);
+	if (sns_type == SNS_TYPE_ACCEL) {
+		sensor->accel_poll_ms = poll_ms;
+		atomic_set(&sensor->accel_delay_change, 1);
+		if (!atomic_read(&sensor->accel_en))
+			return 0;
+	} else {
+		sensor->gyro_poll_ms = poll_ms;
+		atomic_set(&sensor->gyro_delay_change, 1);
+		if (!atomic_read(&sensor->gyro_en))
+			return 0;
+	}
+
+	ret = mpu6050_update_periods(sensor);
+	if (ret < 0)
+		printk("MPU6050 - Unable to update sampling rate! ret=%d\n",
+			ret);
+
+	return 0;
+}
+
+static int mpu6050_gyro_set_poll_delay(struct mpu6050_sensor *sensor,
+					unsigned long delay)
+{
+	int ret;
+
+	if (delay < MPU6050_GYRO_MIN_POLL_INTERVAL_MS)
+		delay = MPU6050_GYRO_MIN_POLL_INTERVAL_MS;
+	if (delay > MPU6050_GYRO_MAX_POLL_INTERVAL_MS)
+		delay = MPU6050_GYRO_MAX_POLL_INTERVAL_MS;
+
+	mutex_lock(&sensor->op_lock);
+	ret = mpu6050_set_poll_period(sensor, SNS_TYPE_GYRO,
+			(u64)delay * NSEC_PER_MSEC);
+	mutex_unlock(&sensor->op_lock);
+	return ret;
+}
+
+static int mpu6050_gyro_cdev_enable(struct sensors_classdev *sensors_cdev,
+			unsigned int enable)
+{
+	struct mpu6050_sensor *sensor = container_of(sensors_cdev,
+			struct mpu6050_sensor, gyro_cdev);
+	return mpu6050_set_enable(sensor, SNS_TYPE_GYRO, enable);
+}
+
+static int mpu6050_gyro_cdev_poll_delay(struct sensors_classdev *sensors_cdev,
+			unsigned int delay_ms)
+{
+	struct mpu6050_sensor *sensor = container_of(sensors_cdev,
+			struct mpu6050_sensor, gyro_cdev);
+	return mpu6050_gyro_set_poll_delay(sensor, delay_ms);
+}
+
+static int mpu6050_gyro_cdev_set_latency(struct sensors_classdev *sensors_cdev,
+			unsigned int max_latency)
+{
+	struct mpu6050_sensor *sensor = container_of(sensors_cdev,
+			struct mpu6050_sensor, gyro_cdev);
+
+	mutex_lock(&sensor->op_lock);
+	sensor->gyro_latency_ms = max_latency;
+	sensor->batch_gyro = (max_latency != 0);
+	mutex_unlock(&sensor->op_lock);
+
+	return 0;
+}
+
+static int mpu6050_gyro_cdev_flush(struct sensors_classdev *sensors_cdev)
+{
+	struct mpu6050_sensor *sensor = container_of(sensors_cdev,
+			struct mpu6050_sensor, gyro_cdev);
+
+	mpu6050_flush_fifo(sensor, SNS_TYPE_GYRO, true);
+	return 0;
+}
+
+static ssize_t mpu6050_get_place(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+
+	return snprintf(buf, 30, "%s\n", mpu6050_place_name2num[sensor->pdata->place].name);
+}
+
+static ssize_t mpu6050_gyro_attr_get_rx(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct axis_data axis;
+
+	mpu6050_read_axis(sensor, &axis);
+	return snprintf(buf, PAGE_SIZE, "%d\n", axis.rx);
+}
+
+static ssize_t mpu6050_gyro_attr_set_rx(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	s16 value;
+
+	if (kstrtos16(buf, 10, &value))
+		return -EINVAL;
+
+	write_seqlock(&sensor->axis_lock);
+	sensor->axis.rx = value;
+	sensor->phys_valid[SNS_TYPE_GYRO] = false;
+	write_sequnlock(&sensor->axis_lock);
+	mpu6050_stat_add(sensor, SNS_TYPE_GYRO, MPU6050_STAT_INJECTED, 1);
+	return count;
+}
+
+static ssize_t mpu6050_gyro_attr_get_ry(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct axis_data axis;
+
+	mpu6050_read_axis(sensor, &axis);
+	return snprintf(buf, PAGE_SIZE, "%d\n", axis.ry);
+}
+
+static ssize_t mpu6050_gyro_attr_set_ry(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	s16 value;
+
+	if (kstrtos16(buf, 10, &value))
+		return -EINVAL;
+
+	write_seqlock(&sensor->axis_lock);
+	sensor->axis.ry = value;
+	sensor->phys_valid[SNS_TYPE_GYRO] = false;
+	write_sequnlock(&sensor->axis_lock);
+	mpu6050_stat_add(sensor, SNS_TYPE_GYRO, MPU6050_STAT_INJECTED, 1);
+	return count;
+}
+
+static ssize_t mpu6050_gyro_attr_get_rz(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct axis_data axis;
+
+	mpu6050_read_axis(sensor, &axis);
+	return snprintf(buf, PAGE_SIZE, "%d\n", axis.rz);
+}
+
+static ssize_t mpu6050_gyro_attr_set_rz(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	s16 value;
+
+	if (kstrtos16(buf, 10, &value))
+		return -EINVAL;
+
+	write_seqlock(&sensor->axis_lock);
+	sensor->axis.rz = value;
+	sensor->phys_valid[SNS_TYPE_GYRO] = false;
+	write_sequnlock(&sensor->axis_lock);
+	mpu6050_stat_add(sensor, SNS_TYPE_GYRO, MPU6050_STAT_INJECTED, 1);
+	return count;
+}
+
+static ssize_t mpu6050_gyro_attr_get_overruns(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%d %d\n",
+			atomic_read(&sensor->overruns[SNS_TYPE_GYRO]),
+			atomic_read(&sensor->dropped[SNS_TYPE_GYRO]));
+}
+
+static ssize_t mpu6050_gyro_attr_get_period(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%llu\n",
+			mpu6050_poll_ns(sensor, SNS_TYPE_GYRO));
+}
+
+static ssize_t mpu6050_gyro_attr_set_period(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	u64 period_ns;
+	int ret;
+
+	if (kstrtoull(buf, 10, &period_ns))
+		return -EINVAL;
+
+	mutex_lock(&sensor->op_lock);
+	ret = mpu6050_set_poll_period(sensor, SNS_TYPE_GYRO, period_ns);
+	mutex_unlock(&sensor->op_lock);
+
+	return ret ? ret : count;
+}
+
+static ssize_t mpu6050_gyro_attr_get_jitter(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%u\n",
+			sensor->ts_jitter_ns[SNS_TYPE_GYRO]);
+}
+
+static ssize_t mpu6050_gyro_attr_set_jitter(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	unsigned int jitter;
+
+	if (kstrtouint(buf, 10, &jitter) || (jitter > NSEC_PER_SEC))
+		return -EINVAL;
+
+	WRITE_ONCE(sensor->ts_jitter_ns[SNS_TYPE_GYRO], jitter);
+	return count;
+}
+
+static ssize_t mpu6050_gyro_attr_get_skew(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%lld %lld\n",
+			sensor->ts_skew_ns[SNS_TYPE_GYRO],
+			sensor->ts_skew_max_ns[SNS_TYPE_GYRO]);
+}
+
+static struct device_attribute gyro_attr[] = {
+	__ATTR(valueX, S_IRUGO | S_IWUSR,
+		mpu6050_gyro_attr_get_rx,
+		mpu6050_gyro_attr_set_rx),
+	__ATTR(valueY, S_IRUGO | S_IWUSR,
+		mpu6050_gyro_attr_get_ry,
+		mpu6050_gyro_attr_set_ry),
+	__ATTR(valueZ, S_IRUGO | S_IWUSR,
+		mpu6050_gyro_attr_get_rz,
+		mpu6050_gyro_attr_set_rz),
+	__ATTR(place, S_IRUSR,
+		mpu6050_get_place,
+		NULL),
+	__ATTR(overruns, S_IRUGO,
+		mpu6050_gyro_attr_get_overruns,
+		NULL),
+	__ATTR(poll_period_ns, S_IRUGO | S_IWUSR,
+		mpu6050_gyro_attr_get_period,
+		mpu6050_gyro_attr_set_period),
+	__ATTR(ts_jitter_ns, S_IRUGO | S_IWUSR,
+		mpu6050_gyro_attr_get_jitter,
+		mpu6050_gyro_attr_set_jitter),
+	__ATTR(ts_skew_ns, S_IRUGO,
+		mpu6050_gyro_attr_get_skew,
+		NULL),
+};
+
+static int create_gyro_sysfs_interfaces(struct device *dev)
+{
+	int i;
+	int err;
+	for (i = 0; i < ARRAY_SIZE(gyro_attr); i++) {
+		err = device_create_file(dev, gyro_attr + i);
+		if (err)
+			goto error;
+	}
+	return 0;
+
+error:
+	for (; i >= 0; i--)
+		device_remove_file(dev, gyro_attr + i);
+	dev_err(dev, "Unable to create interface\n");
+	return err;
+}
+
+static int remove_gyro_sysfs_interfaces(struct device *dev)
+{
+	int i;
+	for (i = 0; i < ARRAY_SIZE(gyro_attr); i++)
+		device_remove_file(dev, gyro_attr + i);
+	return 0;
+}
+
+static int mpu6050_accel_enable(struct mpu6050_sensor *sensor, bool on)
+{
+	int ret;
+
+	if (sensor->cfg.is_asleep)
+		return -EINVAL;
+
+	if (on) {
+		ret = mpu6050_switch_engine(sensor, true,
+			BIT_PWR_ACCEL_STBY_MASK);
+		if (ret)
+			return ret;
+		sensor->cfg.accel_enable = 1;
+
+		ret = mpu6050_set_power_mode(sensor, true);
+		if (ret)
+			return ret;
+		sensor->cfg.enable = 1;
+	} else {
+		ret = mpu6050_switch_engine(sensor, false,
+			BIT_PWR_ACCEL_STBY_MASK);
+		if (ret)
+			return ret;
+		sensor->cfg.accel_enable = 0;
+
+		if (!sensor->cfg.gyro_enable) {
+			ret = mpu6050_set_power_mode(sensor, false);
+			if (ret)
+				return ret;
+			sensor->cfg.enable = 0;
+		}
+	}
+	return 0;
+}
+
+static int mpu6050_engine_enable(struct mpu6050_sensor *sensor, int sns_type,
+				bool on)
+{
+	if (sns_type == SNS_TYPE_GYRO)
+		return mpu6050_gyro_enable(sensor, on);
+	else
+		return mpu6050_accel_enable(sensor, on);
+}
+
+/* Start the stream of a sensor whose engine settled. op_lock must be held. */
+static int mpu6050_stream_start(struct mpu6050_sensor *sensor, int sns_type)
+{
+	int ret;
+
+	if (sns_type == SNS_TYPE_GYRO) {
+		ret = mpu6050_gyro_clk_pll(sensor);
+		if (ret)
+			return ret;
+	}
+
+	ret = mpu6050_update_periods(sensor);
+	if (ret < 0)
+		printk("MPU6050 - Unable to update sampling rate! ret=%d\n",
+			ret);
+
+	/* drop samples queued for an earlier session */
+	kfifo_reset_out(&sensor->inject[sns_type]);
+	if (sns_type == SNS_TYPE_ACCEL)
+		sensor->mot.still_since_ns = 0;
+
+	atomic_set(&sensor->first_pending[sns_type], 1);
+	/* the timer callback stops re-arming once it sees en cleared */
+	if (sns_type == SNS_TYPE_ACCEL)
+		atomic_set(&sensor->accel_en, 1);
+	else
+		atomic_set(&sensor->gyro_en, 1);
+	mpu6050_start_polling(sensor, sns_type);
+	mpu6050_stats_enable(sensor, sns_type, true);
+
+	return 0;
+}
+
+static void mpu6050_stream_stop(struct mpu6050_sensor *sensor, int sns_type)
+{
+	if (sns_type == SNS_TYPE_ACCEL) {
+		atomic_set(&sensor->accel_en, 0);
+		/* motion is detected on the accel, the gyro keeps streaming */
+		mpu6050_motion_resume(sensor, false);
+	} else {
+		atomic_set(&sensor->gyro_en, 0);
+	}
+	mpu6050_stop_polling(sensor, sns_type);
+	mpu6050_stats_enable(sensor, sns_type, false);
+	/* deliver whatever is still batched */
+	mpu6050_flush_fifo(sensor, sns_type, false);
+	atomic_set(&sensor->first_pending[sns_type], 0);
+}
+
+/*
+ * Report a failed enable: counted, signalled to userspace with a change
+ * uevent on the input device and latched for the next mpu6050_set_enable().
+ */
+static void mpu6050_enable_failed(struct mpu6050_sensor *sensor, int sns_type,
+				int err)
+{
+	struct input_dev *idev = (sns_type == SNS_TYPE_ACCEL) ?
+			sensor->accel_dev : sensor->gyro_dev;
+	char event[32];
+	char *envp[] = { event, NULL };
+
+	atomic_set(&sensor->en_err[sns_type], err);
+	mpu6050_stat_add(sensor, sns_type, MPU6050_STAT_ENABLE_ERRORS, 1);
+	snprintf(event, sizeof(event), "ENABLE_ERROR=%d", err);
+	kobject_uevent_env(&idev->dev.kobj, KOBJ_CHANGE, envp);
+}
+
+/*
+ * Move a sensor toward its bit in en_req by every step that is due now:
+ *
+ *   OFF -> BOOTING	take a runtime PM reference
+ *   BOOTING -> SETTLING	restore the context once the chip booted, then
+ *			turn the engine on
+ *   SETTLING -> ON	start streaming once the engine output is valid,
+ *			SENSOR_UP_TIME_MS for the gyro
+ *
+ * A sensor no longer requested walks the same states back to OFF. Return
+ * the time in ns until the next step is due, 0 once the sensor is where it
+ * was requested. op_lock must be held.
+ */
+static u64 mpu6050_enable_step(struct mpu6050_sensor *sensor, int sns_type)
+{
+	bool req = test_bit(sns_type, &sensor->en_req);
+	u64 now, boot_ns;
+	int ret;
+
+	for (;;) {
+		switch (sensor->en_state[sns_type]) {
+		case MPU6050_EN_OFF:
+			if (!req)
+				return 0;
+			ret = mpu6050_pm_get(sensor, sns_type);
+			if (ret < 0)
+				goto err;
+			sensor->en_state[sns_type] = MPU6050_EN_BOOTING;
+			break;
+		case MPU6050_EN_BOOTING:
+			if (!req) {
+				mpu6050_pm_put(sensor, sns_type);
+				sensor->en_state[sns_type] = MPU6050_EN_OFF;
+				break;
+			}
+			boot_ns = mpu6050_boot_remaining(sensor);
+			if (boot_ns)
+				return boot_ns;
+			ret = mpu6050_ctx_restore(sensor);
+			if (ret < 0) {
+				printk("MPU6050 - Failed to restore context\n");
+				goto err;
+			}
+			ret = mpu6050_engine_enable(sensor, sns_type, true);
+			if (ret) {
+				printk("MPU6050 - Fail to enable %s engine ret=%d\n",
+					mpu6050_sns_name[sns_type], ret);
+				goto err;
+			}
+			sensor->ready_ns[sns_type] =
+				ktime_to_ns(ktime_get_boottime());
+			if (sns_type == SNS_TYPE_GYRO)
+				sensor->ready_ns[sns_type] +=
+					SENSOR_UP_TIME_MS * NSEC_PER_MSEC;
+			sensor->en_state[sns_type] = MPU6050_EN_SETTLING;
+			break;
+		case MPU6050_EN_SETTLING:
+			if (!req) {
+				ret = mpu6050_engine_enable(sensor, sns_type,
+						false);
+				if (ret)
+					printk("MPU6050 - Fail to disable %s engine ret=%d\n",
+						mpu6050_sns_name[sns_type],
+						ret);
+				mpu6050_pm_put(sensor, sns_type);
+				sensor->en_state[sns_type] = MPU6050_EN_OFF;
+				break;
+			}
+			now = ktime_to_ns(ktime_get_boottime());
+			if (now < sensor->ready_ns[sns_type])
+				return sensor->ready_ns[sns_type] - now;
+			ret = mpu6050_stream_start(sensor, sns_type);
+			if (ret)
+				goto err;
+			sensor->en_state[sns_type] = MPU6050_EN_ON;
+			break;
+		case MPU6050_EN_ON:
+			if (req)
+				return 0;
+			mpu6050_stream_stop(sensor, sns_type);
+			sensor->en_state[sns_type] = MPU6050_EN_SETTLING;
+			break;
+		}
+		continue;
+
+err:
+		/* drop the request, the states unwind on the next pass */
+		mpu6050_enable_failed(sensor, sns_type, ret);
+		clear_bit(sns_type, &sensor->en_req);
+		req = false;
+	}
+}
+
+static void mpu6050_enable_work(struct work_struct *work)
+{
+	struct mpu6050_sensor *sensor = container_of(to_delayed_work(work),
+			struct mpu6050_sensor, enable_work);
+	u64 next = 0, ns;
+	int type;
+
+	mutex_lock(&sensor->op_lock);
+	for (type = 0; type < SNS_TYPE_MAX; type++) {
+		ns = mpu6050_enable_step(sensor, type);
+		if (ns && (!next || (ns < next)))
+			next = ns;
+	}
+	mutex_unlock(&sensor->op_lock);
+
+	if (next)
+		queue_delayed_work(sensor->data_wq, &sensor->enable_work,
+				nsecs_to_jiffies(next) + 1);
+}
+
+/*
+ * Request a sensor on or off and return at once, power up and settling run
+ * in mpu6050_enable_work(). Requests arriving meanwhile only move the
+ * target, so an enable/disable storm costs at most one transition. The work
+ * drops a request it fails to bring up, see mpu6050_enable_failed(); the
+ * next enable returns that error instead of queueing a new request, the
+ * one after retries.
+ */
+static int mpu6050_set_enable(struct mpu6050_sensor *sensor, int sns_type,
+				bool enable)
+{
+	int err;
+
+	if ((sns_type < 0) || (sns_type >= SNS_TYPE_MAX))
+		return -EINVAL;
+
+	if (enable) {
+		err = atomic_xchg(&sensor->en_err[sns_type], 0);
+		if (err)
+			return err;
+		if (READ_ONCE(sensor->removing))
+			return -ENODEV;
+	}
+
+	trace_mpu6050_enable(sensor->dev, sns_type, enable);
+	if (enable) {
+		if (!test_bit(sns_type, &sensor->en_req)) {
+			WRITE_ONCE(sensor->en_req_ns[sns_type],
+				ktime_to_ns(ktime_get_boottime()));
+			smp_mb__before_atomic();
+			set_bit(sns_type, &sensor->en_req);
+		}
+	} else {
+		clear_bit(sns_type, &sensor->en_req);
+	}
+	mod_delayed_work(sensor->data_wq, &sensor->enable_work, 0);
+
+	return 0;
+}
+
+static int mpu6050_accel_set_poll_delay(struct mpu6050_sensor *sensor,
+					unsigned long delay)
+{
+	int ret;
+
+	if (delay < MPU6050_ACCEL_MIN_POLL_INTERVAL_MS)
+		delay = MPU6050_ACCEL_MIN_POLL_INTERVAL_MS;
+	if (delay > MPU6050_ACCEL_MAX_POLL_INTERVAL_MS)
+		delay = MPU6050_ACCEL_MAX_POLL_INTERVAL_MS;
+
+	mutex_lock(&sensor->op_lock);
+	ret = mpu6050_set_poll_period(sensor, SNS_TYPE_ACCEL,
+			(u64)delay * NSEC_PER_MSEC);
+	mutex_unlock(&sensor->op_lock);
+	return ret;
+}
+
+static int mpu6050_accel_cdev_enable(struct sensors_classdev *sensors_cdev,
+			unsigned int enable)
+{
+	struct mpu6050_sensor *sensor = container_of(sensors_cdev,
+			struct mpu6050_sensor, accel_cdev);
+	int ret;
+
+	mutex_lock(&sensor->op_lock);
+	if (enable)
+		sensor->acc_cal.owned = false;
+	ret = mpu6050_set_enable(sensor, SNS_TYPE_ACCEL, enable);
+	mutex_unlock(&sensor->op_lock);
+
+	return ret;
+}
+
+static int mpu6050_accel_cdev_poll_delay(struct sensors_classdev *sensors_cdev,
+			unsigned int delay_ms)
+{
+	struct mpu6050_sensor *sensor = container_of(sensors_cdev,
+			struct mpu6050_sensor, accel_cdev);
+
+	return mpu6050_accel_set_poll_delay(sensor, delay_ms);
+}
+
+static int mpu6050_accel_cdev_set_latency(struct sensors_classdev *sensors_cdev,
+			unsigned int max_latency)
+{
+	struct mpu6050_sensor *sensor = container_of(sensors_cdev,
+			struct mpu6050_sensor, accel_cdev);
+
+	mutex_lock(&sensor->op_lock);
+	sensor->accel_latency_ms = max_latency;
+	sensor->batch_accel = (max_latency != 0);
+	mutex_unlock(&sensor->op_lock);
+
+	return 0;
+}
+
+static int mpu6050_accel_cdev_flush(struct sensors_classdev *sensors_cdev)
+{
+	struct mpu6050_sensor *sensor = container_of(sensors_cdev,
+			struct mpu6050_sensor, accel_cdev);
+
+	mpu6050_flush_fifo(sensor, SNS_TYPE_ACCEL, true);
+	return 0;
+}
+
+/*
+ * Publish a new bias, keeping the string form for the HAL in sync. The
+ * class core reads the string without our locks, so it is formatted in the
+ * buffer not being shown and then swapped in.
+ */
+static void mpu6050_acc_set_bias(struct mpu6050_sensor *sensor,
+				const int *bias, bool use_cal)
+{
+	char *buf;
+
+	write_seqlock(&sensor->acc_cal_lock);
+	memcpy(sensor->acc_cal_params, bias, sizeof(sensor->acc_cal_params));
+	sensor->acc_use_cal = use_cal;
+
+	buf = (sensor->accel_cdev.params == sensor->acc_cal_buf[0]) ?
+		sensor->acc_cal_buf[1] : sensor->acc_cal_buf[0];
+	snprintf(buf, MPU_ACC_CAL_BUF_SIZE, "%d,%d,%d",
+			bias[0], bias[1], bias[2]);
+	smp_wmb();
+	WRITE_ONCE(sensor->accel_cdev.params, buf);
+	write_sequnlock(&sensor->acc_cal_lock);
+}
+
+/*
+ * Collect MPU_ACC_CAL_COUNT accelerometer samples with the device lying
+ * flat and still. The first CAL_SKIP_COUNT are skipped, the bias is the
+ * average of the rest against 0g on X and Y and 1g at the current full
+ * scale on Z. Samples come at the current rate, a sensor slower than
+ * MPU_ACC_CAL_DELAY ms is sped up to it meanwhile, so no client ever sees
+ * a slower rate. The accelerometer is enabled for the duration if it was
+ * off. Parked streams deliver no samples, so the calibration is refused
+ * until motion resumes them.
+ */
+static int mpu6050_accel_calibrate(struct mpu6050_sensor *sensor,
+				bool apply_now)
+{
+	struct mpu6050_acc_cal *cal = &sensor->acc_cal;
+	int bias[3], i, ret = 0;
+	u64 old_ns, cal_ns;
+	u8 fs;
+
+	mutex_lock(&sensor->op_lock);
+	if (atomic_read(&cal->active) || sensor->mot.parked) {
+		mutex_unlock(&sensor->op_lock);
+		return -EBUSY;
+	}
+	old_ns = sensor->req_ns[SNS_TYPE_ACCEL];
+	cal_ns = min_t(u64, old_ns, (u64)MPU_ACC_CAL_DELAY * NSEC_PER_MSEC);
+	fs = sensor->cfg.accel_fs;
+
+	cal->count = 0;
+	memset(cal->sum, 0, sizeof(cal->sum));
+	reinit_completion(&cal->done);
+	smp_wmb();
+	atomic_set(&cal->active, 1);
+
+	if (cal_ns != old_ns)
+		ret = mpu6050_set_poll_period(sensor, SNS_TYPE_ACCEL, cal_ns);
+	if (!ret && !test_bit(SNS_TYPE_ACCEL, &sensor->en_req)) {
+		ret = mpu6050_set_enable(sensor, SNS_TYPE_ACCEL, true);
+		cal->owned = !ret;
+	}
+	mutex_unlock(&sensor->op_lock);
+
+	if (!ret && !wait_for_completion_timeout(&cal->done,
+			msecs_to_jiffies(MPU_ACC_CAL_TIMEOUT_MS(
+				div_u64(cal_ns, NSEC_PER_MSEC)))))
+		ret = -ETIMEDOUT;
+	atomic_set(&cal->active, 0);
+
+	mutex_lock(&sensor->op_lock);
+	if (cal->owned) {
+		cal->owned = false;
+		mpu6050_set_enable(sensor, SNS_TYPE_ACCEL, false);
+	}
+	/* leave alone a rate a client set meanwhile */
+	if ((cal_ns != old_ns) && (sensor->req_ns[SNS_TYPE_ACCEL] == cal_ns))
+		mpu6050_set_poll_period(sensor, SNS_TYPE_ACCEL, old_ns);
+	/* samples of two full scales cannot be averaged */
+	if (!ret && (sensor->cfg.accel_fs != fs))
+		ret = -EAGAIN;
+	mutex_unlock(&sensor->op_lock);
+
+	if (ret) {
+		printk("MPU6050 - Accel calibration failed ret=%d\n", ret);
+		return ret;
+	}
+
+	for (i = 0; i < 3; i++)
+		bias[i] = cal->sum[i] / MPU_ACC_CAL_NUM;
+	bias[2] -= RAW_TO_1G >> fs;
+	for (i = 0; i < 3; i++)
+		bias[i] = clamp_t(int, bias[i], S16_MIN, S16_MAX);
+
+	mpu6050_acc_set_bias(sensor, bias, apply_now || sensor->acc_use_cal);
+	return 0;
+}
+
+static int mpu6050_accel_cdev_calibrate(struct sensors_classdev *sensors_cdev,
+			int axis, int apply_now)
+{
+	struct mpu6050_sensor *sensor = container_of(sensors_cdev,
+			struct mpu6050_sensor, accel_cdev);
+
+	return mpu6050_accel_calibrate(sensor, apply_now);
+}
+
+static int mpu6050_accel_cdev_write_cal_params(
+			struct sensors_classdev *sensors_cdev,
+			struct cal_result_t *cal_result)
+{
+	struct mpu6050_sensor *sensor = container_of(sensors_cdev,
+			struct mpu6050_sensor, accel_cdev);
+	int bias[3];
+
+	bias[0] = clamp_t(int, cal_result->offset_x, S16_MIN, S16_MAX);
+	bias[1] = clamp_t(int, cal_result->offset_y, S16_MIN, S16_MAX);
+	bias[2] = clamp_t(int, cal_result->offset_z, S16_MIN, S16_MAX);
+	mpu6050_acc_set_bias(sensor, bias, true);
+
+	return 0;
+}
+
+static ssize_t mpu6050_accel_attr_get_matrix(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	s32 (*m)[3] = sensor->acc_cal_matrix;
+
+	return snprintf(buf, PAGE_SIZE, "%d %d %d %d %d %d %d %d %d\n",
+			m[0][0], m[0][1], m[0][2],
+			m[1][0], m[1][1], m[1][2],
+			m[2][0], m[2][1], m[2][2]);
+}
+
+/*
+ * Set the scale and misalignment matrix as nine Q14 values in row order,
+ * "16384 0 0 0 16384 0 0 0 16384" being the identity.
+ */
+static ssize_t mpu6050_accel_attr_set_matrix(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	s32 m[3][3];
+	bool identity = true;
+	int i, j;
+
+	if (sscanf(buf, "%d %d %d %d %d %d %d %d %d",
+			&m[0][0], &m[0][1], &m[0][2],
+			&m[1][0], &m[1][1], &m[1][2],
+			&m[2][0], &m[2][1], &m[2][2]) != 9)
+		return -EINVAL;
+
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 3; j++) {
+			if (abs(m[i][j]) > MPU_ACC_CAL_MATRIX_MAX)
+				return -EINVAL;
+			if (m[i][j] != ((i == j) ?
+					(1 << MPU_ACC_CAL_MATRIX_SHIFT) : 0))
+				identity = false;
+		}
+	}
+
+	write_seqlock(&sensor->acc_cal_lock);
+	memcpy(sensor->acc_cal_matrix, m, sizeof(m));
+	sensor->acc_use_matrix = !identity;
+	write_sequnlock(&sensor->acc_cal_lock);
+	return count;
+}
+
+static ssize_t mpu6050_accel_attr_get_x(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct axis_data axis;
+
+	mpu6050_read_axis(sensor, &axis);
+	return snprintf(buf, PAGE_SIZE, "%d\n", axis.x);
+}
+
+static ssize_t mpu6050_accel_attr_set_x(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	s16 value;
+
+	if (kstrtos16(buf, 10, &value))
+		return -EINVAL;
+
+	write_seqlock(&sensor->axis_lock);
+	sensor->axis.x = value;
+	sensor->phys_valid[SNS_TYPE_ACCEL] = false;
+	write_sequnlock(&sensor->axis_lock);
+	mpu6050_stat_add(sensor, SNS_TYPE_ACCEL, MPU6050_STAT_INJECTED, 1);
+	return count;
+}
+
+static ssize_t mpu6050_accel_attr_get_y(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct axis_data axis;
+
+	mpu6050_read_axis(sensor, &axis);
+	return snprintf(buf, PAGE_SIZE, "%d\n", axis.y);
+}
+
+static ssize_t mpu6050_accel_attr_set_y(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	s16 value;
+
+	if (kstrtos16(buf, 10, &value))
+		return -EINVAL;
+
+	write_seqlock(&sensor->axis_lock);
+	sensor->axis.y = value;
+	sensor->phys_valid[SNS_TYPE_ACCEL] = false;
+	write_sequnlock(&sensor->axis_lock);
+	mpu6050_stat_add(sensor, SNS_TYPE_ACCEL, MPU6050_STAT_INJECTED, 1);
+	return count;
+}
+
+static ssize_t mpu6050_accel_attr_get_z(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct axis_data axis;
+
+	mpu6050_read_axis(sensor, &axis);
+	return snprintf(buf, PAGE_SIZE, "%d\n", axis.z);
+}
+
+static ssize_t mpu6050_accel_attr_set_z(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	s16 value;
+
+	if (kstrtos16(buf, 10, &value))
+		return -EINVAL;
+
+	write_seqlock(&sensor->axis_lock);
+	sensor->axis.z = value;
+	sensor->phys_valid[SNS_TYPE_ACCEL] = false;
+	write_sequnlock(&sensor->axis_lock);
+	mpu6050_stat_add(sensor, SNS_TYPE_ACCEL, MPU6050_STAT_INJECTED, 1);
+	return count;
+}
+
+static ssize_t mpu6050_accel_attr_get_overruns(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%d %d\n",
+			atomic_read(&sensor->overruns[SNS_TYPE_ACCEL]),
+			atomic_read(&sensor->dropped[SNS_TYPE_ACCEL]));
+}
+
+static ssize_t mpu6050_accel_attr_get_period(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%llu\n",
+			mpu6050_poll_ns(sensor, SNS_TYPE_ACCEL));
+}
+
+static ssize_t mpu6050_accel_attr_set_period(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	u64 period_ns;
+	int ret;
+
+	if (kstrtoull(buf, 10, &period_ns))
+		return -EINVAL;
+
+	mutex_lock(&sensor->op_lock);
+	ret = mpu6050_set_poll_period(sensor, SNS_TYPE_ACCEL, period_ns);
+	mutex_unlock(&sensor->op_lock);
+
+	return ret ? ret : count;
+}
+
+static ssize_t mpu6050_accel_attr_get_jitter(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%u\n",
+			sensor->ts_jitter_ns[SNS_TYPE_ACCEL]);
+}
+
+static ssize_t mpu6050_accel_attr_set_jitter(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	unsigned int jitter;
+
+	if (kstrtouint(buf, 10, &jitter) || (jitter > NSEC_PER_SEC))
+		return -EINVAL;
+
+	WRITE_ONCE(sensor->ts_jitter_ns[SNS_TYPE_ACCEL], jitter);
+	return count;
+}
+
+static ssize_t mpu6050_accel_attr_get_skew(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%lld %lld\n",
+			sensor->ts_skew_ns[SNS_TYPE_ACCEL],
+			sensor->ts_skew_max_ns[SNS_TYPE_ACCEL]);
+}
+
+static ssize_t mpu6050_accel_attr_get_motion(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%d %d %u\n", sensor->motion_det_en,
+			sensor->mot.parked, sensor->mot.events);
+}
+
+/* Park the streams while the device lies still, resume them on motion. */
+static ssize_t mpu6050_accel_attr_set_motion(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	bool en;
+
+	if (strtobool(buf, &en))
+		return -EINVAL;
+
+	mutex_lock(&sensor->op_lock);
+	WRITE_ONCE(sensor->motion_det_en, en);
+	sensor->mot.still_since_ns = 0;
+	if (!en)
+		mpu6050_motion_resume(sensor, false);
+	mutex_unlock(&sensor->op_lock);
+	return count;
+}
+
+static ssize_t mpu6050_accel_attr_get_motion_thr(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%u %u\n", sensor->mot.thr,
+			sensor->mot.dur);
+}
+
+/*
+ * "<thr> <dur>" in MOT_THR and MOT_DUR units, 2 mg and 1 ms. The same
+ * threshold tells the driver the device is still.
+ */
+static ssize_t mpu6050_accel_attr_set_motion_thr(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct mpu_reg_map *reg = &sensor->reg;
+	u8 thr, dur;
+	int ret;
+
+	if (sscanf(buf, "%hhu %hhu", &thr, &dur) != 2)
+		return -EINVAL;
+
+	mutex_lock(&sensor->op_lock);
+	ret = regmap_write(sensor->regmap, reg->mot_thr, thr);
+	if (!ret)
+		ret = regmap_write(sensor->regmap, reg->mot_dur, dur);
+	if (!ret) {
+		WRITE_ONCE(sensor->mot.thr, thr);
+		sensor->mot.dur = dur;
+	}
+	mutex_unlock(&sensor->op_lock);
+	return ret ? ret : count;
+}
+
+static ssize_t mpu6050_accel_attr_get_still(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%u\n", sensor->mot.still_ms);
+}
+
+static ssize_t mpu6050_accel_attr_set_still(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	unsigned int ms;
+
+	if (kstrtouint(buf, 10, &ms) || !ms)
+		return -EINVAL;
+
+	WRITE_ONCE(sensor->mot.still_ms, ms);
+	return count;
+}
+
+static struct device_attribute accel_attr[] = {
+	__ATTR(valueX, S_IRUGO | S_IWUSR,
+		mpu6050_accel_attr_get_x,
+		mpu6050_accel_attr_set_x),
+	__ATTR(valueY, S_IRUGO | S_IWUSR,
+		mpu6050_accel_attr_get_y,
+		mpu6050_accel_attr_set_y),
+	__ATTR(valueZ, S_IRUGO | S_IWUSR,
+		mpu6050_accel_attr_get_z,
+		mpu6050_accel_attr_set_z),
+	__ATTR(place, S_IRUSR,
+		mpu6050_get_place,
+		NULL),
+	__ATTR(overruns, S_IRUGO,
+		mpu6050_accel_attr_get_overruns,
+		NULL),
+	__ATTR(poll_period_ns, S_IRUGO | S_IWUSR,
+		mpu6050_accel_attr_get_period,
+		mpu6050_accel_attr_set_period),
+	__ATTR(ts_jitter_ns, S_IRUGO | S_IWUSR,
+		mpu6050_accel_attr_get_jitter,
+		mpu6050_accel_attr_set_jitter),
+	__ATTR(ts_skew_ns, S_IRUGO,
+		mpu6050_accel_attr_get_skew,
+		NULL),
+	__ATTR(cal_matrix, S_IRUGO | S_IWUSR,
+		mpu6050_accel_attr_get_matrix,
+		mpu6050_accel_attr_set_matrix),
+	__ATTR(motion_detect, S_IRUGO | S_IWUSR,
+		mpu6050_accel_attr_get_motion,
+		mpu6050_accel_attr_set_motion),
+	__ATTR(motion_thr, S_IRUGO | S_IWUSR,
+		mpu6050_accel_attr_get_motion_thr,
+		mpu6050_accel_attr_set_motion_thr),
+	__ATTR(motion_still_ms, S_IRUGO | S_IWUSR,
+		mpu6050_accel_attr_get_still,
+		mpu6050_accel_attr_set_still),
+};
+
+static int create_accel_sysfs_interfaces(struct device *dev)
+{
+	int i;
+	int err;
+	for (i = 0; i < ARRAY_SIZE(accel_attr); i++) {
+		err = device_create_file(dev, accel_attr + i);
+		if (err)
+			goto error;
+	}
+	return 0;
+
+error:
+	for (; i >= 0; i--)
+		device_remove_file(dev, accel_attr + i);
+	dev_err(dev, "Unable to create interface\n");
+	return err;
+}
+
+static int remove_accel_sysfs_interfaces(struct device *dev)
+{
+	int i;
+	for (i = 0; i < ARRAY_SIZE(accel_attr); i++)
+		device_remove_file(dev, accel_attr + i);
+	return 0;
+}
+
+static ssize_t mpu6050_axes_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct axis_data axis;
+
+	mpu6050_read_axis(sensor, &axis);
+	return snprintf(buf, PAGE_SIZE, "%d %d %d %d %d %d\n",
+			axis.x, axis.y, axis.z, axis.rx, axis.ry, axis.rz);
+}
+
+/*
+ * Set all six axes at once from "x y z rx ry rz". The frame is validated
+ * as a whole and published in a single seqlock write section, so the poll
+ * threads never see a partially updated frame.
+ */
+static ssize_t mpu6050_axes_store(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	char tmp[64], *str, *tok;
+	s16 val[6];
+	int i;
+
+	if (count >= sizeof(tmp))
+		return -EINVAL;
+	memcpy(tmp, buf, count);
+	tmp[count] = '\0';
+
+	str = strim(tmp);
+	for (i = 0; i < ARRAY_SIZE(val); i++) {
+		tok = strsep(&str, " \t");
+		if (!tok || kstrtos16(tok, 10, &val[i]))
+			return -EINVAL;
+		if (str)
+			str = skip_spaces(str);
+	}
+	if (str && *str)
+		return -EINVAL;
+
+	write_seqlock(&sensor->axis_lock);
+	sensor->axis.x = val[0];
+	sensor->axis.y = val[1];
+	sensor->axis.z = val[2];
+	sensor->axis.rx = val[3];
+	sensor->axis.ry = val[4];
+	sensor->axis.rz = val[5];
+	sensor->phys_valid[SNS_TYPE_ACCEL] = false;
+	sensor->phys_valid[SNS_TYPE_GYRO] = false;
+	write_sequnlock(&sensor->axis_lock);
+	mpu6050_stat_add(sensor, SNS_TYPE_ACCEL, MPU6050_STAT_INJECTED, 1);
+	mpu6050_stat_add(sensor, SNS_TYPE_GYRO, MPU6050_STAT_INJECTED, 1);
+	return count;
+}
 
-		data &= ~BIT_SLEEP;
+static DEVICE_ATTR(axes, S_IRUGO | S_IWUSR,
+		mpu6050_axes_show, mpu6050_axes_store);
 
-		sensor->cfg.enable = 1;
-	} else {
-		if (work_pending(&sensor->resume_work))
-			cancel_work_sync(&sensor->resume_work);
-		ret = mpu6050_switch_engine(sensor, false,
-			BIT_PWR_GYRO_STBY_MASK);
-		if (ret)
-			return ret;
-		sensor->cfg.gyro_enable = 0;
-		if (!sensor->cfg.accel_enable) {
-			data |=  BIT_SLEEP;
-			sensor->cfg.enable = 0;
-		}
+static ssize_t mpu6050_waveform_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct mpu6050_gen *gen = &sensor->gen;
+	struct mpu6050_wave wave[MPU6050_GEN_AXES];
+	unsigned int seq;
+	ssize_t len = 0;
+	int i;
+
+	do {
+		seq = read_seqbegin(&gen->lock);
+		memcpy(wave, gen->wave, sizeof(wave));
+	} while (read_seqretry(&gen->lock, seq));
+
+	for (i = 0; i < MPU6050_GEN_AXES; i++)
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				"%s %s %d %d %u %u\n",
+				mpu6050_gen_axis_name[i],
+				mpu6050_wave_name[wave[i].type],
+				wave[i].amplitude, wave[i].offset,
+				wave[i].freq_mhz, wave[i].noise);
+	return len;
+}
+
+/*
+ * Configure the waveform of one axis with
+ * "<axis> <type> [amplitude] [offset] [freq_mhz] [noise]", for example
+ * "z sine 4096 16384 2000 50". Type "off" hands the axis back to the
+ * injected values. Every write restarts the waveform of the axis.
+ */
+static ssize_t mpu6050_waveform_store(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct mpu6050_gen *gen = &sensor->gen;
+	struct mpu6050_wave wave;
+	char name[4], type[8];
+	int amplitude = 0, offset = 0;
+	unsigned int freq_mhz = 0, noise = 0;
+	int axis, i;
+
+	if (sscanf(buf, "%3s %7s %d %d %u %u", name, type, &amplitude,
+			&offset, &freq_mhz, &noise) < 2)
+		return -EINVAL;
+
+	for (axis = 0; axis < MPU6050_GEN_AXES; axis++) {
+		if (!strcmp(name, mpu6050_gen_axis_name[axis]))
+			break;
 	}
-	return 0;
+	for (i = 0; i < ARRAY_SIZE(mpu6050_wave_name); i++) {
+		if (!strcmp(type, mpu6050_wave_name[i]))
+			break;
+	}
+	if ((axis == MPU6050_GEN_AXES) || (i == ARRAY_SIZE(mpu6050_wave_name)))
+		return -EINVAL;
+	if ((amplitude < S16_MIN) || (amplitude > S16_MAX) ||
+		(offset < S16_MIN) || (offset > S16_MAX) ||
+		(noise > S16_MAX) || (freq_mhz > MPU6050_GEN_MAX_FREQ_MHZ))
+		return -EINVAL;
+
+	wave.type = i;
+	wave.amplitude = amplitude;
+	wave.offset = offset;
+	wave.noise = noise;
+	wave.freq_mhz = freq_mhz;
+
+	write_seqlock(&gen->lock);
+	wave.seq = gen->wave[axis].seq + 1;
+	gen->wave[axis] = wave;
+	if (wave.type == MPU6050_WAVE_OFF)
+		clear_bit(axis, &gen->active);
+	else
+		set_bit(axis, &gen->active);
+	write_sequnlock(&gen->lock);
+
+	return count;
 }
 
-/**
- * mpu6050_restore_context() - update the sensor register context
+static DEVICE_ATTR(waveform, S_IRUGO | S_IWUSR,
+		mpu6050_waveform_show, mpu6050_waveform_store);
+
+/* Quantize mg or mdps to LSB, rounding to nearest and saturating. */
+static inline s16 mpu6050_phys_to_lsb(s32 val, u32 mult)
+{
+	s64 lsb = (s64)abs(val) * mult;
+
+	lsb = (lsb + (1 << (MPU6050_PHYS_SHIFT - 1))) >> MPU6050_PHYS_SHIFT;
+	if (val < 0)
+		lsb = -lsb;
+	return clamp_t(s64, lsb, S16_MIN, S16_MAX);
+}
+
+/*
+ * Requantize the physical injection of one sensor with the current full
+ * scale range. axis_lock must be write locked.
  */
+static void mpu6050_phys_apply(struct mpu6050_sensor *sensor, int sns_type)
+{
+	const s32 *phys = sensor->phys[sns_type];
+	u32 mult;
 
-static int mpu6050_restore_context(struct mpu6050_sensor *sensor)
+	if (!sensor->phys_valid[sns_type])
+		return;
+
+	if (sns_type == SNS_TYPE_ACCEL) {
+		mult = mpu6050_accel_phys_mult[sensor->cfg.accel_fs];
+		sensor->axis.x = mpu6050_phys_to_lsb(phys[0], mult);
+		sensor->axis.y = mpu6050_phys_to_lsb(phys[1], mult);
+		sensor->axis.z = mpu6050_phys_to_lsb(phys[2], mult);
+	} else {
+		mult = mpu6050_gyro_phys_mult[sensor->cfg.fsr];
+		sensor->axis.rx = mpu6050_phys_to_lsb(phys[0], mult);
+		sensor->axis.ry = mpu6050_phys_to_lsb(phys[1], mult);
+		sensor->axis.rz = mpu6050_phys_to_lsb(phys[2], mult);
+	}
+}
+
+static ssize_t mpu6050_axes_phys_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
 {
-	int ret;
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	s32 phys[SNS_TYPE_MAX][3];
+	unsigned int seq;
+
+	do {
+		seq = read_seqbegin(&sensor->axis_lock);
+		memcpy(phys, sensor->phys, sizeof(phys));
+	} while (read_seqretry(&sensor->axis_lock, seq));
+
+	return snprintf(buf, PAGE_SIZE, "%d %d %d %d %d %d\n",
+			phys[SNS_TYPE_ACCEL][0], phys[SNS_TYPE_ACCEL][1],
+			phys[SNS_TYPE_ACCEL][2], phys[SNS_TYPE_GYRO][0],
+			phys[SNS_TYPE_GYRO][1], phys[SNS_TYPE_GYRO][2]);
+}
 
-	ret = mpu6050_set_lpa_freq(sensor, sensor->cfg.lpa_freq);
-	if (ret < 0) {
-		printk("MPU6050 - set lpa_freq failed.\n");
-		goto exit;
+/*
+ * Set all six axes from physical units, "x y z rx ry rz" in mg and mdps.
+ * The values are quantized with the current full scale range and saturate
+ * like the real part. They are kept, so a later range change requantizes
+ * them until raw values are injected again.
+ */
+static ssize_t mpu6050_axes_phys_store(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	s32 val[6];
+	int i;
+
+	if (sscanf(buf, "%d %d %d %d %d %d", &val[0], &val[1], &val[2],
+			&val[3], &val[4], &val[5]) != 6)
+		return -EINVAL;
+	for (i = 0; i < ARRAY_SIZE(val); i++) {
+		if (abs(val[i]) > MPU6050_PHYS_MAX)
+			return -EINVAL;
 	}
 
-	printk("MPU6050 - restore context finished\n");
+	mutex_lock(&sensor->op_lock);
+	write_seqlock(&sensor->axis_lock);
+	memcpy(sensor->phys[SNS_TYPE_ACCEL], &val[0], 3 * sizeof(s32));
+	memcpy(sensor->phys[SNS_TYPE_GYRO], &val[3], 3 * sizeof(s32));
+	sensor->phys_valid[SNS_TYPE_ACCEL] = true;
+	sensor->phys_valid[SNS_TYPE_GYRO] = true;
+	mpu6050_phys_apply(sensor, SNS_TYPE_ACCEL);
+	mpu6050_phys_apply(sensor, SNS_TYPE_GYRO);
+	write_sequnlock(&sensor->axis_lock);
+	mutex_unlock(&sensor->op_lock);
 
-exit:
-	return ret;
+	mpu6050_stat_add(sensor, SNS_TYPE_ACCEL, MPU6050_STAT_INJECTED, 1);
+	mpu6050_stat_add(sensor, SNS_TYPE_GYRO, MPU6050_STAT_INJECTED, 1);
+	return count;
 }
 
-/**
- * mpu6050_reset_chip() - reset chip to default state
- */
-static void mpu6050_reset_chip(struct mpu6050_sensor *sensor)
+static DEVICE_ATTR(axes_phys, S_IRUGO | S_IWUSR,
+		mpu6050_axes_phys_show, mpu6050_axes_phys_store);
+
+static ssize_t mpu6050_accel_fsr_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
 {
-	int ret, i;
-	ret = 1;
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
 
-	for (i = 0; i < MPU6050_RESET_RETRY_CNT; i++) {
-		if ((ret & BIT_H_RESET) == 0) {
-			printk("MPU6050 - Chip reset success! i=%d\n", i);
+	return snprintf(buf, PAGE_SIZE, "%u\n",
+			mpu6050_accel_fsr_g[sensor->cfg.accel_fs]);
+}
+
+/* Select the accelerometer range in g: 2, 4, 8 or 16. */
+static ssize_t mpu6050_accel_fsr_store(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	unsigned int val;
+	int i, ret;
+
+	if (kstrtouint(buf, 10, &val))
+		return -EINVAL;
+	for (i = 0; i < NUM_ACCL_FSR; i++) {
+		if (mpu6050_accel_fsr_g[i] == val)
 			break;
-		}
+	}
+	if (i == NUM_ACCL_FSR)
+		return -EINVAL;
 
-		usleep(MPU6050_RESET_SLEEP_US);
+	mutex_lock(&sensor->op_lock);
+	ret = regmap_update_bits(sensor->regmap, sensor->reg.accel_config,
+			ACCL_CONFIG_FSR_MASK, i << ACCL_CONFIG_FSR_SHIFT);
+	if (ret) {
+		mutex_unlock(&sensor->op_lock);
+		return ret;
 	}
+	write_seqlock(&sensor->axis_lock);
+	sensor->cfg.accel_fs = i;
+	mpu6050_phys_apply(sensor, SNS_TYPE_ACCEL);
+	write_sequnlock(&sensor->axis_lock);
+	mutex_unlock(&sensor->op_lock);
+	return count;
+}
 
-	return;
+static DEVICE_ATTR(accel_fsr, S_IRUGO | S_IWUSR,
+		mpu6050_accel_fsr_show, mpu6050_accel_fsr_store);
+
+static ssize_t mpu6050_gyro_fsr_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%u\n",
+			mpu6050_gyro_fsr_dps[sensor->cfg.fsr]);
 }
 
-static int mpu6050_gyro_set_enable(struct mpu6050_sensor *sensor, bool enable)
+/* Select the gyroscope range in dps: 250, 500, 1000 or 2000. */
+static ssize_t mpu6050_gyro_fsr_store(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
 {
-	int ret = 0;
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	unsigned int val;
+	int i, ret;
+
+	if (kstrtouint(buf, 10, &val))
+		return -EINVAL;
+	for (i = 0; i < NUM_FSR; i++) {
+		if (mpu6050_gyro_fsr_dps[i] == val)
+			break;
+	}
+	if (i == NUM_FSR)
+		return -EINVAL;
 
-	printk("MPU6050 - mpu6050_gyro_set_enable enable=%d\n", enable);
 	mutex_lock(&sensor->op_lock);
-	if (enable) {
-		if (!sensor->power_enabled) {
-			ret = mpu6050_power_ctl(sensor, true);
-			if (ret < 0) {
-				printk("MPU6050 - Failed to power up mpu6050\n");
-				goto exit;
-			}
-			mpu6050_reset_chip(sensor);
-			ret = mpu6050_restore_context(sensor);
-			if (ret < 0) {
-				printk("MPU6050 - Failed to restore context\n");
-				goto exit;
-			}
-		}
+	ret = regmap_update_bits(sensor->regmap, sensor->reg.gyro_config,
+			GYRO_CONFIG_FSR_MASK, i << GYRO_CONFIG_FSR_SHIFT);
+	if (ret) {
+		mutex_unlock(&sensor->op_lock);
+		return ret;
+	}
+	write_seqlock(&sensor->axis_lock);
+	sensor->cfg.fsr = i;
+	mpu6050_phys_apply(sensor, SNS_TYPE_GYRO);
+	write_sequnlock(&sensor->axis_lock);
+	mutex_unlock(&sensor->op_lock);
+	return count;
+}
 
-		ret = mpu6050_gyro_enable(sensor, true);
-		if (ret) {
-			printk("MPU6050 - Fail to enable gyro engine ret=%d\n", ret);
-			ret = -EBUSY;
-			goto exit;
-		}
+static DEVICE_ATTR(gyro_fsr, S_IRUGO | S_IWUSR,
+		mpu6050_gyro_fsr_show, mpu6050_gyro_fsr_store);
 
-		ret = mpu6050_config_sample_rate(sensor);
-		if (ret < 0)
-			printk("MPU6050 - Unable to update sampling rate! ret=%d\n",
-				ret);
+/*
+ * Inject an array of struct mpu6050_trace_frame in one write, the timestamp
+ * is ignored. Each enabled sensor consumes one frame per sampling tick, a
+ * disabled sensor just takes the values of the last frame. The write is
+ * all or nothing: it fails with -ENOSPC if a queue cannot take every frame.
+ * A write is limited to MPU6050_INJECT_MAX_FRAMES frames.
+ */
+static ssize_t mpu6050_inject_write(struct file *filp, struct kobject *kobj,
+			struct bin_attribute *attr, char *buf,
+			loff_t pos, size_t count)
+{
+	struct device *dev = container_of(kobj, struct device, kobj);
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	const struct mpu6050_trace_frame *frame;
+	struct mpu6050_inject_sample sample;
+	bool queue[SNS_TYPE_MAX];
+	u32 i, nr, type;
+	ssize_t ret = count;
+
+	nr = count / MPU6050_TRACE_FRAME_SIZE;
+	if (!nr || (count % MPU6050_TRACE_FRAME_SIZE))
+		return -EINVAL;
+
+	frame = (const struct mpu6050_trace_frame *)buf;
+	for (i = 0; i < nr; i++) {
+		if (frame[i].reserved)
+			return -EINVAL;
+	}
 
-		if (!sensor->batch_gyro)
-		{
-			ktime_t ktime;
-			ktime = ktime_set(0,
-					sensor->gyro_poll_ms * NSEC_PER_MSEC);
-			hrtimer_start(&sensor->gyro_timer, ktime,
-					HRTIMER_MODE_REL);
+	mutex_lock(&sensor->op_lock);
+	for (type = 0; type < SNS_TYPE_MAX; type++) {
+		queue[type] = mpu6050_sensor_enabled(sensor, type);
+		if (queue[type] && (kfifo_avail(&sensor->inject[type]) < nr)) {
+			ret = -ENOSPC;
+			goto exit;
 		}
-		atomic_set(&sensor->gyro_en, 1);
-	} else {
-		atomic_set(&sensor->gyro_en, 0);
-		if (!sensor->batch_gyro)
-		{
-			ret = hrtimer_try_to_cancel(&sensor->gyro_timer);
+	}
+
+	for (i = 0; i < nr; i++) {
+		if (queue[SNS_TYPE_ACCEL]) {
+			sample.data[0] = frame[i].x;
+			sample.data[1] = frame[i].y;
+			sample.data[2] = frame[i].z;
+			kfifo_put(&sensor->inject[SNS_TYPE_ACCEL], sample);
 		}
-		ret = mpu6050_gyro_enable(sensor, false);
-		if (ret) {
-			printk("MPU6050 - Fail to disable gyro engine ret=%d\n", ret);
-			ret = -EBUSY;
-			goto exit;
+		if (queue[SNS_TYPE_GYRO]) {
+			sample.data[0] = frame[i].rx;
+			sample.data[1] = frame[i].ry;
+			sample.data[2] = frame[i].rz;
+			kfifo_put(&sensor->inject[SNS_TYPE_GYRO], sample);
 		}
-		if (!sensor->cfg.accel_enable && !sensor->cfg.gyro_enable)
-			mpu6050_power_ctl(sensor, false);
 	}
 
+	frame += nr - 1;
+	write_seqlock(&sensor->axis_lock);
+	sensor->phys_valid[SNS_TYPE_ACCEL] = false;
+	sensor->phys_valid[SNS_TYPE_GYRO] = false;
+	if (!queue[SNS_TYPE_ACCEL]) {
+		sensor->axis.x = frame->x;
+		sensor->axis.y = frame->y;
+		sensor->axis.z = frame->z;
+	}
+	if (!queue[SNS_TYPE_GYRO]) {
+		sensor->axis.rx = frame->rx;
+		sensor->axis.ry = frame->ry;
+		sensor->axis.rz = frame->rz;
+	}
+	write_sequnlock(&sensor->axis_lock);
+	mpu6050_stat_add(sensor, SNS_TYPE_ACCEL, MPU6050_STAT_INJECTED, nr);
+	mpu6050_stat_add(sensor, SNS_TYPE_GYRO, MPU6050_STAT_INJECTED, nr);
+
 exit:
 	mutex_unlock(&sensor->op_lock);
 	return ret;
 }
 
-/* Update sensor sample rate divider upon accel and gyro polling rate. */
-static int mpu6050_config_sample_rate(struct mpu6050_sensor *sensor)
-{
-	u32 delay_ms;
-	u8 div;
-	printk("MPU6050 - sample rate\n");
-	if (sensor->cfg.is_asleep)
-		return -EINVAL;
+/* size 0, writes are bounded by the PAGE_SIZE chunks of sysfs instead */
+static struct bin_attribute mpu6050_inject_attr = {
+	.attr = {
+		.name = "inject",
+		.mode = S_IWUSR,
+	},
+	.size = 0,
+	.write = mpu6050_inject_write,
+};
 
-	if (sensor->accel_poll_ms <= sensor->gyro_poll_ms)
-		delay_ms = sensor->accel_poll_ms;
-	else
-		delay_ms = sensor->gyro_poll_ms;
+static struct device_attribute *inject_attr[] = {
+	&dev_attr_axes,
+	&dev_attr_waveform,
+	&dev_attr_axes_phys,
+	&dev_attr_accel_fsr,
+	&dev_attr_gyro_fsr,
+};
 
-	/* Sample_rate = internal_ODR/(1+SMPLRT_DIV) */
-	if ((sensor->cfg.lpf != MPU_DLPF_256HZ_NOLPF2) &&
-		(sensor->cfg.lpf != MPU_DLPF_RESERVED)) {
-		if (delay_ms > DELAY_MS_MAX_DLPF)
-			delay_ms = DELAY_MS_MAX_DLPF;
-		if (delay_ms < DELAY_MS_MIN_DLPF)
-			delay_ms = DELAY_MS_MIN_DLPF;
+static int create_inject_sysfs_interfaces(struct device *dev)
+{
+	int i;
+	int err;
 
-		div = (u8)(((ODR_DLPF_ENA * delay_ms) / MSEC_PER_SEC) - 1);
-	} else {
-		if (delay_ms > DELAY_MS_MAX_NODLPF)
-			delay_ms = DELAY_MS_MAX_NODLPF;
-		if (delay_ms < DELAY_MS_MIN_NODLPF)
-			delay_ms = DELAY_MS_MIN_NODLPF;
-		div = (u8)(((ODR_DLPF_DIS * delay_ms) / MSEC_PER_SEC) - 1);
+	err = sysfs_create_bin_file(&dev->kobj, &mpu6050_inject_attr);
+	if (err)
+		goto error;
+	for (i = 0; i < ARRAY_SIZE(inject_attr); i++) {
+		err = device_create_file(dev, inject_attr[i]);
+		if (err)
+			goto err_remove_files;
 	}
+	return 0;
 
-	if (sensor->cfg.rate_div == div)
-		return 0;
-	sensor->cfg.rate_div = div;
+err_remove_files:
+	for (; i >= 0; i--)
+		device_remove_file(dev, inject_attr[i]);
+	sysfs_remove_bin_file(&dev->kobj, &mpu6050_inject_attr);
+error:
+	dev_err(dev, "Unable to create inject interface\n");
+	return err;
+}
 
-	return 0;
+static void remove_inject_sysfs_interfaces(struct device *dev)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(inject_attr); i++)
+		device_remove_file(dev, inject_attr[i]);
+	sysfs_remove_bin_file(&dev->kobj, &mpu6050_inject_attr);
 }
 
-/*
- * Calculate sample interval according to sample rate.
- * Return sample interval in millisecond.
- */
-static inline u64 mpu6050_get_sample_interval(struct mpu6050_sensor *sensor)
+static ssize_t mpu6050_trace_write(struct file *filp, struct kobject *kobj,
+			struct bin_attribute *attr, char *buf,
+			loff_t pos, size_t count)
 {
-	u64 interval_ns;
-	printk("MPU6050 - get sample interval\n");
-	if ((sensor->cfg.lpf == MPU_DLPF_256HZ_NOLPF2) ||
-		(sensor->cfg.lpf == MPU_DLPF_RESERVED)) {
-		interval_ns = (sensor->cfg.rate_div + 1) * NSEC_PER_MSEC;
-		interval_ns /= 8;
-	} else {
-		interval_ns = (sensor->cfg.rate_div + 1) * NSEC_PER_MSEC;
+	struct device *dev = container_of(kobj, struct device, kobj);
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct mpu6050_trace *trace = &sensor->trace;
+	ssize_t ret = count;
+	struct mpu6050_trace_frame *frames;
+	u32 end, max;
+
+	if ((pos % MPU6050_TRACE_FRAME_SIZE) ||
+		(count % MPU6050_TRACE_FRAME_SIZE))
+		return -EINVAL;
+
+	mutex_lock(&sensor->trace_lock);
+	if (trace->mode != MPU6050_REPLAY_OFF) {
+		ret = -EBUSY;
+		goto exit;
 	}
 
-	return interval_ns;
+	/* no sampler reads the frames while the replay is off */
+	end = (pos + count) / MPU6050_TRACE_FRAME_SIZE;
+	if (end > trace->max_frames) {
+		max = max_t(u32, roundup_pow_of_two(end),
+				MPU6050_TRACE_MIN_FRAMES);
+		max = min_t(u32, max, MPU6050_TRACE_MAX_FRAMES);
+		frames = vzalloc(max * MPU6050_TRACE_FRAME_SIZE);
+		if (!frames) {
+			ret = -ENOMEM;
+			goto exit;
+		}
+		if (trace->frames)
+			memcpy(frames, trace->frames,
+				trace->max_frames * MPU6050_TRACE_FRAME_SIZE);
+		vfree(trace->frames);
+		trace->frames = frames;
+		trace->max_frames = max;
+	}
+
+	/* a write at offset 0 starts a new trace */
+	if (pos == 0)
+		trace->nr_frames = 0;
+
+	memcpy((char *)trace->frames + pos, buf, count);
+	if (end > trace->nr_frames)
+		trace->nr_frames = end;
+
+exit:
+	mutex_unlock(&sensor->trace_lock);
+	return ret;
+}
+
+static struct bin_attribute mpu6050_trace_attr = {
+	.attr = {
+		.name = "trace",
+		.mode = S_IWUSR,
+	},
+	.size = MPU6050_TRACE_MAX_FRAMES * MPU6050_TRACE_FRAME_SIZE,
+	.write = mpu6050_trace_write,
+};
+
+static ssize_t mpu6050_replay_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct mpu6050_trace *trace = &sensor->trace;
+
+	return snprintf(buf, PAGE_SIZE, "mode=%d frames=%u accel=%u gyro=%u\n",
+			trace->mode, trace->nr_frames,
+			trace->pos[SNS_TYPE_ACCEL], trace->pos[SNS_TYPE_GYRO]);
 }
 
-static int mpu6050_gyro_set_poll_delay(struct mpu6050_sensor *sensor,
-					unsigned long delay)
+static ssize_t mpu6050_replay_store(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
 {
-	int ret = 0;
-	printk("MPU6050 - mpu6050_gyro_set_poll_delay delay=%ld\n", delay);
-	if (delay < MPU6050_GYRO_MIN_POLL_INTERVAL_MS)
-		delay = MPU6050_GYRO_MIN_POLL_INTERVAL_MS;
-	if (delay > MPU6050_GYRO_MAX_POLL_INTERVAL_MS)
-		delay = MPU6050_GYRO_MAX_POLL_INTERVAL_MS;
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct mpu6050_trace *trace = &sensor->trace;
+	unsigned long mode;
+	int ret = count;
 
-	mutex_lock(&sensor->op_lock);
-	if (sensor->gyro_poll_ms == delay)
-		goto exit;
+	if (kstrtoul(buf, 10, &mode) || (mode > MPU6050_REPLAY_LOOP))
+		return -EINVAL;
 
-	sensor->gyro_delay_change = true;
-	sensor->gyro_poll_ms = delay;
+	mutex_lock(&sensor->trace_lock);
+	if (mode == MPU6050_REPLAY_OFF) {
+		smp_store_release(&trace->mode, MPU6050_REPLAY_OFF);
+		/* samplers past the mode check still read the frames */
+		synchronize_rcu();
+		goto exit;
+	}
 
-	if (!atomic_read(&sensor->gyro_en))
+	if (!trace->nr_frames) {
+		ret = -ENODATA;
 		goto exit;
+	}
+
+	/* restart from the first frame, publish cursors before the mode */
+	trace->pos[SNS_TYPE_ACCEL] = 0;
+	trace->pos[SNS_TYPE_GYRO] = 0;
+	smp_store_release(&trace->mode, (enum mpu6050_replay_mode)mode);
 
 exit:
-	mutex_unlock(&sensor->op_lock);
+	mutex_unlock(&sensor->trace_lock);
 	return ret;
 }
 
-static int mpu6050_gyro_cdev_enable(struct sensors_classdev *sensors_cdev,
-			unsigned int enable)
+static DEVICE_ATTR(replay, S_IRUGO | S_IWUSR,
+		mpu6050_replay_show, mpu6050_replay_store);
+
+static int create_trace_sysfs_interfaces(struct device *dev)
 {
-	struct mpu6050_sensor *sensor = container_of(sensors_cdev,
-			struct mpu6050_sensor, gyro_cdev);
-	return mpu6050_gyro_set_enable(sensor, enable);
+	int err;
+
+	err = sysfs_create_bin_file(&dev->kobj, &mpu6050_trace_attr);
+	if (err)
+		goto error;
+	err = device_create_file(dev, &dev_attr_replay);
+	if (err) {
+		sysfs_remove_bin_file(&dev->kobj, &mpu6050_trace_attr);
+		goto error;
+	}
+	return 0;
+
+error:
+	dev_err(dev, "Unable to create trace interface\n");
+	return err;
 }
 
-static int mpu6050_gyro_cdev_poll_delay(struct sensors_classdev *sensors_cdev,
-			unsigned int delay_ms)
+static void remove_trace_sysfs_interfaces(struct device *dev)
 {
-	struct mpu6050_sensor *sensor = container_of(sensors_cdev,
-			struct mpu6050_sensor, gyro_cdev);
-	return mpu6050_gyro_set_poll_delay(sensor, delay_ms);
+	device_remove_file(dev, &dev_attr_replay);
+	sysfs_remove_bin_file(&dev->kobj, &mpu6050_trace_attr);
 }
 
-static ssize_t mpu6050_get_place(struct device *dev,
-			struct device_attribute *attr, char *buf)
+static void mpu6050_ring_free(struct kref *ref)
 {
-	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct mpu6050_ring *ring = container_of(ref, struct mpu6050_ring, ref);
 
-	return snprintf(buf, 30, "%s\n", mpu6050_place_name2num[sensor->pdata->place].name);
+	vfree(ring->hdr);
+	kfree(ring);
 }
 
-static ssize_t mpu6050_gyro_attr_get_rx(struct device *dev,
-			struct device_attribute *attr, char *buf)
+static int mpu6050_ring_open(struct inode *inode, struct file *file)
 {
-	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct mpu6050_ring *ring = container_of(file->private_data,
+				struct mpu6050_ring, misc);
+
+	kref_get(&ring->ref);
+	atomic_inc(&ring->users);
+	file->private_data = ring;
 
-	return snprintf(buf, 4, "%d\n", sensor->axis.rx);
+	return nonseekable_open(inode, file);
 }
 
-static ssize_t mpu6050_gyro_attr_set_rx(struct device *dev,
-			struct device_attribute *attr,
-			const char *buf, size_t count)
+static int mpu6050_ring_release(struct inode *inode, struct file *file)
 {
-	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
-	unsigned long enable;
-	int ret;
+	struct mpu6050_ring *ring = file->private_data;
 
-	if (kstrtoul(buf, 10, &enable))
-		return -EINVAL;
+	atomic_dec(&ring->users);
+	kref_put(&ring->ref, mpu6050_ring_free);
 
-	sensor->axis.rx = enable;
-	return ret ? -EBUSY : count;
+	return 0;
 }
 
-static ssize_t mpu6050_gyro_attr_get_ry(struct device *dev,
-			struct device_attribute *attr, char *buf)
+static int mpu6050_ring_mmap(struct file *file, struct vm_area_struct *vma)
 {
-	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct mpu6050_ring *ring = file->private_data;
 
-	return snprintf(buf, 4, "%d\n", sensor->axis.ry);
+	return remap_vmalloc_range(vma, ring->hdr, vma->vm_pgoff);
 }
 
-static ssize_t mpu6050_gyro_attr_set_ry(struct device *dev,
-			struct device_attribute *attr,
-			const char *buf, size_t count)
+static unsigned int mpu6050_ring_poll(struct file *file, poll_table *wait)
 {
-	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
-	unsigned long enable;
-	int ret;
+	struct mpu6050_ring *ring = file->private_data;
 
-	if (kstrtoul(buf, 10, &enable))
-		return -EINVAL;
+	poll_wait(file, &ring->wq, wait);
 
-	sensor->axis.ry = enable;
-	return ret ? -EBUSY : count;
+	return mpu6050_ring_ready(ring) ? (POLLIN | POLLRDNORM) : 0;
 }
 
-static ssize_t mpu6050_gyro_attr_get_rz(struct device *dev,
-			struct device_attribute *attr, char *buf)
+static const struct file_operations mpu6050_ring_fops = {
+	.owner		= THIS_MODULE,
+	.open		= mpu6050_ring_open,
+	.release	= mpu6050_ring_release,
+	.mmap		= mpu6050_ring_mmap,
+	.poll		= mpu6050_ring_poll,
+	.llseek		= no_llseek,
+};
+
+/*
+ * Create the /dev/fake6050 ring. Consumers mmap it, set a watermark and
+ * poll() for a batch of frames instead of reading evdev event by event.
+ */
+static int mpu6050_ring_init(struct mpu6050_sensor *sensor)
 {
-	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct mpu6050_ring *ring;
+	struct mpu6050_ring_header *hdr;
+	int ret;
+
+	BUILD_BUG_ON(sizeof(struct mpu6050_ring_header) > PAGE_SIZE);
+	BUILD_BUG_ON(!is_power_of_2(MPU6050_RING_FRAMES));
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (!ring)
+		return -ENOMEM;
+
+	ring->nr_frames = MPU6050_RING_FRAMES;
+	ring->size = PAGE_ALIGN(PAGE_SIZE + ring->nr_frames *
+				sizeof(struct mpu6050_ring_frame));
+	hdr = vmalloc_user(ring->size);
+	if (!hdr) {
+		ret = -ENOMEM;
+		goto err_free_ring;
+	}
+	hdr->magic = MPU6050_RING_MAGIC;
+	hdr->version = MPU6050_RING_VERSION;
+	hdr->data_offset = PAGE_SIZE;
+	hdr->nr_frames = ring->nr_frames;
+	hdr->frame_size = sizeof(struct mpu6050_ring_frame);
+	ring->hdr = hdr;
+	ring->frames = (void *)hdr + PAGE_SIZE;
+
+	kref_init(&ring->ref);
+	spin_lock_init(&ring->lock);
+	atomic_set(&ring->users, 0);
+	init_waitqueue_head(&ring->wq);
+
+	ring->misc.minor = MISC_DYNAMIC_MINOR;
+	ring->misc.name = sensor->name;
+	ring->misc.fops = &mpu6050_ring_fops;
+	ring->misc.parent = sensor->dev;
+	ret = misc_register(&ring->misc);
+	if (ret) {
+		printk("MPU6050 - Failed to register ring device\n");
+		goto err_free_hdr;
+	}
+
+	sensor->ring = ring;
+	return 0;
 
-	return snprintf(buf, 4, "%d\n", sensor->axis.rz);
+err_free_hdr:
+	vfree(hdr);
+err_free_ring:
+	kfree(ring);
+	return ret;
 }
 
-static ssize_t mpu6050_gyro_attr_set_rz(struct device *dev,
-			struct device_attribute *attr,
-			const char *buf, size_t count)
+/* Open files keep the ring alive until they are released. */
+static void mpu6050_ring_exit(struct mpu6050_sensor *sensor)
 {
-	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
-	unsigned long enable;
-	int ret;
-
-	if (kstrtoul(buf, 10, &enable))
-		return -EINVAL;
+	misc_deregister(&sensor->ring->misc);
+	kref_put(&sensor->ring->ref, mpu6050_ring_free);
+}
 
-	sensor->axis.rz = enable;
-	return ret ? -EBUSY : count;
+#ifdef CONFIG_SENSORS_FAKE6050_IIO
+#define MPU6050_IIO_CHANNEL(_type, _mod, _index) {			\
+	.type = _type,							\
+	.modified = 1,							\
+	.channel2 = _mod,						\
+	.info_mask_separate = BIT(IIO_CHAN_INFO_RAW),			\
+	.info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SAMP_FREQ),	\
+	.scan_index = _index,						\
+	.scan_type = {							\
+		.sign = 's',						\
+		.realbits = 16,						\
+		.storagebits = 16,					\
+		.endianness = IIO_CPU,					\
+	},								\
 }
 
-static struct device_attribute gyro_attr[] = {
-	__ATTR(valueX, S_IRUGO | S_IWUSR,
-		mpu6050_gyro_attr_get_rx,
-		mpu6050_gyro_attr_set_rx),
-	__ATTR(valueY, S_IRUGO | S_IWUSR,
-		mpu6050_gyro_attr_get_ry,
-		mpu6050_gyro_attr_set_ry),
-	__ATTR(valueZ, S_IRUGO | S_IWUSR,
-		mpu6050_gyro_attr_get_rz,
-		mpu6050_gyro_attr_set_rz),
-	__ATTR(place, S_IRUSR,
-		mpu6050_get_place,
-		NULL),
+/* scan index order matches axis_data and mpu6050_sensor.iio_last */
+static const struct iio_chan_spec mpu6050_iio_channels[] = {
+	MPU6050_IIO_CHANNEL(IIO_ACCEL, IIO_MOD_X, 0),
+	MPU6050_IIO_CHANNEL(IIO_ACCEL, IIO_MOD_Y, 1),
+	MPU6050_IIO_CHANNEL(IIO_ACCEL, IIO_MOD_Z, 2),
+	MPU6050_IIO_CHANNEL(IIO_ANGL_VEL, IIO_MOD_X, 3),
+	MPU6050_IIO_CHANNEL(IIO_ANGL_VEL, IIO_MOD_Y, 4),
+	MPU6050_IIO_CHANNEL(IIO_ANGL_VEL, IIO_MOD_Z, 5),
+	IIO_CHAN_SOFT_TIMESTAMP(6),
 };
 
-static int create_gyro_sysfs_interfaces(struct device *dev)
+#define MPU6050_IIO_ACCEL_MASK	0x07
+#define MPU6050_IIO_GYRO_MASK	0x38
+
+static inline struct mpu6050_sensor *mpu6050_iio_sensor(
+				struct iio_dev *indio_dev)
 {
-	int i;
-	int err;
-	for (i = 0; i < ARRAY_SIZE(gyro_attr); i++) {
-		err = device_create_file(dev, gyro_attr + i);
-		if (err)
-			goto error;
-	}
-	return 0;
+	return *(struct mpu6050_sensor **)iio_priv(indio_dev);
+}
 
-error:
-	for (; i >= 0; i--)
-		device_remove_file(dev, gyro_attr + i);
-	dev_err(dev, "Unable to create interface\n");
-	return err;
+/* Push one scan, timestamped on the sample clock (CLOCK_BOOTTIME). */
+static irqreturn_t mpu6050_iio_trigger_handler(int irq, void *p)
+{
+	struct iio_poll_func *pf = p;
+	struct iio_dev *indio_dev = pf->indio_dev;
+	struct mpu6050_sensor *sensor = mpu6050_iio_sensor(indio_dev);
+	struct {
+		s16 data[6];
+		s64 timestamp __aligned(8);
+	} scan;
+	s16 last[6];
+	s64 ts;
+	int bit, i = 0;
+
+	spin_lock(&sensor->iio_lock);
+	memcpy(last, sensor->iio_last, sizeof(last));
+	ts = sensor->iio_ts;
+	spin_unlock(&sensor->iio_lock);
+
+	/* unused slots and the padding before the timestamp reach userspace */
+	memset(&scan, 0, sizeof(scan));
+	for_each_set_bit(bit, indio_dev->active_scan_mask, ARRAY_SIZE(last))
+		scan.data[i++] = last[bit];
+	iio_push_to_buffers_with_timestamp(indio_dev, &scan, ts);
+
+	iio_trigger_notify_done(indio_dev->trig);
+	return IRQ_HANDLED;
 }
 
-static int remove_gyro_sysfs_interfaces(struct device *dev)
+static int mpu6050_iio_read_raw(struct iio_dev *indio_dev,
+			struct iio_chan_spec const *chan,
+			int *val, int *val2, long mask)
 {
-	int i;
-	for (i = 0; i < ARRAY_SIZE(gyro_attr); i++)
-		device_remove_file(dev, gyro_attr + i);
-	return 0;
+	struct mpu6050_sensor *sensor = mpu6050_iio_sensor(indio_dev);
+	int type = (chan->type == IIO_ACCEL) ? SNS_TYPE_ACCEL : SNS_TYPE_GYRO;
+	struct axis_data axis;
+	s16 raw[3], out[3];
+	u64 micro_hz;
+	u32 rem;
+
+	switch (mask) {
+	case IIO_CHAN_INFO_RAW:
+		mpu6050_read_axis(sensor, &axis);
+		mpu6050_axis_raw(&axis, type, raw);
+		mpu6050_remap(&sensor->remap[type], raw, out);
+		*val = out[chan->scan_index % 3];
+		return IIO_VAL_INT;
+	case IIO_CHAN_INFO_SAMP_FREQ:
+		micro_hz = div64_u64(NSEC_PER_SEC * 1000000ULL,
+				READ_ONCE(sensor->req_ns[type]));
+		*val = div_u64_rem(micro_hz, 1000000, &rem);
+		*val2 = rem;
+		return IIO_VAL_INT_PLUS_MICRO;
+	default:
+		return -EINVAL;
+	}
 }
 
-static int mpu6050_accel_enable(struct mpu6050_sensor *sensor, bool on)
+static int mpu6050_iio_write_raw(struct iio_dev *indio_dev,
+			struct iio_chan_spec const *chan,
+			int val, int val2, long mask)
 {
+	struct mpu6050_sensor *sensor = mpu6050_iio_sensor(indio_dev);
+	int type = (chan->type == IIO_ACCEL) ? SNS_TYPE_ACCEL : SNS_TYPE_GYRO;
+	s64 micro_hz = (s64)val * 1000000 + val2;
 	int ret;
-	u8 data;
 
-	ret = 0;
-	if (sensor->cfg.is_asleep)
+	if (mask != IIO_CHAN_INFO_SAMP_FREQ)
+		return -EINVAL;
+	if (micro_hz <= 0)
 		return -EINVAL;
 
-	data = (u8)ret;
-	if (on) {
-		ret = mpu6050_switch_engine(sensor, true,
-			BIT_PWR_ACCEL_STBY_MASK);
-		if (ret)
-			return ret;
-		sensor->cfg.accel_enable = 1;
-
-		data &= ~BIT_SLEEP;
+	mutex_lock(&sensor->op_lock);
+	ret = mpu6050_set_poll_period(sensor, type,
+			div64_u64(NSEC_PER_SEC * 1000000ULL, micro_hz));
+	mutex_unlock(&sensor->op_lock);
+	return ret;
+}
 
-		sensor->cfg.enable = 1;
-	} else {
-		if (work_pending(&sensor->resume_work))
-			cancel_work_sync(&sensor->resume_work);
-		ret = mpu6050_switch_engine(sensor, false,
-			BIT_PWR_ACCEL_STBY_MASK);
-		if (ret)
-			return ret;
-		sensor->cfg.accel_enable = 0;
+static const struct iio_info mpu6050_iio_info = {
+	.driver_module = THIS_MODULE,
+	.read_raw = mpu6050_iio_read_raw,
+	.write_raw = mpu6050_iio_write_raw,
+};
 
-		if (!sensor->cfg.gyro_enable) {
-			data |=  BIT_SLEEP;
-			sensor->cfg.enable = 0;
-		}
-	}
-	return 0;
+/* Disable the sensors the buffer enabled, leave the others alone. */
+static void mpu6050_iio_release(struct mpu6050_sensor *sensor)
+{
+	WRITE_ONCE(sensor->iio_lead, -1);
+	if (test_and_clear_bit(SNS_TYPE_GYRO, &sensor->iio_owned))
+		mpu6050_set_enable(sensor, SNS_TYPE_GYRO, false);
+	if (test_and_clear_bit(SNS_TYPE_ACCEL, &sensor->iio_owned))
+		mpu6050_set_enable(sensor, SNS_TYPE_ACCEL, false);
 }
 
-static int mpu6050_accel_set_enable(struct mpu6050_sensor *sensor, bool enable)
+/*
+ * Enable the sensors of the scanned channels. The faster of them fires the
+ * trigger, so every scan carries a fresh sample of it.
+ */
+static int mpu6050_iio_postenable(struct iio_dev *indio_dev)
 {
-	int ret = 0;
-	printk("MPU6050 - accecl set enable\n");
-	printk("MPU6050 - mpu6050_accel_set_enable enable=%d\n", enable);
-	if (enable) {
-		if (!sensor->power_enabled) {
-			ret = mpu6050_power_ctl(sensor, true);
-			if (ret < 0) {
-				printk("MPU6050 - Failed to set power up mpu6050");
-				return ret;
-			}
-			mpu6050_reset_chip(sensor);
-			ret = mpu6050_restore_context(sensor);
-			if (ret < 0) {
-				printk("MPU6050 - Failed to restore context");
-				return ret;
-			}
-		}
+	struct mpu6050_sensor *sensor = mpu6050_iio_sensor(indio_dev);
+	unsigned long mask = *indio_dev->active_scan_mask;
+	bool accel = mask & MPU6050_IIO_ACCEL_MASK;
+	bool gyro = mask & MPU6050_IIO_GYRO_MASK;
+	int ret, lead;
 
-		ret = mpu6050_accel_enable(sensor, true);
-		if (ret) {
-			printk("MPU6050 - Fail to enable accel engine ret=%d\n", ret);
-			ret = -EBUSY;
-			return ret;
-		}
-
-		ret = mpu6050_config_sample_rate(sensor);
-		if (ret < 0)
-			printk("MPU6050 - Unable to update sampling rate! ret=%d\n",
-				ret);
+	if (!accel && !gyro)
+		return -EINVAL;
 
-		if (!sensor->batch_accel) 
-		{
-			ktime_t ktime;
-			ktime = ktime_set(0,
-					sensor->accel_poll_ms * NSEC_PER_MSEC);
-			hrtimer_start(&sensor->accel_timer, ktime,
-					HRTIMER_MODE_REL);
-		}
-		atomic_set(&sensor->accel_en, 1);
-	} else {
-		atomic_set(&sensor->accel_en, 0);
-		if (!sensor->batch_accel)
-		{
-			ret = hrtimer_try_to_cancel(&sensor->accel_timer);
-		}
+	ret = iio_triggered_buffer_postenable(indio_dev);
+	if (ret)
+		return ret;
 
-		ret = mpu6050_accel_enable(sensor, false);
-		if (ret) {
-			printk("MPU6050 - Fail to disable accel engine ret=%d\n", ret);
-			ret = -EBUSY;
-			return ret;
-		}
-		if (!sensor->cfg.accel_enable && !sensor->cfg.gyro_enable)
-			mpu6050_power_ctl(sensor, false);
+	if (gyro && !test_bit(SNS_TYPE_GYRO, &sensor->en_req)) {
+		ret = mpu6050_set_enable(sensor, SNS_TYPE_GYRO, true);
+		if (ret)
+			goto err_release;
+		set_bit(SNS_TYPE_GYRO, &sensor->iio_owned);
+	}
+	if (accel && !test_bit(SNS_TYPE_ACCEL, &sensor->en_req)) {
+		ret = mpu6050_set_enable(sensor, SNS_TYPE_ACCEL, true);
+		if (ret)
+			goto err_release;
+		set_bit(SNS_TYPE_ACCEL, &sensor->iio_owned);
 	}
 
+	if (accel && gyro)
+		lead = (mpu6050_poll_ns(sensor, SNS_TYPE_ACCEL) <
+			mpu6050_poll_ns(sensor, SNS_TYPE_GYRO)) ?
+			SNS_TYPE_ACCEL : SNS_TYPE_GYRO;
+	else
+		lead = accel ? SNS_TYPE_ACCEL : SNS_TYPE_GYRO;
+	WRITE_ONCE(sensor->iio_lead, lead);
+
+	return 0;
+
+err_release:
+	mpu6050_iio_release(sensor);
+	iio_triggered_buffer_predisable(indio_dev);
 	return ret;
 }
 
-static int mpu6050_accel_set_poll_delay(struct mpu6050_sensor *sensor,
-					unsigned long delay)
+static int mpu6050_iio_predisable(struct iio_dev *indio_dev)
+{
+	mpu6050_iio_release(mpu6050_iio_sensor(indio_dev));
+	return iio_triggered_buffer_predisable(indio_dev);
+}
+
+static const struct iio_buffer_setup_ops mpu6050_iio_buffer_ops = {
+	.postenable = mpu6050_iio_postenable,
+	.predisable = mpu6050_iio_predisable,
+};
+
+/*
+ * Register an IIO device with a kfifo triggered buffer next to the input
+ * devices. Its trigger is fired by the poll threads, so the IIO buffer and
+ * the input devices see the same samples and timestamps.
+ */
+static int mpu6050_iio_init(struct mpu6050_sensor *sensor)
 {
+	struct iio_dev *indio_dev;
+	struct iio_trigger *trig;
 	int ret;
 
-	printk("MPU6050 - mpu6050_accel_set_poll_delay delay_ms=%ld\n", delay);
-	if (delay < MPU6050_ACCEL_MIN_POLL_INTERVAL_MS)
-		delay = MPU6050_ACCEL_MIN_POLL_INTERVAL_MS;
-	if (delay > MPU6050_ACCEL_MAX_POLL_INTERVAL_MS)
-		delay = MPU6050_ACCEL_MAX_POLL_INTERVAL_MS;
+	sensor->iio_lead = -1;
+	spin_lock_init(&sensor->iio_lock);
 
-	mutex_lock(&sensor->op_lock);
-	if (sensor->accel_poll_ms == delay)
-		goto exit;
+	indio_dev = iio_device_alloc(sizeof(sensor));
+	if (!indio_dev)
+		return -ENOMEM;
+	*(struct mpu6050_sensor **)iio_priv(indio_dev) = sensor;
+	indio_dev->dev.parent = sensor->dev;
+	indio_dev->name = sensor->name;
+	indio_dev->channels = mpu6050_iio_channels;
+	indio_dev->num_channels = ARRAY_SIZE(mpu6050_iio_channels);
+	indio_dev->info = &mpu6050_iio_info;
+	indio_dev->modes = INDIO_DIRECT_MODE;
+
+	trig = iio_trigger_alloc("%s-dev%d", indio_dev->name, indio_dev->id);
+	if (!trig) {
+		ret = -ENOMEM;
+		goto err_free_dev;
+	}
+	trig->dev.parent = sensor->dev;
+	ret = iio_trigger_register(trig);
+	if (ret)
+		goto err_free_trig;
+	indio_dev->trig = iio_trigger_get(trig);
 
-	sensor->accel_delay_change = true;
-	sensor->accel_poll_ms = delay;
+	ret = iio_triggered_buffer_setup(indio_dev, NULL,
+			mpu6050_iio_trigger_handler, &mpu6050_iio_buffer_ops);
+	if (ret)
+		goto err_unregister_trig;
 
-	if (!atomic_read(&sensor->accel_en))
-		goto exit;
+	ret = iio_device_register(indio_dev);
+	if (ret)
+		goto err_cleanup_buffer;
 
-	if (sensor->use_poll) {
-		ktime_t ktime;
-		ret = hrtimer_try_to_cancel(&sensor->accel_timer);
-		ktime = ktime_set(0,
-				sensor->accel_poll_ms * NSEC_PER_MSEC);
-		hrtimer_start(&sensor->accel_timer, ktime, HRTIMER_MODE_REL);
-	} else {
-		ret = mpu6050_config_sample_rate(sensor);
-		if (ret < 0)
-			printk("MPU6050 - Unable to set polling delay for accel!\n");
-	}
+	sensor->indio_dev = indio_dev;
+	sensor->iio_trig = trig;
+	return 0;
 
-exit:
-	mutex_unlock(&sensor->op_lock);
+err_cleanup_buffer:
+	iio_triggered_buffer_cleanup(indio_dev);
+err_unregister_trig:
+	iio_trigger_unregister(trig);
+err_free_trig:
+	iio_trigger_free(trig);
+err_free_dev:
+	/* drops the reference taken for indio_dev->trig */
+	iio_device_free(indio_dev);
 	return ret;
 }
 
-static int mpu6050_accel_cdev_enable(struct sensors_classdev *sensors_cdev,
-			unsigned int enable)
+static void mpu6050_iio_exit(struct mpu6050_sensor *sensor)
 {
-	struct mpu6050_sensor *sensor = container_of(sensors_cdev,
-			struct mpu6050_sensor, accel_cdev);
-	int err;
-
-	mutex_lock(&sensor->op_lock);
-
-	err = mpu6050_accel_set_enable(sensor, enable);
-
-	mutex_unlock(&sensor->op_lock);
-
-	return err;
+	iio_device_unregister(sensor->indio_dev);
+	iio_triggered_buffer_cleanup(sensor->indio_dev);
+	iio_trigger_unregister(sensor->iio_trig);
+	iio_device_free(sensor->indio_dev);
+	iio_trigger_free(sensor->iio_trig);
 }
-
-static int mpu6050_accel_cdev_poll_delay(struct sensors_classdev *sensors_cdev,
-			unsigned int delay_ms)
+#else
+static inline int mpu6050_iio_init(struct mpu6050_sensor *sensor)
 {
-	struct mpu6050_sensor *sensor = container_of(sensors_cdev,
-			struct mpu6050_sensor, accel_cdev);
+	return 0;
+}
 
-	return mpu6050_accel_set_poll_delay(sensor, delay_ms);
+static inline void mpu6050_iio_exit(struct mpu6050_sensor *sensor)
+{
 }
+#endif
 
-static ssize_t mpu6050_accel_attr_get_x(struct device *dev,
-			struct device_attribute *attr, char *buf)
+static int mpu6050_latency_show(struct seq_file *s, void *unused)
 {
-	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct mpu6050_sensor *sensor = s->private;
+	struct mpu6050_lat_hist *hist;
+	int type, metric, i;
+
+	for (type = 0; type < SNS_TYPE_MAX; type++) {
+		for (metric = 0; metric < MPU6050_LAT_MAX; metric++) {
+			hist = &sensor->lat.hist[type][metric];
+			seq_printf(s, "%s %s: count=%llu max=%llu ns\n",
+				mpu6050_sns_name[type], mpu6050_lat_name[metric],
+				hist->count, hist->max_ns);
+			for (i = 0; i < MPU6050_LAT_BUCKETS; i++) {
+				if (!hist->bucket[i])
+					continue;
+				if (i == MPU6050_LAT_BUCKETS - 1)
+					seq_printf(s, "  >= %llu ns: %llu\n",
+						1ULL << (i - 1), hist->bucket[i]);
+				else
+					seq_printf(s, "  < %llu ns: %llu\n",
+						1ULL << i, hist->bucket[i]);
+			}
+		}
+	}
 
-	return snprintf(buf, 4, "%d\n", sensor->axis.x);
+	return 0;
 }
 
-static ssize_t mpu6050_accel_attr_set_x(struct device *dev,
-			struct device_attribute *attr,
-			const char *buf, size_t count)
+static int mpu6050_latency_open(struct inode *inode, struct file *file)
 {
-	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
-	unsigned long enable;
-	int ret;
+	return single_open(file, mpu6050_latency_show, inode->i_private);
+}
 
-	if (kstrtoul(buf, 10, &enable))
-		return -EINVAL;
+/* Any write resets the histograms. */
+static ssize_t mpu6050_latency_write(struct file *file,
+			const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct mpu6050_sensor *sensor =
+		((struct seq_file *)file->private_data)->private;
 
-	sensor->axis.x = enable;
-	return ret ? -EBUSY : count;
+	memset(sensor->lat.hist, 0, sizeof(sensor->lat.hist));
+	memset(sensor->lat.fire_ns, 0, sizeof(sensor->lat.fire_ns));
+	memset(sensor->lat.wake_ns, 0, sizeof(sensor->lat.wake_ns));
+	return count;
 }
 
-static ssize_t mpu6050_accel_attr_get_y(struct device *dev,
-			struct device_attribute *attr, char *buf)
+static const struct file_operations mpu6050_latency_fops = {
+	.owner		= THIS_MODULE,
+	.open		= mpu6050_latency_open,
+	.read		= seq_read,
+	.write		= mpu6050_latency_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/* Sum the per-CPU counters, enabled_ns includes the running period. */
+static void mpu6050_stats_snapshot(struct mpu6050_sensor *sensor,
+				struct mpu6050_stats_snapshot *snap)
 {
-	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct mpu6050_stats *stats;
+	u64 since;
+	int cpu, type, i;
+
+	memset(snap, 0, sizeof(*snap));
+	snap->version = MPU6050_STATS_VERSION;
+	snap->nr_stats = MPU6050_STAT_MAX;
+	snap->timestamp_ns = ktime_to_ns(ktime_get_boottime());
+
+	for_each_possible_cpu(cpu) {
+		stats = per_cpu_ptr(sensor->stats, cpu);
+		for (type = 0; type < SNS_TYPE_MAX; type++)
+			for (i = 0; i < MPU6050_STAT_MAX; i++)
+				snap->stats[type][i] += stats->cnt[type][i];
+	}
 
-	return snprintf(buf, 4, "%d\n", sensor->axis.y);
+	for (type = 0; type < SNS_TYPE_MAX; type++) {
+		since = READ_ONCE(sensor->enabled_since_ns[type]);
+		if (since)
+			snap->stats[type][MPU6050_STAT_ENABLED_NS] +=
+				snap->timestamp_ns - since;
+	}
 }
 
-static ssize_t mpu6050_accel_attr_set_y(struct device *dev,
-			struct device_attribute *attr,
-			const char *buf, size_t count)
+static int mpu6050_stats_show(struct seq_file *s, void *unused)
 {
-	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
-	unsigned long enable;
-	int ret;
+	struct mpu6050_sensor *sensor = s->private;
+	struct mpu6050_stats_snapshot snap;
+	int type, i;
+
+	mpu6050_stats_snapshot(sensor, &snap);
+	for (type = 0; type < SNS_TYPE_MAX; type++) {
+		seq_printf(s, "%s:", mpu6050_sns_name[type]);
+		for (i = 0; i < MPU6050_STAT_MAX; i++)
+			seq_printf(s, " %s=%llu", mpu6050_stat_name[i],
+					snap.stats[type][i]);
+		seq_putc(s, '\n');
+	}
 
-	if (kstrtoul(buf, 10, &enable))
-		return -EINVAL;
+	return 0;
+}
 
-	sensor->axis.y = enable;
-	return ret ? -EBUSY : count;
+static int mpu6050_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mpu6050_stats_show, inode->i_private);
 }
 
-static ssize_t mpu6050_accel_attr_get_z(struct device *dev,
-			struct device_attribute *attr, char *buf)
+static const struct file_operations mpu6050_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= mpu6050_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/* The binary snapshot is taken at open, so partial reads stay coherent. */
+static int mpu6050_stats_bin_open(struct inode *inode, struct file *file)
 {
-	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	struct mpu6050_stats_snapshot *snap;
+
+	snap = kmalloc(sizeof(*snap), GFP_KERNEL);
+	if (!snap)
+		return -ENOMEM;
 
-	return snprintf(buf, 4, "%d\n", sensor->axis.z);
+	mpu6050_stats_snapshot(inode->i_private, snap);
+	file->private_data = snap;
+	return 0;
 }
 
-static ssize_t mpu6050_accel_attr_set_z(struct device *dev,
-			struct device_attribute *attr,
-			const char *buf, size_t count)
+static ssize_t mpu6050_stats_bin_read(struct file *file, char __user *buf,
+			size_t count, loff_t *ppos)
 {
-	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
-	unsigned long enable;
-	int ret;
-
-	if (kstrtoul(buf, 10, &enable))
-		return -EINVAL;
+	return simple_read_from_buffer(buf, count, ppos, file->private_data,
+			sizeof(struct mpu6050_stats_snapshot));
+}
 
-	sensor->axis.z = enable;
-	return ret ? -EBUSY : count;
+static int mpu6050_stats_bin_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+	return 0;
 }
 
-static struct device_attribute accel_attr[] = {
-	__ATTR(valueX, S_IRUGO | S_IWUSR,
-		mpu6050_accel_attr_get_x,
-		mpu6050_accel_attr_set_x),
-	__ATTR(valueY, S_IRUGO | S_IWUSR,
-		mpu6050_accel_attr_get_y,
-		mpu6050_accel_attr_set_y),
-	__ATTR(valueZ, S_IRUGO | S_IWUSR,
-		mpu6050_accel_attr_get_z,
-		mpu6050_accel_attr_set_z),
-	__ATTR(place, S_IRUSR,
-		mpu6050_get_place,
-		NULL),
+static const struct file_operations mpu6050_stats_bin_fops = {
+	.owner		= THIS_MODULE,
+	.open		= mpu6050_stats_bin_open,
+	.read		= mpu6050_stats_bin_read,
+	.llseek		= default_llseek,
+	.release	= mpu6050_stats_bin_release,
 };
 
-static int create_accel_sysfs_interfaces(struct device *dev)
+/*
+ * Debug interfaces are best effort, a failure to create them does not fail
+ * the probe.
+ */
+static void mpu6050_debugfs_init(struct mpu6050_sensor *sensor)
 {
-	int i;
-	int err;
-	for (i = 0; i < ARRAY_SIZE(accel_attr); i++) {
-		err = device_create_file(dev, accel_attr + i);
-		if (err)
-			goto error;
+	char *name;
+
+	name = kasprintf(GFP_KERNEL, "%s-%s", MPU6050_RING_NAME,
+			dev_name(sensor->dev));
+	if (!name)
+		return;
+	sensor->debugfs = debugfs_create_dir(name, NULL);
+	kfree(name);
+	if (IS_ERR_OR_NULL(sensor->debugfs)) {
+		sensor->debugfs = NULL;
+		return;
 	}
-	return 0;
 
-error:
-	for (; i >= 0; i--)
-		device_remove_file(dev, accel_attr + i);
-	dev_err(dev, "Unable to create interface\n");
-	return err;
+	debugfs_create_u32("latency_enable", S_IRUSR | S_IWUSR,
+			sensor->debugfs, &sensor->lat.enable);
+	debugfs_create_u32("hw_fifo_batch", S_IRUSR | S_IWUSR,
+			sensor->debugfs, &sensor->hwfifo_batch);
+	debugfs_create_file("latency", S_IRUSR | S_IWUSR, sensor->debugfs,
+			sensor, &mpu6050_latency_fops);
+	debugfs_create_file("stats", S_IRUSR, sensor->debugfs, sensor,
+			&mpu6050_stats_fops);
+	debugfs_create_file("stats_bin", S_IRUSR, sensor->debugfs, sensor,
+			&mpu6050_stats_bin_fops);
 }
 
-static int remove_accel_sysfs_interfaces(struct device *dev)
+static void mpu6050_debugfs_exit(struct mpu6050_sensor *sensor)
 {
-	int i;
-	for (i = 0; i < ARRAY_SIZE(accel_attr); i++)
-		device_remove_file(dev, accel_attr + i);
-	return 0;
+	debugfs_remove_recursive(sensor->debugfs);
 }
 
 static void setup_mpu6050_reg(struct mpu_reg_map *reg)
@@ -1258,6 +6029,7 @@ static void setup_mpu6050_reg(struct mpu_reg_map *reg)
 static int mpu_check_chip_type(struct mpu6050_sensor *sensor)
 {
 	struct mpu_reg_map *reg;
+	unsigned int val;
 	s32 ret;
 
 	sensor->chip_type = INV_MPU6050;
@@ -1265,6 +6037,14 @@ static int mpu_check_chip_type(struct mpu6050_sensor *sensor)
 	reg = &sensor->reg;
 	setup_mpu6050_reg(reg);
 
+	ret = regmap_read(sensor->regmap, REG_WHOAMI, &val);
+	if (ret)
+		return ret;
+	if (val != MPU6050_ID) {
+		printk("MPU6050 - Unexpected chip id 0x%x\n", val);
+		return -ENODEV;
+	}
+
 	/* turn off and turn on power to ensure gyro engine is on */
 
 	ret = mpu6050_set_power_mode(sensor, false);
@@ -1292,8 +6072,10 @@ static int mpu_check_chip_type(struct mpu6050_sensor *sensor)
  */
 static int mpu6050_init_config(struct mpu6050_sensor *sensor)
 {
+	struct mpu_reg_map *reg = &sensor->reg;
 	u8 data;
-	
+	int ret;
+
 	printk("MPU6050 - init config\n");
 
 	if (sensor->cfg.is_asleep)
@@ -1303,35 +6085,58 @@ static int mpu6050_init_config(struct mpu6050_sensor *sensor)
 
 	memset(&sensor->cfg, 0, sizeof(struct mpu_chip_config));
 
+	ret = regmap_write(sensor->regmap, reg->gyro_config,
+			MPU_FSR_2000DPS << GYRO_CONFIG_FSR_SHIFT);
+	if (ret)
+		return ret;
 	sensor->cfg.fsr = MPU_FSR_2000DPS;
+
+	ret = regmap_write(sensor->regmap, reg->lpf, MPU_DLPF_42HZ);
+	if (ret)
+		return ret;
 	sensor->cfg.lpf = MPU_DLPF_42HZ;
 
 	data = (u8)(ODR_DLPF_ENA / INIT_FIFO_RATE - 1);
-
+	ret = regmap_write(sensor->regmap, reg->sample_rate_div, data);
+	if (ret)
+		return ret;
 	sensor->cfg.rate_div = data;
+
+	ret = regmap_write(sensor->regmap, reg->accel_config,
+			ACCEL_FS_02G << ACCL_CONFIG_FSR_SHIFT);
+	if (ret)
+		return ret;
 	sensor->cfg.accel_fs = ACCEL_FS_02G;
 
+	ret = regmap_write(sensor->regmap, reg->mot_thr, sensor->mot.thr);
+	if (ret)
+		return ret;
+	ret = regmap_write(sensor->regmap, reg->mot_dur, sensor->mot.dur);
+	if (ret)
+		return ret;
+
 	if ((sensor->pdata->int_flags & IRQF_TRIGGER_FALLING) ||
 		(sensor->pdata->int_flags & IRQF_TRIGGER_LOW))
 		data = BIT_INT_CFG_DEFAULT | BIT_INT_ACTIVE_LOW;
 	else
 		data = BIT_INT_CFG_DEFAULT;
 
+	ret = regmap_write(sensor->regmap, reg->int_pin_cfg, data);
+	if (ret)
+		return ret;
 	sensor->cfg.int_pin_cfg = data;
 	sensor->cfg.gyro_enable = 0;
 	sensor->cfg.gyro_fifo_enable = 0;
 	sensor->cfg.accel_enable = 0;
 	sensor->cfg.accel_fifo_enable = 0;
 
-	return 0;
+	/* push what the reset dropped, such as the engine and LPA setup */
+	return mpu6050_restore_context(sensor);
 }
 
 static void mpu6050_pinctrl_state(struct mpu6050_sensor *sensor,
 			bool active)
 {
-	printk("MPU6050 - Pinctrl state\n");
-
-	return;
 }
 
 #ifdef CONFIG_OF
@@ -1391,23 +6196,42 @@ static int mpu6050_parse_dt(struct device *dev,
 }
 #endif
 
+/*
+ * Name the user visible interfaces. The I2C bound sensor keeps the plain
+ * names the HAL looks for, virtual sensor @id gets a ".<id>" suffix.
+ */
+static void mpu6050_set_names(struct mpu6050_sensor *sensor, int id)
+{
+	char sfx[16] = "";
+
+	if (id >= 0)
+		snprintf(sfx, sizeof(sfx), ".%d", id);
+	snprintf(sensor->name, MPU6050_NAME_LEN, "%s%s",
+		MPU6050_RING_NAME, sfx);
+	snprintf(sensor->accel_name, MPU6050_NAME_LEN, "%s%s",
+		MPU6050_DEV_NAME_ACCEL, sfx);
+	snprintf(sensor->gyro_name, MPU6050_NAME_LEN, "%s%s",
+		MPU6050_DEV_NAME_GYRO, sfx);
+	snprintf(sensor->gyro_cdev_name, MPU6050_NAME_LEN, "%s%s",
+		mpu6050_gyro_cdev.name, sfx);
+}
+
 /**
- * mpu6050_probe() - device detection callback
- * @client: i2c client of found device
- * @id: id match information
+ * mpu6050_probe_dev() - set up a sensor
+ * @dev: I2C client or virtual platform device
+ * @id: virtual sensor index, -1 for an I2C client
  *
- * The I2C layer calls us when it believes a sensor is present at this
- * address. Probe to see if this is correct and to validate the device.
+ * Probe to see if this is correct and to validate the device.
  *
  * If present install the relevant sysfs interfaces and input device.
  */
-static int mpu6050_probe(struct i2c_client *client,const struct i2c_device_id *id)
+static int mpu6050_probe_dev(struct device *dev, int id)
 {
 	struct mpu6050_sensor *sensor;
 	struct mpu6050_platform_data *pdata;
 	int ret;
 
-	sensor = devm_kzalloc(&client->dev, sizeof(struct mpu6050_sensor),
+	sensor = devm_kzalloc(dev, sizeof(struct mpu6050_sensor),
 			GFP_KERNEL);
 	if (!sensor) {
 		printk("MPU6050 - Failed to allocate driver data\n");
@@ -1420,20 +6244,25 @@ static int mpu6050_probe(struct i2c_client *client,const struct i2c_device_id *i
 	sensor->axis.rx = 0;
 	sensor->axis.ry = 0;
 	sensor->axis.rz = 0;
+	seqlock_init(&sensor->axis_lock);
+	INIT_KFIFO(sensor->inject[SNS_TYPE_ACCEL]);
+	INIT_KFIFO(sensor->inject[SNS_TYPE_GYRO]);
+	seqlock_init(&sensor->gen.lock);
 	
-	sensor->client = client;
-	sensor->dev = &client->dev;
-	i2c_set_clientdata(client, sensor);
+	sensor->client = i2c_verify_client(dev);
+	sensor->dev = dev;
+	dev_set_drvdata(dev, sensor);
+	mpu6050_set_names(sensor, id);
 
-	if (client->dev.of_node) {
-		pdata = devm_kzalloc(&client->dev,
+	if (dev->of_node) {
+		pdata = devm_kzalloc(dev,
 			sizeof(struct mpu6050_platform_data), GFP_KERNEL);
 		if (!pdata) {
 			printk("MPU6050 - Failed to allcated memory\n");
 			ret = -ENOMEM;
 			goto err_free_devmem;
 		}
-		ret = mpu6050_parse_dt(&client->dev, pdata);
+		ret = mpu6050_parse_dt(dev, pdata);
 		if (ret) {
 			printk("MPU6050 - Failed to parse device tree\n");
 			ret = -EINVAL;
@@ -1443,7 +6272,7 @@ static int mpu6050_probe(struct i2c_client *client,const struct i2c_device_id *i
 		printk("MPU6050 - interrupt flags is %d\n", pdata->int_flags);
 	} else {
 		printk("MPU6050 - use platform\n");
-		pdata = client->dev.platform_data;
+		pdata = dev->platform_data;
 	}
 
 	if (!pdata) {
@@ -1453,8 +6282,44 @@ static int mpu6050_probe(struct i2c_client *client,const struct i2c_device_id *i
 	}
 
 	mutex_init(&sensor->op_lock);
+	mutex_init(&sensor->trace_lock);
 	sensor->pdata = pdata;
 	sensor->enable_gpio = sensor->pdata->gpio_en;
+	mpu6050_remap_init(&sensor->remap[SNS_TYPE_ACCEL],
+			mpu6050_accel_axis_remap_tab, pdata->place);
+	mpu6050_remap_init(&sensor->remap[SNS_TYPE_GYRO],
+			mpu6050_gyro_axis_remap_tab, pdata->place);
+
+	spin_lock_init(&sensor->regs_lock);
+	mutex_init(&sensor->src_lock);
+	hrtimer_init(&sensor->drdy_timer, CLOCK_BOOTTIME, HRTIMER_MODE_REL);
+	sensor->drdy_timer.function = mpu6050_drdy_timer_handle;
+	INIT_DELAYED_WORK(&sensor->mot_clk, mpu6050_regs_mot_work);
+	init_irq_work(&sensor->mot_irq_work, mpu6050_regs_mot_irq);
+	mpu6050_regs_reset(sensor);
+	sensor->regmap = devm_regmap_init(dev, &mpu6050_regmap_bus,
+			sensor, &mpu6050_regmap_config);
+	if (IS_ERR(sensor->regmap)) {
+		ret = PTR_ERR(sensor->regmap);
+		printk("MPU6050 - Failed to init register map\n");
+		goto err_free_enable_gpio;
+	}
+	sensor->fifo_map = devm_regmap_init(dev, &mpu6050_regmap_bus,
+			sensor, &mpu6050_fifo_regmap_config);
+	if (IS_ERR(sensor->fifo_map)) {
+		ret = PTR_ERR(sensor->fifo_map);
+		printk("MPU6050 - Failed to init FIFO register map\n");
+		goto err_free_enable_gpio;
+	}
+	mutex_init(&sensor->hwfifo_lock);
+	sensor->hwfifo_batch = MPU6050_HWFIFO_BATCH;
+	sensor->mot.thr = DEFAULT_MOT_THR;
+	sensor->mot.dur = DEFAULT_MOT_DET_DUR;
+	sensor->mot.still_ms = MPU6050_MOT_STILL_MS;
+	INIT_DELAYED_WORK(&sensor->mot.work, mpu6050_motion_work);
+	INIT_DELAYED_WORK(&sensor->resume_work, mpu6050_resume_work);
+	INIT_DELAYED_WORK(&sensor->enable_work, mpu6050_enable_work);
+	mutex_init(&sensor->pm_lock);
 
 	ret = mpu6050_power_init(sensor);
 	if (ret) {
@@ -1494,27 +6359,41 @@ static int mpu6050_probe(struct i2c_client *client,const struct i2c_device_id *i
 		goto err_power_off_device;
 	}
 
-	sensor->accel_dev = devm_input_allocate_device(&client->dev);
+	sensor->accel_dev = devm_input_allocate_device(dev);
 	if (!sensor->accel_dev) {
 		printk("MPU6050 - Failed to allocate accelerometer input device\n");
 		ret = -ENOMEM;
 		goto err_power_off_device;
 	}
 
-	sensor->gyro_dev = devm_input_allocate_device(&client->dev);
+	sensor->gyro_dev = devm_input_allocate_device(dev);
 	if (!sensor->gyro_dev) {
 		printk("MPU6050 - Failed to allocate gyroscope input device\n");
 		ret = -ENOMEM;
 		goto err_power_off_device;
 	}
 
-	sensor->accel_dev->name = MPU6050_DEV_NAME_ACCEL;
-	sensor->gyro_dev->name = MPU6050_DEV_NAME_GYRO;
-	sensor->accel_dev->id.bustype = BUS_I2C;
-	sensor->gyro_dev->id.bustype = BUS_I2C;
+	sensor->accel_dev->name = sensor->accel_name;
+	sensor->gyro_dev->name = sensor->gyro_name;
+	sensor->accel_dev->id.bustype = sensor->client ? BUS_I2C : BUS_VIRTUAL;
+	sensor->gyro_dev->id.bustype = sensor->accel_dev->id.bustype;
 	sensor->accel_poll_ms = MPU6050_ACCEL_DEFAULT_POLL_INTERVAL_MS;
 	sensor->gyro_poll_ms = MPU6050_GYRO_DEFAULT_POLL_INTERVAL_MS;
+	sensor->req_ns[SNS_TYPE_ACCEL] =
+		(u64)MPU6050_ACCEL_DEFAULT_POLL_INTERVAL_MS * NSEC_PER_MSEC;
+	sensor->req_ns[SNS_TYPE_GYRO] =
+		(u64)MPU6050_GYRO_DEFAULT_POLL_INTERVAL_MS * NSEC_PER_MSEC;
+	sensor->poll_ns[SNS_TYPE_ACCEL] = sensor->req_ns[SNS_TYPE_ACCEL];
+	sensor->poll_ns[SNS_TYPE_GYRO] = sensor->req_ns[SNS_TYPE_GYRO];
+	sensor->burst[SNS_TYPE_ACCEL] = 1;
+	sensor->burst[SNS_TYPE_GYRO] = 1;
 	sensor->acc_use_cal = false;
+	seqlock_init(&sensor->acc_cal_lock);
+	sensor->acc_cal_matrix[0][0] = 1 << MPU_ACC_CAL_MATRIX_SHIFT;
+	sensor->acc_cal_matrix[1][1] = 1 << MPU_ACC_CAL_MATRIX_SHIFT;
+	sensor->acc_cal_matrix[2][2] = 1 << MPU_ACC_CAL_MATRIX_SHIFT;
+	init_completion(&sensor->acc_cal.done);
+	snprintf(sensor->acc_cal_buf[0], MPU_ACC_CAL_BUF_SIZE, "0,0,0");
 
 	input_set_capability(sensor->accel_dev, EV_ABS, ABS_MISC);
 	input_set_capability(sensor->gyro_dev, EV_ABS, ABS_MISC);
@@ -1536,13 +6415,14 @@ static int mpu6050_probe(struct i2c_client *client,const struct i2c_device_id *i
 	input_set_abs_params(sensor->gyro_dev, ABS_RZ,
 			     MPU6050_GYRO_MIN_VALUE, MPU6050_GYRO_MAX_VALUE,
 			     0, 0);
-	sensor->accel_dev->dev.parent = &client->dev;
-	sensor->gyro_dev->dev.parent = &client->dev;
+	sensor->accel_dev->dev.parent = dev;
+	sensor->gyro_dev->dev.parent = dev;
 	input_set_drvdata(sensor->accel_dev, sensor);
 	input_set_drvdata(sensor->gyro_dev, sensor);
 
-	sensor->use_poll = 1;
-	printk("MPU6050 - Polling mode is enabled. use_int=%d gpio_int=%d",
+	sensor->use_poll = !(use_irq || sensor->pdata->use_int);
+	printk("MPU6050 - %s mode is enabled. use_int=%d gpio_int=%d",
+		sensor->use_poll ? "Polling" : "Interrupt",
 		sensor->pdata->use_int, sensor->pdata->gpio_int);
 
 	sensor->data_wq = create_freezable_workqueue("mpu6050_data_work");
@@ -1555,56 +6435,113 @@ static int mpu6050_probe(struct i2c_client *client,const struct i2c_device_id *i
 	sensor->gyro_timer.function = gyro_timer_handle;
 	hrtimer_init(&sensor->accel_timer, CLOCK_BOOTTIME, HRTIMER_MODE_REL);
 	sensor->accel_timer.function = accel_timer_handle;
+	hrtimer_init(&sensor->sched_timer, CLOCK_BOOTTIME, HRTIMER_MODE_ABS);
+	sensor->sched_timer.function = sched_timer_handle;
+	spin_lock_init(&sensor->sched_lock);
 
 	init_waitqueue_head(&sensor->gyro_wq);
 	init_waitqueue_head(&sensor->accel_wq);
-	sensor->gyro_wkp_flag = 0;
-	sensor->accel_wkp_flag = 0;
+	init_waitqueue_head(&sensor->sched_wq);
+
+	sensor->stats = alloc_percpu(struct mpu6050_stats);
+	if (!sensor->stats) {
+		printk("MPU6050 - Failed to allocate statistics\n");
+		ret = -ENOMEM;
+		goto err_destroy_workqueue;
+	}
+
+	ret = mpu6050_ring_init(sensor);
+	if (ret) {
+		printk("MPU6050 - Failed to create ring device\n");
+		goto err_free_stats;
+	}
 
-	sensor->gyr_task = kthread_run(gyro_poll_thread, sensor, "sns_gyro");
-	sensor->accel_task = kthread_run(accel_poll_thread, sensor,
+	/* the chip FIFO carries both sensors, one thread reads it */
+	sensor->hwfifo_mode = hw_fifo;
+	sensor->unified = unified_sched || hw_fifo;
+	if (!sensor->use_poll) {
+		ret = mpu6050_irq_init(sensor);
+		if (ret) {
+			printk("MPU6050 - Failed to request interrupt\n");
+			goto err_ring_exit;
+		}
+	} else if (sensor->unified) {
+		sensor->sched_task = kthread_run(imu_poll_thread, sensor,
+						"sns_imu");
+	} else {
+		sensor->gyr_task = kthread_run(gyro_poll_thread, sensor,
+						"sns_gyro");
+		sensor->accel_task = kthread_run(accel_poll_thread, sensor,
 						"sns_accel");
+	}
 
 	ret = input_register_device(sensor->accel_dev);
 	if (ret) {
 		printk("MPU6050 - Failed to register input device\n");
-		goto err_destroy_workqueue;
+		goto err_stop_threads;
 	}
 	ret = input_register_device(sensor->gyro_dev);
 	if (ret) {
 		printk("MPU6050 - Failed to register input device\n");
-		goto err_destroy_workqueue;
+		goto err_stop_threads;
 	}
 	ret = create_accel_sysfs_interfaces(&sensor->accel_dev->dev);
 	if (ret < 0) {
-		dev_err(&client->dev, "failed to create sysfs for accel\n");
-		goto err_destroy_workqueue;
+		dev_err(dev, "failed to create sysfs for accel\n");
+		goto err_stop_threads;
 	}
 	ret = create_gyro_sysfs_interfaces(&sensor->gyro_dev->dev);
 	if (ret < 0) {
-		dev_err(&client->dev, "failed to create sysfs for gyro\n");
+		dev_err(dev, "failed to create sysfs for gyro\n");
 		goto err_remove_accel_sysfs;
 	}
+	ret = create_trace_sysfs_interfaces(dev);
+	if (ret < 0) {
+		dev_err(dev, "failed to create sysfs for trace\n");
+		goto err_remove_gyro_sysfs;
+	}
+	ret = create_inject_sysfs_interfaces(dev);
+	if (ret < 0) {
+		dev_err(dev, "failed to create sysfs for inject\n");
+		goto err_remove_trace_sysfs;
+	}
+	ret = mpu6050_iio_init(sensor);
+	if (ret) {
+		printk("MPU6050 - Failed to register IIO device\n");
+		goto err_remove_inject_sysfs;
+	}
 
 	sensor->accel_cdev = mpu6050_acc_cdev;
+	sensor->accel_cdev.name = sensor->accel_name;
 	sensor->accel_cdev.delay_msec = sensor->accel_poll_ms;
 	sensor->accel_cdev.sensors_enable = mpu6050_accel_cdev_enable;
 	sensor->accel_cdev.sensors_poll_delay = mpu6050_accel_cdev_poll_delay;
+	sensor->accel_cdev.sensors_set_latency = mpu6050_accel_cdev_set_latency;
+	sensor->accel_cdev.sensors_flush = mpu6050_accel_cdev_flush;
+	sensor->accel_cdev.sensors_calibrate = mpu6050_accel_cdev_calibrate;
+	sensor->accel_cdev.sensors_write_cal_params =
+			mpu6050_accel_cdev_write_cal_params;
+	sensor->accel_cdev.params = sensor->acc_cal_buf[0];
 	sensor->accel_cdev.fifo_reserved_event_count = 0;
+	sensor->accel_cdev.fifo_max_event_count = MPU6050_MAX_EVENT_CNT;
 
 	ret = sensors_classdev_register(&sensor->accel_dev->dev,
 			&sensor->accel_cdev);
 	if (ret) {
 		printk("MPU6050 - create accel class device file failed!\n");
 		ret = -EINVAL;
-		goto err_remove_gyro_sysfs;
+		goto err_iio_exit;
 	}
 
 	sensor->gyro_cdev = mpu6050_gyro_cdev;
+	sensor->gyro_cdev.name = sensor->gyro_cdev_name;
 	sensor->gyro_cdev.delay_msec = sensor->gyro_poll_ms;
 	sensor->gyro_cdev.sensors_enable = mpu6050_gyro_cdev_enable;
 	sensor->gyro_cdev.sensors_poll_delay = mpu6050_gyro_cdev_poll_delay;
+	sensor->gyro_cdev.sensors_set_latency = mpu6050_gyro_cdev_set_latency;
+	sensor->gyro_cdev.sensors_flush = mpu6050_gyro_cdev_flush;
 	sensor->gyro_cdev.fifo_reserved_event_count = 0;
+	sensor->gyro_cdev.fifo_max_event_count = MPU6050_MAX_EVENT_CNT;
 
 	ret = sensors_classdev_register(&sensor->gyro_dev->dev,
 			&sensor->gyro_cdev);
@@ -1614,27 +6551,42 @@ static int mpu6050_probe(struct i2c_client *client,const struct i2c_device_id *i
 		goto err_remove_accel_cdev;
 	}
 
-	ret = mpu6050_power_ctl(sensor, false);
-	if (ret) {
-		printk("MPU6050 - Power off mpu6050 failed\n");
-		goto err_remove_gyro_cdev;
-	}
+	mpu6050_debugfs_init(sensor);
+
+	/* nothing runs yet, the chip powers down after the autosuspend delay */
+	pm_runtime_get_noresume(dev);
+	pm_runtime_set_active(dev);
+	pm_runtime_set_autosuspend_delay(dev, MPU6050_AUTOSUSPEND_MS);
+	pm_runtime_use_autosuspend(dev);
+	pm_runtime_enable(dev);
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
 
 	return 0;
-err_remove_gyro_cdev:
-	sensors_classdev_unregister(&sensor->gyro_cdev);
 err_remove_accel_cdev:
 	 sensors_classdev_unregister(&sensor->accel_cdev);
+err_iio_exit:
+	mpu6050_iio_exit(sensor);
+err_remove_inject_sysfs:
+	remove_inject_sysfs_interfaces(dev);
+err_remove_trace_sysfs:
+	remove_trace_sysfs_interfaces(dev);
 err_remove_gyro_sysfs:
 	remove_accel_sysfs_interfaces(&sensor->gyro_dev->dev);
 err_remove_accel_sysfs:
 	remove_accel_sysfs_interfaces(&sensor->accel_dev->dev);
-err_destroy_workqueue:
-	destroy_workqueue(sensor->data_wq);
+err_stop_threads:
 	hrtimer_try_to_cancel(&sensor->gyro_timer);
 	hrtimer_try_to_cancel(&sensor->accel_timer);
-	kthread_stop(sensor->gyr_task);
-	kthread_stop(sensor->accel_task);
+	hrtimer_try_to_cancel(&sensor->sched_timer);
+	mpu6050_stop_threads(sensor);
+err_ring_exit:
+	mpu6050_ring_exit(sensor);
+err_free_stats:
+	free_percpu(sensor->stats);
+err_destroy_workqueue:
+	cancel_delayed_work_sync(&sensor->enable_work);
+	destroy_workqueue(sensor->data_wq);
 err_free_gpio:
 err_power_off_device:
 	mpu6050_power_ctl(sensor, false);
@@ -1642,36 +6594,159 @@ err_deinit_regulator:
 	mpu6050_power_deinit(sensor);
 err_free_enable_gpio:
 err_free_devmem:
-	devm_kfree(&client->dev, sensor);
+	devm_kfree(dev, sensor);
 	printk("MPU6050 - Probe device return error%d\n", ret);
 	return ret;
 }
 
 /**
- * mpu6050_remove() - remove a sensor
- * @client: i2c client of sensor being removed
+ * mpu6050_probe() - device detection callback
+ * @client: i2c client of found device
+ * @id: id match information
+ *
+ * The I2C layer calls us when it believes a sensor is present at this
+ * address.
+ */
+static int mpu6050_probe(struct i2c_client *client,const struct i2c_device_id *id)
+{
+	return mpu6050_probe_dev(&client->dev, -1);
+}
+
+/**
+ * mpu6050_remove_dev() - remove a sensor
+ * @dev: I2C client or virtual platform device of the sensor
  *
  * Our sensor is going away, clean up the resources.
  */
-static int mpu6050_remove(struct i2c_client *client)
+static int mpu6050_remove_dev(struct device *dev)
 {
-	struct mpu6050_sensor *sensor = i2c_get_clientdata(client);
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	int type;
 
+	WRITE_ONCE(sensor->removing, true);
+	/* streams still enabled hold a reference each, the chip goes off below */
+	mutex_lock(&sensor->op_lock);
+	for (type = 0; type < SNS_TYPE_MAX; type++)
+		if (test_and_clear_bit(type, &sensor->pm_refs))
+			pm_runtime_put_noidle(dev);
+	mutex_unlock(&sensor->op_lock);
+	pm_runtime_disable(dev);
+	pm_runtime_dont_use_autosuspend(dev);
+	pm_runtime_set_suspended(dev);
+	cancel_delayed_work_sync(&sensor->resume_work);
+	mpu6050_debugfs_exit(sensor);
 	sensors_classdev_unregister(&sensor->accel_cdev);
 	sensors_classdev_unregister(&sensor->gyro_cdev);
+	remove_inject_sysfs_interfaces(dev);
+	remove_trace_sysfs_interfaces(dev);
 	remove_gyro_sysfs_interfaces(&sensor->gyro_dev->dev);
 	remove_accel_sysfs_interfaces(&sensor->accel_dev->dev);
-	destroy_workqueue(sensor->data_wq);
+	/* no stream may start behind the timers */
+	cancel_delayed_work_sync(&sensor->enable_work);
 	hrtimer_try_to_cancel(&sensor->gyro_timer);
 	hrtimer_try_to_cancel(&sensor->accel_timer);
-	kthread_stop(sensor->gyr_task);
-	kthread_stop(sensor->accel_task);
+	hrtimer_try_to_cancel(&sensor->sched_timer);
+	mpu6050_stop_threads(sensor);
+	mpu6050_iio_exit(sensor);
+	/*
+	 * The threads queue motion work and the IIO buffer release queues
+	 * enable work, the workqueue goes after both. Requests left are
+	 * dropped, the chip is powered off below.
+	 */
+	cancel_delayed_work_sync(&sensor->enable_work);
+	cancel_delayed_work_sync(&sensor->mot_clk);
+	cancel_delayed_work_sync(&sensor->mot.work);
+	destroy_workqueue(sensor->data_wq);
+	mpu6050_ring_exit(sensor);
+	free_percpu(sensor->stats);
+	vfree(sensor->trace.frames);
 	mpu6050_power_ctl(sensor, false);
 	mpu6050_power_deinit(sensor);
-	devm_kfree(&client->dev, sensor);
+	devm_kfree(dev, sensor);
+
+	return 0;
+}
+
+static int mpu6050_remove(struct i2c_client *client)
+{
+	return mpu6050_remove_dev(&client->dev);
+}
+
+#ifdef CONFIG_PM
+/*
+ * The registers are lost with the power. Writes while powered down only go
+ * to the register cache, the context restore pushes them to the chip.
+ */
+static int mpu6050_runtime_suspend(struct device *dev)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+
+	mutex_lock(&sensor->pm_lock);
+	regcache_cache_only(sensor->regmap, true);
+	regcache_mark_dirty(sensor->regmap);
+	sensor->ctx_lost = true;
+	mpu6050_power_ctl(sensor, false);
+	mutex_unlock(&sensor->pm_lock);
+
+	return 0;
+}
+
+/* Power up only, the resume work restores the context once booted. */
+static int mpu6050_runtime_resume(struct device *dev)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+
+	mutex_lock(&sensor->pm_lock);
+	mpu6050_power_ctl(sensor, true);
+	mutex_unlock(&sensor->pm_lock);
+	queue_delayed_work(sensor->data_wq, &sensor->resume_work, 0);
+
+	return 0;
+}
+#endif
+
+#ifdef CONFIG_PM_SLEEP
+/*
+ * Stop the sample clocks of the running sensors, they keep their enable
+ * state. The poll threads are frozen, so nothing is left running.
+ */
+static int mpu6050_suspend(struct device *dev)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	int type;
 
+	cancel_delayed_work_sync(&sensor->resume_work);
+
+	mutex_lock(&sensor->op_lock);
+	WRITE_ONCE(sensor->suspended, true);
+	for (type = 0; type < SNS_TYPE_MAX; type++)
+		if (mpu6050_sensor_enabled(sensor, type))
+			mpu6050_stop_polling(sensor, type);
+	mutex_unlock(&sensor->op_lock);
+
+	return pm_runtime_force_suspend(dev);
+}
+
+/* Return right away, the context restore runs on data_wq after thaw. */
+static int mpu6050_resume(struct device *dev)
+{
+	struct mpu6050_sensor *sensor = dev_get_drvdata(dev);
+	int ret;
+
+	ret = pm_runtime_force_resume(dev);
+	if (ret)
+		return ret;
+
+	queue_delayed_work(sensor->data_wq, &sensor->resume_work, 0);
 	return 0;
 }
+#endif
+
+static const struct dev_pm_ops mpu6050_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(mpu6050_suspend, mpu6050_resume)
+	SET_RUNTIME_PM_OPS(mpu6050_runtime_suspend, mpu6050_runtime_resume,
+			NULL)
+};
 
 static const struct i2c_device_id mpu6050_ids[] = {
 	{ "mpu6050", 0 },
@@ -1690,13 +6765,122 @@ static struct i2c_driver mpu6050_i2c_driver = {
 		.name	= "mpu6050",
 		.owner	= THIS_MODULE,
 		.of_match_table = mpu6050_of_match,
+		.pm	= &mpu6050_pm_ops,
 	},
 	.probe		= mpu6050_probe,
 	.remove		= mpu6050_remove,
 	.id_table	= mpu6050_ids,
 };
 
-module_i2c_driver(mpu6050_i2c_driver);
+/*
+ * Virtual sensors run the same emulation without an I2C client, each with
+ * its own register file, data source, input and class devices.
+ */
+static const struct mpu6050_platform_data mpu6050_virt_pdata = {
+	.gpio_en = -1,
+	.gpio_int = -1,
+	.place = MPU6050_PLACE_PU,
+};
+
+static int mpu6050_virt_probe(struct platform_device *pdev)
+{
+	return mpu6050_probe_dev(&pdev->dev, pdev->id);
+}
+
+static int mpu6050_virt_remove(struct platform_device *pdev)
+{
+	return mpu6050_remove_dev(&pdev->dev);
+}
+
+static struct platform_driver mpu6050_virt_driver = {
+	.driver	= {
+		.name	= MPU6050_RING_NAME,
+		.owner	= THIS_MODULE,
+		.pm	= &mpu6050_pm_ops,
+	},
+	.probe		= mpu6050_virt_probe,
+	.remove		= mpu6050_virt_remove,
+};
+
+static struct platform_device **mpu6050_virt_devs;
+
+static int mpu6050_virt_init(void)
+{
+	struct platform_device *pdev;
+	unsigned int i;
+	int ret;
+
+	if (virt_devices > MPU6050_VIRT_MAX) {
+		printk("MPU6050 - Limit virtual devices to %d\n",
+			MPU6050_VIRT_MAX);
+		virt_devices = MPU6050_VIRT_MAX;
+	}
+
+	mpu6050_virt_devs = kcalloc(virt_devices, sizeof(*mpu6050_virt_devs),
+			GFP_KERNEL);
+	if (!mpu6050_virt_devs)
+		return -ENOMEM;
+
+	ret = platform_driver_register(&mpu6050_virt_driver);
+	if (ret)
+		goto err_free_devs;
+
+	for (i = 0; i < virt_devices; i++) {
+		pdev = platform_device_register_data(NULL, MPU6050_RING_NAME, i,
+				&mpu6050_virt_pdata,
+				sizeof(mpu6050_virt_pdata));
+		if (IS_ERR(pdev)) {
+			ret = PTR_ERR(pdev);
+			printk("MPU6050 - Failed to create virtual device %u\n",
+				i);
+			goto err_unregister_devs;
+		}
+		mpu6050_virt_devs[i] = pdev;
+	}
+
+	return 0;
+
+err_unregister_devs:
+	while (i--)
+		platform_device_unregister(mpu6050_virt_devs[i]);
+	platform_driver_unregister(&mpu6050_virt_driver);
+err_free_devs:
+	kfree(mpu6050_virt_devs);
+	return ret;
+}
+
+static void mpu6050_virt_exit(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < virt_devices; i++)
+		platform_device_unregister(mpu6050_virt_devs[i]);
+	platform_driver_unregister(&mpu6050_virt_driver);
+	kfree(mpu6050_virt_devs);
+}
+
+static int __init mpu6050_init(void)
+{
+	int ret;
+
+	ret = i2c_add_driver(&mpu6050_i2c_driver);
+	if (ret || !virt_devices)
+		return ret;
+
+	ret = mpu6050_virt_init();
+	if (ret)
+		i2c_del_driver(&mpu6050_i2c_driver);
+	return ret;
+}
+module_init(mpu6050_init);
+
+static void __exit mpu6050_exit(void)
+{
+	if (virt_devices)
+		mpu6050_virt_exit();
+	i2c_del_driver(&mpu6050_i2c_driver);
+}
+module_exit(mpu6050_exit);
 
 MODULE_DESCRIPTION("MPU6050 Tri-axis gyroscope driver");
 MODULE_LICENSE("GPL v2");
@@ -22,11 +22,13 @@
 #define REG_GYRO_CONFIG		0x1B
 #define BITS_SELF_TEST_EN	0xE0
 #define GYRO_CONFIG_FSR_SHIFT	3
+#define GYRO_CONFIG_FSR_MASK	0x18
 
 #define REG_ACCEL_CONFIG	0x1C
 #define REG_ACCEL_MOT_THR	0x1F
 #define REG_ACCEL_MOT_DUR	0x20
 #define ACCL_CONFIG_FSR_SHIFT	3
+#define ACCL_CONFIG_FSR_MASK	0x18
 
 #define REG_ACCELMOT_THR	0x1F
 
@@ -34,8 +36,12 @@
 
 #define REG_FIFO_EN		0x23
 #define FIFO_DISABLE_ALL	0x00
+#define BIT_TEMP_OUT		0x80
 #define BIT_ACCEL_OUT		0x08
 #define BITS_GYRO_OUT		0x70
+#define BIT_GYRO_X_OUT		0x40
+#define BIT_GYRO_Y_OUT		0x20
+#define BIT_GYRO_Z_OUT		0x10
 
 #define REG_INT_PIN_CFG		0x37
 #define BIT_INT_ACTIVE_LOW	0x80
@@ -67,6 +73,8 @@
 #define REG_TEMPERATURE		0x41
 #define REG_RAW_GYRO		0x43
 #define REG_EXT_SENS_DATA_00	0x49
+/* accel, temperature and gyro, read as one burst */
+#define MPU6050_RAW_DATA_LEN	(REG_EXT_SENS_DATA_00 - REG_RAW_ACCEL)
 
 #define BIT_FIFO_RST		0x04
 #define BIT_DMP_RST		0x08
@@ -99,8 +107,10 @@
 				BIT_PWR_GYRO_STBY_MASK)
 
 #define REG_FIFO_COUNT_H	0x72
+#define REG_FIFO_COUNT_L	0x73
 #define REG_FIFO_R_W		0x74
 #define REG_WHOAMI		0x75
+#define MPU6050_NUM_REGS	(REG_WHOAMI + 1)
 
 #define SAMPLE_DIV_MAX		0xFF
 #define ODR_DLPF_DIS		8000
@@ -131,13 +141,16 @@
 #define DEFAULT_MOT_THR		1
 #define DEFAULT_MOT_DET_DUR	1
 #define DEFAULT_MOT_DET_DELAY	0
+#define MOT_THR_MG_PER_LSB	2
 
 /* chip reset wait */
 #define MPU6050_RESET_RETRY_CNT	10
 #define MPU6050_RESET_WAIT_MS	20
 
 /* FIFO related constant */
-#define MPU6050_FIFO_SIZE_BYTE	1024
+#define MPU6050_FIFO_SIZE_BYTE	1024	/* power of two */
+/* accel, temperature and gyro */
+#define MPU6050_FIFO_FRAME_MAX	14
 #define	MPU6050_FIFO_CNT_SIZE	2
 
 /* Define values of register */
@@ -323,4 +336,116 @@ struct mpu6050_platform_data {
 	u8 place;
 };
 
+/**
+ *  struct mpu6050_trace_frame - one frame of a recorded replay trace.
+ *  @timestamp_ns:	capture time of the frame, informational only.
+ *			Replay is paced by the configured poll rate.
+ *  @x:		accelerometer X axis raw value.
+ *  @y:		accelerometer Y axis raw value.
+ *  @z:		accelerometer Z axis raw value.
+ *  @rx:		gyroscope X axis raw value.
+ *  @ry:		gyroscope Y axis raw value.
+ *  @rz:		gyroscope Z axis raw value.
+ *  @reserved:	must be zero.
+ *
+ *  A trace is a flat array of these frames written to the "trace" binary
+ *  attribute of the i2c device.
+ */
+struct mpu6050_trace_frame {
+	s64 timestamp_ns;
+	s16 x;
+	s16 y;
+	s16 z;
+	s16 rx;
+	s16 ry;
+	s16 rz;
+	u32 reserved;
+} __packed;
+
+#define MPU6050_RING_MAGIC	0x36303530	/* "6050" */
+#define MPU6050_RING_VERSION	1
+#define MPU6050_RING_FLAG_FLUSH	0x01
+
+/**
+ *  struct mpu6050_ring_header - control page of the /dev/fake6050 ring.
+ *  @magic:		MPU6050_RING_MAGIC.
+ *  @version:		MPU6050_RING_VERSION.
+ *  @data_offset:	offset of the first frame in the mapping.
+ *  @nr_frames:		number of frames in the ring, a power of two.
+ *  @frame_size:	size of struct mpu6050_ring_frame.
+ *  @head:		free running count of frames written by the driver.
+ *  @overruns:		frames dropped because the ring was full.
+ *  @tail:		free running count of frames consumed, written by
+ *			the consumer.
+ *  @watermark:		unread frames needed before poll() reports the
+ *			ring readable, written by the consumer. 0 means 1.
+ *
+ *  Frame n is at index n & (nr_frames - 1). The driver stores @head with
+ *  release semantics once the frame is written, the consumer loads it with
+ *  acquire semantics and stores @tail once it is done with the frames.
+ *  Producer and consumer fields live in separate cache lines.
+ */
+struct mpu6050_ring_header {
+	u32 magic;
+	u32 version;
+	u32 data_offset;
+	u32 nr_frames;
+	u32 frame_size;
+	u32 reserved0[11];
+	u32 head;
+	u32 overruns;
+	u32 reserved1[14];
+	u32 tail;
+	u32 watermark;
+	u32 reserved2[14];
+};
+
+/**
+ *  struct mpu6050_ring_frame - one sample in the /dev/fake6050 ring.
+ *  @timestamp_ns:	sample timestamp, CLOCK_BOOTTIME.
+ *  @data:		X, Y and Z axis value after remapping.
+ *  @sns_type:		0 for gyroscope, 1 for accelerometer.
+ *  @flags:		MPU6050_RING_FLAG_FLUSH marks a flush complete
+ *			frame without data, which always makes poll()
+ *			report the ring readable.
+ */
+struct mpu6050_ring_frame {
+	s64 timestamp_ns;
+	s16 data[3];
+	u8 sns_type;
+	u8 flags;
+};
+
+enum mpu6050_stat {
+	MPU6050_STAT_SAMPLES = 0,	/* samples delivered to userspace */
+	MPU6050_STAT_DROPPED,		/* catch-up drops and FIFO overflows */
+	MPU6050_STAT_OVERRUNS,		/* ticks serviced after their deadline */
+	MPU6050_STAT_INJECTED,		/* samples injected through sysfs */
+	MPU6050_STAT_DUPLICATES,	/* samples equal to the previous one */
+	MPU6050_STAT_ENABLES,
+	MPU6050_STAT_DISABLES,
+	MPU6050_STAT_RATE_CHANGES,	/* effective sampling period changes */
+	MPU6050_STAT_ENABLED_NS,	/* time spent enabled */
+	MPU6050_STAT_PARKS,		/* streams parked while still */
+	MPU6050_STAT_ENABLE_ERRORS,	/* enables that failed to stream */
+	MPU6050_STAT_MAX,
+};
+
+#define MPU6050_STATS_VERSION	2
+
+/**
+ *  struct mpu6050_stats_snapshot - debugfs "stats_bin" file contents.
+ *  @version:		MPU6050_STATS_VERSION.
+ *  @nr_stats:		MPU6050_STAT_MAX.
+ *  @timestamp_ns:	CLOCK_BOOTTIME time of the snapshot.
+ *  @stats:		counters indexed by sensor type (0 for gyroscope,
+ *			1 for accelerometer) and enum mpu6050_stat.
+ */
+struct mpu6050_stats_snapshot {
+	u32 version;
+	u32 nr_stats;
+	s64 timestamp_ns;
+	u64 stats[2][MPU6050_STAT_MAX];
+};
+
 #endif /* __MPU6050_H__ */
@@ -0,0 +1,184 @@
+/*
+ * MPU6050 6-axis gyroscope + accelerometer driver tracepoints
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM fake6050
+
+#if !defined(_FAKE6050_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _FAKE6050_TRACE_H
+
+#include <linux/device.h>
+#include <linux/tracepoint.h>
+
+/* matches SNS_TYPE_GYRO and SNS_TYPE_ACCEL */
+#define show_mpu6050_sns_type(type)				\
+	__print_symbolic(type, { 0, "gyro" }, { 1, "accel" })
+
+TRACE_EVENT(mpu6050_power,
+
+	TP_PROTO(struct device *dev, bool on, bool changed),
+
+	TP_ARGS(dev, on, changed),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(bool, on)
+		__field(bool, changed)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->on = on;
+		__entry->changed = changed;
+	),
+
+	TP_printk("%s on=%d changed=%d",
+		__get_str(dev), __entry->on, __entry->changed)
+);
+
+TRACE_EVENT(mpu6050_switch_engine,
+
+	TP_PROTO(struct device *dev, bool en, u32 mask),
+
+	TP_ARGS(dev, en, mask),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(bool, en)
+		__field(u32, mask)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->en = en;
+		__entry->mask = mask;
+	),
+
+	TP_printk("%s en=%d mask=0x%x",
+		__get_str(dev), __entry->en, __entry->mask)
+);
+
+TRACE_EVENT(mpu6050_enable,
+
+	TP_PROTO(struct device *dev, int sns_type, bool enable),
+
+	TP_ARGS(dev, sns_type, enable),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(int, sns_type)
+		__field(bool, enable)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->sns_type = sns_type;
+		__entry->enable = enable;
+	),
+
+	TP_printk("%s %s enable=%d", __get_str(dev),
+		show_mpu6050_sns_type(__entry->sns_type), __entry->enable)
+);
+
+TRACE_EVENT(mpu6050_sample_rate,
+
+	TP_PROTO(struct device *dev, u64 period_ns, u32 odr, u32 rate_div),
+
+	TP_ARGS(dev, period_ns, odr, rate_div),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(u64, period_ns)
+		__field(u32, odr)
+		__field(u32, rate_div)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->period_ns = period_ns;
+		__entry->odr = odr;
+		__entry->rate_div = rate_div;
+	),
+
+	TP_printk("%s period_ns=%llu odr=%u rate_div=%u", __get_str(dev),
+		__entry->period_ns, __entry->odr, __entry->rate_div)
+);
+
+TRACE_EVENT(mpu6050_poll_period,
+
+	TP_PROTO(struct device *dev, int sns_type, u64 req_ns, u64 poll_ns,
+		u32 burst),
+
+	TP_ARGS(dev, sns_type, req_ns, poll_ns, burst),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(int, sns_type)
+		__field(u64, req_ns)
+		__field(u64, poll_ns)
+		__field(u32, burst)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->sns_type = sns_type;
+		__entry->req_ns = req_ns;
+		__entry->poll_ns = poll_ns;
+		__entry->burst = burst;
+	),
+
+	TP_printk("%s %s req_ns=%llu poll_ns=%llu burst=%u", __get_str(dev),
+		show_mpu6050_sns_type(__entry->sns_type),
+		__entry->req_ns, __entry->poll_ns, __entry->burst)
+);
+
+TRACE_EVENT(mpu6050_sample,
+
+	TP_PROTO(struct device *dev, int sns_type, const s16 *data,
+		s64 timestamp_ns),
+
+	TP_ARGS(dev, sns_type, data, timestamp_ns),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(int, sns_type)
+		__field(s16, x)
+		__field(s16, y)
+		__field(s16, z)
+		__field(s64, timestamp_ns)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->sns_type = sns_type;
+		__entry->x = data[0];
+		__entry->y = data[1];
+		__entry->z = data[2];
+		__entry->timestamp_ns = timestamp_ns;
+	),
+
+	TP_printk("%s %s x=%d y=%d z=%d timestamp_ns=%lld", __get_str(dev),
+		show_mpu6050_sns_type(__entry->sns_type),
+		__entry->x, __entry->y, __entry->z, __entry->timestamp_ns)
+);
+
+#endif /* _FAKE6050_TRACE_H */
+
+/* the header lives next to the driver, not in include/trace/events */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE fake6050_trace
+
+#include <trace/define_trace.h>
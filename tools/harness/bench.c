@@ -0,0 +1,351 @@
+/*
+ * Throughput and timing benchmark of the fake6050 driver core
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Loads the driver with virtual sensors, streams accel and gyro at one rate
+ * and counts what reaches the input devices. Reported are samples per
+ * second, process CPU time per sample, the error of the sample timestamp
+ * intervals against the period and the delivery latency, from the sample
+ * timestamp to the input_sync() of the sample.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include "kshim.h"
+
+#define BENCH_MAX_STREAMS	(2 * 64)
+/* histograms are 1us granular up to 20ms, the last bucket takes the rest */
+#define BENCH_HIST_BUCKETS	20001
+
+struct bench_stream {
+	struct input_dev *idev;
+	struct sensors_classdev *cdev;
+	s64 period_ns;
+	s64 sec;
+	s64 last_ts;
+	u64 samples;
+};
+
+struct bench_hist {
+	u64 count;
+	u64 sum;
+	double sum_sq;
+	u64 max;
+	u32 bucket[BENCH_HIST_BUCKETS];
+};
+
+static struct bench_stream streams[BENCH_MAX_STREAMS];
+static unsigned int nr_streams;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct bench_hist interval_err;
+static struct bench_hist latency;
+static bool measuring;
+
+static void bench_hist_add(struct bench_hist *h, u64 v)
+{
+	u64 us = v / NSEC_PER_USEC;
+
+	h->count++;
+	h->sum += v;
+	h->sum_sq += (double)v * v;
+	if (v > h->max)
+		h->max = v;
+	h->bucket[min_t(u64, us, BENCH_HIST_BUCKETS - 1)]++;
+}
+
+/* upper bound of the bucket holding the @pct percentile, in us */
+static unsigned int bench_hist_pct(const struct bench_hist *h, double pct)
+{
+	u64 target = (u64)ceil(h->count * pct / 100.0);
+	u64 seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < BENCH_HIST_BUCKETS; i++) {
+		seen += h->bucket[i];
+		if (seen >= target)
+			return i + 1;
+	}
+	return BENCH_HIST_BUCKETS;
+}
+
+static void bench_hist_print(const char *name, const struct bench_hist *h)
+{
+	double mean, sd;
+
+	if (!h->count) {
+		printf("%-16s no samples\n", name);
+		return;
+	}
+
+	mean = (double)h->sum / h->count;
+	sd = sqrt(fmax(h->sum_sq / h->count - mean * mean, 0.0));
+	printf("%-16s mean %8.1f us  sd %8.1f us  p50 <%6u us  p99 <%6u us  max %8.1f us\n",
+		name, mean / 1000.0, sd / 1000.0, bench_hist_pct(h, 50),
+		bench_hist_pct(h, 99), h->max / 1000.0);
+}
+
+static struct bench_stream *bench_stream(struct input_dev *dev)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_streams; i++)
+		if (streams[i].idev == dev)
+			return &streams[i];
+	return NULL;
+}
+
+static void bench_input_event(struct input_dev *dev, unsigned int type,
+			unsigned int code, int value)
+{
+	struct bench_stream *s;
+	s64 now, ts;
+
+	if (type != EV_SYN)
+		return;
+	s = bench_stream(dev);
+	if (!s)
+		return;
+
+	switch (code) {
+	case SYN_TIME_SEC:
+		s->sec = value;
+		return;
+	case SYN_TIME_NSEC:
+		ts = s->sec * NSEC_PER_SEC + (u32)value;
+		now = kshim_clock_ns();
+		pthread_mutex_lock(&stats_lock);
+		if (measuring) {
+			s->samples++;
+			bench_hist_add(&latency, max_t(s64, now - ts, 0));
+			if (s->last_ts)
+				bench_hist_add(&interval_err,
+					abs(ts - s->last_ts - s->period_ns));
+		}
+		s->last_ts = ts;
+		pthread_mutex_unlock(&stats_lock);
+		return;
+	}
+}
+
+static s64 bench_cpu_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (s64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void bench_sleep_ms(unsigned int ms)
+{
+	struct timespec ts = {
+		.tv_sec = ms / MSEC_PER_SEC,
+		.tv_nsec = (ms % MSEC_PER_SEC) * NSEC_PER_MSEC,
+	};
+
+	while (nanosleep(&ts, &ts) && (errno == EINTR))
+		;
+}
+
+static int bench_add_stream(const char *input_name, const char *cdev_name,
+			s64 period_ns)
+{
+	struct bench_stream *s = &streams[nr_streams];
+	char buf[32];
+	ssize_t ret;
+
+	s->idev = kshim_find_input(input_name);
+	s->cdev = kshim_find_cdev(cdev_name);
+	if (!s->idev || !s->cdev) {
+		fprintf(stderr, "bench: %s not found\n", input_name);
+		return -ENODEV;
+	}
+
+	snprintf(buf, sizeof(buf), "%lld", period_ns);
+	ret = kshim_attr_store(&s->idev->dev, "poll_period_ns", buf);
+	if (ret < 0) {
+		fprintf(stderr, "bench: %s: poll_period_ns: %zd\n",
+			input_name, ret);
+		return ret;
+	}
+
+	nr_streams++;
+	return 0;
+}
+
+/* the driver clamps the period to its ODR, use the one a stream runs at */
+static int bench_read_period(struct bench_stream *s, s64 period_ns)
+{
+	char buf[PAGE_SIZE];
+	ssize_t ret;
+
+	ret = kshim_attr_show(&s->idev->dev, "poll_period_ns", buf);
+	if ((ret < 0) || kstrtoll(buf, 10, &s->period_ns) || !s->period_ns) {
+		fprintf(stderr, "bench: %s: poll_period_ns unreadable\n",
+			s->idev->name);
+		return -EIO;
+	}
+	if (s->period_ns != period_ns)
+		printf("%s: period %lld ns instead of %lld ns\n",
+			s->idev->name, s->period_ns, period_ns);
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-t seconds] [-r rate_hz] [-n devices] [-s accel|gyro|both]\n"
+		"          [-m split|unified|fifo|irq] [-w warmup_ms] [-v]\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int seconds = 5, rate = 200, devices = 1, warmup_ms = 500;
+	const char *mode = "split", *sensors = "both";
+	s64 wall_start, wall_ns, cpu_start, cpu_ns;
+	u64 samples = 0;
+	double expected = 0.0;
+	char in_name[32], cdev_name[32], buf[PAGE_SIZE];
+	unsigned int i;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "t:r:n:s:m:w:v")) != -1) {
+		switch (opt) {
+		case 't':
+			seconds = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			rate = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			devices = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			sensors = optarg;
+			break;
+		case 'm':
+			mode = optarg;
+			break;
+		case 'w':
+			warmup_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			kshim_printk_enabled = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!seconds || !rate || !devices || (devices > 64))
+		usage(argv[0]);
+	if (strcmp(sensors, "accel") && strcmp(sensors, "gyro") &&
+		strcmp(sensors, "both"))
+		usage(argv[0]);
+
+	if (!strcmp(mode, "unified"))
+		kshim_param_set("unified_sched", "1");
+	else if (!strcmp(mode, "fifo"))
+		kshim_param_set("hw_fifo", "1");
+	else if (!strcmp(mode, "irq"))
+		kshim_param_set("use_irq", "1");
+	else if (strcmp(mode, "split"))
+		usage(argv[0]);
+	snprintf(buf, sizeof(buf), "%u", devices);
+	kshim_param_set("virt_devices", buf);
+
+	kshim_hooks.input_event = bench_input_event;
+
+	ret = kshim_module_init();
+	if (ret) {
+		fprintf(stderr, "bench: module init failed: %d\n", ret);
+		return 1;
+	}
+
+	for (i = 0; i < devices; i++) {
+		if (strcmp(sensors, "gyro")) {
+			snprintf(in_name, sizeof(in_name), "MPU6050-accel.%u", i);
+			ret = bench_add_stream(in_name, in_name,
+					NSEC_PER_SEC / rate);
+			if (ret)
+				goto exit;
+		}
+		if (strcmp(sensors, "accel")) {
+			snprintf(in_name, sizeof(in_name), "gyroscope.%u", i);
+			snprintf(cdev_name, sizeof(cdev_name), "MPU6050-gyro.%u",
+				i);
+			ret = bench_add_stream(in_name, cdev_name,
+					NSEC_PER_SEC / rate);
+			if (ret)
+				goto exit;
+		}
+	}
+
+	for (i = 0; i < nr_streams; i++) {
+		ret = streams[i].cdev->sensors_enable(streams[i].cdev, 1);
+		if (ret) {
+			fprintf(stderr, "bench: enable %s: %d\n",
+				streams[i].cdev->name, ret);
+			goto disable;
+		}
+	}
+
+	bench_sleep_ms(warmup_ms);
+
+	for (i = 0; i < nr_streams; i++) {
+		ret = bench_read_period(&streams[i], NSEC_PER_SEC / rate);
+		if (ret) {
+			i = nr_streams;
+			goto disable;
+		}
+	}
+
+	pthread_mutex_lock(&stats_lock);
+	measuring = true;
+	pthread_mutex_unlock(&stats_lock);
+	wall_start = kshim_clock_ns();
+	cpu_start = bench_cpu_ns();
+
+	bench_sleep_ms(seconds * MSEC_PER_SEC);
+
+	pthread_mutex_lock(&stats_lock);
+	measuring = false;
+	pthread_mutex_unlock(&stats_lock);
+	cpu_ns = bench_cpu_ns() - cpu_start;
+	wall_ns = kshim_clock_ns() - wall_start;
+
+	for (i = 0; i < nr_streams; i++) {
+		samples += streams[i].samples;
+		expected += (double)wall_ns / streams[i].period_ns;
+	}
+
+	printf("mode %s, %u device(s), %u stream(s) at %u Hz, %.2f s\n",
+		mode, devices, nr_streams, rate, wall_ns / 1e9);
+	printf("%-16s %.0f/s (%llu of %.0f expected, %.2f%%)\n", "samples",
+		samples * 1e9 / wall_ns, samples, expected,
+		expected ? 100.0 * samples / expected : 0.0);
+	printf("%-16s %.0f ns/sample, %.2f%% of one CPU\n", "cpu",
+		samples ? (double)cpu_ns / samples : 0.0,
+		100.0 * cpu_ns / wall_ns);
+	bench_hist_print("interval error", &interval_err);
+	bench_hist_print("latency", &latency);
+
+	if (kshim_attr_show(&streams[0].idev->dev, "overruns", buf) > 0)
+		printf("%-16s %s", "overruns[0]", buf);
+
+disable:
+	while (i--)
+		streams[i].cdev->sensors_enable(streams[i].cdev, 0);
+exit:
+	kshim_module_exit();
+	return ret ? 1 : 0;
+}
@@ -0,0 +1,2813 @@
+/*
+ * Userspace stand-in for the kernel APIs used by fake6050.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <sys/prctl.h>
+#include "kshim.h"
+
+struct kshim_hooks kshim_hooks;
+bool kshim_printk_enabled;
+
+/* harness wide registries: params, devices, drivers, input and class devs */
+static pthread_mutex_t reg_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void kshim_cond_init(pthread_cond_t *cond)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+static void kshim_ns_to_timespec(s64 ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / NSEC_PER_SEC;
+	ts->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+void kshim_set_thread_name(const char *name)
+{
+	char comm[16];
+	size_t len = min_t(size_t, strlen(name), sizeof(comm) - 1);
+
+	/* truncated to the 15 characters of a task name */
+	memcpy(comm, name, len);
+	comm[len] = '\0';
+	pthread_setname_np(pthread_self(), comm);
+}
+
+/* printk and strings */
+
+int printk(const char *fmt, ...)
+{
+	va_list args;
+	int ret;
+
+	if (!kshim_printk_enabled)
+		return 0;
+
+	va_start(args, fmt);
+	ret = vfprintf(stderr, fmt, args);
+	va_end(args);
+	return ret;
+}
+
+int scnprintf(char *buf, size_t size, const char *fmt, ...)
+{
+	va_list args;
+	int ret;
+
+	if (!size)
+		return 0;
+
+	va_start(args, fmt);
+	ret = vsnprintf(buf, size, fmt, args);
+	va_end(args);
+	if (ret < 0)
+		return 0;
+	return ((size_t)ret >= size) ? (int)size - 1 : ret;
+}
+
+/* freed with kfree(), which is free() */
+char *kasprintf(gfp_t gfp, const char *fmt, ...)
+{
+	va_list args;
+	char *p;
+	int ret;
+
+	va_start(args, fmt);
+	ret = vasprintf(&p, fmt, args);
+	va_end(args);
+	return (ret < 0) ? NULL : p;
+}
+
+char *skip_spaces(const char *str)
+{
+	while (isspace((unsigned char)*str))
+		++str;
+	return (char *)str;
+}
+
+char *strim(char *s)
+{
+	size_t size = strlen(s);
+	char *end;
+
+	if (!size)
+		return s;
+
+	end = s + size - 1;
+	while (end >= s && isspace((unsigned char)*end))
+		end--;
+	*(end + 1) = '\0';
+
+	return skip_spaces(s);
+}
+
+/* kernel rules: optional 0x/0 prefix, digits, one trailing newline */
+static int kshim_parse_ull(const char *s, unsigned int base,
+			unsigned long long *res)
+{
+	unsigned long long acc = 0;
+	unsigned int digit;
+	int n = 0;
+
+	if (s[0] == '+')
+		s++;
+	if (!base) {
+		if ((s[0] == '0') && (tolower((unsigned char)s[1]) == 'x') &&
+			isxdigit((unsigned char)s[2]))
+			base = 16;
+		else if (s[0] == '0')
+			base = 8;
+		else
+			base = 10;
+	}
+	if ((base == 16) && (s[0] == '0') &&
+		(tolower((unsigned char)s[1]) == 'x'))
+		s += 2;
+
+	for (; *s; s++, n++) {
+		if (isdigit((unsigned char)*s))
+			digit = *s - '0';
+		else if (isxdigit((unsigned char)*s))
+			digit = tolower((unsigned char)*s) - 'a' + 10;
+		else
+			break;
+		if (digit >= base)
+			break;
+		if (acc > (ULLONG_MAX - digit) / base)
+			return -ERANGE;
+		acc = acc * base + digit;
+	}
+
+	if (!n)
+		return -EINVAL;
+	if (*s == '\n')
+		s++;
+	if (*s)
+		return -EINVAL;
+
+	*res = acc;
+	return 0;
+}
+
+int kstrtoull(const char *s, unsigned int base, unsigned long long *res)
+{
+	return kshim_parse_ull(s, base, res);
+}
+
+int kstrtoll(const char *s, unsigned int base, long long *res)
+{
+	unsigned long long tmp;
+	int ret;
+
+	if (s[0] == '-') {
+		ret = kshim_parse_ull(s + 1, base, &tmp);
+		if (ret)
+			return ret;
+		if (tmp > (unsigned long long)LLONG_MAX + 1)
+			return -ERANGE;
+		*res = -(long long)tmp;
+		return 0;
+	}
+
+	ret = kshim_parse_ull(s, base, &tmp);
+	if (ret)
+		return ret;
+	if (tmp > LLONG_MAX)
+		return -ERANGE;
+	*res = tmp;
+	return 0;
+}
+
+#define KSHIM_KSTRTOU(name, type, maxval)				\
+int name(const char *s, unsigned int base, type *res)			\
+{									\
+	unsigned long long tmp;						\
+	int ret = kstrtoull(s, base, &tmp);				\
+									\
+	if (ret)							\
+		return ret;						\
+	if (tmp > (maxval))						\
+		return -ERANGE;						\
+	*res = tmp;							\
+	return 0;							\
+}
+
+#define KSHIM_KSTRTOS(name, type, minval, maxval)			\
+int name(const char *s, unsigned int base, type *res)			\
+{									\
+	long long tmp;							\
+	int ret = kstrtoll(s, base, &tmp);				\
+									\
+	if (ret)							\
+		return ret;						\
+	if ((tmp < (minval)) || (tmp > (maxval)))			\
+		return -ERANGE;						\
+	*res = tmp;							\
+	return 0;							\
+}
+
+KSHIM_KSTRTOU(kstrtoul, unsigned long, ULONG_MAX)
+KSHIM_KSTRTOU(kstrtouint, unsigned int, UINT_MAX)
+KSHIM_KSTRTOU(kstrtou32, u32, UINT_MAX)
+KSHIM_KSTRTOU(kstrtou16, u16, USHRT_MAX)
+KSHIM_KSTRTOU(kstrtou8, u8, UCHAR_MAX)
+KSHIM_KSTRTOS(kstrtol, long, LONG_MIN, LONG_MAX)
+KSHIM_KSTRTOS(kstrtoint, int, INT_MIN, INT_MAX)
+KSHIM_KSTRTOS(kstrtos16, s16, SHRT_MIN, SHRT_MAX)
+
+int kstrtobool(const char *s, bool *res)
+{
+	if (!s)
+		return -EINVAL;
+
+	switch (s[0]) {
+	case 'y':
+	case 'Y':
+	case '1':
+		*res = true;
+		return 0;
+	case 'n':
+	case 'N':
+	case '0':
+		*res = false;
+		return 0;
+	case 'o':
+	case 'O':
+		if ((s[1] == 'n') || (s[1] == 'N')) {
+			*res = true;
+			return 0;
+		}
+		if ((s[1] == 'f') || (s[1] == 'F')) {
+			*res = false;
+			return 0;
+		}
+		break;
+	}
+
+	return -EINVAL;
+}
+
+/* memory */
+
+void *vmalloc_user(unsigned long size)
+{
+	void *p = aligned_alloc(PAGE_SIZE, PAGE_ALIGN(size));
+
+	if (p)
+		memset(p, 0, PAGE_ALIGN(size));
+	return p;
+}
+
+ssize_t simple_read_from_buffer(void __user *to, size_t count, loff_t *ppos,
+				const void *from, size_t available)
+{
+	loff_t pos = *ppos;
+
+	if (pos < 0)
+		return -EINVAL;
+	if ((size_t)pos >= available || !count)
+		return 0;
+	if (count > available - pos)
+		count = available - pos;
+	memcpy(to, (const char *)from + pos, count);
+	*ppos = pos + count;
+	return count;
+}
+
+u32 prandom_u32(void)
+{
+	static __thread u64 state;
+
+	if (!state)
+		state = (u64)kshim_clock_ns() | 1;
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state >> 32;
+}
+
+/* RCU */
+
+static pthread_rwlock_t rcu_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+void rcu_read_lock(void)
+{
+	pthread_rwlock_rdlock(&rcu_lock);
+}
+
+void rcu_read_unlock(void)
+{
+	pthread_rwlock_unlock(&rcu_lock);
+}
+
+void synchronize_rcu(void)
+{
+	pthread_rwlock_wrlock(&rcu_lock);
+	pthread_rwlock_unlock(&rcu_lock);
+}
+
+/* sleeping */
+
+void usleep_range(unsigned long min, unsigned long max)
+{
+	struct timespec ts;
+
+	kshim_ns_to_timespec((s64)min * NSEC_PER_USEC, &ts);
+	while (nanosleep(&ts, &ts) && (errno == EINTR))
+		;
+}
+
+void msleep(unsigned int msecs)
+{
+	usleep_range((unsigned long)msecs * USEC_PER_MSEC,
+			(unsigned long)msecs * USEC_PER_MSEC);
+}
+
+/* kthreads */
+
+struct task_struct {
+	pthread_t thread;
+	int (*fn)(void *data);
+	void *data;
+	char comm[16];
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool started;
+	bool should_stop;
+	wait_queue_head_t *waiting;
+	int ret;
+};
+
+static __thread struct task_struct *kshim_current;
+
+static void *kshim_kthread(void *arg)
+{
+	struct task_struct *task = arg;
+
+	kshim_current = task;
+	kshim_set_thread_name(task->comm);
+
+	pthread_mutex_lock(&task->lock);
+	while (!task->started && !task->should_stop)
+		pthread_cond_wait(&task->cond, &task->lock);
+	pthread_mutex_unlock(&task->lock);
+
+	if (!task->started)
+		task->ret = -EINTR;
+	else
+		task->ret = task->fn(task->data);
+	return NULL;
+}
+
+struct task_struct *kthread_create_on_node(int (*fn)(void *data), void *data,
+					int node, const char *fmt, ...)
+{
+	struct task_struct *task;
+	va_list args;
+
+	task = calloc(1, sizeof(*task));
+	if (!task)
+		return ERR_PTR(-ENOMEM);
+
+	task->fn = fn;
+	task->data = data;
+	va_start(args, fmt);
+	vsnprintf(task->comm, sizeof(task->comm), fmt, args);
+	va_end(args);
+	pthread_mutex_init(&task->lock, NULL);
+	pthread_cond_init(&task->cond, NULL);
+
+	if (pthread_create(&task->thread, NULL, kshim_kthread, task)) {
+		free(task);
+		return ERR_PTR(-EAGAIN);
+	}
+
+	return task;
+}
+
+int wake_up_process(struct task_struct *task)
+{
+	pthread_mutex_lock(&task->lock);
+	task->started = true;
+	pthread_cond_signal(&task->cond);
+	pthread_mutex_unlock(&task->lock);
+	return 1;
+}
+
+bool kthread_should_stop(void)
+{
+	return kshim_current &&
+		__atomic_load_n(&kshim_current->should_stop, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * The thread checks kthread_should_stop() in its wait condition after it
+ * published the queue it sleeps on, so waking that queue cannot be missed.
+ */
+int kthread_stop(struct task_struct *task)
+{
+	wait_queue_head_t *wq;
+	int ret;
+
+	__atomic_store_n(&task->should_stop, true, __ATOMIC_SEQ_CST);
+	pthread_mutex_lock(&task->lock);
+	pthread_cond_signal(&task->cond);
+	pthread_mutex_unlock(&task->lock);
+
+	wq = __atomic_load_n(&task->waiting, __ATOMIC_SEQ_CST);
+	if (wq)
+		wake_up(wq);
+
+	pthread_join(task->thread, NULL);
+	ret = task->ret;
+	pthread_cond_destroy(&task->cond);
+	pthread_mutex_destroy(&task->lock);
+	free(task);
+	return ret;
+}
+
+/* wait queues and completions */
+
+void init_waitqueue_head(wait_queue_head_t *wq)
+{
+	pthread_mutex_init(&wq->lock, NULL);
+	kshim_cond_init(&wq->cond);
+}
+
+void wake_up(wait_queue_head_t *wq)
+{
+	pthread_mutex_lock(&wq->lock);
+	pthread_cond_broadcast(&wq->cond);
+	pthread_mutex_unlock(&wq->lock);
+}
+
+void kshim_wait_enter(wait_queue_head_t *wq)
+{
+	pthread_mutex_lock(&wq->lock);
+	if (kshim_current)
+		__atomic_store_n(&kshim_current->waiting, wq, __ATOMIC_SEQ_CST);
+}
+
+void kshim_wait_sleep(wait_queue_head_t *wq)
+{
+	pthread_cond_wait(&wq->cond, &wq->lock);
+}
+
+/* sleep at most *timeout jiffies, *timeout is left with what remains */
+int kshim_wait_sleep_timeout(wait_queue_head_t *wq, long *timeout)
+{
+	s64 start = kshim_clock_ns();
+	s64 left = (s64)*timeout * NSEC_PER_MSEC;
+	struct timespec ts;
+	int ret;
+
+	kshim_ns_to_timespec(start + left, &ts);
+	ret = pthread_cond_timedwait(&wq->cond, &wq->lock, &ts);
+	left -= kshim_clock_ns() - start;
+	*timeout = (left > 0) ? DIV_ROUND_UP(left, NSEC_PER_MSEC) : 0;
+	return ret;
+}
+
+void kshim_wait_leave(wait_queue_head_t *wq)
+{
+	if (kshim_current)
+		__atomic_store_n(&kshim_current->waiting, NULL,
+				__ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&wq->lock);
+}
+
+void init_completion(struct completion *x)
+{
+	x->done = 0;
+	init_waitqueue_head(&x->wait);
+}
+
+void reinit_completion(struct completion *x)
+{
+	pthread_mutex_lock(&x->wait.lock);
+	x->done = 0;
+	pthread_mutex_unlock(&x->wait.lock);
+}
+
+void complete(struct completion *x)
+{
+	pthread_mutex_lock(&x->wait.lock);
+	if (x->done != UINT_MAX)
+		x->done++;
+	pthread_cond_broadcast(&x->wait.cond);
+	pthread_mutex_unlock(&x->wait.lock);
+}
+
+void complete_all(struct completion *x)
+{
+	pthread_mutex_lock(&x->wait.lock);
+	x->done = UINT_MAX;
+	pthread_cond_broadcast(&x->wait.cond);
+	pthread_mutex_unlock(&x->wait.lock);
+}
+
+void wait_for_completion(struct completion *x)
+{
+	kshim_wait_enter(&x->wait);
+	while (!x->done)
+		kshim_wait_sleep(&x->wait);
+	if (x->done != UINT_MAX)
+		x->done--;
+	kshim_wait_leave(&x->wait);
+}
+
+unsigned long wait_for_completion_timeout(struct completion *x,
+					unsigned long timeout)
+{
+	long left = timeout;
+
+	kshim_wait_enter(&x->wait);
+	while (!x->done && (left > 0))
+		kshim_wait_sleep_timeout(&x->wait, &left);
+	if (x->done) {
+		if (x->done != UINT_MAX)
+			x->done--;
+		if (!left)
+			left = 1;
+	} else {
+		left = 0;
+	}
+	kshim_wait_leave(&x->wait);
+
+	return left;
+}
+
+bool completion_done(struct completion *x)
+{
+	return READ_ONCE(x->done) != 0;
+}
+
+/* hrtimers: one expiry thread, timers sorted by expiry */
+
+static pthread_mutex_t hr_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t hr_cond;		/* the first expiry changed */
+static pthread_cond_t hr_idle;		/* a callback returned */
+static struct hrtimer *hr_head;
+
+static void hr_enqueue(struct hrtimer *timer)
+{
+	struct hrtimer **pos = &hr_head;
+
+	while (*pos && ((*pos)->expires <= timer->expires))
+		pos = &(*pos)->next;
+	timer->next = *pos;
+	*pos = timer;
+	timer->queued = true;
+	if (hr_head == timer)
+		pthread_cond_signal(&hr_cond);
+}
+
+static void hr_dequeue(struct hrtimer *timer)
+{
+	struct hrtimer **pos = &hr_head;
+
+	while (*pos && (*pos != timer))
+		pos = &(*pos)->next;
+	if (*pos)
+		*pos = timer->next;
+	timer->next = NULL;
+	timer->queued = false;
+}
+
+static void *kshim_hrtimer_thread(void *arg)
+{
+	enum hrtimer_restart ret;
+	struct hrtimer *timer;
+	struct timespec ts;
+
+	kshim_set_thread_name("hrtimer");
+	/* expire on time, like the hrtimer interrupt */
+	prctl(PR_SET_TIMERSLACK, 1UL);
+
+	pthread_mutex_lock(&hr_lock);
+	for (;;) {
+		timer = hr_head;
+		if (!timer) {
+			pthread_cond_wait(&hr_cond, &hr_lock);
+			continue;
+		}
+		if (timer->expires > kshim_clock_ns()) {
+			kshim_ns_to_timespec(timer->expires, &ts);
+			pthread_cond_timedwait(&hr_cond, &hr_lock, &ts);
+			continue;
+		}
+
+		hr_dequeue(timer);
+		timer->running = true;
+		pthread_mutex_unlock(&hr_lock);
+		ret = timer->function(timer);
+		pthread_mutex_lock(&hr_lock);
+		timer->running = false;
+		if ((ret == HRTIMER_RESTART) && !timer->queued)
+			hr_enqueue(timer);
+		pthread_cond_broadcast(&hr_idle);
+	}
+
+	return NULL;
+}
+
+void hrtimer_init(struct hrtimer *timer, clockid_t clock,
+		enum hrtimer_mode mode)
+{
+	memset(timer, 0, sizeof(*timer));
+}
+
+int hrtimer_start(struct hrtimer *timer, ktime_t tim,
+		const enum hrtimer_mode mode)
+{
+	pthread_mutex_lock(&hr_lock);
+	if (timer->queued)
+		hr_dequeue(timer);
+	timer->expires = (mode & HRTIMER_MODE_REL) ? kshim_clock_ns() + tim :
+			tim;
+	hr_enqueue(timer);
+	pthread_mutex_unlock(&hr_lock);
+
+	return 0;
+}
+
+int hrtimer_try_to_cancel(struct hrtimer *timer)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&hr_lock);
+	if (timer->queued) {
+		hr_dequeue(timer);
+		ret = 1;
+	} else if (timer->running) {
+		ret = -1;
+	}
+	pthread_mutex_unlock(&hr_lock);
+
+	return ret;
+}
+
+int hrtimer_cancel(struct hrtimer *timer)
+{
+	int ret;
+
+	pthread_mutex_lock(&hr_lock);
+	for (;;) {
+		if (timer->queued) {
+			hr_dequeue(timer);
+			ret = 1;
+			break;
+		}
+		if (!timer->running) {
+			ret = 0;
+			break;
+		}
+		pthread_cond_wait(&hr_idle, &hr_lock);
+	}
+	pthread_mutex_unlock(&hr_lock);
+
+	return ret;
+}
+
+bool hrtimer_active(const struct hrtimer *timer)
+{
+	return READ_ONCE(timer->queued) || READ_ONCE(timer->running);
+}
+
+bool hrtimer_is_queued(struct hrtimer *timer)
+{
+	return READ_ONCE(timer->queued);
+}
+
+u64 hrtimer_forward(struct hrtimer *timer, ktime_t now, ktime_t interval)
+{
+	s64 delta = now - timer->expires;
+	u64 orun = 1;
+
+	if (delta < 0)
+		return 0;
+	if (interval < 1)
+		interval = 1;
+
+	if (delta >= interval) {
+		orun = delta / interval;
+		timer->expires += interval * orun;
+		if (timer->expires > now)
+			return orun;
+		orun++;
+	}
+	timer->expires += interval;
+
+	return orun;
+}
+
+/* work queues: one ordered worker thread per queue */
+
+struct workqueue_struct {
+	char name[24];
+	pthread_cond_t cond;		/* work queued or stopping */
+	struct work_struct *head;
+	struct work_struct *tail;
+	struct work_struct *current;
+	pthread_t thread;
+	bool stop;
+};
+
+static pthread_mutex_t wq_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wq_done;		/* a work function returned */
+
+struct workqueue_struct *system_wq;
+struct workqueue_struct *system_power_efficient_wq;
+struct workqueue_struct *system_freezable_wq;
+
+static void *kshim_worker(void *arg)
+{
+	struct workqueue_struct *wq = arg;
+	struct work_struct *work;
+
+	kshim_set_thread_name(wq->name);
+
+	pthread_mutex_lock(&wq_lock);
+	for (;;) {
+		while (!wq->head && !wq->stop)
+			pthread_cond_wait(&wq->cond, &wq_lock);
+		work = wq->head;
+		if (!work)
+			break;
+
+		wq->head = work->next;
+		if (!wq->head)
+			wq->tail = NULL;
+		work->next = NULL;
+		work->state = KSHIM_WORK_IDLE;
+		work->running = true;
+		wq->current = work;
+		pthread_mutex_unlock(&wq_lock);
+		work->func(work);
+		pthread_mutex_lock(&wq_lock);
+		work->running = false;
+		wq->current = NULL;
+		pthread_cond_broadcast(&wq_done);
+	}
+	pthread_mutex_unlock(&wq_lock);
+
+	return NULL;
+}
+
+struct workqueue_struct *alloc_ordered_workqueue(const char *fmt,
+					unsigned int flags, ...)
+{
+	struct workqueue_struct *wq;
+	va_list args;
+
+	wq = calloc(1, sizeof(*wq));
+	if (!wq)
+		return NULL;
+
+	va_start(args, flags);
+	vsnprintf(wq->name, sizeof(wq->name), fmt, args);
+	va_end(args);
+	pthread_cond_init(&wq->cond, NULL);
+	if (pthread_create(&wq->thread, NULL, kshim_worker, wq)) {
+		free(wq);
+		return NULL;
+	}
+
+	return wq;
+}
+
+void flush_workqueue(struct workqueue_struct *wq)
+{
+	pthread_mutex_lock(&wq_lock);
+	while (wq->head || wq->current)
+		pthread_cond_wait(&wq_done, &wq_lock);
+	pthread_mutex_unlock(&wq_lock);
+}
+
+void destroy_workqueue(struct workqueue_struct *wq)
+{
+	flush_workqueue(wq);
+	pthread_mutex_lock(&wq_lock);
+	wq->stop = true;
+	pthread_cond_signal(&wq->cond);
+	pthread_mutex_unlock(&wq_lock);
+	pthread_join(wq->thread, NULL);
+	pthread_cond_destroy(&wq->cond);
+	free(wq);
+}
+
+/* wq_lock held */
+static bool kshim_queue_work(struct workqueue_struct *wq,
+			struct work_struct *work)
+{
+	if ((work->state != KSHIM_WORK_IDLE) || work->canceling)
+		return false;
+
+	work->state = KSHIM_WORK_QUEUED;
+	work->wq = wq;
+	work->next = NULL;
+	if (wq->tail)
+		wq->tail->next = work;
+	else
+		wq->head = work;
+	wq->tail = work;
+	pthread_cond_signal(&wq->cond);
+
+	return true;
+}
+
+/*
+ * Take a pending work back, wq_lock held. A delayed work timer that is
+ * already expiring finds the work idle and does nothing.
+ */
+static bool kshim_dequeue_work(struct work_struct *work)
+{
+	struct workqueue_struct *wq = work->wq;
+	struct work_struct **pos, *prev = NULL;
+
+	switch (work->state) {
+	case KSHIM_WORK_IDLE:
+		return false;
+	case KSHIM_WORK_TIMER:
+		hrtimer_try_to_cancel(&to_delayed_work(work)->timer);
+		break;
+	case KSHIM_WORK_QUEUED:
+		for (pos = &wq->head; *pos && (*pos != work);
+				pos = &(*pos)->next)
+			prev = *pos;
+		if (*pos) {
+			*pos = work->next;
+			if (wq->tail == work)
+				wq->tail = prev;
+		}
+		work->next = NULL;
+		break;
+	}
+	work->state = KSHIM_WORK_IDLE;
+
+	return true;
+}
+
+static enum hrtimer_restart kshim_delayed_work_timer(struct hrtimer *timer)
+{
+	struct delayed_work *dwork = container_of(timer, struct delayed_work,
+			timer);
+
+	pthread_mutex_lock(&wq_lock);
+	/* a re-armed timer may be expiring for an older delay */
+	if ((dwork->work.state == KSHIM_WORK_TIMER) &&
+		(kshim_clock_ns() >= dwork->due)) {
+		dwork->work.state = KSHIM_WORK_IDLE;
+		kshim_queue_work(dwork->work.wq, &dwork->work);
+	}
+	pthread_mutex_unlock(&wq_lock);
+
+	return HRTIMER_NORESTART;
+}
+
+void kshim_init_delayed_work(struct delayed_work *dwork, work_func_t func)
+{
+	memset(dwork, 0, sizeof(*dwork));
+	dwork->work.func = func;
+	hrtimer_init(&dwork->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	dwork->timer.function = kshim_delayed_work_timer;
+}
+
+/* wq_lock held */
+static bool kshim_queue_delayed_work(struct workqueue_struct *wq,
+			struct delayed_work *dwork, unsigned long delay)
+{
+	struct work_struct *work = &dwork->work;
+
+	if (!delay)
+		return kshim_queue_work(wq, work);
+	if ((work->state != KSHIM_WORK_IDLE) || work->canceling)
+		return false;
+
+	work->state = KSHIM_WORK_TIMER;
+	work->wq = wq;
+	dwork->due = kshim_clock_ns() + (s64)delay * NSEC_PER_MSEC;
+	hrtimer_start(&dwork->timer, dwork->due, HRTIMER_MODE_ABS);
+
+	return true;
+}
+
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work)
+{
+	bool ret;
+
+	pthread_mutex_lock(&wq_lock);
+	ret = kshim_queue_work(wq, work);
+	pthread_mutex_unlock(&wq_lock);
+
+	return ret;
+}
+
+bool queue_delayed_work(struct workqueue_struct *wq,
+			struct delayed_work *dwork, unsigned long delay)
+{
+	bool ret;
+
+	pthread_mutex_lock(&wq_lock);
+	ret = kshim_queue_delayed_work(wq, dwork, delay);
+	pthread_mutex_unlock(&wq_lock);
+
+	return ret;
+}
+
+bool mod_delayed_work(struct workqueue_struct *wq,
+		struct delayed_work *dwork, unsigned long delay)
+{
+	bool ret = false;
+
+	pthread_mutex_lock(&wq_lock);
+	if (!dwork->work.canceling) {
+		ret = kshim_dequeue_work(&dwork->work);
+		kshim_queue_delayed_work(wq, dwork, delay);
+	}
+	pthread_mutex_unlock(&wq_lock);
+
+	return ret;
+}
+
+static bool kshim_cancel_work(struct work_struct *work, bool sync)
+{
+	bool ret;
+
+	pthread_mutex_lock(&wq_lock);
+	ret = kshim_dequeue_work(work);
+	if (sync) {
+		/* the work may not queue itself again while it finishes */
+		work->canceling = true;
+		while (work->running)
+			pthread_cond_wait(&wq_done, &wq_lock);
+		work->canceling = false;
+	}
+	pthread_mutex_unlock(&wq_lock);
+
+	return ret;
+}
+
+bool cancel_work_sync(struct work_struct *work)
+{
+	return kshim_cancel_work(work, true);
+}
+
+bool cancel_delayed_work(struct delayed_work *dwork)
+{
+	return kshim_cancel_work(&dwork->work, false);
+}
+
+bool cancel_delayed_work_sync(struct delayed_work *dwork)
+{
+	bool ret = kshim_cancel_work(&dwork->work, true);
+
+	/* the timer callback may still be waiting for wq_lock */
+	hrtimer_cancel(&dwork->timer);
+	return ret;
+}
+
+bool flush_work(struct work_struct *work)
+{
+	bool ret = false;
+
+	pthread_mutex_lock(&wq_lock);
+	while ((work->state == KSHIM_WORK_QUEUED) || work->running) {
+		ret = true;
+		pthread_cond_wait(&wq_done, &wq_lock);
+	}
+	pthread_mutex_unlock(&wq_lock);
+
+	return ret;
+}
+
+bool flush_delayed_work(struct delayed_work *dwork)
+{
+	struct work_struct *work = &dwork->work;
+
+	pthread_mutex_lock(&wq_lock);
+	if (work->state == KSHIM_WORK_TIMER) {
+		kshim_dequeue_work(work);
+		kshim_queue_work(work->wq, work);
+	}
+	pthread_mutex_unlock(&wq_lock);
+
+	return flush_work(work);
+}
+
+static void kshim_irq_work_fn(struct work_struct *work)
+{
+	struct irq_work *iw = container_of(work, struct irq_work, work);
+
+	iw->func(iw);
+}
+
+void init_irq_work(struct irq_work *work, void (*func)(struct irq_work *))
+{
+	INIT_WORK(&work->work, kshim_irq_work_fn);
+	work->func = func;
+}
+
+bool irq_work_queue(struct irq_work *work)
+{
+	return queue_work(system_wq, &work->work);
+}
+
+void irq_work_sync(struct irq_work *work)
+{
+	flush_work(&work->work);
+}
+
+static void __attribute__((constructor)) kshim_init(void)
+{
+	pthread_t thread;
+
+	kshim_cond_init(&hr_cond);
+	pthread_cond_init(&hr_idle, NULL);
+	pthread_cond_init(&wq_done, NULL);
+	if (pthread_create(&thread, NULL, kshim_hrtimer_thread, NULL))
+		abort();
+	pthread_detach(thread);
+
+	system_wq = alloc_ordered_workqueue("events", 0);
+	system_power_efficient_wq = alloc_ordered_workqueue("events_pwr", 0);
+	system_freezable_wq = alloc_ordered_workqueue("events_frz", 0);
+	if (!system_wq || !system_power_efficient_wq || !system_freezable_wq)
+		abort();
+}
+
+/* module parameters */
+
+struct kshim_param {
+	const char *name;
+	void *var;
+	const char *type;
+};
+
+static struct kshim_param kshim_params[16];
+static unsigned int kshim_nr_params;
+
+void kshim_param_register(const char *name, void *var, const char *type)
+{
+	if (kshim_nr_params == ARRAY_SIZE(kshim_params))
+		abort();
+	kshim_params[kshim_nr_params].name = name;
+	kshim_params[kshim_nr_params].var = var;
+	kshim_params[kshim_nr_params].type = type;
+	kshim_nr_params++;
+}
+
+int kshim_param_set(const char *name, const char *val)
+{
+	struct kshim_param *p;
+	unsigned int i;
+
+	for (i = 0; i < kshim_nr_params; i++) {
+		p = &kshim_params[i];
+		if (strcmp(p->name, name))
+			continue;
+		if (!strcmp(p->type, "bool"))
+			return kstrtobool(val, p->var);
+		if (!strcmp(p->type, "uint"))
+			return kstrtouint(val, 0, p->var);
+		if (!strcmp(p->type, "int"))
+			return kstrtoint(val, 0, p->var);
+		if (!strcmp(p->type, "ulong"))
+			return kstrtoul(val, 0, p->var);
+		return -EINVAL;
+	}
+
+	return -ENOENT;
+}
+
+/* managed resources */
+
+struct kshim_devres {
+	void (*release)(struct device *dev, void *res);
+	void *res;
+	struct kshim_devres *next;
+};
+
+static int kshim_devres_add(struct device *dev,
+			void (*release)(struct device *dev, void *res),
+			void *res)
+{
+	struct kshim_devres *dr = malloc(sizeof(*dr));
+
+	if (!dr)
+		return -ENOMEM;
+
+	dr->release = release;
+	dr->res = res;
+	pthread_mutex_lock(&reg_lock);
+	dr->next = dev->devres;
+	dev->devres = dr;
+	pthread_mutex_unlock(&reg_lock);
+
+	return 0;
+}
+
+/* newest first, like devres_release_all() */
+static void kshim_devres_release_all(struct device *dev)
+{
+	struct kshim_devres *dr;
+
+	for (;;) {
+		pthread_mutex_lock(&reg_lock);
+		dr = dev->devres;
+		if (dr)
+			dev->devres = dr->next;
+		pthread_mutex_unlock(&reg_lock);
+		if (!dr)
+			break;
+		dr->release(dev, dr->res);
+		free(dr);
+	}
+}
+
+static void kshim_devm_free(struct device *dev, void *res)
+{
+	free(res);
+}
+
+void *devm_kzalloc(struct device *dev, size_t size, gfp_t gfp)
+{
+	void *p = calloc(1, size);
+
+	if (p && kshim_devres_add(dev, kshim_devm_free, p)) {
+		free(p);
+		return NULL;
+	}
+
+	return p;
+}
+
+void devm_kfree(struct device *dev, void *p)
+{
+	struct kshim_devres **pos, *dr = NULL;
+
+	pthread_mutex_lock(&reg_lock);
+	for (pos = &dev->devres; *pos; pos = &(*pos)->next) {
+		if ((*pos)->res == p) {
+			dr = *pos;
+			*pos = dr->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&reg_lock);
+
+	if (dr) {
+		dr->release(dev, dr->res);
+		free(dr);
+	}
+}
+
+/* sysfs */
+
+struct kshim_attr {
+	const struct device_attribute *dattr;
+	const struct bin_attribute *battr;
+	struct kshim_attr *next;
+};
+
+static struct kshim_attr *kshim_attr_find(struct device *dev,
+					const char *name)
+{
+	struct kshim_attr *a;
+	const char *aname;
+
+	for (a = dev->attrs; a; a = a->next) {
+		aname = a->dattr ? a->dattr->attr.name : a->battr->attr.name;
+		if (!strcmp(aname, name))
+			return a;
+	}
+
+	return NULL;
+}
+
+static int kshim_attr_add(struct device *dev,
+			const struct device_attribute *dattr,
+			const struct bin_attribute *battr)
+{
+	const char *name = dattr ? dattr->attr.name : battr->attr.name;
+	struct kshim_attr *a;
+	int ret = 0;
+
+	pthread_mutex_lock(&reg_lock);
+	if (kshim_attr_find(dev, name)) {
+		ret = -EEXIST;
+		goto exit;
+	}
+
+	a = calloc(1, sizeof(*a));
+	if (!a) {
+		ret = -ENOMEM;
+		goto exit;
+	}
+	a->dattr = dattr;
+	a->battr = battr;
+	a->next = dev->attrs;
+	dev->attrs = a;
+
+exit:
+	pthread_mutex_unlock(&reg_lock);
+	return ret;
+}
+
+static void kshim_attr_remove(struct device *dev, const void *attr)
+{
+	struct kshim_attr **pos, *a;
+
+	pthread_mutex_lock(&reg_lock);
+	for (pos = &dev->attrs; *pos; pos = &(*pos)->next) {
+		a = *pos;
+		if (((const void *)a->dattr == attr) ||
+			((const void *)a->battr == attr)) {
+			*pos = a->next;
+			free(a);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&reg_lock);
+}
+
+int device_create_file(struct device *dev,
+		const struct device_attribute *attr)
+{
+	return kshim_attr_add(dev, attr, NULL);
+}
+
+void device_remove_file(struct device *dev,
+		const struct device_attribute *attr)
+{
+	kshim_attr_remove(dev, attr);
+}
+
+int sysfs_create_bin_file(struct kobject *kobj,
+		const struct bin_attribute *attr)
+{
+	return kshim_attr_add(kobj_to_dev(kobj), NULL, attr);
+}
+
+void sysfs_remove_bin_file(struct kobject *kobj,
+		const struct bin_attribute *attr)
+{
+	kshim_attr_remove(kobj_to_dev(kobj), attr);
+}
+
+/* buf holds PAGE_SIZE bytes, like a sysfs read */
+ssize_t kshim_attr_show(struct device *dev, const char *name, char *buf)
+{
+	struct kshim_attr *a;
+
+	pthread_mutex_lock(&reg_lock);
+	a = kshim_attr_find(dev, name);
+	pthread_mutex_unlock(&reg_lock);
+	if (!a || !a->dattr)
+		return -ENOENT;
+	if (!a->dattr->show)
+		return -EIO;
+
+	return a->dattr->show(dev, (struct device_attribute *)a->dattr, buf);
+}
+
+ssize_t kshim_attr_store(struct device *dev, const char *name,
+			const char *buf)
+{
+	struct kshim_attr *a;
+
+	pthread_mutex_lock(&reg_lock);
+	a = kshim_attr_find(dev, name);
+	pthread_mutex_unlock(&reg_lock);
+	if (!a || !a->dattr)
+		return -ENOENT;
+	if (!a->dattr->store)
+		return -EIO;
+
+	return a->dattr->store(dev, (struct device_attribute *)a->dattr, buf,
+			strlen(buf));
+}
+
+int kobject_uevent_env(struct kobject *kobj, enum kobject_action action,
+		char *envp[])
+{
+	if (kshim_hooks.uevent)
+		kshim_hooks.uevent(kobj, action, envp);
+	return 0;
+}
+
+/* input */
+
+static struct input_dev *kshim_inputs;
+static unsigned int kshim_input_nr;
+
+struct input_dev *input_allocate_device(void)
+{
+	struct input_dev *dev = calloc(1, sizeof(*dev));
+
+	if (!dev)
+		return NULL;
+
+	pthread_mutex_lock(&reg_lock);
+	snprintf(dev->dev.name, sizeof(dev->dev.name), "input%u",
+		kshim_input_nr++);
+	pthread_mutex_unlock(&reg_lock);
+	dev->dev.kobj.name = dev->dev.name;
+
+	return dev;
+}
+
+void input_free_device(struct input_dev *dev)
+{
+	free(dev);
+}
+
+static void kshim_devm_input_release(struct device *parent, void *res)
+{
+	struct input_dev *dev = res;
+
+	if (dev->registered)
+		input_unregister_device(dev);
+	input_free_device(dev);
+}
+
+struct input_dev *devm_input_allocate_device(struct device *dev)
+{
+	struct input_dev *input = input_allocate_device();
+
+	if (input && kshim_devres_add(dev, kshim_devm_input_release, input)) {
+		input_free_device(input);
+		return NULL;
+	}
+
+	return input;
+}
+
+int input_register_device(struct input_dev *dev)
+{
+	pthread_mutex_lock(&reg_lock);
+	dev->next = kshim_inputs;
+	kshim_inputs = dev;
+	dev->registered = true;
+	pthread_mutex_unlock(&reg_lock);
+
+	return 0;
+}
+
+void input_unregister_device(struct input_dev *dev)
+{
+	struct input_dev **pos;
+
+	pthread_mutex_lock(&reg_lock);
+	for (pos = &kshim_inputs; *pos; pos = &(*pos)->next) {
+		if (*pos == dev) {
+			*pos = dev->next;
+			break;
+		}
+	}
+	dev->registered = false;
+	pthread_mutex_unlock(&reg_lock);
+}
+
+struct input_dev *kshim_find_input(const char *name)
+{
+	struct input_dev *dev;
+
+	pthread_mutex_lock(&reg_lock);
+	for (dev = kshim_inputs; dev; dev = dev->next)
+		if (dev->name && !strcmp(dev->name, name))
+			break;
+	pthread_mutex_unlock(&reg_lock);
+
+	return dev;
+}
+
+void input_set_capability(struct input_dev *dev, unsigned int type,
+			unsigned int code)
+{
+	dev->evbit[0] |= BIT(type);
+	if (type == EV_ABS)
+		dev->absbit |= 1ULL << code;
+}
+
+void input_set_abs_params(struct input_dev *dev, unsigned int axis,
+			int min, int max, int fuzz, int flat)
+{
+	struct input_absinfo *absinfo = &dev->absinfo[axis];
+
+	absinfo->minimum = min;
+	absinfo->maximum = max;
+	absinfo->fuzz = fuzz;
+	absinfo->flat = flat;
+	input_set_capability(dev, EV_ABS, axis);
+}
+
+void input_event(struct input_dev *dev, unsigned int type,
+		unsigned int code, int value)
+{
+	if ((type == EV_ABS) && (code < ABS_CNT))
+		dev->absinfo[code].value = value;
+	if (dev->registered && kshim_hooks.input_event)
+		kshim_hooks.input_event(dev, type, code, value);
+}
+
+/* sensors class */
+
+static struct sensors_classdev *kshim_cdevs;
+
+int sensors_classdev_register(struct device *parent,
+			struct sensors_classdev *sensors_cdev)
+{
+	pthread_mutex_lock(&reg_lock);
+	sensors_cdev->dev = parent;
+	sensors_cdev->next = kshim_cdevs;
+	kshim_cdevs = sensors_cdev;
+	pthread_mutex_unlock(&reg_lock);
+
+	return 0;
+}
+
+void sensors_classdev_unregister(struct sensors_classdev *sensors_cdev)
+{
+	struct sensors_classdev **pos;
+
+	pthread_mutex_lock(&reg_lock);
+	for (pos = &kshim_cdevs; *pos; pos = &(*pos)->next) {
+		if (*pos == sensors_cdev) {
+			*pos = sensors_cdev->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&reg_lock);
+}
+
+struct sensors_classdev *kshim_find_cdev(const char *name)
+{
+	struct sensors_classdev *cdev;
+
+	pthread_mutex_lock(&reg_lock);
+	for (cdev = kshim_cdevs; cdev; cdev = cdev->next)
+		if (!strcmp(cdev->name, name))
+			break;
+	pthread_mutex_unlock(&reg_lock);
+
+	return cdev;
+}
+
+/* misc devices, debugfs and seq_file */
+
+int misc_register(struct miscdevice *misc)
+{
+	static int minor = 64;
+
+	if (misc->minor == MISC_DYNAMIC_MINOR)
+		misc->minor = __atomic_fetch_add(&minor, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+void misc_deregister(struct miscdevice *misc)
+{
+}
+
+int remap_vmalloc_range(struct vm_area_struct *vma, void *addr,
+			unsigned long pgoff)
+{
+	return -ENXIO;
+}
+
+loff_t no_llseek(struct file *file, loff_t offset, int whence)
+{
+	return -ESPIPE;
+}
+
+loff_t default_llseek(struct file *file, loff_t offset, int whence)
+{
+	return -ESPIPE;
+}
+
+loff_t seq_lseek(struct file *file, loff_t offset, int whence)
+{
+	return -ESPIPE;
+}
+
+static int kshim_seq_grow(struct seq_file *m, size_t len)
+{
+	size_t size = m->size ? m->size : PAGE_SIZE;
+	char *buf;
+
+	while (m->count + len + 1 > size)
+		size *= 2;
+	if (size == m->size)
+		return 0;
+
+	buf = realloc(m->buf, size);
+	if (!buf)
+		return -ENOMEM;
+	m->buf = buf;
+	m->size = size;
+	return 0;
+}
+
+int seq_printf(struct seq_file *m, const char *fmt, ...)
+{
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(NULL, 0, fmt, args);
+	va_end(args);
+	if ((len < 0) || kshim_seq_grow(m, len))
+		return -ENOMEM;
+
+	va_start(args, fmt);
+	vsnprintf(m->buf + m->count, len + 1, fmt, args);
+	va_end(args);
+	m->count += len;
+	return 0;
+}
+
+int seq_puts(struct seq_file *m, const char *s)
+{
+	return seq_printf(m, "%s", s);
+}
+
+int seq_putc(struct seq_file *m, char c)
+{
+	return seq_printf(m, "%c", c);
+}
+
+int single_open(struct file *file, int (*show)(struct seq_file *, void *),
+		void *data)
+{
+	struct seq_file *m = calloc(1, sizeof(*m));
+
+	if (!m)
+		return -ENOMEM;
+
+	m->show = show;
+	m->private = data;
+	file->private_data = m;
+	return 0;
+}
+
+int single_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *m = file->private_data;
+
+	free(m->buf);
+	free(m);
+	return 0;
+}
+
+ssize_t seq_read(struct file *file, char __user *buf, size_t size,
+		loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	int ret;
+
+	if (!*ppos) {
+		m->count = 0;
+		ret = m->show(m, NULL);
+		if (ret)
+			return ret;
+	}
+
+	return simple_read_from_buffer(buf, size, ppos, m->buf, m->count);
+}
+
+struct dentry {
+	int unused;
+};
+
+static struct dentry kshim_dentry;
+
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent)
+{
+	return &kshim_dentry;
+}
+
+struct dentry *debugfs_create_file(const char *name, umode_t mode,
+				struct dentry *parent, void *data,
+				const struct file_operations *fops)
+{
+	return &kshim_dentry;
+}
+
+struct dentry *debugfs_create_u32(const char *name, umode_t mode,
+				struct dentry *parent, u32 *value)
+{
+	return &kshim_dentry;
+}
+
+struct dentry *debugfs_create_bool(const char *name, umode_t mode,
+				struct dentry *parent, bool *value)
+{
+	return &kshim_dentry;
+}
+
+void debugfs_remove_recursive(struct dentry *dentry)
+{
+}
+
+/*
+ * Interrupts. generic_handle_irq() runs the primary handler in the caller,
+ * IRQ_WAKE_THREAD runs the thread function on a thread of the line, once
+ * more if it was woken again meanwhile, like handle_simple_irq().
+ */
+
+#define KSHIM_NR_IRQS	64
+
+struct irq_desc {
+	bool used;
+	struct irq_data data;
+	struct irq_chip *chip;
+	irq_handler_t handler;
+	irq_handler_t thread_fn;
+	void *dev_id;
+	unsigned int depth;
+	bool pending;		/* raised while disabled */
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool run_thread;
+	bool thread_busy;
+	bool stop;
+};
+
+struct irq_chip dummy_irq_chip = {
+	.name = "dummy",
+};
+
+static struct irq_desc kshim_irqs[KSHIM_NR_IRQS];
+static pthread_mutex_t irq_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct irq_desc *kshim_irq_desc(unsigned int irq)
+{
+	if (!irq || (irq >= KSHIM_NR_IRQS) || !kshim_irqs[irq].used)
+		return NULL;
+	return &kshim_irqs[irq];
+}
+
+struct irq_domain *irq_domain_add_linear(struct device_node *of_node,
+				unsigned int size,
+				const struct irq_domain_ops *ops,
+				void *host_data)
+{
+	struct irq_domain *d = calloc(1, sizeof(*d));
+
+	if (!d)
+		return NULL;
+
+	d->map = calloc(size, sizeof(*d->map));
+	if (!d->map) {
+		free(d);
+		return NULL;
+	}
+	d->ops = ops;
+	d->host_data = host_data;
+	d->size = size;
+
+	return d;
+}
+
+void irq_domain_remove(struct irq_domain *domain)
+{
+	free(domain->map);
+	free(domain);
+}
+
+int irq_domain_xlate_onecell(struct irq_domain *d, struct device_node *ctrlr,
+			const u32 *intspec, unsigned int intsize,
+			unsigned long *out_hwirq, unsigned int *out_type)
+{
+	if (intsize < 1)
+		return -EINVAL;
+	*out_hwirq = intspec[0];
+	*out_type = 0;
+	return 0;
+}
+
+unsigned int irq_create_mapping(struct irq_domain *domain,
+				unsigned long hwirq)
+{
+	struct irq_desc *desc;
+	unsigned int irq;
+
+	if (hwirq >= domain->size)
+		return 0;
+	if (domain->map[hwirq])
+		return domain->map[hwirq];
+
+	pthread_mutex_lock(&irq_lock);
+	for (irq = 1; irq < KSHIM_NR_IRQS; irq++)
+		if (!kshim_irqs[irq].used)
+			break;
+	if (irq == KSHIM_NR_IRQS) {
+		pthread_mutex_unlock(&irq_lock);
+		return 0;
+	}
+	desc = &kshim_irqs[irq];
+	memset(desc, 0, sizeof(*desc));
+	desc->used = true;
+	desc->data.irq = irq;
+	pthread_mutex_init(&desc->lock, NULL);
+	pthread_cond_init(&desc->cond, NULL);
+	pthread_mutex_unlock(&irq_lock);
+
+	if (domain->ops->map && domain->ops->map(domain, irq, hwirq)) {
+		irq_dispose_mapping(irq);
+		return 0;
+	}
+	domain->map[hwirq] = irq;
+
+	return irq;
+}
+
+void irq_dispose_mapping(unsigned int virq)
+{
+	struct irq_desc *desc = kshim_irq_desc(virq);
+
+	if (!desc)
+		return;
+
+	pthread_mutex_lock(&irq_lock);
+	pthread_cond_destroy(&desc->cond);
+	pthread_mutex_destroy(&desc->lock);
+	desc->used = false;
+	pthread_mutex_unlock(&irq_lock);
+}
+
+int irq_set_chip_and_handler(unsigned int irq, struct irq_chip *chip,
+			irq_flow_handler_t handle)
+{
+	struct irq_desc *desc = kshim_irq_desc(irq);
+
+	if (!desc)
+		return -EINVAL;
+	desc->chip = chip;
+	return 0;
+}
+
+int irq_set_chip_data(unsigned int irq, void *data)
+{
+	struct irq_desc *desc = kshim_irq_desc(irq);
+
+	if (!desc)
+		return -EINVAL;
+	desc->data.chip_data = data;
+	return 0;
+}
+
+void irq_set_noprobe(unsigned int irq)
+{
+}
+
+static void *kshim_irq_thread(void *arg)
+{
+	struct irq_desc *desc = arg;
+	char comm[16];
+
+	snprintf(comm, sizeof(comm), "irq/%u", desc->data.irq);
+	kshim_set_thread_name(comm);
+
+	pthread_mutex_lock(&desc->lock);
+	for (;;) {
+		while (!desc->run_thread && !desc->stop)
+			pthread_cond_wait(&desc->cond, &desc->lock);
+		if (desc->stop)
+			break;
+		desc->run_thread = false;
+		desc->thread_busy = true;
+		pthread_mutex_unlock(&desc->lock);
+		desc->thread_fn(desc->data.irq, desc->dev_id);
+		pthread_mutex_lock(&desc->lock);
+		desc->thread_busy = false;
+		pthread_cond_broadcast(&desc->cond);
+	}
+	pthread_mutex_unlock(&desc->lock);
+
+	return NULL;
+}
+
+int request_threaded_irq(unsigned int irq, irq_handler_t handler,
+			irq_handler_t thread_fn, unsigned long flags,
+			const char *name, void *dev)
+{
+	struct irq_desc *desc = kshim_irq_desc(irq);
+
+	if (!desc)
+		return -EINVAL;
+	if (desc->handler || desc->thread_fn)
+		return -EBUSY;
+
+	desc->handler = handler;
+	desc->thread_fn = thread_fn;
+	desc->dev_id = dev;
+	desc->depth = 0;
+	if (thread_fn && pthread_create(&desc->thread, NULL,
+			kshim_irq_thread, desc)) {
+		desc->handler = NULL;
+		desc->thread_fn = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/* wait for a running thread function, like synchronize_irq() */
+static void kshim_irq_sync(struct irq_desc *desc)
+{
+	pthread_mutex_lock(&desc->lock);
+	while (desc->thread_busy || desc->run_thread)
+		pthread_cond_wait(&desc->cond, &desc->lock);
+	pthread_mutex_unlock(&desc->lock);
+}
+
+void free_irq(unsigned int irq, void *dev_id)
+{
+	struct irq_desc *desc = kshim_irq_desc(irq);
+
+	if (!desc || (desc->dev_id != dev_id))
+		return;
+
+	disable_irq(irq);
+	if (desc->thread_fn) {
+		pthread_mutex_lock(&desc->lock);
+		desc->stop = true;
+		pthread_cond_broadcast(&desc->cond);
+		pthread_mutex_unlock(&desc->lock);
+		pthread_join(desc->thread, NULL);
+	}
+	desc->handler = NULL;
+	desc->thread_fn = NULL;
+	desc->dev_id = NULL;
+	desc->stop = false;
+}
+
+void irq_wake_thread(unsigned int irq, void *dev_id)
+{
+	struct irq_desc *desc = kshim_irq_desc(irq);
+
+	if (!desc || !desc->thread_fn || (desc->dev_id != dev_id))
+		return;
+
+	pthread_mutex_lock(&desc->lock);
+	desc->run_thread = true;
+	pthread_cond_broadcast(&desc->cond);
+	pthread_mutex_unlock(&desc->lock);
+}
+
+int generic_handle_irq(unsigned int irq)
+{
+	struct irq_desc *desc = kshim_irq_desc(irq);
+	irqreturn_t ret = IRQ_WAKE_THREAD;
+
+	if (!desc)
+		return -EINVAL;
+
+	pthread_mutex_lock(&desc->lock);
+	if (desc->depth || (!desc->handler && !desc->thread_fn)) {
+		desc->pending = true;
+		pthread_mutex_unlock(&desc->lock);
+		return 0;
+	}
+	pthread_mutex_unlock(&desc->lock);
+
+	if (desc->handler)
+		ret = desc->handler(irq, desc->dev_id);
+	if (ret == IRQ_WAKE_THREAD)
+		irq_wake_thread(irq, desc->dev_id);
+
+	return 0;
+}
+
+void disable_irq_nosync(unsigned int irq)
+{
+	struct irq_desc *desc = kshim_irq_desc(irq);
+
+	if (!desc)
+		return;
+
+	pthread_mutex_lock(&desc->lock);
+	desc->depth++;
+	pthread_mutex_unlock(&desc->lock);
+}
+
+void disable_irq(unsigned int irq)
+{
+	struct irq_desc *desc = kshim_irq_desc(irq);
+
+	if (!desc)
+		return;
+
+	disable_irq_nosync(irq);
+	kshim_irq_sync(desc);
+}
+
+/* an edge raised while disabled is resent, like check_irq_resend() */
+void enable_irq(unsigned int irq)
+{
+	struct irq_desc *desc = kshim_irq_desc(irq);
+	bool resend;
+
+	if (!desc)
+		return;
+
+	pthread_mutex_lock(&desc->lock);
+	if (desc->depth)
+		desc->depth--;
+	resend = !desc->depth && desc->pending;
+	if (resend)
+		desc->pending = false;
+	pthread_mutex_unlock(&desc->lock);
+
+	if (resend)
+		generic_handle_irq(irq);
+}
+
+/*
+ * Runtime PM. Callbacks run without the device lock, concurrent callers
+ * wait for a transition in flight. The autosuspend timer is a delayed work.
+ */
+
+enum kshim_rpm_status {
+	KSHIM_RPM_ACTIVE,
+	KSHIM_RPM_RESUMING,
+	KSHIM_RPM_SUSPENDED,
+	KSHIM_RPM_SUSPENDING,
+};
+
+struct kshim_pm {
+	struct device *dev;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	enum kshim_rpm_status status;
+	int usage;
+	int disable_depth;
+	bool use_autosuspend;
+	int autosuspend_delay;
+	s64 last_busy;
+	bool force_resume;
+	struct delayed_work suspend_work;
+};
+
+static void kshim_rpm_suspend_work(struct work_struct *work);
+
+static struct kshim_pm *kshim_pm(struct device *dev)
+{
+	struct kshim_pm *pm;
+
+	pthread_mutex_lock(&reg_lock);
+	pm = dev->power;
+	if (!pm) {
+		pm = calloc(1, sizeof(*pm));
+		if (!pm)
+			abort();
+		pm->dev = dev;
+		pthread_mutex_init(&pm->lock, NULL);
+		pthread_cond_init(&pm->cond, NULL);
+		pm->status = KSHIM_RPM_SUSPENDED;
+		pm->disable_depth = 1;
+		INIT_DELAYED_WORK(&pm->suspend_work, kshim_rpm_suspend_work);
+		dev->power = pm;
+	}
+	pthread_mutex_unlock(&reg_lock);
+
+	return pm;
+}
+
+static void kshim_pm_free(struct device *dev)
+{
+	struct kshim_pm *pm = dev->power;
+
+	if (!pm)
+		return;
+
+	cancel_delayed_work_sync(&pm->suspend_work);
+	pthread_cond_destroy(&pm->cond);
+	pthread_mutex_destroy(&pm->lock);
+	free(pm);
+	dev->power = NULL;
+}
+
+static int kshim_rpm_callback(struct device *dev, bool resume)
+{
+	const struct dev_pm_ops *ops = dev->driver ? dev->driver->pm : NULL;
+	int (*cb)(struct device *dev);
+
+	if (!ops)
+		return 0;
+	cb = resume ? ops->runtime_resume : ops->runtime_suspend;
+	return cb ? cb(dev) : 0;
+}
+
+/* pm->lock held, dropped around the callback */
+static int kshim_rpm_resume(struct kshim_pm *pm)
+{
+	int ret;
+
+	for (;;) {
+		if (pm->status == KSHIM_RPM_ACTIVE)
+			return 1;
+		if (pm->status == KSHIM_RPM_SUSPENDED)
+			break;
+		pthread_cond_wait(&pm->cond, &pm->lock);
+	}
+	if (pm->disable_depth)
+		return -EACCES;
+
+	pm->status = KSHIM_RPM_RESUMING;
+	pthread_mutex_unlock(&pm->lock);
+	ret = kshim_rpm_callback(pm->dev, true);
+	pthread_mutex_lock(&pm->lock);
+	pm->status = ret ? KSHIM_RPM_SUSPENDED : KSHIM_RPM_ACTIVE;
+	pthread_cond_broadcast(&pm->cond);
+
+	return ret;
+}
+
+/* pm->lock held */
+static void kshim_rpm_idle(struct kshim_pm *pm)
+{
+	s64 delay = 0;
+
+	if (pm->usage || pm->disable_depth ||
+		(pm->status != KSHIM_RPM_ACTIVE))
+		return;
+
+	if (pm->use_autosuspend)
+		delay = pm->last_busy +
+			(s64)pm->autosuspend_delay * NSEC_PER_MSEC -
+			kshim_clock_ns();
+	mod_delayed_work(system_power_efficient_wq, &pm->suspend_work,
+			(delay > 0) ? DIV_ROUND_UP(delay, NSEC_PER_MSEC) : 0);
+}
+
+static void kshim_rpm_suspend_work(struct work_struct *work)
+{
+	struct kshim_pm *pm = container_of(to_delayed_work(work),
+			struct kshim_pm, suspend_work);
+	s64 expires;
+	int ret;
+
+	pthread_mutex_lock(&pm->lock);
+	if (pm->usage || pm->disable_depth ||
+		(pm->status != KSHIM_RPM_ACTIVE))
+		goto exit;
+
+	expires = pm->last_busy + (s64)pm->autosuspend_delay * NSEC_PER_MSEC;
+	if (pm->use_autosuspend && (expires > kshim_clock_ns())) {
+		kshim_rpm_idle(pm);
+		goto exit;
+	}
+
+	pm->status = KSHIM_RPM_SUSPENDING;
+	pthread_mutex_unlock(&pm->lock);
+	ret = kshim_rpm_callback(pm->dev, false);
+	pthread_mutex_lock(&pm->lock);
+	pm->status = ret ? KSHIM_RPM_ACTIVE : KSHIM_RPM_SUSPENDED;
+	pthread_cond_broadcast(&pm->cond);
+
+exit:
+	pthread_mutex_unlock(&pm->lock);
+}
+
+void pm_runtime_enable(struct device *dev)
+{
+	struct kshim_pm *pm = kshim_pm(dev);
+
+	pthread_mutex_lock(&pm->lock);
+	if (pm->disable_depth)
+		pm->disable_depth--;
+	pthread_mutex_unlock(&pm->lock);
+}
+
+void pm_runtime_disable(struct device *dev)
+{
+	struct kshim_pm *pm = kshim_pm(dev);
+
+	pthread_mutex_lock(&pm->lock);
+	pm->disable_depth++;
+	pthread_mutex_unlock(&pm->lock);
+	cancel_delayed_work_sync(&pm->suspend_work);
+}
+
+bool pm_runtime_enabled(struct device *dev)
+{
+	return !kshim_pm(dev)->disable_depth;
+}
+
+int pm_runtime_get_sync(struct device *dev)
+{
+	struct kshim_pm *pm = kshim_pm(dev);
+	int ret;
+
+	pthread_mutex_lock(&pm->lock);
+	pm->usage++;
+	ret = kshim_rpm_resume(pm);
+	pthread_mutex_unlock(&pm->lock);
+
+	return ret;
+}
+
+void pm_runtime_get_noresume(struct device *dev)
+{
+	struct kshim_pm *pm = kshim_pm(dev);
+
+	pthread_mutex_lock(&pm->lock);
+	pm->usage++;
+	pthread_mutex_unlock(&pm->lock);
+}
+
+int pm_runtime_put_noidle(struct device *dev)
+{
+	struct kshim_pm *pm = kshim_pm(dev);
+
+	pthread_mutex_lock(&pm->lock);
+	if (pm->usage)
+		pm->usage--;
+	pthread_mutex_unlock(&pm->lock);
+
+	return 0;
+}
+
+int pm_runtime_put_autosuspend(struct device *dev)
+{
+	struct kshim_pm *pm = kshim_pm(dev);
+
+	pthread_mutex_lock(&pm->lock);
+	if (pm->usage && !--pm->usage)
+		kshim_rpm_idle(pm);
+	pthread_mutex_unlock(&pm->lock);
+
+	return 0;
+}
+
+int pm_runtime_put_sync(struct device *dev)
+{
+	return pm_runtime_put_autosuspend(dev);
+}
+
+void pm_runtime_mark_last_busy(struct device *dev)
+{
+	struct kshim_pm *pm = kshim_pm(dev);
+
+	WRITE_ONCE(pm->last_busy, kshim_clock_ns());
+}
+
+int pm_runtime_set_active(struct device *dev)
+{
+	struct kshim_pm *pm = kshim_pm(dev);
+
+	pthread_mutex_lock(&pm->lock);
+	pm->status = KSHIM_RPM_ACTIVE;
+	pthread_mutex_unlock(&pm->lock);
+
+	return 0;
+}
+
+void pm_runtime_set_suspended(struct device *dev)
+{
+	struct kshim_pm *pm = kshim_pm(dev);
+
+	pthread_mutex_lock(&pm->lock);
+	pm->status = KSHIM_RPM_SUSPENDED;
+	pthread_mutex_unlock(&pm->lock);
+}
+
+void pm_runtime_set_autosuspend_delay(struct device *dev, int delay)
+{
+	struct kshim_pm *pm = kshim_pm(dev);
+
+	pthread_mutex_lock(&pm->lock);
+	pm->autosuspend_delay = delay;
+	pthread_mutex_unlock(&pm->lock);
+}
+
+void pm_runtime_use_autosuspend(struct device *dev)
+{
+	struct kshim_pm *pm = kshim_pm(dev);
+
+	pthread_mutex_lock(&pm->lock);
+	pm->use_autosuspend = true;
+	pthread_mutex_unlock(&pm->lock);
+}
+
+void pm_runtime_dont_use_autosuspend(struct device *dev)
+{
+	struct kshim_pm *pm = kshim_pm(dev);
+
+	pthread_mutex_lock(&pm->lock);
+	pm->use_autosuspend = false;
+	pthread_mutex_unlock(&pm->lock);
+}
+
+int pm_runtime_force_suspend(struct device *dev)
+{
+	struct kshim_pm *pm = kshim_pm(dev);
+	int ret = 0;
+
+	pm_runtime_disable(dev);
+	pthread_mutex_lock(&pm->lock);
+	if (pm->status == KSHIM_RPM_ACTIVE) {
+		pthread_mutex_unlock(&pm->lock);
+		ret = kshim_rpm_callback(dev, false);
+		pthread_mutex_lock(&pm->lock);
+		if (!ret) {
+			pm->status = KSHIM_RPM_SUSPENDED;
+			pm->force_resume = pm->usage > 0;
+		}
+	}
+	pthread_mutex_unlock(&pm->lock);
+
+	if (ret)
+		pm_runtime_enable(dev);
+	return ret;
+}
+
+int pm_runtime_force_resume(struct device *dev)
+{
+	struct kshim_pm *pm = kshim_pm(dev);
+	int ret = 0;
+
+	pthread_mutex_lock(&pm->lock);
+	if (pm->force_resume) {
+		pthread_mutex_unlock(&pm->lock);
+		ret = kshim_rpm_callback(dev, true);
+		pthread_mutex_lock(&pm->lock);
+		if (!ret)
+			pm->status = KSHIM_RPM_ACTIVE;
+		pm->force_resume = false;
+	}
+	pthread_mutex_unlock(&pm->lock);
+
+	pm_runtime_enable(dev);
+	return ret;
+}
+
+bool pm_runtime_suspended(struct device *dev)
+{
+	struct kshim_pm *pm = kshim_pm(dev);
+
+	return !pm->disable_depth && (pm->status == KSHIM_RPM_SUSPENDED);
+}
+
+/* I2C bus */
+
+const struct device_type i2c_client_type = {
+	.name = "i2c_client",
+};
+
+static struct i2c_driver *kshim_i2c_drvs;
+static struct i2c_client *kshim_i2c_clients;
+
+static void kshim_i2c_probe(struct i2c_client *client,
+				struct i2c_driver *drv)
+{
+	const struct i2c_device_id *id;
+
+	if (client->dev.driver)
+		return;
+	for (id = drv->id_table; id->name[0]; id++)
+		if (!strcmp(client->name, id->name))
+			break;
+	if (!id->name[0])
+		return;
+
+	client->dev.driver = &drv->driver;
+	if (drv->probe(client, id)) {
+		kshim_devres_release_all(&client->dev);
+		client->dev.driver = NULL;
+	}
+}
+
+static void kshim_i2c_unbind(struct i2c_client *client)
+{
+	struct i2c_driver *drv;
+
+	if (!client->dev.driver)
+		return;
+
+	drv = container_of(client->dev.driver, struct i2c_driver, driver);
+	drv->remove(client);
+	kshim_devres_release_all(&client->dev);
+	client->dev.driver = NULL;
+}
+
+int i2c_add_driver(struct i2c_driver *drv)
+{
+	struct i2c_client *client;
+
+	pthread_mutex_lock(&reg_lock);
+	drv->next = kshim_i2c_drvs;
+	kshim_i2c_drvs = drv;
+	client = kshim_i2c_clients;
+	pthread_mutex_unlock(&reg_lock);
+
+	for (; client; client = client->next)
+		kshim_i2c_probe(client, drv);
+
+	return 0;
+}
+
+void i2c_del_driver(struct i2c_driver *drv)
+{
+	struct i2c_driver **pos;
+	struct i2c_client *client;
+
+	for (client = kshim_i2c_clients; client; client = client->next)
+		if (client->dev.driver == &drv->driver)
+			kshim_i2c_unbind(client);
+
+	pthread_mutex_lock(&reg_lock);
+	for (pos = &kshim_i2c_drvs; *pos; pos = &(*pos)->next) {
+		if (*pos == drv) {
+			*pos = drv->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&reg_lock);
+}
+
+struct i2c_client *i2c_new_client_device(struct i2c_adapter *adap,
+				const struct i2c_board_info *info)
+{
+	struct i2c_client *client;
+	struct i2c_driver *drv;
+
+	client = calloc(1, sizeof(*client));
+	if (!client)
+		return ERR_PTR(-ENOMEM);
+
+	snprintf(client->name, sizeof(client->name), "%s", info->type);
+	client->addr = info->addr;
+	client->irq = info->irq;
+	client->dev.type = &i2c_client_type;
+	client->dev.platform_data = (void *)info->platform_data;
+	snprintf(client->dev.name, sizeof(client->dev.name), "0-%04x",
+		info->addr);
+	client->dev.kobj.name = client->dev.name;
+
+	pthread_mutex_lock(&reg_lock);
+	client->next = kshim_i2c_clients;
+	kshim_i2c_clients = client;
+	drv = kshim_i2c_drvs;
+	pthread_mutex_unlock(&reg_lock);
+
+	for (; drv; drv = drv->next)
+		kshim_i2c_probe(client, drv);
+
+	return client;
+}
+
+void i2c_unregister_device(struct i2c_client *client)
+{
+	struct i2c_client **pos;
+
+	if (IS_ERR_OR_NULL(client))
+		return;
+
+	kshim_i2c_unbind(client);
+
+	pthread_mutex_lock(&reg_lock);
+	for (pos = &kshim_i2c_clients; *pos; pos = &(*pos)->next) {
+		if (*pos == client) {
+			*pos = client->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&reg_lock);
+
+	kshim_pm_free(&client->dev);
+	free(client);
+}
+
+/* platform bus */
+
+static struct platform_driver *kshim_pdrvs;
+static struct platform_device *kshim_pdevs;
+
+static void kshim_platform_probe(struct platform_device *pdev,
+				struct platform_driver *drv)
+{
+	if (pdev->dev.driver || strcmp(pdev->name, drv->driver.name))
+		return;
+
+	pdev->dev.driver = &drv->driver;
+	if (drv->probe(pdev)) {
+		kshim_devres_release_all(&pdev->dev);
+		pdev->dev.driver = NULL;
+	}
+}
+
+static void kshim_platform_unbind(struct platform_device *pdev)
+{
+	struct platform_driver *drv;
+
+	if (!pdev->dev.driver)
+		return;
+
+	drv = container_of(pdev->dev.driver, struct platform_driver, driver);
+	drv->remove(pdev);
+	kshim_devres_release_all(&pdev->dev);
+	pdev->dev.driver = NULL;
+}
+
+int platform_driver_register(struct platform_driver *drv)
+{
+	struct platform_device *pdev;
+
+	pthread_mutex_lock(&reg_lock);
+	drv->next = kshim_pdrvs;
+	kshim_pdrvs = drv;
+	pdev = kshim_pdevs;
+	pthread_mutex_unlock(&reg_lock);
+
+	for (; pdev; pdev = pdev->next)
+		kshim_platform_probe(pdev, drv);
+
+	return 0;
+}
+
+void platform_driver_unregister(struct platform_driver *drv)
+{
+	struct platform_driver **pos;
+	struct platform_device *pdev;
+
+	for (pdev = kshim_pdevs; pdev; pdev = pdev->next)
+		if (pdev->dev.driver == &drv->driver)
+			kshim_platform_unbind(pdev);
+
+	pthread_mutex_lock(&reg_lock);
+	for (pos = &kshim_pdrvs; *pos; pos = &(*pos)->next) {
+		if (*pos == drv) {
+			*pos = drv->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&reg_lock);
+}
+
+struct platform_device *platform_device_register_data(struct device *parent,
+				const char *name, int id, const void *data,
+				size_t size)
+{
+	struct platform_device *pdev;
+	struct platform_driver *drv;
+
+	pdev = calloc(1, sizeof(*pdev));
+	if (!pdev)
+		return ERR_PTR(-ENOMEM);
+
+	if (size) {
+		pdev->dev.platform_data = malloc(size);
+		if (!pdev->dev.platform_data) {
+			free(pdev);
+			return ERR_PTR(-ENOMEM);
+		}
+		memcpy(pdev->dev.platform_data, data, size);
+	}
+	pdev->name = name;
+	pdev->id = id;
+	pdev->dev.parent = parent;
+	if (id == -1)
+		snprintf(pdev->dev.name, sizeof(pdev->dev.name), "%s", name);
+	else
+		snprintf(pdev->dev.name, sizeof(pdev->dev.name), "%s.%d",
+			name, id);
+	pdev->dev.kobj.name = pdev->dev.name;
+
+	pthread_mutex_lock(&reg_lock);
+	pdev->next = kshim_pdevs;
+	kshim_pdevs = pdev;
+	drv = kshim_pdrvs;
+	pthread_mutex_unlock(&reg_lock);
+
+	for (; drv; drv = drv->next)
+		kshim_platform_probe(pdev, drv);
+
+	return pdev;
+}
+
+void platform_device_unregister(struct platform_device *pdev)
+{
+	struct platform_device **pos;
+
+	if (IS_ERR_OR_NULL(pdev))
+		return;
+
+	kshim_platform_unbind(pdev);
+
+	pthread_mutex_lock(&reg_lock);
+	for (pos = &kshim_pdevs; *pos; pos = &(*pos)->next) {
+		if (*pos == pdev) {
+			*pos = pdev->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&reg_lock);
+
+	kshim_pm_free(&pdev->dev);
+	free(pdev->dev.platform_data);
+	free(pdev);
+}
+
+/*
+ * Register maps, as regmap behaves for 8 bit registers and values: cached
+ * registers are read from the flat cache, writes in cache only mode only
+ * mark the cache dirty and regcache_sync() writes back what differs from
+ * the defaults. Bus accesses are serialized by the map lock.
+ */
+
+struct regmap {
+	struct device *dev;
+	const struct regmap_bus *bus;
+	void *ctx;
+	struct regmap_config config;
+	pthread_mutex_t lock;
+	unsigned int *cache;
+	bool cache_only;
+	bool cache_dirty;
+};
+
+static bool kshim_regmap_readable(struct regmap *map, unsigned int reg)
+{
+	if (reg > map->config.max_register)
+		return false;
+	return !map->config.readable_reg ||
+		map->config.readable_reg(map->dev, reg);
+}
+
+static bool kshim_regmap_writeable(struct regmap *map, unsigned int reg)
+{
+	if (reg > map->config.max_register)
+		return false;
+	return !map->config.writeable_reg ||
+		map->config.writeable_reg(map->dev, reg);
+}
+
+static bool kshim_regmap_volatile(struct regmap *map, unsigned int reg)
+{
+	if (!map->cache)
+		return true;
+	return map->config.volatile_reg &&
+		map->config.volatile_reg(map->dev, reg);
+}
+
+static bool kshim_regmap_default(struct regmap *map, unsigned int reg,
+				unsigned int *def)
+{
+	unsigned int i;
+
+	for (i = 0; i < map->config.num_reg_defaults; i++) {
+		if (map->config.reg_defaults[i].reg == reg) {
+			*def = map->config.reg_defaults[i].def;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void kshim_regmap_release(struct device *dev, void *res)
+{
+	struct regmap *map = res;
+
+	pthread_mutex_destroy(&map->lock);
+	free(map->cache);
+	free(map);
+}
+
+struct regmap *devm_regmap_init(struct device *dev,
+				const struct regmap_bus *bus, void *bus_context,
+				const struct regmap_config *config)
+{
+	struct regmap *map;
+	unsigned int i, reg;
+
+	if ((config->reg_bits != 8) || (config->val_bits != 8))
+		return ERR_PTR(-EINVAL);
+
+	map = calloc(1, sizeof(*map));
+	if (!map)
+		return ERR_PTR(-ENOMEM);
+
+	map->dev = dev;
+	map->bus = bus;
+	map->ctx = bus_context;
+	map->config = *config;
+	pthread_mutex_init(&map->lock, NULL);
+	if (config->cache_type != REGCACHE_NONE) {
+		map->cache = calloc(config->max_register + 1,
+				sizeof(*map->cache));
+		if (!map->cache)
+			goto err_free;
+		for (i = 0; i < config->num_reg_defaults; i++) {
+			reg = config->reg_defaults[i].reg;
+			if (reg <= config->max_register)
+				map->cache[reg] = config->reg_defaults[i].def;
+		}
+	}
+
+	if (kshim_devres_add(dev, kshim_regmap_release, map))
+		goto err_free;
+
+	return map;
+
+err_free:
+	pthread_mutex_destroy(&map->lock);
+	free(map->cache);
+	free(map);
+	return ERR_PTR(-ENOMEM);
+}
+
+/* map->lock held */
+static int kshim_regmap_bus_read(struct regmap *map, unsigned int reg,
+				void *val, size_t val_len)
+{
+	u8 reg8 = reg;
+
+	if (map->cache_only)
+		return -EBUSY;
+	return map->bus->read(map->ctx, &reg8, 1, val, val_len);
+}
+
+/* map->lock held */
+static int kshim_regmap_read(struct regmap *map, unsigned int reg,
+			unsigned int *val)
+{
+	u8 val8;
+	int ret;
+
+	if (!kshim_regmap_readable(map, reg))
+		return -EIO;
+	if (!kshim_regmap_volatile(map, reg)) {
+		*val = map->cache[reg];
+		return 0;
+	}
+
+	ret = kshim_regmap_bus_read(map, reg, &val8, 1);
+	if (!ret)
+		*val = val8;
+	return ret;
+}
+
+/* map->lock held */
+static int kshim_regmap_write(struct regmap *map, unsigned int reg,
+			unsigned int val)
+{
+	u8 buf[2] = { reg, val };
+
+	if (!kshim_regmap_writeable(map, reg))
+		return -EIO;
+	if (!kshim_regmap_volatile(map, reg))
+		map->cache[reg] = val & 0xff;
+	if (map->cache_only) {
+		map->cache_dirty = true;
+		return 0;
+	}
+
+	return map->bus->write(map->ctx, buf, sizeof(buf));
+}
+
+int regmap_read(struct regmap *map, unsigned int reg, unsigned int *val)
+{
+	int ret;
+
+	pthread_mutex_lock(&map->lock);
+	ret = kshim_regmap_read(map, reg, val);
+	pthread_mutex_unlock(&map->lock);
+
+	return ret;
+}
+
+int regmap_write(struct regmap *map, unsigned int reg, unsigned int val)
+{
+	int ret;
+
+	pthread_mutex_lock(&map->lock);
+	ret = kshim_regmap_write(map, reg, val);
+	pthread_mutex_unlock(&map->lock);
+
+	return ret;
+}
+
+int regmap_update_bits(struct regmap *map, unsigned int reg,
+		unsigned int mask, unsigned int val)
+{
+	unsigned int orig, tmp;
+	int ret;
+
+	pthread_mutex_lock(&map->lock);
+	ret = kshim_regmap_read(map, reg, &orig);
+	if (!ret) {
+		tmp = (orig & ~mask) | (val & mask);
+		if (tmp != orig)
+			ret = kshim_regmap_write(map, reg, tmp);
+	}
+	pthread_mutex_unlock(&map->lock);
+
+	return ret;
+}
+
+/* map->lock held, true if no register of the range is cached */
+static bool kshim_regmap_volatile_range(struct regmap *map, unsigned int reg,
+				size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		if (!kshim_regmap_volatile(map, reg + i))
+			return false;
+	return true;
+}
+
+/* a volatile range is one bus burst, a cached one is read register-wise */
+int regmap_raw_read(struct regmap *map, unsigned int reg, void *val,
+		size_t val_len)
+{
+	unsigned int v;
+	u8 *buf = val;
+	size_t i;
+	int ret = 0;
+
+	pthread_mutex_lock(&map->lock);
+	if (kshim_regmap_volatile_range(map, reg, val_len)) {
+		ret = kshim_regmap_bus_read(map, reg, val, val_len);
+	} else {
+		for (i = 0; i < val_len; i++) {
+			ret = kshim_regmap_read(map, reg + i, &v);
+			if (ret)
+				break;
+			buf[i] = v;
+		}
+	}
+	pthread_mutex_unlock(&map->lock);
+
+	return ret;
+}
+
+int regmap_bulk_read(struct regmap *map, unsigned int reg, void *val,
+		size_t val_count)
+{
+	return regmap_raw_read(map, reg, val, val_count);
+}
+
+void regcache_cache_only(struct regmap *map, bool enable)
+{
+	pthread_mutex_lock(&map->lock);
+	map->cache_only = enable;
+	pthread_mutex_unlock(&map->lock);
+}
+
+void regcache_mark_dirty(struct regmap *map)
+{
+	pthread_mutex_lock(&map->lock);
+	map->cache_dirty = true;
+	pthread_mutex_unlock(&map->lock);
+}
+
+int regcache_sync(struct regmap *map)
+{
+	unsigned int reg, def;
+	u8 buf[2];
+	int ret = 0;
+
+	pthread_mutex_lock(&map->lock);
+	if (!map->cache || !map->cache_dirty)
+		goto exit;
+
+	for (reg = 0; reg <= map->config.max_register; reg++) {
+		if (!kshim_regmap_writeable(map, reg) ||
+			kshim_regmap_volatile(map, reg))
+			continue;
+		if (kshim_regmap_default(map, reg, &def) &&
+			(def == map->cache[reg]))
+			continue;
+		buf[0] = reg;
+		buf[1] = map->cache[reg];
+		ret = map->bus->write(map->ctx, buf, sizeof(buf));
+		if (ret)
+			goto exit;
+	}
+	map->cache_dirty = false;
+
+exit:
+	pthread_mutex_unlock(&map->lock);
+	return ret;
+}
@@ -0,0 +1,1861 @@
+/*
+ * Userspace stand-in for the kernel APIs used by fake6050.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Every <linux/...> header the driver includes is generated by the Makefile
+ * and includes this file. Locking, timers, threads and work queues map to
+ * pthreads and keep the kernel semantics the driver relies on: hrtimer
+ * callbacks never run concurrently with themselves, hrtimer_cancel() and
+ * cancel_delayed_work_sync() wait for a running callback, wake-ups are never
+ * lost and kthread_stop() wakes the thread it stops. Only one CPU is
+ * modelled, per-CPU data has a single instance.
+ */
+
+#ifndef __KSHIM_H__
+#define __KSHIM_H__
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <ctype.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+/* types */
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef long long s64;
+typedef u8 __u8;
+typedef u16 __u16;
+typedef u32 __u32;
+typedef u64 __u64;
+typedef s16 __s16;
+typedef s32 __s32;
+typedef s64 __s64;
+typedef u16 __be16;
+typedef u32 __be32;
+typedef s64 ktime_t;
+typedef unsigned int gfp_t;
+typedef unsigned short umode_t;
+typedef int irqreturn_t;
+typedef unsigned long irq_hw_number_t;
+
+#define S16_MIN		((s16)(-32768))
+#define S16_MAX		((s16)32767)
+#define U16_MAX		((u16)~0U)
+#define S32_MIN		((s32)(-2147483647 - 1))
+#define S32_MAX		((s32)2147483647)
+#define U32_MAX		((u32)~0U)
+#define S64_MAX		((s64)(~0ULL >> 1))
+#define U64_MAX		((u64)~0ULL)
+#define KTIME_MAX	S64_MAX
+
+#define ENOTSUPP	524
+#define ERESTARTSYS	512
+
+/* compiler */
+
+#define __init
+#define __exit
+#define __user
+#define __percpu
+#define __rcu
+#define __iomem
+#define __force
+#define __must_check
+#define __maybe_unused	__attribute__((unused))
+#define __packed	__attribute__((packed))
+#define __aligned(x)	__attribute__((aligned(x)))
+#define likely(x)	__builtin_expect(!!(x), 1)
+#define unlikely(x)	__builtin_expect(!!(x), 0)
+#define barrier()	__asm__ __volatile__("" ::: "memory")
+
+#define READ_ONCE(x)	(*(const volatile __typeof__(x) *)&(x))
+#define WRITE_ONCE(x, val)						\
+	do { *(volatile __typeof__(x) *)&(x) = (val); } while (0)
+
+#define smp_mb()	__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define smp_rmb()	__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define smp_wmb()	__atomic_thread_fence(__ATOMIC_RELEASE)
+#define smp_mb__before_atomic()	smp_mb()
+#define smp_mb__after_atomic()	smp_mb()
+#define smp_load_acquire(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+#define BUILD_BUG_ON(cond)	((void)sizeof(char[1 - 2 * !!(cond)]))
+#define BUG_ON(cond)	do { if (cond) abort(); } while (0)
+#define WARN_ON(cond)	({ int __w = !!(cond);				\
+	if (__w) fprintf(stderr, "WARNING at %s:%d\n", __FILE__, __LINE__); \
+	__w; })
+#define WARN_ON_ONCE(cond)	WARN_ON(cond)
+
+#define container_of(ptr, type, member)					\
+	((type *)((char *)(ptr) - offsetof(type, member)))
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+#define BIT(n)		(1UL << (n))
+#define BIT_ULL(n)	(1ULL << (n))
+#define BITS_PER_LONG	(8 * (int)sizeof(long))
+#define GENMASK(h, l)	(((~0UL) << (l)) & (~0UL >> (BITS_PER_LONG - 1 - (h))))
+#define DIV_ROUND_UP(n, d)	(((n) + (d) - 1) / (d))
+#define DIV_ROUND_CLOSEST(x, d)	(((x) + ((d) / 2)) / (d))
+#define ALIGN(x, a)	(((x) + (a) - 1) & ~((__typeof__(x))(a) - 1))
+#define PAGE_SIZE	4096UL
+#define PAGE_SHIFT	12
+#define PAGE_ALIGN(x)	ALIGN(x, PAGE_SIZE)
+
+#define min(x, y) ({ __typeof__(x) __x = (x); __typeof__(y) __y = (y);	\
+	__x < __y ? __x : __y; })
+#define max(x, y) ({ __typeof__(x) __x = (x); __typeof__(y) __y = (y);	\
+	__x > __y ? __x : __y; })
+#define min_t(t, x, y)	({ t __x = (x); t __y = (y); __x < __y ? __x : __y; })
+#define max_t(t, x, y)	({ t __x = (x); t __y = (y); __x > __y ? __x : __y; })
+#define clamp(v, lo, hi)	min(max(v, lo), hi)
+#define clamp_t(t, v, lo, hi)	min_t(t, max_t(t, v, lo), hi)
+#define clamp_val(v, lo, hi)	clamp_t(__typeof__(v), v, lo, hi)
+#define swap(a, b) do { __typeof__(a) __t = (a); (a) = (b); (b) = __t; } while (0)
+#define abs(x) ({ __typeof__(x) __a = (x); __a < 0 ? -__a : __a; })
+
+#define IS_ENABLED(opt)	0
+
+/* errors */
+
+#define MAX_ERRNO	4095
+#define IS_ERR_VALUE(x)	((unsigned long)(x) >= (unsigned long)-MAX_ERRNO)
+
+static inline void *ERR_PTR(long error)
+{
+	return (void *)error;
+}
+
+static inline long PTR_ERR(const void *ptr)
+{
+	return (long)ptr;
+}
+
+static inline bool IS_ERR(const void *ptr)
+{
+	return IS_ERR_VALUE(ptr);
+}
+
+static inline bool IS_ERR_OR_NULL(const void *ptr)
+{
+	return !ptr || IS_ERR_VALUE(ptr);
+}
+
+/* arithmetic */
+
+static inline u64 div_u64_rem(u64 dividend, u32 divisor, u32 *remainder)
+{
+	*remainder = dividend % divisor;
+	return dividend / divisor;
+}
+
+static inline u64 div_u64(u64 dividend, u32 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline s64 div_s64(s64 dividend, s32 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline u64 div64_u64(u64 dividend, u64 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline u64 div64_u64_rem(u64 dividend, u64 divisor, u64 *remainder)
+{
+	*remainder = dividend % divisor;
+	return dividend / divisor;
+}
+
+static inline s64 div64_s64(s64 dividend, s64 divisor)
+{
+	return dividend / divisor;
+}
+
+#define do_div(n, base) ({ u32 __rem = (u64)(n) % (base);		\
+	(n) = (u64)(n) / (base); __rem; })
+
+static inline int fls(unsigned int x)
+{
+	return x ? 32 - __builtin_clz(x) : 0;
+}
+
+static inline int fls64(u64 x)
+{
+	return x ? 64 - __builtin_clzll(x) : 0;
+}
+
+static inline int ilog2_u64(u64 n)
+{
+	return fls64(n) - 1;
+}
+#define ilog2(n)	ilog2_u64(n)
+
+static inline unsigned int hweight8(unsigned int w)
+{
+	return __builtin_popcount(w & 0xff);
+}
+
+static inline unsigned int hweight32(unsigned int w)
+{
+	return __builtin_popcount(w);
+}
+
+static inline bool is_power_of_2(unsigned long n)
+{
+	return n != 0 && ((n & (n - 1)) == 0);
+}
+
+static inline unsigned long roundup_pow_of_two(unsigned long n)
+{
+	return n <= 1 ? 1 : 1UL << (BITS_PER_LONG - __builtin_clzl(n - 1));
+}
+
+static inline unsigned long rounddown_pow_of_two(unsigned long n)
+{
+	return 1UL << (BITS_PER_LONG - 1 - __builtin_clzl(n));
+}
+
+/* byte order */
+
+static inline u16 be16_to_cpu(u16 v)
+{
+	return __builtin_bswap16(v);
+}
+
+static inline u16 cpu_to_be16(u16 v)
+{
+	return __builtin_bswap16(v);
+}
+
+static inline u16 get_unaligned_be16(const void *p)
+{
+	const u8 *b = p;
+
+	return (b[0] << 8) | b[1];
+}
+
+static inline void put_unaligned_be16(u16 val, void *p)
+{
+	u8 *b = p;
+
+	b[0] = val >> 8;
+	b[1] = val & 0xff;
+}
+
+static inline u32 get_unaligned_be32(const void *p)
+{
+	const u8 *b = p;
+
+	return ((u32)b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+}
+
+/* printk */
+
+#define KERN_ERR	""
+#define KERN_WARNING	""
+#define KERN_INFO	""
+#define KERN_DEBUG	""
+
+int printk(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+#define pr_err(fmt, ...)	printk(fmt, ##__VA_ARGS__)
+#define pr_warn(fmt, ...)	printk(fmt, ##__VA_ARGS__)
+#define pr_info(fmt, ...)	printk(fmt, ##__VA_ARGS__)
+#define pr_debug(fmt, ...)	do { } while (0)
+#define dev_err(dev, fmt, ...)	printk("%s: " fmt, dev_name(dev), ##__VA_ARGS__)
+#define dev_warn(dev, fmt, ...)	printk("%s: " fmt, dev_name(dev), ##__VA_ARGS__)
+#define dev_info(dev, fmt, ...)	printk("%s: " fmt, dev_name(dev), ##__VA_ARGS__)
+#define dev_dbg(dev, fmt, ...)	do { } while (0)
+
+/* strings */
+
+int scnprintf(char *buf, size_t size, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+char *kasprintf(gfp_t gfp, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+char *skip_spaces(const char *str);
+char *strim(char *s);
+int kstrtoull(const char *s, unsigned int base, unsigned long long *res);
+int kstrtoll(const char *s, unsigned int base, long long *res);
+int kstrtoul(const char *s, unsigned int base, unsigned long *res);
+int kstrtol(const char *s, unsigned int base, long *res);
+int kstrtouint(const char *s, unsigned int base, unsigned int *res);
+int kstrtoint(const char *s, unsigned int base, int *res);
+int kstrtou8(const char *s, unsigned int base, u8 *res);
+int kstrtos16(const char *s, unsigned int base, s16 *res);
+int kstrtou16(const char *s, unsigned int base, u16 *res);
+int kstrtou32(const char *s, unsigned int base, u32 *res);
+int kstrtobool(const char *s, bool *res);
+#define strtobool(s, res)	kstrtobool(s, res)
+
+/* memory */
+
+#define GFP_KERNEL	0U
+#define GFP_ATOMIC	1U
+#define __GFP_ZERO	2U
+
+static inline void *kmalloc(size_t size, gfp_t flags)
+{
+	return (flags & __GFP_ZERO) ? calloc(1, size) : malloc(size);
+}
+
+static inline void *kzalloc(size_t size, gfp_t flags)
+{
+	return calloc(1, size);
+}
+
+static inline void *kcalloc(size_t n, size_t size, gfp_t flags)
+{
+	return calloc(n, size);
+}
+
+static inline void *kmalloc_array(size_t n, size_t size, gfp_t flags)
+{
+	return calloc(n, size);
+}
+
+static inline void kfree(const void *p)
+{
+	free((void *)p);
+}
+
+static inline void *vmalloc(unsigned long size)
+{
+	return malloc(size);
+}
+
+static inline void *vzalloc(unsigned long size)
+{
+	return calloc(1, size);
+}
+
+void *vmalloc_user(unsigned long size);
+
+static inline void vfree(const void *p)
+{
+	free((void *)p);
+}
+
+static inline unsigned long copy_to_user(void *to, const void *from,
+					unsigned long n)
+{
+	memcpy(to, from, n);
+	return 0;
+}
+
+static inline unsigned long copy_from_user(void *to, const void *from,
+					unsigned long n)
+{
+	memcpy(to, from, n);
+	return 0;
+}
+
+ssize_t simple_read_from_buffer(void __user *to, size_t count, loff_t *ppos,
+				const void *from, size_t available);
+
+/* per-CPU data, one CPU */
+
+#define alloc_percpu(type)	((type *)calloc(1, sizeof(type)))
+#define free_percpu(p)		free(p)
+#define per_cpu_ptr(p, cpu)	((void)(cpu), (p))
+#define this_cpu_ptr(p)		(p)
+#define this_cpu_add(var, n)						\
+	((void)__atomic_fetch_add(&(var), (n), __ATOMIC_RELAXED))
+#define this_cpu_inc(var)	this_cpu_add(var, 1)
+#define for_each_possible_cpu(cpu)	for ((cpu) = 0; (cpu) < 1; (cpu)++)
+#define num_possible_cpus()	1
+#define get_cpu()		0
+#define put_cpu()		do { } while (0)
+#define smp_processor_id()	0
+
+/* atomics and bitops */
+
+typedef struct {
+	int counter;
+} atomic_t;
+
+typedef struct {
+	s64 counter;
+} atomic64_t;
+
+#define ATOMIC_INIT(i)	{ (i) }
+
+static inline int atomic_read(const atomic_t *v)
+{
+	return __atomic_load_n(&v->counter, __ATOMIC_RELAXED);
+}
+
+static inline void atomic_set(atomic_t *v, int i)
+{
+	__atomic_store_n(&v->counter, i, __ATOMIC_RELAXED);
+}
+
+static inline void atomic_add(int i, atomic_t *v)
+{
+	__atomic_fetch_add(&v->counter, i, __ATOMIC_RELAXED);
+}
+
+static inline void atomic_sub(int i, atomic_t *v)
+{
+	__atomic_fetch_sub(&v->counter, i, __ATOMIC_RELAXED);
+}
+
+static inline void atomic_inc(atomic_t *v)
+{
+	atomic_add(1, v);
+}
+
+static inline void atomic_dec(atomic_t *v)
+{
+	atomic_sub(1, v);
+}
+
+static inline int atomic_add_return(int i, atomic_t *v)
+{
+	return __atomic_add_fetch(&v->counter, i, __ATOMIC_SEQ_CST);
+}
+
+static inline int atomic_sub_return(int i, atomic_t *v)
+{
+	return __atomic_sub_fetch(&v->counter, i, __ATOMIC_SEQ_CST);
+}
+
+#define atomic_inc_return(v)		atomic_add_return(1, v)
+#define atomic_dec_return(v)		atomic_sub_return(1, v)
+#define atomic_dec_and_test(v)		(atomic_sub_return(1, v) == 0)
+
+static inline int atomic_xchg(atomic_t *v, int i)
+{
+	return __atomic_exchange_n(&v->counter, i, __ATOMIC_SEQ_CST);
+}
+
+static inline int atomic_cmpxchg(atomic_t *v, int old, int new)
+{
+	__atomic_compare_exchange_n(&v->counter, &old, new, false,
+			__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return old;
+}
+
+static inline s64 atomic64_read(const atomic64_t *v)
+{
+	return __atomic_load_n(&v->counter, __ATOMIC_RELAXED);
+}
+
+static inline void atomic64_set(atomic64_t *v, s64 i)
+{
+	__atomic_store_n(&v->counter, i, __ATOMIC_RELAXED);
+}
+
+static inline void atomic64_add(s64 i, atomic64_t *v)
+{
+	__atomic_fetch_add(&v->counter, i, __ATOMIC_RELAXED);
+}
+
+static inline void set_bit(long nr, volatile unsigned long *addr)
+{
+	__atomic_fetch_or(addr, 1UL << nr, __ATOMIC_SEQ_CST);
+}
+
+static inline void clear_bit(long nr, volatile unsigned long *addr)
+{
+	__atomic_fetch_and(addr, ~(1UL << nr), __ATOMIC_SEQ_CST);
+}
+
+static inline bool test_bit(long nr, const volatile unsigned long *addr)
+{
+	return (__atomic_load_n(addr, __ATOMIC_RELAXED) >> nr) & 1;
+}
+
+static inline bool test_and_set_bit(long nr, volatile unsigned long *addr)
+{
+	return (__atomic_fetch_or(addr, 1UL << nr, __ATOMIC_SEQ_CST) >> nr) & 1;
+}
+
+static inline bool test_and_clear_bit(long nr, volatile unsigned long *addr)
+{
+	return (__atomic_fetch_and(addr, ~(1UL << nr),
+			__ATOMIC_SEQ_CST) >> nr) & 1;
+}
+
+#define __set_bit(nr, addr)	set_bit(nr, addr)
+#define __clear_bit(nr, addr)	clear_bit(nr, addr)
+
+/* locking */
+
+typedef struct {
+	pthread_mutex_t m;
+} spinlock_t;
+
+#define DEFINE_SPINLOCK(x)	spinlock_t x = { PTHREAD_MUTEX_INITIALIZER }
+
+static inline void spin_lock_init(spinlock_t *l)
+{
+	pthread_mutex_init(&l->m, NULL);
+}
+
+static inline void spin_lock(spinlock_t *l)
+{
+	pthread_mutex_lock(&l->m);
+}
+
+static inline void spin_unlock(spinlock_t *l)
+{
+	pthread_mutex_unlock(&l->m);
+}
+
+#define spin_lock_irqsave(l, flags)	do { (flags) = 0; spin_lock(l); } while (0)
+#define spin_unlock_irqrestore(l, flags)				\
+	do { (void)(flags); spin_unlock(l); } while (0)
+#define spin_lock_irq(l)	spin_lock(l)
+#define spin_unlock_irq(l)	spin_unlock(l)
+#define spin_lock_bh(l)		spin_lock(l)
+#define spin_unlock_bh(l)	spin_unlock(l)
+
+struct mutex {
+	pthread_mutex_t m;
+};
+
+#define DEFINE_MUTEX(x)	struct mutex x = { PTHREAD_MUTEX_INITIALIZER }
+
+static inline void mutex_init(struct mutex *l)
+{
+	pthread_mutex_init(&l->m, NULL);
+}
+
+static inline void mutex_lock(struct mutex *l)
+{
+	pthread_mutex_lock(&l->m);
+}
+
+static inline int mutex_lock_interruptible(struct mutex *l)
+{
+	pthread_mutex_lock(&l->m);
+	return 0;
+}
+
+static inline int mutex_trylock(struct mutex *l)
+{
+	return pthread_mutex_trylock(&l->m) == 0;
+}
+
+static inline void mutex_unlock(struct mutex *l)
+{
+	pthread_mutex_unlock(&l->m);
+}
+
+static inline void mutex_destroy(struct mutex *l)
+{
+	pthread_mutex_destroy(&l->m);
+}
+
+/* writers are serialized by the lock, readers retry on a changed sequence */
+typedef struct {
+	unsigned int sequence;
+	spinlock_t lock;
+} seqlock_t;
+
+static inline void seqlock_init(seqlock_t *sl)
+{
+	sl->sequence = 0;
+	spin_lock_init(&sl->lock);
+}
+
+static inline unsigned int read_seqbegin(const seqlock_t *sl)
+{
+	unsigned int seq;
+
+	while ((seq = __atomic_load_n(&sl->sequence, __ATOMIC_ACQUIRE)) & 1)
+		sched_yield();
+	return seq;
+}
+
+static inline unsigned int read_seqretry(const seqlock_t *sl,
+					unsigned int start)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&sl->sequence, __ATOMIC_RELAXED) != start;
+}
+
+static inline void write_seqlock(seqlock_t *sl)
+{
+	spin_lock(&sl->lock);
+	__atomic_store_n(&sl->sequence, sl->sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void write_sequnlock(seqlock_t *sl)
+{
+	__atomic_store_n(&sl->sequence, sl->sequence + 1, __ATOMIC_RELEASE);
+	spin_unlock(&sl->lock);
+}
+
+#define write_seqlock_irqsave(sl, flags)				\
+	do { (flags) = 0; write_seqlock(sl); } while (0)
+#define write_sequnlock_irqrestore(sl, flags)				\
+	do { (void)(flags); write_sequnlock(sl); } while (0)
+
+/* RCU: readers share a lock that synchronize_rcu() takes exclusively */
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+void synchronize_rcu(void);
+#define rcu_dereference(p)	READ_ONCE(p)
+#define rcu_assign_pointer(p, v)	smp_store_release(&(p), (v))
+
+struct kref {
+	atomic_t refcount;
+};
+
+static inline void kref_init(struct kref *kref)
+{
+	atomic_set(&kref->refcount, 1);
+}
+
+static inline void kref_get(struct kref *kref)
+{
+	atomic_inc(&kref->refcount);
+}
+
+static inline int kref_put(struct kref *kref,
+			void (*release)(struct kref *kref))
+{
+	if (atomic_dec_and_test(&kref->refcount)) {
+		release(kref);
+		return 1;
+	}
+	return 0;
+}
+
+/* time */
+
+#define HZ		1000
+#define MSEC_PER_SEC	1000L
+#define USEC_PER_MSEC	1000L
+#define USEC_PER_SEC	1000000L
+#define NSEC_PER_USEC	1000L
+#define NSEC_PER_MSEC	1000000L
+#define NSEC_PER_SEC	1000000000L
+
+static inline unsigned long msecs_to_jiffies(unsigned int m)
+{
+	return m;
+}
+
+static inline unsigned long usecs_to_jiffies(unsigned int u)
+{
+	return DIV_ROUND_UP(u, 1000);
+}
+
+static inline unsigned long nsecs_to_jiffies(u64 n)
+{
+	return n / NSEC_PER_MSEC;
+}
+
+static inline unsigned int jiffies_to_msecs(unsigned long j)
+{
+	return j;
+}
+
+/* the boot time clock is CLOCK_MONOTONIC, userspace does not suspend */
+static inline ktime_t kshim_clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (s64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+#define jiffies	((unsigned long)(kshim_clock_ns() / NSEC_PER_MSEC))
+
+#define ktime_get()		kshim_clock_ns()
+#define ktime_get_boottime()	kshim_clock_ns()
+#define ktime_get_ns()		((u64)kshim_clock_ns())
+#define ktime_get_boot_ns()	((u64)kshim_clock_ns())
+#define ktime_to_ns(kt)		((s64)(kt))
+#define ktime_to_us(kt)		((s64)(kt) / NSEC_PER_USEC)
+#define ktime_to_ms(kt)		((s64)(kt) / NSEC_PER_MSEC)
+#define ns_to_ktime(ns)		((ktime_t)(ns))
+#define ms_to_ktime(ms)		((ktime_t)(ms) * NSEC_PER_MSEC)
+#define ktime_set(s, ns)	((ktime_t)(s) * NSEC_PER_SEC + (ns))
+#define ktime_add(a, b)		((a) + (b))
+#define ktime_sub(a, b)		((a) - (b))
+#define ktime_add_ns(kt, ns)	((kt) + (s64)(ns))
+#define ktime_sub_ns(kt, ns)	((kt) - (s64)(ns))
+#define ktime_add_us(kt, us)	((kt) + (s64)(us) * NSEC_PER_USEC)
+#define ktime_compare(a, b)	((a) < (b) ? -1 : (a) > (b) ? 1 : 0)
+#define ktime_after(a, b)	((a) > (b))
+#define ktime_before(a, b)	((a) < (b))
+
+static inline struct timespec ktime_to_timespec(ktime_t kt)
+{
+	struct timespec ts;
+
+	ts.tv_sec = kt / NSEC_PER_SEC;
+	ts.tv_nsec = kt % NSEC_PER_SEC;
+	return ts;
+}
+
+void usleep_range(unsigned long min, unsigned long max);
+void msleep(unsigned int msecs);
+#define udelay(us)	usleep_range(us, us)
+#define mdelay(ms)	msleep(ms)
+
+/* wait queues and completions */
+
+struct kshim_task;
+
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} wait_queue_head_t;
+
+void init_waitqueue_head(wait_queue_head_t *wq);
+void wake_up(wait_queue_head_t *wq);
+void kshim_wait_enter(wait_queue_head_t *wq);
+void kshim_wait_sleep(wait_queue_head_t *wq);
+int kshim_wait_sleep_timeout(wait_queue_head_t *wq, long *timeout);
+void kshim_wait_leave(wait_queue_head_t *wq);
+#define wake_up_interruptible(wq)	wake_up(wq)
+#define wake_up_all(wq)			wake_up(wq)
+
+/* the condition is evaluated under the queue lock, no wake-up is lost */
+#define wait_event(wq, condition)					\
+	do {								\
+		kshim_wait_enter(&(wq));				\
+		while (!(condition))					\
+			kshim_wait_sleep(&(wq));			\
+		kshim_wait_leave(&(wq));				\
+	} while (0)
+#define wait_event_interruptible(wq, condition)				\
+	({ wait_event(wq, condition); 0; })
+#define wait_event_freezable(wq, condition)				\
+	wait_event_interruptible(wq, condition)
+#define wait_event_timeout(wq, condition, timeout)			\
+	({								\
+		long __t = (timeout);					\
+		kshim_wait_enter(&(wq));				\
+		while (!(condition) && __t > 0)				\
+			kshim_wait_sleep_timeout(&(wq), &__t);		\
+		if ((condition) && !__t)				\
+			__t = 1;					\
+		kshim_wait_leave(&(wq));				\
+		__t;							\
+	})
+#define wait_event_interruptible_timeout(wq, condition, timeout)	\
+	wait_event_timeout(wq, condition, timeout)
+
+struct completion {
+	unsigned int done;
+	wait_queue_head_t wait;
+};
+
+void init_completion(struct completion *x);
+void reinit_completion(struct completion *x);
+void complete(struct completion *x);
+void complete_all(struct completion *x);
+void wait_for_completion(struct completion *x);
+unsigned long wait_for_completion_timeout(struct completion *x,
+					unsigned long timeout);
+#define wait_for_completion_interruptible_timeout(x, t)			\
+	((long)wait_for_completion_timeout(x, t))
+bool completion_done(struct completion *x);
+
+/* poll */
+
+typedef struct poll_table_struct {
+	int unused;
+} poll_table;
+
+struct file;
+
+static inline void poll_wait(struct file *filp, wait_queue_head_t *wq,
+			poll_table *p)
+{
+}
+
+#define POLLIN		0x0001
+#define POLLRDNORM	0x0040
+
+/* hrtimers */
+
+enum hrtimer_restart {
+	HRTIMER_NORESTART,
+	HRTIMER_RESTART,
+};
+
+enum hrtimer_mode {
+	HRTIMER_MODE_ABS = 0x0,
+	HRTIMER_MODE_REL = 0x1,
+	HRTIMER_MODE_PINNED = 0x2,
+	HRTIMER_MODE_ABS_PINNED = 0x2,
+	HRTIMER_MODE_REL_PINNED = 0x3,
+};
+
+/*
+ * All timers expire on one thread, in expiry order, like the timers of one
+ * CPU. A callback runs with the base unlocked; a timer restarted from
+ * inside its own callback stays queued when the callback returns.
+ */
+struct hrtimer {
+	ktime_t expires;
+	enum hrtimer_restart (*function)(struct hrtimer *timer);
+	struct hrtimer *next;
+	bool queued;
+	bool running;
+};
+
+void hrtimer_init(struct hrtimer *timer, clockid_t clock,
+		enum hrtimer_mode mode);
+int hrtimer_start(struct hrtimer *timer, ktime_t tim,
+		const enum hrtimer_mode mode);
+int hrtimer_try_to_cancel(struct hrtimer *timer);
+int hrtimer_cancel(struct hrtimer *timer);
+bool hrtimer_active(const struct hrtimer *timer);
+bool hrtimer_is_queued(struct hrtimer *timer);
+u64 hrtimer_forward(struct hrtimer *timer, ktime_t now, ktime_t interval);
+
+static inline ktime_t hrtimer_cb_get_time(struct hrtimer *timer)
+{
+	return kshim_clock_ns();
+}
+
+static inline u64 hrtimer_forward_now(struct hrtimer *timer,
+				ktime_t interval)
+{
+	return hrtimer_forward(timer, kshim_clock_ns(), interval);
+}
+
+static inline void hrtimer_set_expires(struct hrtimer *timer, ktime_t time)
+{
+	timer->expires = time;
+}
+
+static inline ktime_t hrtimer_get_expires(const struct hrtimer *timer)
+{
+	return timer->expires;
+}
+
+static inline ktime_t hrtimer_get_remaining(const struct hrtimer *timer)
+{
+	return timer->expires - kshim_clock_ns();
+}
+
+/* work queues */
+
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct *work);
+struct workqueue_struct;
+
+enum kshim_work_state {
+	KSHIM_WORK_IDLE,
+	KSHIM_WORK_TIMER,	/* delayed, the timer queues it */
+	KSHIM_WORK_QUEUED,	/* on the list of @wq */
+};
+
+struct work_struct {
+	work_func_t func;
+	struct work_struct *next;
+	struct workqueue_struct *wq;
+	enum kshim_work_state state;
+	bool running;
+	bool canceling;
+};
+
+struct delayed_work {
+	struct work_struct work;
+	struct hrtimer timer;
+	ktime_t due;
+};
+
+#define INIT_WORK(w, f)							\
+	do { memset((w), 0, sizeof(*(w))); (w)->func = (f); } while (0)
+void kshim_init_delayed_work(struct delayed_work *dwork, work_func_t func);
+#define INIT_DELAYED_WORK(w, f)		kshim_init_delayed_work(w, f)
+#define INIT_DEFERRABLE_WORK(w, f)	kshim_init_delayed_work(w, f)
+
+static inline struct delayed_work *to_delayed_work(struct work_struct *work)
+{
+	return container_of(work, struct delayed_work, work);
+}
+
+extern struct workqueue_struct *system_wq;
+extern struct workqueue_struct *system_power_efficient_wq;
+extern struct workqueue_struct *system_freezable_wq;
+
+struct workqueue_struct *alloc_ordered_workqueue(const char *fmt,
+					unsigned int flags, ...);
+#define create_singlethread_workqueue(name)				\
+	alloc_ordered_workqueue("%s", 0, name)
+#define create_freezable_workqueue(name)				\
+	alloc_ordered_workqueue("%s", 0, name)
+#define alloc_workqueue(fmt, flags, max, ...)				\
+	alloc_ordered_workqueue(fmt, flags, ##__VA_ARGS__)
+void destroy_workqueue(struct workqueue_struct *wq);
+void flush_workqueue(struct workqueue_struct *wq);
+
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work);
+bool queue_delayed_work(struct workqueue_struct *wq,
+			struct delayed_work *dwork, unsigned long delay);
+bool mod_delayed_work(struct workqueue_struct *wq,
+		struct delayed_work *dwork, unsigned long delay);
+bool cancel_work_sync(struct work_struct *work);
+bool cancel_delayed_work(struct delayed_work *dwork);
+bool cancel_delayed_work_sync(struct delayed_work *dwork);
+bool flush_work(struct work_struct *work);
+bool flush_delayed_work(struct delayed_work *dwork);
+
+static inline bool schedule_work(struct work_struct *work)
+{
+	return queue_work(system_wq, work);
+}
+
+static inline bool schedule_delayed_work(struct delayed_work *dwork,
+					unsigned long delay)
+{
+	return queue_delayed_work(system_wq, dwork, delay);
+}
+
+static inline bool work_pending(struct work_struct *work)
+{
+	return READ_ONCE(work->state) != KSHIM_WORK_IDLE;
+}
+
+static inline bool delayed_work_pending(struct delayed_work *dwork)
+{
+	return READ_ONCE(dwork->work.state) != KSHIM_WORK_IDLE;
+}
+
+/* irq_work runs the callback from system_wq */
+struct irq_work {
+	struct work_struct work;
+	void (*func)(struct irq_work *work);
+};
+
+void init_irq_work(struct irq_work *work, void (*func)(struct irq_work *));
+bool irq_work_queue(struct irq_work *work);
+void irq_work_sync(struct irq_work *work);
+
+/* kthreads */
+
+struct task_struct;
+
+struct task_struct *kthread_create_on_node(int (*fn)(void *data), void *data,
+					int node, const char *fmt, ...);
+int wake_up_process(struct task_struct *task);
+bool kthread_should_stop(void);
+int kthread_stop(struct task_struct *task);
+
+#define kthread_run(fn, data, fmt, ...)					\
+	({								\
+		struct task_struct *__k = kthread_create_on_node(fn,	\
+				data, -1, fmt, ##__VA_ARGS__);		\
+		if (!IS_ERR(__k))					\
+			wake_up_process(__k);				\
+		__k;							\
+	})
+
+#define set_freezable()			do { } while (0)
+#define try_to_freeze()			false
+#define set_wake_up_idle(enable)	do { (void)(enable); } while (0)
+#define cond_resched()			do { } while (0)
+#define might_sleep()			do { } while (0)
+
+/* kfifo: single producer, single consumer, power of two sizes */
+
+#define DECLARE_KFIFO(fifo, type, size)					\
+	struct {							\
+		unsigned int in;					\
+		unsigned int out;					\
+		type buf[((size) < 2) || ((size) & ((size) - 1)) ? -1 : (size)]; \
+	} fifo
+#define INIT_KFIFO(fifo)	do { (fifo).in = 0; (fifo).out = 0; } while (0)
+#define kfifo_size(fifo)	((unsigned int)ARRAY_SIZE((fifo)->buf))
+#define kfifo_len(fifo)							\
+	(__atomic_load_n(&(fifo)->in, __ATOMIC_ACQUIRE) -		\
+	 __atomic_load_n(&(fifo)->out, __ATOMIC_ACQUIRE))
+#define kfifo_is_empty(fifo)	(kfifo_len(fifo) == 0)
+#define kfifo_is_full(fifo)	(kfifo_len(fifo) >= kfifo_size(fifo))
+#define kfifo_avail(fifo)	(kfifo_size(fifo) - kfifo_len(fifo))
+#define kfifo_reset(fifo)	do { (fifo)->in = 0; (fifo)->out = 0; } while (0)
+#define kfifo_reset_out(fifo)						\
+	__atomic_store_n(&(fifo)->out,					\
+			__atomic_load_n(&(fifo)->in, __ATOMIC_ACQUIRE),	\
+			__ATOMIC_RELEASE)
+#define kfifo_put(fifo, val)						\
+	({								\
+		__typeof__(fifo) __f = (fifo);				\
+		unsigned int __in = __f->in;				\
+		int __ok = !kfifo_is_full(__f);				\
+		if (__ok) {						\
+			__f->buf[__in & (kfifo_size(__f) - 1)] = (val);	\
+			__atomic_store_n(&__f->in, __in + 1,		\
+					__ATOMIC_RELEASE);		\
+		}							\
+		__ok;							\
+	})
+#define kfifo_get(fifo, val)						\
+	({								\
+		__typeof__(fifo) __f = (fifo);				\
+		unsigned int __out = __f->out;				\
+		int __ok = !kfifo_is_empty(__f);			\
+		if (__ok) {						\
+			*(val) = __f->buf[__out & (kfifo_size(__f) - 1)]; \
+			__atomic_store_n(&__f->out, __out + 1,		\
+					__ATOMIC_RELEASE);		\
+		}							\
+		__ok;							\
+	})
+#define kfifo_peek(fifo, val)						\
+	({								\
+		__typeof__(fifo) __f = (fifo);				\
+		int __ok = !kfifo_is_empty(__f);			\
+		if (__ok)						\
+			*(val) = __f->buf[__f->out & (kfifo_size(__f) - 1)]; \
+		__ok;							\
+	})
+
+/* random */
+
+u32 prandom_u32(void);
+
+static inline u32 prandom_u32_max(u32 ep_ro)
+{
+	return (u32)(((u64)prandom_u32() * ep_ro) >> 32);
+}
+
+/* devices, sysfs and kobjects */
+
+#define S_IRUSR		00400
+#define S_IWUSR		00200
+#define S_IRGRP		00040
+#define S_IWGRP		00020
+#define S_IROTH		00004
+#define S_IRUGO		(S_IRUSR | S_IRGRP | S_IROTH)
+#define S_IWUGO		(S_IWUSR | S_IWGRP | 00002)
+
+struct module;
+#define THIS_MODULE	((struct module *)NULL)
+
+struct kobject {
+	const char *name;
+};
+
+enum kobject_action {
+	KOBJ_ADD,
+	KOBJ_REMOVE,
+	KOBJ_CHANGE,
+	KOBJ_MOVE,
+	KOBJ_ONLINE,
+	KOBJ_OFFLINE,
+};
+
+int kobject_uevent_env(struct kobject *kobj, enum kobject_action action,
+		char *envp[]);
+
+static inline int kobject_uevent(struct kobject *kobj,
+				enum kobject_action action)
+{
+	return kobject_uevent_env(kobj, action, NULL);
+}
+
+struct attribute {
+	const char *name;
+	umode_t mode;
+};
+
+struct device;
+struct device_node;
+struct dev_pm_ops;
+struct kshim_attr;
+struct kshim_devres;
+struct kshim_pm;
+
+struct device_type {
+	const char *name;
+};
+
+struct device_driver {
+	const char *name;
+	struct module *owner;
+	const struct of_device_id *of_match_table;
+	const struct dev_pm_ops *pm;
+};
+
+struct device {
+	struct kobject kobj;
+	struct device *parent;
+	const struct device_type *type;
+	struct device_node *of_node;
+	struct device_driver *driver;
+	void *platform_data;
+	void *driver_data;
+	char name[64];
+	struct kshim_attr *attrs;
+	struct kshim_devres *devres;
+	struct kshim_pm *power;
+};
+
+struct device_attribute {
+	struct attribute attr;
+	ssize_t (*show)(struct device *dev, struct device_attribute *attr,
+			char *buf);
+	ssize_t (*store)(struct device *dev, struct device_attribute *attr,
+			const char *buf, size_t count);
+};
+
+struct vm_area_struct;
+struct file;
+
+struct bin_attribute {
+	struct attribute attr;
+	size_t size;
+	void *private;
+	ssize_t (*read)(struct file *filp, struct kobject *kobj,
+			struct bin_attribute *attr, char *buf, loff_t off,
+			size_t count);
+	ssize_t (*write)(struct file *filp, struct kobject *kobj,
+			struct bin_attribute *attr, char *buf, loff_t off,
+			size_t count);
+	int (*mmap)(struct file *filp, struct kobject *kobj,
+			struct bin_attribute *attr, struct vm_area_struct *vma);
+};
+
+#define __ATTR(_name, _mode, _show, _store)				\
+	{ .attr = { .name = #_name, .mode = (_mode) },			\
+	  .show = (_show), .store = (_store) }
+#define __ATTR_RO(_name)	__ATTR(_name, S_IRUGO, _name##_show, NULL)
+#define __ATTR_NULL		{ .attr = { .name = NULL } }
+#define DEVICE_ATTR(_name, _mode, _show, _store)			\
+	struct device_attribute dev_attr_##_name =			\
+		__ATTR(_name, _mode, _show, _store)
+
+static inline struct device *kobj_to_dev(struct kobject *kobj)
+{
+	return container_of(kobj, struct device, kobj);
+}
+
+static inline const char *dev_name(const struct device *dev)
+{
+	return dev->name;
+}
+
+static inline void *dev_get_drvdata(const struct device *dev)
+{
+	return dev->driver_data;
+}
+
+static inline void dev_set_drvdata(struct device *dev, void *data)
+{
+	dev->driver_data = data;
+}
+
+int device_create_file(struct device *dev,
+		const struct device_attribute *attr);
+void device_remove_file(struct device *dev,
+		const struct device_attribute *attr);
+int sysfs_create_bin_file(struct kobject *kobj,
+		const struct bin_attribute *attr);
+void sysfs_remove_bin_file(struct kobject *kobj,
+		const struct bin_attribute *attr);
+
+/* managed resources are released when the driver unbinds */
+void *devm_kzalloc(struct device *dev, size_t size, gfp_t gfp);
+void devm_kfree(struct device *dev, void *p);
+
+/* module */
+
+#define MODULE_DESCRIPTION(x)
+#define MODULE_LICENSE(x)
+#define MODULE_AUTHOR(x)
+#define MODULE_PARM_DESC(name, desc)
+#define MODULE_DEVICE_TABLE(type, name)
+
+/* module_init()/module_exit() become entry points for the harness */
+#define module_init(fn)							\
+	int kshim_module_init(void) { return fn(); }
+#define module_exit(fn)							\
+	void kshim_module_exit(void) { fn(); }
+int kshim_module_init(void);
+void kshim_module_exit(void);
+
+void kshim_param_register(const char *name, void *var, const char *type);
+#define module_param(name, type, perm)					\
+	static void __attribute__((constructor))			\
+	kshim_param_##name(void)					\
+	{								\
+		kshim_param_register(#name, &(name), #type);		\
+	}
+
+/* device tree and GPIO, the harness has neither */
+
+struct device_node;
+
+struct of_device_id {
+	char name[32];
+	char type[32];
+	char compatible[128];
+	const void *data;
+};
+
+enum of_gpio_flags {
+	OF_GPIO_ACTIVE_LOW = 0x1,
+};
+
+static inline int of_property_read_string(const struct device_node *np,
+				const char *propname, const char **out)
+{
+	return -EINVAL;
+}
+
+static inline bool of_property_read_bool(const struct device_node *np,
+				const char *propname)
+{
+	return false;
+}
+
+static inline int of_property_read_u32(const struct device_node *np,
+				const char *propname, u32 *out)
+{
+	return -EINVAL;
+}
+
+static inline int of_get_named_gpio_flags(struct device_node *np,
+				const char *list_name, int index,
+				enum of_gpio_flags *flags)
+{
+	return -ENOSYS;
+}
+
+static inline bool gpio_is_valid(int number)
+{
+	return false;
+}
+
+static inline int gpio_request(unsigned int gpio, const char *label)
+{
+	return -ENOSYS;
+}
+
+static inline void gpio_free(unsigned int gpio)
+{
+}
+
+static inline int gpio_direction_input(unsigned int gpio)
+{
+	return -ENOSYS;
+}
+
+static inline int gpio_direction_output(unsigned int gpio, int value)
+{
+	return -ENOSYS;
+}
+
+static inline void gpio_set_value(unsigned int gpio, int value)
+{
+}
+
+static inline int gpio_to_irq(unsigned int gpio)
+{
+	return -ENOSYS;
+}
+
+struct pinctrl;
+struct pinctrl_state;
+struct regulator;
+
+/* interrupts, only what the data ready emulation needs */
+
+#define IRQ_NONE		0
+#define IRQ_HANDLED		1
+#define IRQ_WAKE_THREAD		2
+
+#define IRQF_TRIGGER_RISING	0x00000001
+#define IRQF_TRIGGER_FALLING	0x00000002
+#define IRQF_TRIGGER_HIGH	0x00000004
+#define IRQF_TRIGGER_LOW	0x00000008
+#define IRQF_ONESHOT		0x00002000
+
+typedef irqreturn_t (*irq_handler_t)(int irq, void *dev_id);
+
+struct irq_data {
+	unsigned int irq;
+	void *chip_data;
+};
+
+struct irq_chip {
+	const char *name;
+	void (*irq_mask)(struct irq_data *data);
+	void (*irq_unmask)(struct irq_data *data);
+	void (*irq_enable)(struct irq_data *data);
+	void (*irq_disable)(struct irq_data *data);
+};
+
+struct irq_desc;
+typedef void (*irq_flow_handler_t)(struct irq_desc *desc);
+
+extern struct irq_chip dummy_irq_chip;
+
+struct irq_domain;
+
+struct irq_domain_ops {
+	int (*map)(struct irq_domain *d, unsigned int virq,
+		irq_hw_number_t hw);
+	int (*xlate)(struct irq_domain *d, struct device_node *node,
+		const u32 *intspec, unsigned int intsize,
+		unsigned long *out_hwirq, unsigned int *out_type);
+};
+
+struct irq_domain {
+	const struct irq_domain_ops *ops;
+	void *host_data;
+	unsigned int size;
+	unsigned int *map;
+};
+
+int irq_domain_xlate_onecell(struct irq_domain *d, struct device_node *ctrlr,
+			const u32 *intspec, unsigned int intsize,
+			unsigned long *out_hwirq, unsigned int *out_type);
+
+static inline void handle_simple_irq(struct irq_desc *desc)
+{
+}
+
+static inline void *irq_data_get_irq_chip_data(struct irq_data *d)
+{
+	return d->chip_data;
+}
+
+struct irq_domain *irq_domain_add_linear(struct device_node *of_node,
+				unsigned int size,
+				const struct irq_domain_ops *ops,
+				void *host_data);
+void irq_domain_remove(struct irq_domain *domain);
+unsigned int irq_create_mapping(struct irq_domain *domain,
+				unsigned long hwirq);
+void irq_dispose_mapping(unsigned int virq);
+int irq_set_chip_and_handler(unsigned int irq, struct irq_chip *chip,
+			irq_flow_handler_t handle);
+int irq_set_chip_data(unsigned int irq, void *data);
+void irq_set_noprobe(unsigned int irq);
+int request_threaded_irq(unsigned int irq, irq_handler_t handler,
+			irq_handler_t thread_fn, unsigned long flags,
+			const char *name, void *dev);
+void free_irq(unsigned int irq, void *dev_id);
+void enable_irq(unsigned int irq);
+void disable_irq(unsigned int irq);
+void disable_irq_nosync(unsigned int irq);
+int generic_handle_irq(unsigned int irq);
+void irq_wake_thread(unsigned int irq, void *dev_id);
+#define enable_irq_wake(irq)	0
+#define disable_irq_wake(irq)	0
+
+/* input */
+
+#define EV_SYN		0x00
+#define EV_KEY		0x01
+#define EV_REL		0x02
+#define EV_ABS		0x03
+#define EV_MSC		0x04
+#define EV_MAX		0x1f
+#define EV_CNT		(EV_MAX + 1)
+
+#define SYN_REPORT	0
+#define SYN_CONFIG	1
+#define SYN_TIME_SEC	3
+#define SYN_TIME_NSEC	4
+
+#define ABS_X		0x00
+#define ABS_Y		0x01
+#define ABS_Z		0x02
+#define ABS_RX		0x03
+#define ABS_RY		0x04
+#define ABS_RZ		0x05
+#define ABS_MISC	0x28
+#define ABS_MAX		0x3f
+#define ABS_CNT		(ABS_MAX + 1)
+
+#define MSC_TIMESTAMP	0x05
+
+#define BUS_I2C		0x18
+#define BUS_VIRTUAL	0x06
+
+struct input_id {
+	u16 bustype;
+	u16 vendor;
+	u16 product;
+	u16 version;
+};
+
+struct input_absinfo {
+	s32 value;
+	s32 minimum;
+	s32 maximum;
+	s32 fuzz;
+	s32 flat;
+	s32 resolution;
+};
+
+struct input_dev {
+	const char *name;
+	const char *phys;
+	struct input_id id;
+	unsigned long evbit[1];
+	unsigned long long absbit;
+	struct input_absinfo absinfo[ABS_CNT];
+	struct device dev;
+	struct input_dev *next;
+	bool registered;
+};
+
+struct input_dev *devm_input_allocate_device(struct device *dev);
+struct input_dev *input_allocate_device(void);
+void input_free_device(struct input_dev *dev);
+int input_register_device(struct input_dev *dev);
+void input_unregister_device(struct input_dev *dev);
+void input_set_capability(struct input_dev *dev, unsigned int type,
+			unsigned int code);
+void input_set_abs_params(struct input_dev *dev, unsigned int axis,
+			int min, int max, int fuzz, int flat);
+void input_event(struct input_dev *dev, unsigned int type,
+		unsigned int code, int value);
+
+static inline void input_set_drvdata(struct input_dev *dev, void *data)
+{
+	dev_set_drvdata(&dev->dev, data);
+}
+
+static inline void *input_get_drvdata(struct input_dev *dev)
+{
+	return dev_get_drvdata(&dev->dev);
+}
+
+static inline void input_report_abs(struct input_dev *dev, unsigned int code,
+				int value)
+{
+	input_event(dev, EV_ABS, code, value);
+}
+
+static inline void input_sync(struct input_dev *dev)
+{
+	input_event(dev, EV_SYN, SYN_REPORT, 0);
+}
+
+/* sensors class of the msm tree */
+
+#define SENSORS_ACCELERATION_HANDLE	0
+#define SENSORS_MAGNETIC_FIELD_HANDLE	1
+#define SENSORS_ORIENTATION_HANDLE	2
+#define SENSORS_LIGHT_HANDLE		3
+#define SENSORS_PROXIMITY_HANDLE	4
+#define SENSORS_GYROSCOPE_HANDLE	5
+#define SENSORS_PRESSURE_HANDLE		6
+
+#define SENSOR_TYPE_ACCELEROMETER	1
+#define SENSOR_TYPE_GEOMAGNETIC_FIELD	2
+#define SENSOR_TYPE_MAGNETIC_FIELD	SENSOR_TYPE_GEOMAGNETIC_FIELD
+#define SENSOR_TYPE_ORIENTATION		3
+#define SENSOR_TYPE_GYROSCOPE		4
+
+#define SENSOR_FLAG_CONTINUOUS_MODE	0x0
+
+struct cal_result_t {
+	union {
+		struct {
+			int offset_x;
+			int offset_y;
+			int offset_z;
+		};
+		struct {
+			int threshold_h;
+			int threshold_l;
+			int bias;
+		};
+		int offset[3];
+	};
+};
+
+struct sensors_classdev {
+	struct device *dev;
+	struct sensors_classdev *next;
+	const char *name;
+	const char *vendor;
+	int version;
+	int handle;
+	int type;
+	const char *max_range;
+	const char *resolution;
+	const char *sensor_power;
+	int min_delay;
+	int fifo_reserved_event_count;
+	int fifo_max_event_count;
+	int32_t max_delay;
+	uint32_t flags;
+	unsigned int enabled;
+	unsigned int delay_msec;
+	unsigned int wakeup;
+	unsigned int max_latency;
+	char *params;
+	struct cal_result_t cal_result;
+	int (*sensors_enable)(struct sensors_classdev *sensors_cdev,
+			unsigned int enabled);
+	int (*sensors_poll_delay)(struct sensors_classdev *sensors_cdev,
+			unsigned int delay_msec);
+	int (*sensors_self_test)(struct sensors_classdev *sensors_cdev);
+	int (*sensors_set_latency)(struct sensors_classdev *sensor_cdev,
+			unsigned int max_latency);
+	int (*sensors_enable_wakeup)(struct sensors_classdev *sensor_cdev,
+			unsigned int enable);
+	int (*sensors_flush)(struct sensors_classdev *sensors_cdev);
+	int (*sensors_calibrate)(struct sensors_classdev *sensor_cdev,
+			int axis, int apply_now);
+	int (*sensors_write_cal_params)(struct sensors_classdev
+			*sensor_cdev, struct cal_result_t *cal_result);
+};
+
+int sensors_classdev_register(struct device *parent,
+			struct sensors_classdev *sensors_cdev);
+void sensors_classdev_unregister(struct sensors_classdev *sensors_cdev);
+
+/* files, misc devices, debugfs and seq_file */
+
+struct inode {
+	void *i_private;
+};
+
+struct file_operations;
+
+struct file {
+	void *private_data;
+	const struct file_operations *f_op;
+	unsigned int f_flags;
+};
+
+#define VM_READ		0x00000001
+#define VM_WRITE	0x00000002
+#define VM_SHARED	0x00000008
+
+struct vm_area_struct {
+	unsigned long vm_start;
+	unsigned long vm_end;
+	unsigned long vm_pgoff;
+	unsigned long vm_flags;
+};
+
+struct file_operations {
+	struct module *owner;
+	loff_t (*llseek)(struct file *, loff_t, int);
+	ssize_t (*read)(struct file *, char __user *, size_t, loff_t *);
+	ssize_t (*write)(struct file *, const char __user *, size_t,
+			loff_t *);
+	unsigned int (*poll)(struct file *, poll_table *);
+	long (*unlocked_ioctl)(struct file *, unsigned int, unsigned long);
+	int (*mmap)(struct file *, struct vm_area_struct *);
+	int (*open)(struct inode *, struct file *);
+	int (*release)(struct inode *, struct file *);
+};
+
+static inline int nonseekable_open(struct inode *inode, struct file *filp)
+{
+	return 0;
+}
+
+loff_t no_llseek(struct file *file, loff_t offset, int whence);
+loff_t default_llseek(struct file *file, loff_t offset, int whence);
+loff_t seq_lseek(struct file *file, loff_t offset, int whence);
+
+int remap_vmalloc_range(struct vm_area_struct *vma, void *addr,
+			unsigned long pgoff);
+
+#define MISC_DYNAMIC_MINOR	255
+
+struct miscdevice {
+	int minor;
+	const char *name;
+	const struct file_operations *fops;
+	struct device *parent;
+	umode_t mode;
+};
+
+int misc_register(struct miscdevice *misc);
+void misc_deregister(struct miscdevice *misc);
+
+struct seq_file {
+	char *buf;
+	size_t size;
+	size_t count;
+	void *private;
+	int (*show)(struct seq_file *m, void *v);
+};
+
+int seq_printf(struct seq_file *m, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+int seq_puts(struct seq_file *m, const char *s);
+int seq_putc(struct seq_file *m, char c);
+int single_open(struct file *file, int (*show)(struct seq_file *, void *),
+		void *data);
+int single_release(struct inode *inode, struct file *file);
+ssize_t seq_read(struct file *file, char __user *buf, size_t size,
+		loff_t *ppos);
+
+struct dentry;
+
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent);
+struct dentry *debugfs_create_file(const char *name, umode_t mode,
+				struct dentry *parent, void *data,
+				const struct file_operations *fops);
+struct dentry *debugfs_create_u32(const char *name, umode_t mode,
+				struct dentry *parent, u32 *value);
+struct dentry *debugfs_create_bool(const char *name, umode_t mode,
+				struct dentry *parent, bool *value);
+void debugfs_remove_recursive(struct dentry *dentry);
+
+/* I2C, the harness creates clients on one emulated adapter */
+
+struct i2c_adapter;
+
+extern const struct device_type i2c_client_type;
+
+struct i2c_client {
+	unsigned short flags;
+	unsigned short addr;
+	char name[20];
+	struct i2c_adapter *adapter;
+	struct device dev;
+	int irq;
+	struct i2c_client *next;
+};
+
+struct i2c_device_id {
+	char name[20];
+	unsigned long driver_data;
+};
+
+struct i2c_board_info {
+	char type[20];
+	unsigned short addr;
+	const void *platform_data;
+	int irq;
+};
+
+struct i2c_driver {
+	struct device_driver driver;
+	int (*probe)(struct i2c_client *client,
+		const struct i2c_device_id *id);
+	int (*remove)(struct i2c_client *client);
+	const struct i2c_device_id *id_table;
+	struct i2c_driver *next;
+};
+
+static inline struct i2c_client *i2c_verify_client(struct device *dev)
+{
+	return (dev->type == &i2c_client_type) ?
+		container_of(dev, struct i2c_client, dev) : NULL;
+}
+
+int i2c_add_driver(struct i2c_driver *driver);
+void i2c_del_driver(struct i2c_driver *driver);
+/* @adap is ignored, all clients sit on the emulated adapter */
+struct i2c_client *i2c_new_client_device(struct i2c_adapter *adap,
+				const struct i2c_board_info *info);
+void i2c_unregister_device(struct i2c_client *client);
+
+#define module_i2c_driver(drv)						\
+	static int __init drv##_init(void)				\
+	{								\
+		return i2c_add_driver(&(drv));				\
+	}								\
+	module_init(drv##_init);					\
+	static void __exit drv##_exit(void)				\
+	{								\
+		i2c_del_driver(&(drv));					\
+	}								\
+	module_exit(drv##_exit)
+
+static inline void *i2c_get_clientdata(const struct i2c_client *client)
+{
+	return dev_get_drvdata(&client->dev);
+}
+
+static inline void i2c_set_clientdata(struct i2c_client *client, void *data)
+{
+	dev_set_drvdata(&client->dev, data);
+}
+
+/* platform bus */
+
+struct platform_device {
+	const char *name;
+	int id;
+	struct device dev;
+	struct platform_device *next;
+};
+
+struct platform_driver {
+	int (*probe)(struct platform_device *pdev);
+	int (*remove)(struct platform_device *pdev);
+	struct device_driver driver;
+	struct platform_driver *next;
+};
+
+static inline struct platform_device *to_platform_device(struct device *dev)
+{
+	return container_of(dev, struct platform_device, dev);
+}
+
+int platform_driver_register(struct platform_driver *drv);
+void platform_driver_unregister(struct platform_driver *drv);
+struct platform_device *platform_device_register_data(struct device *parent,
+				const char *name, int id, const void *data,
+				size_t size);
+void platform_device_unregister(struct platform_device *pdev);
+
+/* power management */
+
+#define CONFIG_PM	1
+#define CONFIG_PM_SLEEP	1
+
+struct dev_pm_ops {
+	int (*suspend)(struct device *dev);
+	int (*resume)(struct device *dev);
+	int (*runtime_suspend)(struct device *dev);
+	int (*runtime_resume)(struct device *dev);
+	int (*runtime_idle)(struct device *dev);
+};
+
+#define SET_SYSTEM_SLEEP_PM_OPS(suspend_fn, resume_fn)			\
+	.suspend = suspend_fn, .resume = resume_fn,
+#define SET_RUNTIME_PM_OPS(suspend_fn, resume_fn, idle_fn)		\
+	.runtime_suspend = suspend_fn, .runtime_resume = resume_fn,	\
+	.runtime_idle = idle_fn,
+
+void pm_runtime_enable(struct device *dev);
+void pm_runtime_disable(struct device *dev);
+bool pm_runtime_enabled(struct device *dev);
+int pm_runtime_get_sync(struct device *dev);
+void pm_runtime_get_noresume(struct device *dev);
+int pm_runtime_put_noidle(struct device *dev);
+int pm_runtime_put_autosuspend(struct device *dev);
+int pm_runtime_put_sync(struct device *dev);
+void pm_runtime_mark_last_busy(struct device *dev);
+int pm_runtime_set_active(struct device *dev);
+void pm_runtime_set_suspended(struct device *dev);
+void pm_runtime_set_autosuspend_delay(struct device *dev, int delay);
+void pm_runtime_use_autosuspend(struct device *dev);
+void pm_runtime_dont_use_autosuspend(struct device *dev);
+int pm_runtime_force_suspend(struct device *dev);
+int pm_runtime_force_resume(struct device *dev);
+bool pm_runtime_suspended(struct device *dev);
+
+/* register maps: flat cache, custom bus, 8 bit registers and values */
+
+enum regcache_type {
+	REGCACHE_NONE,
+	REGCACHE_RBTREE,
+	REGCACHE_COMPRESSED,
+	REGCACHE_FLAT,
+};
+
+struct reg_default {
+	unsigned int reg;
+	unsigned int def;
+};
+
+struct regmap_bus {
+	bool fast_io;
+	int (*write)(void *context, const void *data, size_t count);
+	int (*read)(void *context, const void *reg_buf, size_t reg_size,
+		void *val_buf, size_t val_size);
+};
+
+struct regmap_config {
+	const char *name;
+	int reg_bits;
+	int val_bits;
+	unsigned int max_register;
+	bool (*writeable_reg)(struct device *dev, unsigned int reg);
+	bool (*readable_reg)(struct device *dev, unsigned int reg);
+	bool (*volatile_reg)(struct device *dev, unsigned int reg);
+	bool (*precious_reg)(struct device *dev, unsigned int reg);
+	const struct reg_default *reg_defaults;
+	unsigned int num_reg_defaults;
+	enum regcache_type cache_type;
+};
+
+struct regmap;
+
+struct regmap *devm_regmap_init(struct device *dev,
+				const struct regmap_bus *bus, void *bus_context,
+				const struct regmap_config *config);
+int regmap_read(struct regmap *map, unsigned int reg, unsigned int *val);
+int regmap_write(struct regmap *map, unsigned int reg, unsigned int val);
+int regmap_update_bits(struct regmap *map, unsigned int reg,
+		unsigned int mask, unsigned int val);
+int regmap_bulk_read(struct regmap *map, unsigned int reg, void *val,
+		size_t val_count);
+int regmap_raw_read(struct regmap *map, unsigned int reg, void *val,
+		size_t val_len);
+void regcache_cache_only(struct regmap *map, bool enable);
+void regcache_mark_dirty(struct regmap *map);
+int regcache_sync(struct regmap *map);
+
+/* tracepoints compile to nothing */
+
+#define TP_PROTO(args...)	args
+#define TP_ARGS(args...)	args
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print)		\
+	static inline void trace_##name(proto) { }
+#define DECLARE_EVENT_CLASS(name, proto, args, tstruct, assign, print)
+#define DEFINE_EVENT(template, name, proto, args)			\
+	static inline void trace_##name(proto) { }
+
+/* harness side */
+
+/**
+ * struct kshim_hooks - callbacks of the harness
+ * @input_event:	every event reported by an input device
+ * @uevent:		every uevent sent for a kobject
+ */
+struct kshim_hooks {
+	void (*input_event)(struct input_dev *dev, unsigned int type,
+			unsigned int code, int value);
+	void (*uevent)(struct kobject *kobj, enum kobject_action action,
+			char *envp[]);
+};
+
+extern struct kshim_hooks kshim_hooks;
+extern bool kshim_printk_enabled;
+
+int kshim_param_set(const char *name, const char *val);
+struct sensors_classdev *kshim_find_cdev(const char *name);
+struct input_dev *kshim_find_input(const char *name);
+ssize_t kshim_attr_show(struct device *dev, const char *name, char *buf);
+ssize_t kshim_attr_store(struct device *dev, const char *name,
+			const char *buf);
+void kshim_set_thread_name(const char *name);
+
+#endif /* __KSHIM_H__ */